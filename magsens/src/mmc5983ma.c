@@ -70,3 +70,62 @@ int mmc5983ma_validate_product_id(uint8_t product_id) {
 float mmc5983ma_calculate_magnitude(float x, float y, float z) {
   return sqrtf(x * x + y * y + z * z);
 }
+
+/**
+ * @brief CTRL2 Cm_freq bits for a continuous-measurement rate
+ */
+int mmc5983ma_cm_freq_bits(uint16_t odr_hz) {
+  static const uint16_t rates[] = {0, 1, 10, 20, 50, 100, 200, 1000};
+
+  for (int i = 1; i < (int)(sizeof(rates) / sizeof(rates[0])); i++) {
+    if (rates[i] == odr_hz) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief CTRL1 BW bits for a filter bandwidth
+ */
+int mmc5983ma_bw_bits(uint16_t bw_hz) {
+  switch (bw_hz) {
+  case 100:
+    return MMC5983MA_CTRL1_BW_100HZ;
+  case 200:
+    return MMC5983MA_CTRL1_BW_200HZ;
+  case 400:
+    return MMC5983MA_CTRL1_BW_400HZ;
+  case 800:
+    return MMC5983MA_CTRL1_BW_800HZ;
+  default:
+    return -1;
+  }
+}
+
+/**
+ * @brief Narrowest bandwidth whose measurement time fits a rate
+ */
+uint16_t mmc5983ma_min_bw_hz(uint16_t odr_hz) {
+  if (odr_hz > 200) {
+    return 800;
+  }
+  if (odr_hz > 100) {
+    return 200;
+  }
+  return 100;
+}
+
+/**
+ * @brief CTRL2 Prd_set bits for a periodic SET interval
+ */
+int mmc5983ma_prd_set_bits(uint16_t measurements) {
+  static const uint16_t periods[] = {1, 25, 75, 100, 250, 500, 1000, 2000};
+
+  for (int i = 0; i < (int)(sizeof(periods) / sizeof(periods[0])); i++) {
+    if (periods[i] == measurements) {
+      return i;
+    }
+  }
+  return -1;
+}
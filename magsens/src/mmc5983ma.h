@@ -31,14 +31,31 @@
 
 /* Control register bits */
 #define MMC5983MA_CTRL0_TM 0x01       /* Trigger measurement */
+#define MMC5983MA_CTRL0_TM_T 0x02     /* Trigger temperature measurement */
+#define MMC5983MA_CTRL0_INT_EN 0x04   /* INT pin on measurement done */
 #define MMC5983MA_CTRL0_SET 0x08      /* SET operation */
 #define MMC5983MA_CTRL0_RESET 0x10    /* RESET operation */
-#define MMC5983MA_CTRL1_BW_100HZ 0x00 /* Bandwidth 100Hz */
-#define MMC5983MA_CTRL2_CMM_EN 0x10   /* Continuous measurement mode */
+#define MMC5983MA_CTRL0_AUTO_SR 0x20  /* Automatic SET/RESET */
+#define MMC5983MA_CTRL1_BW_100HZ 0x00 /* Bandwidth 100Hz (8 ms measurement) */
+#define MMC5983MA_CTRL1_BW_200HZ 0x01 /* Bandwidth 200Hz (4 ms) */
+#define MMC5983MA_CTRL1_BW_400HZ 0x02 /* Bandwidth 400Hz (2 ms) */
+#define MMC5983MA_CTRL1_BW_800HZ 0x03 /* Bandwidth 800Hz (0.5 ms) */
+#define MMC5983MA_CTRL1_SW_RST 0x80   /* Software reset */
+#define MMC5983MA_CTRL2_CM_FREQ 0x07  /* Continuous mode rate field */
+#define MMC5983MA_CTRL2_CMM_EN 0x08   /* Continuous measurement mode */
+#define MMC5983MA_CTRL2_PRD_SET_SHIFT 4 /* Periodic SET interval field */
+#define MMC5983MA_CTRL2_EN_PRD_SET 0x80 /* Periodic SET in continuous mode */
+
+/* Status register bits (write 1 to clear the done flags) */
+#define MMC5983MA_STATUS_MEAS_M_DONE 0x01
+#define MMC5983MA_STATUS_MEAS_T_DONE 0x02
 
 /* Conversion constants */
 #define MMC5983MA_OFFSET 131072           /* 18-bit midpoint (2^17) */
 #define MMC5983MA_LSB_TO_GAUSS 0.0000625f /* 1 LSB = 0.0625 mG */
+#define MMC5983MA_LSB_TO_UGAUSS_X2 125    /* 1 LSB = 62.5 uG */
+#define MMC5983MA_TEMP_LSB_MILLI_C 800    /* Temperature: 0.8 C per LSB */
+#define MMC5983MA_TEMP_MIN_MILLI_C (-75000) /* Temperature at TOUT = 0 */
 
 /**
  * @brief Magnetometer data structure (raw counts)
@@ -95,4 +112,38 @@ int mmc5983ma_validate_product_id(uint8_t product_id);
  */
 float mmc5983ma_calculate_magnitude(float x, float y, float z);
 
+/**
+ * @brief CTRL2 Cm_freq bits for a continuous-measurement rate
+ *
+ * @param odr_hz 1, 10, 20, 50, 100, 200 or 1000
+ * @return Field value (1-7), or -1 if the rate is not supported
+ */
+int mmc5983ma_cm_freq_bits(uint16_t odr_hz);
+
+/**
+ * @brief CTRL1 BW bits for a filter bandwidth
+ *
+ * @param bw_hz 100, 200, 400 or 800
+ * @return Field value (0-3), or -1 if the bandwidth is not supported
+ */
+int mmc5983ma_bw_bits(uint16_t bw_hz);
+
+/**
+ * @brief Narrowest bandwidth whose measurement time fits a rate
+ *
+ * 200 Hz needs at least the 200 Hz bandwidth, 1000 Hz the 800 Hz one.
+ *
+ * @param odr_hz Continuous-measurement rate
+ * @return Bandwidth in Hz
+ */
+uint16_t mmc5983ma_min_bw_hz(uint16_t odr_hz);
+
+/**
+ * @brief CTRL2 Prd_set bits for a periodic SET interval
+ *
+ * @param measurements 1, 25, 75, 100, 250, 500, 1000 or 2000
+ * @return Field value (0-7), or -1 if the interval is not supported
+ */
+int mmc5983ma_prd_set_bits(uint16_t measurements);
+
 #endif /* MMC5983MA_H */
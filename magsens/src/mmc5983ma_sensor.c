@@ -0,0 +1,428 @@
+/*
+ * MMC5983MA Magnetometer Driver - Zephyr Sensor API
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Runs the sensor in continuous-measurement mode at the devicetree odr, so
+ * a sample fetch is one 7-byte burst read of the latest result and never
+ * waits for a conversion. With int-gpios and CONFIG_MMC5983MA_TRIGGER, the
+ * INT pin reports each finished measurement as SENSOR_TRIG_DATA_READY.
+ *
+ * Channels: SENSOR_CHAN_MAGN_X/Y/Z/XYZ in Gauss, SENSOR_CHAN_DIE_TEMP in
+ * degrees C (fetched on request; briefly pauses continuous mode).
+ * Attribute: SENSOR_ATTR_SAMPLING_FREQUENCY on SENSOR_CHAN_MAGN_XYZ
+ * changes the rate at runtime.
+ *
+ * A temperature fetch stops and restarts continuous mode, so fetches, rate
+ * changes and trigger setup are serialized by a per-device mutex: the
+ * data-ready handler fetches from the system workqueue while the
+ * application may fetch the temperature from its own thread.
+ */
+
+#define DT_DRV_COMPAT memsic_mmc5983ma
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "mmc5983ma.h"
+
+LOG_MODULE_REGISTER(MMC5983MA, CONFIG_SENSOR_LOG_LEVEL);
+
+/* Single measurement at the slowest bandwidth takes 8 ms */
+#define MMC5983MA_MEAS_TIMEOUT_MS 20
+#define MMC5983MA_TEMP_TIMEOUT_MS 10
+
+struct mmc5983ma_config {
+  struct i2c_dt_spec i2c;
+#ifdef CONFIG_MMC5983MA_TRIGGER
+  struct gpio_dt_spec int_gpio;
+#endif
+  uint16_t odr;
+  uint16_t bandwidth;
+  uint16_t set_period;
+};
+
+struct mmc5983ma_drv_data {
+  struct k_mutex lock; /* Held across every register sequence */
+  struct mmc5983ma_raw_data raw;
+  int32_t temp_milli_c;
+  uint16_t odr;
+  uint8_t ctrl0; /* Enable bits repeated on every CTRL0 command */
+  uint8_t ctrl2; /* Current continuous-mode setting */
+#ifdef CONFIG_MMC5983MA_TRIGGER
+  const struct device *dev;
+  struct gpio_callback gpio_cb;
+  struct k_work work;
+  sensor_trigger_handler_t handler;
+  const struct sensor_trigger *trigger;
+#endif
+};
+
+static int reg_write(const struct device *dev, uint8_t reg, uint8_t val) {
+  const struct mmc5983ma_config *cfg = dev->config;
+
+  return i2c_reg_write_byte_dt(&cfg->i2c, reg, val);
+}
+
+/* Wait for a done flag in STATUS, then clear it */
+static int wait_done(const struct device *dev, uint8_t flag, int timeout_ms) {
+  const struct mmc5983ma_config *cfg = dev->config;
+  uint8_t status;
+
+  for (int t = 0; t <= timeout_ms; t++) {
+    int err = i2c_reg_read_byte_dt(&cfg->i2c, MMC5983MA_REG_STATUS, &status);
+    if (err) {
+      return err;
+    }
+    if (status & flag) {
+      return reg_write(dev, MMC5983MA_REG_STATUS, flag);
+    }
+    k_msleep(1);
+  }
+  return -ETIMEDOUT;
+}
+
+/* Program CTRL1/CTRL2 for a rate; 0 stops continuous mode */
+static int set_odr(const struct device *dev, uint16_t odr) {
+  const struct mmc5983ma_config *cfg = dev->config;
+  struct mmc5983ma_drv_data *data = dev->data;
+  uint8_t ctrl2 = 0;
+
+  if (odr) {
+    int freq = mmc5983ma_cm_freq_bits(odr);
+    if (freq < 0) {
+      return -EINVAL;
+    }
+    ctrl2 = (uint8_t)freq | MMC5983MA_CTRL2_CMM_EN;
+    if (cfg->set_period) {
+      ctrl2 |= MMC5983MA_CTRL2_EN_PRD_SET |
+               (uint8_t)(mmc5983ma_prd_set_bits(cfg->set_period)
+                         << MMC5983MA_CTRL2_PRD_SET_SHIFT);
+    }
+  }
+
+  uint16_t bw = MAX(cfg->bandwidth, mmc5983ma_min_bw_hz(odr));
+
+  /* Leave continuous mode before changing its rate or bandwidth */
+  int err = reg_write(dev, MMC5983MA_REG_CTRL2, 0);
+  if (!err) {
+    err = reg_write(dev, MMC5983MA_REG_CTRL1, (uint8_t)mmc5983ma_bw_bits(bw));
+  }
+  if (!err && ctrl2) {
+    err = reg_write(dev, MMC5983MA_REG_CTRL2, ctrl2);
+  }
+  if (err) {
+    return err;
+  }
+
+  data->odr = odr;
+  data->ctrl2 = ctrl2;
+  return 0;
+}
+
+static int fetch_temp(const struct device *dev) {
+  struct mmc5983ma_drv_data *data = dev->data;
+  const struct mmc5983ma_config *cfg = dev->config;
+  uint8_t tout;
+
+  /* Temperature is a single measurement: pause continuous mode for it */
+  int err = data->ctrl2 ? reg_write(dev, MMC5983MA_REG_CTRL2, 0) : 0;
+  if (!err) {
+    err = reg_write(dev, MMC5983MA_REG_CTRL0,
+                    data->ctrl0 | MMC5983MA_CTRL0_TM_T);
+  }
+  if (!err) {
+    err = wait_done(dev, MMC5983MA_STATUS_MEAS_T_DONE,
+                    MMC5983MA_TEMP_TIMEOUT_MS);
+  }
+  if (!err) {
+    err = i2c_reg_read_byte_dt(&cfg->i2c, MMC5983MA_REG_TOUT, &tout);
+  }
+
+  int restore = data->ctrl2 ? reg_write(dev, MMC5983MA_REG_CTRL2, data->ctrl2)
+                            : 0;
+  if (err || restore) {
+    return err ? err : restore;
+  }
+
+  data->temp_milli_c =
+      MMC5983MA_TEMP_MIN_MILLI_C + (int32_t)tout * MMC5983MA_TEMP_LSB_MILLI_C;
+  return 0;
+}
+
+static int fetch_xyz(const struct device *dev) {
+  const struct mmc5983ma_config *cfg = dev->config;
+  struct mmc5983ma_drv_data *data = dev->data;
+  uint8_t buf[7];
+
+  if (!data->odr) {
+    /* Single-measurement mode: trigger one and wait for it */
+    int err = reg_write(dev, MMC5983MA_REG_CTRL0,
+                        data->ctrl0 | MMC5983MA_CTRL0_TM);
+    if (!err) {
+      err = wait_done(dev, MMC5983MA_STATUS_MEAS_M_DONE,
+                      MMC5983MA_MEAS_TIMEOUT_MS);
+    }
+    if (err) {
+      return err;
+    }
+  }
+
+  int err = i2c_burst_read_dt(&cfg->i2c, MMC5983MA_REG_XOUT0, buf, sizeof(buf));
+  if (err) {
+    return err;
+  }
+  mmc5983ma_convert_raw_bytes(buf, &data->raw);
+  return 0;
+}
+
+static int mmc5983ma_sample_fetch(const struct device *dev,
+                                  enum sensor_channel chan) {
+  struct mmc5983ma_drv_data *data = dev->data;
+  int err;
+
+  if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_MAGN_XYZ &&
+      chan != SENSOR_CHAN_MAGN_X && chan != SENSOR_CHAN_MAGN_Y &&
+      chan != SENSOR_CHAN_MAGN_Z && chan != SENSOR_CHAN_DIE_TEMP) {
+    return -ENOTSUP;
+  }
+
+  k_mutex_lock(&data->lock, K_FOREVER);
+  err = chan == SENSOR_CHAN_DIE_TEMP ? fetch_temp(dev) : fetch_xyz(dev);
+  k_mutex_unlock(&data->lock);
+  return err;
+}
+
+/* Counts to Gauss, exactly: one count is 62.5 uG */
+static void counts_to_value(int32_t counts, struct sensor_value *val) {
+  int32_t ug = counts * MMC5983MA_LSB_TO_UGAUSS_X2 / 2;
+
+  val->val1 = ug / 1000000;
+  val->val2 = ug % 1000000;
+}
+
+static int mmc5983ma_channel_get(const struct device *dev,
+                                 enum sensor_channel chan,
+                                 struct sensor_value *val) {
+  struct mmc5983ma_drv_data *data = dev->data;
+
+  switch (chan) {
+  case SENSOR_CHAN_MAGN_X:
+    counts_to_value(data->raw.x, val);
+    break;
+  case SENSOR_CHAN_MAGN_Y:
+    counts_to_value(data->raw.y, val);
+    break;
+  case SENSOR_CHAN_MAGN_Z:
+    counts_to_value(data->raw.z, val);
+    break;
+  case SENSOR_CHAN_MAGN_XYZ:
+    counts_to_value(data->raw.x, &val[0]);
+    counts_to_value(data->raw.y, &val[1]);
+    counts_to_value(data->raw.z, &val[2]);
+    break;
+  case SENSOR_CHAN_DIE_TEMP:
+    val->val1 = data->temp_milli_c / 1000;
+    val->val2 = (data->temp_milli_c % 1000) * 1000;
+    break;
+  default:
+    return -ENOTSUP;
+  }
+  return 0;
+}
+
+static int mmc5983ma_attr_set(const struct device *dev,
+                              enum sensor_channel chan,
+                              enum sensor_attribute attr,
+                              const struct sensor_value *val) {
+  if (attr != SENSOR_ATTR_SAMPLING_FREQUENCY ||
+      (chan != SENSOR_CHAN_MAGN_XYZ && chan != SENSOR_CHAN_ALL)) {
+    return -ENOTSUP;
+  }
+  if (val->val1 < 0 || val->val1 > UINT16_MAX || val->val2 != 0) {
+    return -EINVAL;
+  }
+
+  struct mmc5983ma_drv_data *data = dev->data;
+
+  k_mutex_lock(&data->lock, K_FOREVER);
+  int err = set_odr(dev, (uint16_t)val->val1);
+  k_mutex_unlock(&data->lock);
+  return err;
+}
+
+/* ------------ Data-ready trigger ------------ */
+
+#ifdef CONFIG_MMC5983MA_TRIGGER
+
+static void mmc5983ma_gpio_cb(const struct device *port,
+                              struct gpio_callback *cb, uint32_t pins) {
+  struct mmc5983ma_drv_data *data =
+      CONTAINER_OF(cb, struct mmc5983ma_drv_data, gpio_cb);
+  const struct mmc5983ma_config *cfg = data->dev->config;
+
+  ARG_UNUSED(port);
+  ARG_UNUSED(pins);
+
+  /* INT is level: mask it until the work item has cleared the flag */
+  gpio_pin_interrupt_configure_dt(&cfg->int_gpio, GPIO_INT_DISABLE);
+  k_work_submit(&data->work);
+}
+
+static void mmc5983ma_work_cb(struct k_work *work) {
+  struct mmc5983ma_drv_data *data =
+      CONTAINER_OF(work, struct mmc5983ma_drv_data, work);
+  const struct device *dev = data->dev;
+  const struct mmc5983ma_config *cfg = dev->config;
+
+  if (data->handler) {
+    data->handler(dev, data->trigger);
+  }
+
+  /* Clear after the handler read the result; INT drops until the next one */
+  k_mutex_lock(&data->lock, K_FOREVER);
+  (void)reg_write(dev, MMC5983MA_REG_STATUS, MMC5983MA_STATUS_MEAS_M_DONE);
+  k_mutex_unlock(&data->lock);
+  gpio_pin_interrupt_configure_dt(&cfg->int_gpio, GPIO_INT_LEVEL_ACTIVE);
+}
+
+static int mmc5983ma_trigger_set(const struct device *dev,
+                                 const struct sensor_trigger *trig,
+                                 sensor_trigger_handler_t handler) {
+  const struct mmc5983ma_config *cfg = dev->config;
+  struct mmc5983ma_drv_data *data = dev->data;
+
+  if (trig->type != SENSOR_TRIG_DATA_READY || !cfg->int_gpio.port) {
+    return -ENOTSUP;
+  }
+
+  k_mutex_lock(&data->lock, K_FOREVER);
+  gpio_pin_interrupt_configure_dt(&cfg->int_gpio, GPIO_INT_DISABLE);
+  data->handler = handler;
+  data->trigger = trig;
+
+  data->ctrl0 = handler ? (data->ctrl0 | MMC5983MA_CTRL0_INT_EN)
+                        : (data->ctrl0 & ~MMC5983MA_CTRL0_INT_EN);
+  int err = reg_write(dev, MMC5983MA_REG_CTRL0, data->ctrl0);
+  if (!err && handler) {
+    (void)reg_write(dev, MMC5983MA_REG_STATUS, MMC5983MA_STATUS_MEAS_M_DONE);
+    err = gpio_pin_interrupt_configure_dt(&cfg->int_gpio,
+                                          GPIO_INT_LEVEL_ACTIVE);
+  }
+  k_mutex_unlock(&data->lock);
+  return err;
+}
+
+static int init_trigger(const struct device *dev) {
+  const struct mmc5983ma_config *cfg = dev->config;
+  struct mmc5983ma_drv_data *data = dev->data;
+
+  if (!cfg->int_gpio.port) {
+    return 0; /* This instance has no INT wired */
+  }
+  if (!device_is_ready(cfg->int_gpio.port)) {
+    LOG_ERR("INT GPIO not ready");
+    return -ENODEV;
+  }
+
+  data->dev = dev;
+  k_work_init(&data->work, mmc5983ma_work_cb);
+
+  int err = gpio_pin_configure_dt(&cfg->int_gpio, GPIO_INPUT);
+  if (err) {
+    return err;
+  }
+  gpio_init_callback(&data->gpio_cb, mmc5983ma_gpio_cb, BIT(cfg->int_gpio.pin));
+  return gpio_add_callback(cfg->int_gpio.port, &data->gpio_cb);
+}
+
+#endif /* CONFIG_MMC5983MA_TRIGGER */
+
+/* ------------ Init ------------ */
+
+static int mmc5983ma_init(const struct device *dev) {
+  const struct mmc5983ma_config *cfg = dev->config;
+  struct mmc5983ma_drv_data *data = dev->data;
+  uint8_t id;
+
+  k_mutex_init(&data->lock);
+
+  if (!device_is_ready(cfg->i2c.bus)) {
+    LOG_ERR("I2C bus not ready");
+    return -ENODEV;
+  }
+
+  int err = i2c_reg_read_byte_dt(&cfg->i2c, MMC5983MA_REG_PRODUCT_ID, &id);
+  if (err) {
+    return err;
+  }
+  if (mmc5983ma_validate_product_id(id) != 0) {
+    LOG_ERR("Invalid product ID 0x%02x", id);
+    return -ENODEV;
+  }
+
+  /* Reset to defaults, then one SET to clear any magnetization offset */
+  err = reg_write(dev, MMC5983MA_REG_CTRL1, MMC5983MA_CTRL1_SW_RST);
+  if (err) {
+    return err;
+  }
+  k_msleep(10);
+
+  data->ctrl0 = MMC5983MA_CTRL0_AUTO_SR;
+  err = reg_write(dev, MMC5983MA_REG_CTRL0, data->ctrl0 | MMC5983MA_CTRL0_SET);
+  if (err) {
+    return err;
+  }
+  k_msleep(1);
+
+#ifdef CONFIG_MMC5983MA_TRIGGER
+  err = init_trigger(dev);
+  if (err) {
+    return err;
+  }
+#endif
+
+  err = set_odr(dev, cfg->odr);
+  if (err) {
+    LOG_ERR("Configuring %u Hz failed (%d)", cfg->odr, err);
+    return err;
+  }
+
+  LOG_DBG("%s: %u Hz continuous", dev->name, cfg->odr);
+  return 0;
+}
+
+static const struct sensor_driver_api mmc5983ma_api = {
+    .sample_fetch = mmc5983ma_sample_fetch,
+    .channel_get = mmc5983ma_channel_get,
+    .attr_set = mmc5983ma_attr_set,
+#ifdef CONFIG_MMC5983MA_TRIGGER
+    .trigger_set = mmc5983ma_trigger_set,
+#endif
+};
+
+#ifdef CONFIG_MMC5983MA_TRIGGER
+#define MMC5983MA_INT_CFG(inst)                                                \
+  .int_gpio = GPIO_DT_SPEC_INST_GET_OR(inst, int_gpios, {0}),
+#else
+#define MMC5983MA_INT_CFG(inst)
+#endif
+
+#define MMC5983MA_DEFINE(inst)                                                 \
+  static struct mmc5983ma_drv_data mmc5983ma_data_##inst;                      \
+  static const struct mmc5983ma_config mmc5983ma_config_##inst = {             \
+      .i2c = I2C_DT_SPEC_INST_GET(inst),                                       \
+      MMC5983MA_INT_CFG(inst)                                                  \
+      .odr = DT_INST_PROP(inst, odr),                                          \
+      .bandwidth = DT_INST_PROP(inst, bandwidth),                              \
+      .set_period = DT_INST_PROP(inst, set_period),                            \
+  };                                                                           \
+  SENSOR_DEVICE_DT_INST_DEFINE(inst, mmc5983ma_init, NULL,                     \
+                               &mmc5983ma_data_##inst,                         \
+                               &mmc5983ma_config_##inst, POST_KERNEL,          \
+                               CONFIG_SENSOR_INIT_PRIORITY, &mmc5983ma_api);
+
+DT_INST_FOREACH_STATUS_OKAY(MMC5983MA_DEFINE)
@@ -0,0 +1,74 @@
+/**
+ * @file boot_epoch.c
+ * @brief Gateway boot count (Zephyr settings), the epoch of its beacons
+ *
+ * Beacons are sealed with a keystream derived from (epoch, beacon count),
+ * and the count restarts at 1 every boot. Without a new epoch per boot the
+ * keystream of the first beacons would repeat, and a node that lost the
+ * schedule could not tell a recorded beacon from a fresh one.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+#include <errno.h>
+
+#include "boot_epoch.h"
+
+LOG_MODULE_REGISTER(boot_epoch, LOG_LEVEL_INF);
+
+/* ------------ Internal Helpers ------------ */
+
+static uint16_t g_stored;
+
+static int epoch_set(const char *key, size_t len, settings_read_cb read_cb,
+                     void *cb_arg, void *param)
+{
+    ARG_UNUSED(key);
+    ARG_UNUSED(param);
+
+    if (len != sizeof(g_stored))
+    {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &g_stored, sizeof(g_stored));
+    return rc < 0 ? rc : 0;
+}
+
+/* ------------ Public API ------------ */
+
+int boot_epoch_next(uint16_t *epoch)
+{
+    int rc = settings_subsys_init();
+    if (rc == 0)
+    {
+        rc = settings_load_subtree_direct(BOOT_EPOCH_KEY, epoch_set, NULL);
+    }
+    if (rc < 0)
+    {
+        LOG_ERR("Boot epoch load failed: %d", rc);
+        return rc;
+    }
+
+    if (g_stored == UINT16_MAX)
+    {
+        LOG_ERR("Boot epoch exhausted");
+        return -ERANGE;
+    }
+
+    /* Saved before the first beacon goes out, so a reset right after
+     * this cannot reuse the epoch */
+    uint16_t next = g_stored + 1;
+    rc = settings_save_one(BOOT_EPOCH_KEY, &next, sizeof(next));
+    if (rc < 0)
+    {
+        LOG_ERR("Boot epoch save failed: %d", rc);
+        return rc;
+    }
+
+    g_stored = next;
+    *epoch = next;
+    LOG_INF("Boot epoch %u", next);
+    return 0;
+}
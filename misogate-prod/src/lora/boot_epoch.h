@@ -0,0 +1,28 @@
+#ifndef BOOT_EPOCH_H
+#define BOOT_EPOCH_H
+
+#include <stdint.h>
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Settings key of the gateway's boot count
+ */
+#define BOOT_EPOCH_KEY "misogate/epoch"
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Count this boot in flash and return the new count
+ *
+ * The count is the epoch every beacon of this boot is sealed with (see
+ * tdma_init()). Nodes take only beacons newer than the last one they took,
+ * so the count must never repeat or go back: it is saved before it is
+ * returned, and the call fails once it would wrap.
+ *
+ * @param epoch Output epoch, 1 or more
+ * @return 0 on success, negative errno otherwise (no beacons may be sent)
+ */
+int boot_epoch_next(uint16_t *epoch);
+
+#endif /* BOOT_EPOCH_H */
@@ -0,0 +1,405 @@
+/**
+ * @file calib_store.c
+ * @brief Persistent storage of the calibration (Zephyr settings)
+ *
+ * The calibration is stored as one header record plus one record per
+ * calibration point under CALIB_STORE_SUBTREE:
+ *
+ *   misogate/cal/hdr       - version, node layout, baselines, save
+ *                            generation, bank holding the points
+ *   misogate/cal/b<b>/p<i> - calibration point i in bank b (0 or 1)
+ *
+ * A save writes its points to the bank the stored header does not point
+ * to, then the header. Each settings record is replaced as a whole, so
+ * an interrupted save leaves the previous header and the points it points
+ * to untouched, and the previous calibration is loaded. Every record
+ * carries a CRC and the generation of its save, so a point left in a bank
+ * by an older save is never taken for one of the current save.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calib_store.h"
+#include "position.h"
+
+LOG_MODULE_REGISTER(calib_store, LOG_LEVEL_INF);
+
+#define CALIB_STORE_MAGIC 0x4d43414cu /* "MCAL" */
+
+/* ------------ Stored records ------------ */
+
+struct calib_store_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t max_nodes;
+    uint32_t generation;
+    uint8_t node_count;
+    uint8_t point_count;
+    uint8_t bank; /* Bank of the points, 0 or 1 */
+    uint8_t reserved;
+    uint32_t baseline_mask; /* Bit n-1 set if node n has a baseline */
+    struct sensor_pos sensors[MAX_NODES];
+    struct vec3_i32 baseline[MAX_NODES];
+    uint32_t crc; /* CRC32 of everything above */
+};
+
+struct calib_store_point
+{
+    uint32_t generation;
+    int16_t x;
+    int16_t y;
+    uint32_t valid_mask; /* Bit n-1 set if node n has a reading */
+    struct vec3_i32 B_mag[MAX_NODES];
+    int32_t absB[MAX_NODES];
+    uint32_t crc; /* CRC32 of everything above */
+};
+
+BUILD_ASSERT(MAX_NODES <= 32, "node masks are 32 bits");
+BUILD_ASSERT(MAX_CALIB_POINTS <= UINT8_MAX, "point count is stored in 8 bits");
+
+/* ------------ Internal Helpers ------------ */
+
+static bool g_settings_ready;
+
+static int store_init(void)
+{
+    if (g_settings_ready)
+    {
+        return 0;
+    }
+
+    int err = settings_subsys_init();
+    if (err)
+    {
+        LOG_ERR("settings_subsys_init failed: %d", err);
+        return err;
+    }
+    g_settings_ready = true;
+    return 0;
+}
+
+static uint32_t record_crc(const void *rec, size_t len_before_crc)
+{
+    return crc32_ieee(rec, len_before_crc);
+}
+
+static void point_key(char *buf, size_t len, int bank, int idx)
+{
+    snprintf(buf, len, CALIB_STORE_SUBTREE "/b%d/p%d", bank, idx);
+}
+
+/* Loader state for settings_load_subtree_direct() */
+struct load_ctx
+{
+    struct calib_store_header hdr;
+    bool have_hdr;
+    struct calib_point *points;
+    uint32_t points_seen; /* Bit i set once point i passed its checks */
+    int bad_records;
+};
+
+static int read_record(settings_read_cb read_cb, void *cb_arg, size_t len,
+                       void *dst, size_t dst_len)
+{
+    if (len != dst_len)
+    {
+        return -EINVAL;
+    }
+    ssize_t n = read_cb(cb_arg, dst, dst_len);
+    return (n == (ssize_t)dst_len) ? 0 : -EIO;
+}
+
+static int load_header_cb(const char *key, size_t len, settings_read_cb read_cb,
+                          void *cb_arg, void *param)
+{
+    struct load_ctx *ctx = param;
+
+    if (strcmp(key, "hdr") != 0)
+    {
+        return 0;
+    }
+
+    struct calib_store_header *h = &ctx->hdr;
+    if (read_record(read_cb, cb_arg, len, h, sizeof(*h)) != 0 ||
+        h->magic != CALIB_STORE_MAGIC ||
+        h->version != CALIB_STORE_VERSION ||
+        h->max_nodes != MAX_NODES ||
+        h->crc != record_crc(h, offsetof(struct calib_store_header, crc)) ||
+        h->node_count < 2 || h->node_count > MAX_NODES ||
+        h->point_count > MAX_CALIB_POINTS ||
+        h->bank > 1)
+    {
+        ctx->bad_records++;
+        return 0;
+    }
+
+    ctx->have_hdr = true;
+    return 0;
+}
+
+static int load_point_cb(const char *key, size_t len, settings_read_cb read_cb,
+                         void *cb_arg, void *param)
+{
+    struct load_ctx *ctx = param;
+
+    /* "b<bank>/p<i>"; the other bank holds the previous save */
+    if (key[0] != 'b' || key[1] != (char)('0' + ctx->hdr.bank) ||
+        key[2] != '/' || key[3] != 'p')
+    {
+        return 0;
+    }
+
+    char *end;
+    long idx = strtol(&key[4], &end, 10);
+    if (*end != '\0' || idx < 0 || idx >= ctx->hdr.point_count)
+    {
+        /* Left over from an earlier, larger calibration */
+        return 0;
+    }
+
+    struct calib_store_point rec;
+    if (read_record(read_cb, cb_arg, len, &rec, sizeof(rec)) != 0 ||
+        rec.generation != ctx->hdr.generation ||
+        rec.crc != record_crc(&rec, offsetof(struct calib_store_point, crc)))
+    {
+        ctx->bad_records++;
+        return 0;
+    }
+
+    struct calib_point *cp = &ctx->points[idx];
+    memset(cp, 0, sizeof(*cp));
+    cp->x = rec.x;
+    cp->y = rec.y;
+    cp->valid_mask = rec.valid_mask;
+    memcpy(cp->node_B_mag, rec.B_mag, sizeof(cp->node_B_mag));
+    memcpy(cp->node_absB, rec.absB, sizeof(cp->node_absB));
+
+    ctx->points_seen |= BIT(idx);
+    return 0;
+}
+
+/* ------------ Public API ------------ */
+
+int calib_store_save(const struct baseline_data *baselines,
+                     const struct calib_point *points,
+                     int point_count)
+{
+    static struct calib_store_header hdr;
+    static struct calib_store_point rec;
+    char key[32];
+
+    int err = store_init();
+    if (err)
+    {
+        return err;
+    }
+
+    /* Points go to the bank the stored calibration does not use */
+    static struct load_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    err = settings_load_subtree_direct(CALIB_STORE_SUBTREE, load_header_cb, &ctx);
+    if (err)
+    {
+        return err;
+    }
+    uint8_t bank = (ctx.have_hdr && ctx.hdr.bank == 0) ? 1 : 0;
+
+    /* New generation so points from an older save can never be mixed in */
+    uint32_t generation = k_cycle_get_32() ^ (uint32_t)k_uptime_get();
+
+    for (int i = 0; i < point_count; i++)
+    {
+        const struct calib_point *cp = &points[i];
+
+        memset(&rec, 0, sizeof(rec));
+        rec.generation = generation;
+        rec.x = (int16_t)cp->x;
+        rec.y = (int16_t)cp->y;
+        rec.valid_mask = cp->valid_mask;
+        memcpy(rec.B_mag, cp->node_B_mag, sizeof(rec.B_mag));
+        memcpy(rec.absB, cp->node_absB, sizeof(rec.absB));
+        rec.crc = record_crc(&rec, offsetof(struct calib_store_point, crc));
+
+        point_key(key, sizeof(key), bank, i);
+        err = settings_save_one(key, &rec, sizeof(rec));
+        if (err)
+        {
+            LOG_ERR("Saving %s failed: %d", key, err);
+            return err;
+        }
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CALIB_STORE_MAGIC;
+    hdr.version = CALIB_STORE_VERSION;
+    hdr.max_nodes = MAX_NODES;
+    hdr.generation = generation;
+    hdr.node_count = (uint8_t)position_get_node_count();
+    hdr.point_count = (uint8_t)point_count;
+    hdr.bank = bank;
+    for (int nid = 1; nid <= MAX_NODES; nid++)
+    {
+        const struct sensor_pos *sp = position_get_sensor_pos(nid);
+        if (sp)
+        {
+            hdr.sensors[nid - 1] = *sp;
+        }
+        if (baselines[nid].valid)
+        {
+            hdr.baseline_mask |= BIT(nid - 1);
+            hdr.baseline[nid - 1] = baselines[nid].B_ambient;
+        }
+    }
+    hdr.crc = record_crc(&hdr, offsetof(struct calib_store_header, crc));
+
+    err = settings_save_one(CALIB_STORE_SUBTREE "/hdr", &hdr, sizeof(hdr));
+    if (err)
+    {
+        LOG_ERR("Saving calibration header failed: %d", err);
+        return err;
+    }
+
+    LOG_INF("Calibration stored (%d nodes, %d points, bank %u)", hdr.node_count, point_count,
+            bank);
+    return 0;
+}
+
+int calib_store_save_baselines(const struct baseline_data *baselines)
+{
+    static struct load_ctx ctx;
+
+    int err = store_init();
+    if (err)
+    {
+        return err;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    err = settings_load_subtree_direct(CALIB_STORE_SUBTREE, load_header_cb, &ctx);
+    if (err)
+    {
+        return err;
+    }
+    if (!ctx.have_hdr)
+    {
+        return -ENOENT;
+    }
+
+    /* Same generation and bank: the stored points stay with the header */
+    struct calib_store_header *h = &ctx.hdr;
+    h->baseline_mask = 0;
+    memset(h->baseline, 0, sizeof(h->baseline));
+    for (int nid = 1; nid <= MAX_NODES; nid++)
+    {
+        if (baselines[nid].valid)
+        {
+            h->baseline_mask |= BIT(nid - 1);
+            h->baseline[nid - 1] = baselines[nid].B_ambient;
+        }
+    }
+    h->crc = record_crc(h, offsetof(struct calib_store_header, crc));
+
+    err = settings_save_one(CALIB_STORE_SUBTREE "/hdr", h, sizeof(*h));
+    if (err)
+    {
+        LOG_ERR("Saving calibration header failed: %d", err);
+        return err;
+    }
+
+    LOG_INF("Stored baselines updated");
+    return 0;
+}
+
+int calib_store_load(struct baseline_data *baselines,
+                     struct calib_point *points,
+                     int *point_count)
+{
+    static struct load_ctx ctx;
+
+    int err = store_init();
+    if (err)
+    {
+        return err;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.points = points;
+
+    /* Header first: it says which points and generation to accept */
+    err = settings_load_subtree_direct(CALIB_STORE_SUBTREE, load_header_cb, &ctx);
+    if (err)
+    {
+        return err;
+    }
+    if (!ctx.have_hdr)
+    {
+        return ctx.bad_records ? -EINVAL : -ENOENT;
+    }
+
+    err = settings_load_subtree_direct(CALIB_STORE_SUBTREE, load_point_cb, &ctx);
+    if (err)
+    {
+        return err;
+    }
+
+    uint32_t all_points = ctx.hdr.point_count ? (uint32_t)BIT(ctx.hdr.point_count) - 1u : 0u;
+    if (ctx.points_seen != all_points)
+    {
+        LOG_WRN("Stored calibration incomplete (points 0x%x of 0x%x)",
+                (unsigned)ctx.points_seen, (unsigned)all_points);
+        return -EINVAL;
+    }
+
+    /* Every record checked out: apply layout and baselines */
+    position_set_node_count(ctx.hdr.node_count);
+    for (int nid = 1; nid <= ctx.hdr.node_count; nid++)
+    {
+        position_set_sensor(nid, &ctx.hdr.sensors[nid - 1]);
+    }
+
+    for (int nid = 1; nid <= MAX_NODES; nid++)
+    {
+        struct baseline_data *bd = &baselines[nid];
+        memset(bd, 0, sizeof(*bd));
+        if (ctx.hdr.baseline_mask & BIT(nid - 1))
+        {
+            bd->valid = true;
+            bd->B_ambient = ctx.hdr.baseline[nid - 1];
+        }
+    }
+
+    *point_count = ctx.hdr.point_count;
+    return 0;
+}
+
+int calib_store_clear(void)
+{
+    char key[32];
+
+    int err = store_init();
+    if (err)
+    {
+        return err;
+    }
+
+    /* Without a header nothing else is loaded; points are removed too to
+     * free the space */
+    err = settings_delete(CALIB_STORE_SUBTREE "/hdr");
+    for (int bank = 0; bank <= 1; bank++)
+    {
+        for (int i = 0; i < MAX_CALIB_POINTS; i++)
+        {
+            point_key(key, sizeof(key), bank, i);
+            (void)settings_delete(key);
+        }
+    }
+    return err;
+}
@@ -0,0 +1,115 @@
+#ifndef CALIB_STORE_H
+#define CALIB_STORE_H
+
+#include <errno.h>
+#include "calibration.h"
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Settings subtree holding the stored calibration
+ */
+#define CALIB_STORE_SUBTREE "misogate/cal"
+
+/**
+ * @brief Stored format version
+ *
+ * Bump whenever a stored structure changes; older records are then
+ * ignored and a fresh calibration is run.
+ */
+#define CALIB_STORE_VERSION 2
+
+/* ------------ Public API ------------ */
+
+#if defined(CONFIG_MISOGATE_CALIB_PERSIST)
+
+/**
+ * @brief Store the node layout, baselines and calibration points
+ *
+ * The layout comes from the position module (node count and sensor
+ * positions), so a restore brings back exactly the geometry the
+ * calibration was taken with. If the save is interrupted or fails, the
+ * previously stored calibration is still the one loaded.
+ *
+ * @param baselines Baselines indexed by node ID (MAX_NODES + 1 entries)
+ * @param points Calibration points
+ * @param point_count Number of points
+ * @return 0 on success, negative errno otherwise
+ */
+int calib_store_save(const struct baseline_data *baselines,
+                     const struct calib_point *points,
+                     int point_count);
+
+/**
+ * @brief Replace the baselines of the stored calibration
+ *
+ * Rewrites only the header record, so the stored layout and points are
+ * kept; an interrupted update leaves the previous baselines.
+ *
+ * @param baselines Baselines indexed by node ID (MAX_NODES + 1 entries)
+ * @return 0 on success, -ENOENT if no calibration is stored, negative
+ *         errno otherwise
+ */
+int calib_store_save_baselines(const struct baseline_data *baselines);
+
+/**
+ * @brief Restore a stored calibration
+ *
+ * Fills the baselines and points and applies the stored node layout to
+ * the position module. The layout is only applied once every record has
+ * passed its checks; on failure the outputs may be partly written and
+ * must be discarded by the caller.
+ *
+ * @param baselines Output baselines (MAX_NODES + 1 entries)
+ * @param points Output calibration points (MAX_CALIB_POINTS entries)
+ * @param point_count Output number of points
+ * @return 0 on success, -ENOENT if nothing is stored, -EINVAL if the
+ *         stored record is from another version or corrupt
+ */
+int calib_store_load(struct baseline_data *baselines,
+                     struct calib_point *points,
+                     int *point_count);
+
+/**
+ * @brief Delete the stored calibration
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int calib_store_clear(void);
+
+#else
+
+static inline int calib_store_save(const struct baseline_data *baselines,
+                                   const struct calib_point *points,
+                                   int point_count)
+{
+    ARG_UNUSED(baselines);
+    ARG_UNUSED(points);
+    ARG_UNUSED(point_count);
+    return -ENOTSUP;
+}
+
+static inline int calib_store_save_baselines(const struct baseline_data *baselines)
+{
+    ARG_UNUSED(baselines);
+    return -ENOTSUP;
+}
+
+static inline int calib_store_load(struct baseline_data *baselines,
+                                   struct calib_point *points,
+                                   int *point_count)
+{
+    ARG_UNUSED(baselines);
+    ARG_UNUSED(points);
+    ARG_UNUSED(point_count);
+    return -ENOTSUP;
+}
+
+static inline int calib_store_clear(void)
+{
+    return -ENOTSUP;
+}
+
+#endif /* CONFIG_MISOGATE_CALIB_PERSIST */
+
+#endif /* CALIB_STORE_H */
@@ -15,6 +15,19 @@
  * After calibration completes, the system enters RUNNING state where:
  *   - B_magnet = B_measured - B_baseline
  *   - Position is estimated using dipole model + optional lookup table
+ *
+ * The finished calibration is stored in flash (calib_store.c). On the next
+ * boot it is restored and tracking resumes immediately; the first reading
+ * from each node is checked against its stored baseline, and if most nodes
+ * disagree (sensors moved, environment changed) the stored calibration is
+ * dropped and a fresh baseline capture starts.
+ *
+ * While running, each baseline follows slow ambient drift (temperature,
+ * geomagnetic variation, steel moved nearby) with an exponential moving
+ * average that only updates while the sensor sees no magnet. Once a
+ * baseline has drifted CALIB_DRIFT_SAVE_MUT from the stored one, the
+ * stored baselines are updated (rate limited), so a reboot restores the
+ * drifted ones.
  */
 
 #include <zephyr/kernel.h>
@@ -27,7 +40,9 @@
 #include <ctype.h>
 
 #include "calibration.h"
+#include "calib_store.h"
 #include "position.h"
+#include "telemetry.h"
 
 LOG_MODULE_REGISTER(calibration, LOG_LEVEL_INF);
 
@@ -38,10 +53,14 @@ static calib_state_t g_calib_state = CALIB_STATE_IDLE;
 /* Baseline data for each sensor */
 static struct baseline_data g_baselines[MAX_NODES + 1];
 
+/* Copy of g_baselines for calib_store_save() (too big for the console stack) */
+static struct baseline_data g_baselines_snapshot[MAX_NODES + 1];
+
 /* Position calibration points */
 static struct calib_point g_calib_points[MAX_CALIB_POINTS];
 static int g_calib_point_count = 0;
 static int g_current_calib_idx = -1;
+static struct calib_accum g_calib_accum;
 
 /* Mutex for thread-safe access */
 static K_MUTEX_DEFINE(calib_mutex);
@@ -49,6 +68,23 @@ static K_MUTEX_DEFINE(calib_mutex);
 /* Flag to control MQTT publishing */
 static bool g_mqtt_publish_enabled = false;
 
+/* Restored calibration still being checked against live readings.
+ * Bit n-1 set while node n has not reported since the restore. */
+static uint32_t g_restore_pending;
+static int g_restore_agree;
+static int g_restore_disagree;
+
+#if defined(CONFIG_MISOGATE_BASELINE_DRIFT) && defined(CONFIG_MISOGATE_CALIB_PERSIST)
+/* Baselines as last stored, and the work that stores drifted ones (flash
+ * writes stay off the processing thread) */
+static struct vec3_i32 g_stored_ambient[MAX_NODES + 1];
+static struct baseline_data g_drift_snapshot[MAX_NODES + 1];
+static int64_t g_drift_saved_ms;
+static void mark_baselines_stored(const struct baseline_data *baselines);
+static void drift_save_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(drift_save_work, drift_save_work_fn);
+#endif
+
 /* Console input thread */
 #define CONSOLE_STACK_SIZE 4096
 #define CONSOLE_PRIORITY 6
@@ -65,7 +101,7 @@ static K_SEM_DEFINE(console_start_sem, 0, 1);
 static void print_baseline_status(void)
 {
     printk("\nBaseline Status:\n");
-    for (int i = 1; i <= MAX_NODES; i++)
+    for (int i = 1; i <= position_get_node_count(); i++)
     {
         struct baseline_data *bd = &g_baselines[i];
         if (bd->valid)
@@ -102,6 +138,9 @@ static void print_baseline_help(void)
     printk("  STATUS  - Show baseline capture progress\n");
     printk("  DONE    - Finish baseline calibration\n");
     printk("  RESTART - Clear and restart baseline capture\n");
+    printk("  NODES N - Set number of deployed sensors (2-%d)\n", MAX_NODES);
+    printk("  NODE ID X Y [Z] - Set sensor position\n");
+    printk("  TELEM [N] - Show the last N telemetry events\n");
     printk("\n");
     printk("Baseline automatically captures from incoming sensor data.\n");
     printk("Wait until all sensors show READY, then type DONE.\n");
@@ -127,6 +166,7 @@ static void print_position_calibration_help(void)
     printk("  START   - Skip/finish calibration, begin tracking mode\n");
     printk("  STATUS  - Show current calibration points\n");
     printk("  CLEAR   - Clear all calibration points\n");
+    printk("  TELEM [N] - Show the last N telemetry events\n");
     printk("\n");
     printk("Position calibration is optional. Type START to skip.\n");
     printk("==============================================\n");
@@ -134,6 +174,22 @@ static void print_position_calibration_help(void)
     printk("> ");
 }
 
+static void print_running_help(void)
+{
+    printk("\n");
+    printk("==============================================\n");
+    printk("     TRACKING MODE\n");
+    printk("==============================================\n");
+    printk("\n");
+    printk("Commands:\n");
+    printk("  STATUS  - Show baselines, sensor layout and calibration points\n");
+    printk("  RECAL   - Discard the calibration and restart from PHASE 1\n");
+    printk("  TELEM [N] - Show the last N telemetry events\n");
+    printk("==============================================\n");
+    printk("\n");
+    printk("> ");
+}
+
 static void print_calibration_status(void)
 {
     printk("\nPosition Calibration Points: %d\n", g_calib_point_count);
@@ -143,12 +199,12 @@ static void print_calibration_status(void)
         printk("  Point %d: (%d, %d) -> ", i + 1, cp->x, cp->y);
         for (int nid = 1; nid <= MAX_NODES; nid++)
         {
-            if (cp->node_valid[nid])
+            if (cp->valid_mask & BIT(nid - 1))
             {
                 printk("S%d:(%d,%d,%d) ", nid,
-                       cp->node_B_mag[nid].x,
-                       cp->node_B_mag[nid].y,
-                       cp->node_B_mag[nid].z);
+                       cp->node_B_mag[nid - 1].x,
+                       cp->node_B_mag[nid - 1].y,
+                       cp->node_B_mag[nid - 1].z);
             }
         }
         printk("\n");
@@ -156,10 +212,49 @@ static void print_calibration_status(void)
     printk("\n> ");
 }
 
+static void print_node_layout(void)
+{
+    printk("\nSensor layout (%d nodes):\n", position_get_node_count());
+    for (int i = 1; i <= position_get_node_count(); i++)
+    {
+        const struct sensor_pos *sp = position_get_sensor_pos(i);
+        printk("  Sensor %d: (%d, %d, %d)\n", i,
+               (int)sp->x, (int)sp->y, (int)sp->z);
+    }
+    printk("\n");
+}
+
+static void print_telemetry(const char *args)
+{
+    int count;
+    if (sscanf(args, "%d", &count) != 1 || count <= 0 || count > TELEMETRY_EVENTS)
+    {
+        count = 16;
+    }
+
+    struct telemetry_stats stats;
+    telemetry_get_stats(&stats);
+    printk("\nTelemetry: %u events recorded, %u overwritten, %u positions published\n",
+           (unsigned)stats.recorded, (unsigned)stats.overwritten,
+           (unsigned)stats.published);
+
+    uint32_t cursor = telemetry_cursor_latest((uint32_t)count);
+    struct telem_event ev;
+    while (count-- > 0 && telemetry_read(&cursor, &ev, 1) == 1)
+    {
+        char line[192];
+        if (telemetry_format_json(&ev, line, sizeof(line)) > 0)
+        {
+            printk("  %s\n", line);
+        }
+    }
+    printk("\n");
+}
+
 static bool check_all_baselines_ready(void)
 {
     int ready_count = 0;
-    for (int i = 1; i <= MAX_NODES; i++)
+    for (int i = 1; i <= position_get_node_count(); i++)
     {
         if (g_baselines[i].valid)
         {
@@ -170,6 +265,220 @@ static bool check_all_baselines_ready(void)
     return ready_count >= 2;
 }
 
+/* ------------ Stored Calibration ------------ */
+
+/* Drop baselines and points and go back to PHASE 1 */
+static void restart_baseline(const char *reason)
+{
+    k_mutex_lock(&calib_mutex, K_FOREVER);
+    memset(g_baselines, 0, sizeof(g_baselines));
+    memset(g_calib_points, 0, sizeof(g_calib_points));
+    g_calib_point_count = 0;
+    g_current_calib_idx = -1;
+    g_restore_pending = 0;
+    g_calib_state = CALIB_STATE_BASELINE;
+    g_mqtt_publish_enabled = false;
+    k_mutex_unlock(&calib_mutex);
+
+    printk("\n*** %s, restarting baseline calibration ***\n", reason);
+}
+
+static void restore_calibration(void)
+{
+    int err = calib_store_load(g_baselines, g_calib_points, &g_calib_point_count);
+    if (err)
+    {
+        if (err != -ENOENT && err != -ENOTSUP)
+        {
+            LOG_WRN("Stored calibration unusable (%d), running full calibration", err);
+        }
+        memset(g_baselines, 0, sizeof(g_baselines));
+        memset(g_calib_points, 0, sizeof(g_calib_points));
+        g_calib_point_count = 0;
+        return;
+    }
+
+    g_restore_pending = 0;
+    g_restore_agree = 0;
+    g_restore_disagree = 0;
+    for (int nid = 1; nid <= position_get_node_count(); nid++)
+    {
+        if (g_baselines[nid].valid)
+        {
+            g_restore_pending |= BIT(nid - 1);
+        }
+    }
+
+    if (!check_all_baselines_ready())
+    {
+        memset(g_baselines, 0, sizeof(g_baselines));
+        g_calib_point_count = 0;
+        g_restore_pending = 0;
+        return;
+    }
+
+    g_calib_state = CALIB_STATE_RUNNING;
+    g_mqtt_publish_enabled = true;
+#if defined(CONFIG_MISOGATE_BASELINE_DRIFT) && defined(CONFIG_MISOGATE_CALIB_PERSIST)
+    mark_baselines_stored(g_baselines);
+#endif
+
+    LOG_INF("Calibration restored: %d nodes, %d points, tracking resumed",
+            position_get_node_count(), g_calib_point_count);
+}
+
+/*
+ * Check a node's first reading after a restore against its stored
+ * baseline. The magnet may legitimately sit next to one sensor at boot,
+ * so the calibration is only declared stale when most nodes disagree.
+ * Called with calib_mutex held; returns true if it must be discarded.
+ */
+static bool verify_restored_baseline(uint8_t node_id, const struct vec3_i32 *B_raw)
+{
+    uint32_t bit = BIT(node_id - 1);
+    if (!(g_restore_pending & bit))
+    {
+        return false;
+    }
+    g_restore_pending &= ~bit;
+
+    const struct vec3_i32 *B0 = &g_baselines[node_id].B_ambient;
+    int32_t dev = position_compute_absB(B_raw->x - B0->x,
+                                        B_raw->y - B0->y,
+                                        B_raw->z - B0->z);
+    if (dev > CALIB_RESTORE_MAX_DEVIATION)
+    {
+        g_restore_disagree++;
+        LOG_WRN("Sensor %u is %d m-uT off its stored baseline", node_id, dev);
+    }
+    else
+    {
+        g_restore_agree++;
+    }
+
+    int total = g_restore_agree + g_restore_disagree + __builtin_popcount(g_restore_pending);
+    if (2 * g_restore_disagree >= total)
+    {
+        return true;
+    }
+    if (2 * g_restore_agree > total)
+    {
+        /* Majority agrees, no need to look at the rest */
+        g_restore_pending = 0;
+        LOG_INF("Stored calibration verified against live readings");
+    }
+    return false;
+}
+
+/* ------------ Baseline Drift ------------ */
+
+#if defined(CONFIG_MISOGATE_BASELINE_DRIFT)
+
+/*
+ * One O(1) step of the drift tracker, called with calib_mutex held.
+ *
+ * The baseline moves 1/2^CONFIG_MISOGATE_BASELINE_DRIFT_SHIFT of the way
+ * towards each quiet reading, kept in 1/256 m-uT so small steps are not
+ * lost to rounding. A reading further than the freeze threshold from the
+ * baseline is taken as the magnet (or a transient) and stops adaptation
+ * until the sensor has been quiet for CALIB_DRIFT_SETTLE_READINGS again.
+ */
+static void track_baseline_drift(struct baseline_data *bd, const struct vec3_i32 *B_raw)
+{
+    int32_t dx = B_raw->x - bd->B_ambient.x;
+    int32_t dy = B_raw->y - bd->B_ambient.y;
+    int32_t dz = B_raw->z - bd->B_ambient.z;
+
+    if (position_compute_absB(dx, dy, dz) > CONFIG_MISOGATE_BASELINE_DRIFT_FREEZE_MUT)
+    {
+        bd->quiet_readings = 0;
+        return;
+    }
+
+    if (bd->quiet_readings < CALIB_DRIFT_SETTLE_READINGS)
+    {
+        if (++bd->quiet_readings == CALIB_DRIFT_SETTLE_READINGS)
+        {
+            bd->drift_q8.x = bd->B_ambient.x * 256;
+            bd->drift_q8.y = bd->B_ambient.y * 256;
+            bd->drift_q8.z = bd->B_ambient.z * 256;
+        }
+        return;
+    }
+
+    /* Arithmetic shift: rounds towards -inf, the bias is below 1/256 m-uT */
+    bd->drift_q8.x += (B_raw->x * 256 - bd->drift_q8.x) >> CONFIG_MISOGATE_BASELINE_DRIFT_SHIFT;
+    bd->drift_q8.y += (B_raw->y * 256 - bd->drift_q8.y) >> CONFIG_MISOGATE_BASELINE_DRIFT_SHIFT;
+    bd->drift_q8.z += (B_raw->z * 256 - bd->drift_q8.z) >> CONFIG_MISOGATE_BASELINE_DRIFT_SHIFT;
+
+    bd->B_ambient.x = (bd->drift_q8.x + 128) >> 8;
+    bd->B_ambient.y = (bd->drift_q8.y + 128) >> 8;
+    bd->B_ambient.z = (bd->drift_q8.z + 128) >> 8;
+}
+
+#endif /* CONFIG_MISOGATE_BASELINE_DRIFT */
+
+#if defined(CONFIG_MISOGATE_BASELINE_DRIFT) && defined(CONFIG_MISOGATE_CALIB_PERSIST)
+
+/* Note the baselines just stored or restored. Called with calib_mutex held,
+ * or before the processing thread starts. */
+static void mark_baselines_stored(const struct baseline_data *baselines)
+{
+    for (int nid = 1; nid <= MAX_NODES; nid++)
+    {
+        g_stored_ambient[nid] = baselines[nid].B_ambient;
+    }
+    g_drift_saved_ms = k_uptime_get();
+}
+
+/* Schedule a store of the baselines once node_id's has drifted far enough
+ * from the stored one. Called with calib_mutex held. */
+static void request_drift_save(uint8_t node_id)
+{
+    const struct vec3_i32 *B = &g_baselines[node_id].B_ambient;
+    const struct vec3_i32 *B0 = &g_stored_ambient[node_id];
+
+    if (position_compute_absB(B->x - B0->x, B->y - B0->y, B->z - B0->z) <= CALIB_DRIFT_SAVE_MUT)
+    {
+        return;
+    }
+
+    /* No-op while already scheduled */
+    int64_t wait_ms = g_drift_saved_ms + CALIB_DRIFT_SAVE_MIN_MS - k_uptime_get();
+    k_work_schedule(&drift_save_work, wait_ms > 0 ? K_MSEC(wait_ms) : K_NO_WAIT);
+}
+
+static void drift_save_work_fn(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&calib_mutex, K_FOREVER);
+    if (g_calib_state != CALIB_STATE_RUNNING)
+    {
+        k_mutex_unlock(&calib_mutex);
+        return;
+    }
+    memcpy(g_drift_snapshot, g_baselines, sizeof(g_baselines));
+    k_mutex_unlock(&calib_mutex);
+
+    int err = calib_store_save_baselines(g_drift_snapshot);
+
+    k_mutex_lock(&calib_mutex, K_FOREVER);
+    if (err)
+    {
+        /* Try again after the rate limit, if still drifted */
+        LOG_WRN("Storing drifted baselines failed: %d", err);
+        g_drift_saved_ms = k_uptime_get();
+    }
+    else
+    {
+        mark_baselines_stored(g_drift_snapshot);
+    }
+    k_mutex_unlock(&calib_mutex);
+}
+
+#endif
+
 /* ------------ Console Input Thread ------------ */
 
 static void console_input_thread(void *p1, void *p2, void *p3)
@@ -188,7 +497,15 @@ static void console_input_thread(void *p1, void *p2, void *p3)
     console_getline_init();
 
     printk("\n\n*** Console input ready ***\n");
-    print_baseline_help();
+    if (calibration_get_state() == CALIB_STATE_RUNNING)
+    {
+        printk("Calibration restored from flash, tracking resumed.\n");
+        print_running_help();
+    }
+    else
+    {
+        print_baseline_help();
+    }
 
     while (1)
     {
@@ -219,8 +536,14 @@ static void console_input_thread(void *p1, void *p2, void *p3)
         calib_state_t current_state = g_calib_state;
         k_mutex_unlock(&calib_mutex);
 
+        /* ------------ COMMANDS AVAILABLE IN EVERY PHASE ------------ */
+        if (strncmp(cmd_upper, "TELEM", 5) == 0)
+        {
+            print_telemetry(cmd_upper + 5);
+            printk("> ");
+        }
         /* ------------ BASELINE PHASE COMMANDS ------------ */
-        if (current_state == CALIB_STATE_BASELINE)
+        else if (current_state == CALIB_STATE_BASELINE)
         {
             if (strncmp(cmd_upper, "STATUS", 6) == 0)
             {
@@ -253,9 +576,47 @@ static void console_input_thread(void *p1, void *p2, void *p3)
                 k_mutex_unlock(&calib_mutex);
                 printk("> ");
             }
+            else if (strncmp(cmd_upper, "NODES", 5) == 0)
+            {
+                int count;
+                if (sscanf(cmd_upper + 5, "%d", &count) != 1)
+                {
+                    print_node_layout();
+                }
+                else if (position_set_node_count(count) != 0)
+                {
+                    printk("Error: node count must be 2-%d\n", MAX_NODES);
+                }
+                else
+                {
+                    print_node_layout();
+                }
+                printk("> ");
+            }
+            else if (strncmp(cmd_upper, "NODE", 4) == 0)
+            {
+                int id, x, y;
+                int z = 0;
+                int n = sscanf(cmd_upper + 4, "%d %d %d %d", &id, &x, &y, &z);
+                struct sensor_pos sp = {.x = (float)x, .y = (float)y, .z = (float)z};
+
+                if (n < 3)
+                {
+                    printk("Usage: NODE ID X Y [Z]\n");
+                }
+                else if (position_set_sensor(id, &sp) != 0)
+                {
+                    printk("Error: node ID must be 1-%d\n", position_get_node_count());
+                }
+                else
+                {
+                    print_node_layout();
+                }
+                printk("> ");
+            }
             else
             {
-                printk("Unknown command. Type STATUS, DONE, or RESTART.\n");
+                printk("Unknown command. Type STATUS, DONE, RESTART, NODES or NODE.\n");
                 printk("> ");
             }
         }
@@ -284,11 +645,29 @@ static void console_input_thread(void *p1, void *p2, void *p3)
                 g_calib_state = CALIB_STATE_RUNNING;
                 g_mqtt_publish_enabled = true;
                 g_current_calib_idx = -1;
+                g_restore_pending = 0;
 
+                /* Baseline drift tracking updates g_baselines on the
+                 * processing thread from here on, so store a copy taken
+                 * under the mutex. The points only change on this thread. */
+                memcpy(g_baselines_snapshot, g_baselines, sizeof(g_baselines));
                 k_mutex_unlock(&calib_mutex);
 
-                /* Exit console thread */
-                return;
+                int err = calib_store_save(g_baselines_snapshot, g_calib_points,
+                                           g_calib_point_count);
+                if (err && err != -ENOTSUP)
+                {
+                    printk("Warning: calibration not stored (%d), it will be lost on reboot\n", err);
+                }
+#if defined(CONFIG_MISOGATE_BASELINE_DRIFT) && defined(CONFIG_MISOGATE_CALIB_PERSIST)
+                else
+                {
+                    k_mutex_lock(&calib_mutex, K_FOREVER);
+                    mark_baselines_stored(g_baselines_snapshot);
+                    k_mutex_unlock(&calib_mutex);
+                }
+#endif
+                print_running_help();
             }
             else if (strncmp(cmd_upper, "STATUS", 6) == 0)
             {
@@ -329,6 +708,7 @@ static void console_input_thread(void *p1, void *p2, void *p3)
 
                         int idx = g_calib_point_count;
                         memset(&g_calib_points[idx], 0, sizeof(struct calib_point));
+                        memset(&g_calib_accum, 0, sizeof(g_calib_accum));
                         g_calib_points[idx].x = x;
                         g_calib_points[idx].y = y;
                         g_current_calib_idx = idx;
@@ -356,6 +736,29 @@ static void console_input_thread(void *p1, void *p2, void *p3)
                 }
             }
         }
+        /* ------------ TRACKING PHASE COMMANDS ------------ */
+        else if (current_state == CALIB_STATE_RUNNING)
+        {
+            if (strncmp(cmd_upper, "STATUS", 6) == 0)
+            {
+                k_mutex_lock(&calib_mutex, K_FOREVER);
+                print_baseline_status();
+                print_node_layout();
+                print_calibration_status();
+                k_mutex_unlock(&calib_mutex);
+            }
+            else if (strncmp(cmd_upper, "RECAL", 5) == 0)
+            {
+                (void)calib_store_clear();
+                restart_baseline("Calibration discarded");
+                print_baseline_help();
+            }
+            else
+            {
+                printk("Unknown command. Type STATUS, RECAL or TELEM.\n");
+                printk("> ");
+            }
+        }
     }
 }
 
@@ -369,6 +772,10 @@ void calibration_init(void)
     g_calib_state = CALIB_STATE_IDLE;
     g_current_calib_idx = -1;
     g_mqtt_publish_enabled = false;
+    g_restore_pending = 0;
+
+    /* Warm start: resume tracking straight away if a calibration is stored */
+    restore_calibration();
 
     /* Create console input thread */
     console_thread_id = k_thread_create(&console_thread_data,
@@ -382,12 +789,14 @@ void calibration_init(void)
 
 void calibration_start_console(void)
 {
-    printk("Starting calibration mode...\n");
-    printk("PHASE 1: Baseline calibration (remove magnet from area)\n");
-
     k_mutex_lock(&calib_mutex, K_FOREVER);
-    g_calib_state = CALIB_STATE_BASELINE;
-    g_mqtt_publish_enabled = false;
+    if (g_calib_state != CALIB_STATE_RUNNING)
+    {
+        printk("Starting calibration mode...\n");
+        printk("PHASE 1: Baseline calibration (remove magnet from area)\n");
+        g_calib_state = CALIB_STATE_BASELINE;
+        g_mqtt_publish_enabled = false;
+    }
     k_mutex_unlock(&calib_mutex);
 
     /* Start console input thread */
@@ -450,6 +859,31 @@ void calibration_process_reading_3d(uint8_t node_id, const struct vec3_i32 *B_ra
 
     k_mutex_lock(&calib_mutex, K_FOREVER);
 
+    /* ------------ RUNNING: verify a restored calibration ------------ */
+    if (g_calib_state == CALIB_STATE_RUNNING)
+    {
+        bool stale = verify_restored_baseline(node_id, B_raw);
+
+#if defined(CONFIG_MISOGATE_BASELINE_DRIFT)
+        if (!stale && g_baselines[node_id].valid)
+        {
+            track_baseline_drift(&g_baselines[node_id], B_raw);
+#if defined(CONFIG_MISOGATE_CALIB_PERSIST)
+            request_drift_save(node_id);
+#endif
+        }
+#endif
+        k_mutex_unlock(&calib_mutex);
+
+        if (stale)
+        {
+            (void)calib_store_clear();
+            restart_baseline("Stored calibration does not match live readings");
+            print_baseline_help();
+        }
+        return;
+    }
+
     /* ------------ BASELINE PHASE: Capture ambient field ------------ */
     if (g_calib_state == CALIB_STATE_BASELINE)
     {
@@ -490,10 +924,12 @@ void calibration_process_reading_3d(uint8_t node_id, const struct vec3_i32 *B_ra
     else if (g_calib_state == CALIB_STATE_WAITING_INPUT && g_current_calib_idx >= 0)
     {
         struct calib_point *cp = &g_calib_points[g_current_calib_idx];
+        struct calib_accum *acc = &g_calib_accum;
         struct baseline_data *bd = &g_baselines[node_id];
+        int idx = node_id - 1;
 
         /* Only collect if this node hasn't finished and has valid baseline */
-        if (!cp->node_valid[node_id] && bd->valid)
+        if (!(cp->valid_mask & BIT(idx)) && bd->valid)
         {
             /* Compute magnet-induced field: B_mag = B_raw - B_baseline */
             int32_t B_mag_x = B_raw->x - bd->B_ambient.x;
@@ -501,34 +937,34 @@ void calibration_process_reading_3d(uint8_t node_id, const struct vec3_i32 *B_ra
             int32_t B_mag_z = B_raw->z - bd->B_ambient.z;
 
             /* Accumulate for averaging */
-            cp->sum_x[node_id] += B_mag_x;
-            cp->sum_y[node_id] += B_mag_y;
-            cp->sum_z[node_id] += B_mag_z;
-            cp->reading_count[node_id]++;
+            acc->sum_x[idx] += B_mag_x;
+            acc->sum_y[idx] += B_mag_y;
+            acc->sum_z[idx] += B_mag_z;
+            acc->reading_count[idx]++;
 
             /* Also track scalar for legacy compatibility */
             int32_t absB = position_compute_absB(B_mag_x, B_mag_y, B_mag_z);
-            cp->reading_sum[node_id] += absB;
+            acc->reading_sum[idx] += absB;
 
             printk("CALIB: Sensor %u reading %d/%d B_mag=(%d, %d, %d)\n",
-                   node_id, cp->reading_count[node_id], CALIB_READINGS_PER_POINT,
+                   node_id, acc->reading_count[idx], CALIB_READINGS_PER_POINT,
                    B_mag_x, B_mag_y, B_mag_z);
 
             /* Check if we have enough readings */
-            if (cp->reading_count[node_id] >= CALIB_READINGS_PER_POINT)
+            if (acc->reading_count[idx] >= CALIB_READINGS_PER_POINT)
             {
-                int n = cp->reading_count[node_id];
-                cp->node_B_mag[node_id].x = (int32_t)(cp->sum_x[node_id] / n);
-                cp->node_B_mag[node_id].y = (int32_t)(cp->sum_y[node_id] / n);
-                cp->node_B_mag[node_id].z = (int32_t)(cp->sum_z[node_id] / n);
-                cp->node_absB[node_id] = (int32_t)(cp->reading_sum[node_id] / n);
-                cp->node_valid[node_id] = true;
+                int n = acc->reading_count[idx];
+                cp->node_B_mag[idx].x = (int32_t)(acc->sum_x[idx] / n);
+                cp->node_B_mag[idx].y = (int32_t)(acc->sum_y[idx] / n);
+                cp->node_B_mag[idx].z = (int32_t)(acc->sum_z[idx] / n);
+                cp->node_absB[idx] = (int32_t)(acc->reading_sum[idx] / n);
+                cp->valid_mask |= BIT(idx);
 
                 printk("CALIB: Sensor %u DONE avg B_mag=(%d, %d, %d) m-uT\n",
                        node_id,
-                       cp->node_B_mag[node_id].x,
-                       cp->node_B_mag[node_id].y,
-                       cp->node_B_mag[node_id].z);
+                       cp->node_B_mag[idx].x,
+                       cp->node_B_mag[idx].y,
+                       cp->node_B_mag[idx].z);
             }
         }
     }
@@ -539,22 +975,29 @@ void calibration_process_reading_3d(uint8_t node_id, const struct vec3_i32 *B_ra
 void calibration_process_reading(uint8_t node_id, int32_t absB)
 {
     /* Legacy scalar processing - minimal implementation for backwards compat */
+    if (node_id < 1 || node_id > MAX_NODES)
+    {
+        return;
+    }
+
     k_mutex_lock(&calib_mutex, K_FOREVER);
 
     if (g_calib_state == CALIB_STATE_WAITING_INPUT && g_current_calib_idx >= 0)
     {
         struct calib_point *cp = &g_calib_points[g_current_calib_idx];
+        struct calib_accum *acc = &g_calib_accum;
+        int idx = node_id - 1;
 
-        if (!cp->node_valid[node_id])
+        if (!(cp->valid_mask & BIT(idx)))
         {
-            cp->reading_sum[node_id] += absB;
-            cp->reading_count[node_id]++;
+            acc->reading_sum[idx] += absB;
+            acc->reading_count[idx]++;
 
-            if (cp->reading_count[node_id] >= CALIB_READINGS_PER_POINT)
+            if (acc->reading_count[idx] >= CALIB_READINGS_PER_POINT)
             {
-                cp->node_absB[node_id] = (int32_t)(cp->reading_sum[node_id] /
-                                                   cp->reading_count[node_id]);
-                cp->node_valid[node_id] = true;
+                cp->node_absB[idx] = (int32_t)(acc->reading_sum[idx] /
+                                               acc->reading_count[idx]);
+                cp->valid_mask |= BIT(idx);
             }
         }
     }
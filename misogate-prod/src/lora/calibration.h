@@ -12,6 +12,20 @@
 #define BASELINE_READINGS_REQUIRED 10 /* Number of readings to average for baseline */
 #define CALIB_READINGS_PER_POINT 5    /* Number of readings to average per calibration point */
 
+/* A restored baseline is stale if a node's first reading after boot is
+ * further than this from it (m-uT); Earth's field is ~50000 m-uT */
+#define CALIB_RESTORE_MAX_DEVIATION 5000
+
+/* Readings a sensor must stay quiet after an anomaly before its baseline
+ * adapts again, so the tail of a passing magnet is not learned */
+#define CALIB_DRIFT_SETTLE_READINGS 10
+
+/* A drift-tracked baseline is stored again once it has moved this far
+ * (m-uT) from the stored one, well inside CALIB_RESTORE_MAX_DEVIATION, and
+ * at most once per CALIB_DRIFT_SAVE_MIN_MS to spare the flash */
+#define CALIB_DRIFT_SAVE_MUT 500
+#define CALIB_DRIFT_SAVE_MIN_MS (30 * 60 * 1000)
+
 /* ------------ Calibration data structures ------------ */
 
 /**
@@ -28,6 +42,10 @@ struct baseline_data
     int64_t sum_y;
     int64_t sum_z;
     struct vec3_i32 B_ambient; /* Averaged ambient field in m-uT */
+
+    /* Drift tracking while RUNNING (CONFIG_MISOGATE_BASELINE_DRIFT) */
+    struct vec3_i32 drift_q8; /* B_ambient in 1/256 m-uT */
+    int quiet_readings;       /* Readings without an anomaly, saturates */
 };
 
 /**
@@ -35,25 +53,38 @@ struct baseline_data
  *
  * Stores the user-specified position and measured 3D field vectors.
  * The stored field is the magnet-induced field (measured - baseline).
+ * Only the averaged result is kept per point; the running sums live in
+ * a single accumulator for the point being recorded.
+ *
+ * The per-node arrays are indexed by node ID - 1 and a bit mask says which
+ * nodes have a reading, the same layout as the stored record.
  */
 struct calib_point
 {
     int x; /* User-specified X (0-1000) */
     int y; /* User-specified Y (0-1000) */
 
-    /* 3D magnet-induced field at each sensor (after subtracting baseline) */
-    struct vec3_i32 node_B_mag[MAX_NODES + 1];
-    bool node_valid[MAX_NODES + 1]; /* Whether we have valid reading for each node */
+    uint32_t valid_mask; /* Bit n-1 set if node n has a reading */
 
-    /* Accumulation for averaging */
-    int reading_count[MAX_NODES + 1];
-    int64_t sum_x[MAX_NODES + 1];
-    int64_t sum_y[MAX_NODES + 1];
-    int64_t sum_z[MAX_NODES + 1];
+    /* 3D magnet-induced field at each sensor (after subtracting baseline) */
+    struct vec3_i32 node_B_mag[MAX_NODES];
 
     /* Legacy: scalar |B| for backwards compatibility */
-    int32_t node_absB[MAX_NODES + 1];
-    int64_t reading_sum[MAX_NODES + 1];
+    int32_t node_absB[MAX_NODES];
+};
+
+/**
+ * @brief Running sums for the calibration point currently being recorded
+ *
+ * Indexed by node ID - 1.
+ */
+struct calib_accum
+{
+    int reading_count[MAX_NODES];
+    int64_t sum_x[MAX_NODES];
+    int64_t sum_y[MAX_NODES];
+    int64_t sum_z[MAX_NODES];
+    int64_t reading_sum[MAX_NODES];
 };
 
 /* ------------ Public API ------------ */
@@ -118,6 +149,11 @@ const struct calib_point *calibration_get_points(int *count);
  * Called from the frame processing logic when a new reading arrives.
  * During baseline phase: accumulates ambient field readings
  * During calibration phase: accumulates magnet-present readings
+ * While running from a restored calibration: checks the first reading of
+ * each node against its stored baseline and falls back to a new baseline
+ * capture if most nodes disagree
+ * While running: slowly tracks baseline drift for sensors that do not see
+ * the magnet (CONFIG_MISOGATE_BASELINE_DRIFT)
  *
  * @param node_id Node ID that sent the reading
  * @param B_raw Raw 3D magnetic field vector
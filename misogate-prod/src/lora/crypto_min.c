@@ -28,29 +28,21 @@ void kdf_split_keys(const uint8_t k_master[16], uint8_t node_id,
 }
 
 void keystream_from_seq(uint8_t *out, size_t n,
-                        const uint8_t K_enc[16], uint32_t tx_seq)
+                        const uint8_t K_enc[16], uint16_t epoch, uint32_t tx_seq)
 {
-    /* Generate 8B blocks: SipHash(K_enc, 'S' || tx_seq || block#) */
-    uint8_t in[1 + 4 + 4];
-    in[0] = 'S';
-    in[1] = (uint8_t)(tx_seq >> 0);
-    in[2] = (uint8_t)(tx_seq >> 8);
-    in[3] = (uint8_t)(tx_seq >> 16);
-    in[4] = (uint8_t)(tx_seq >> 24);
+    /* 8B blocks: SipHash(K_enc, 'S' || tx_seq || epoch || 0x00 || block#),
+     * the block number alone in the last word so all blocks share the
+     * first one; frames are far shorter than 256 blocks */
+    uint8_t prefix[8];
+    prefix[0] = 'S';
+    prefix[1] = (uint8_t)(tx_seq >> 0);
+    prefix[2] = (uint8_t)(tx_seq >> 8);
+    prefix[3] = (uint8_t)(tx_seq >> 16);
+    prefix[4] = (uint8_t)(tx_seq >> 24);
+    prefix[5] = (uint8_t)(epoch >> 0);
+    prefix[6] = (uint8_t)(epoch >> 8);
+    prefix[7] = 0;
 
-    uint8_t tag[8];
-    uint32_t block = 0;
-    size_t produced = 0;
-    while (produced < n) {
-        in[5] = (uint8_t)(block >> 0);
-        in[6] = (uint8_t)(block >> 8);
-        in[7] = (uint8_t)(block >> 16);
-        in[8] = (uint8_t)(block >> 24);
-        siphash24(tag, in, sizeof(in), K_enc);
-        size_t take = (n - produced < 8) ? (n - produced) : 8;
-        for (size_t i = 0; i < take; ++i) out[produced + i] = tag[i];
-        produced += take;
-        block++;
-    }
+    siphash24_ctr(out, n, prefix, K_enc);
 }
 
@@ -0,0 +1,485 @@
+/**
+ * @file ekf.c
+ * @brief Extended Kalman Filter tracking stage on top of the dipole model
+ *
+ * The Gauss-Newton solver in position.c is stateless: every packet re-solves
+ * (x, y, M) from whatever field values the nodes last reported. This module
+ * instead keeps a running state estimate and fuses each node's field vector
+ * as its packet arrives.
+ *
+ * State:        s = [x, y, vx, vy, M]
+ * Process:      constant velocity, white acceleration noise, M random walk
+ * Measurement:  B_node = dipole_field(x, y, M; sensor_node) + noise
+ *
+ * The field falls off as 1/r^3, so a single linearization at the predicted
+ * state is poor whenever the prior is wide (e.g. right after seeding from
+ * triangulation). Each measurement update is therefore iterated: the model
+ * is relinearized at the updated state a few times (IEKF), which is a
+ * Gauss-Newton step on the posterior and costs one fused field/Jacobian
+ * evaluation per iteration.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "ekf.h"
+#include "position.h"
+
+LOG_MODULE_REGISTER(ekf, LOG_LEVEL_INF);
+
+/* State indices */
+#define S_X 0
+#define S_Y 1
+#define S_VX 2
+#define S_VY 3
+#define S_M 4
+
+/* Lower bound on M, same as the Gauss-Newton solver */
+#define EKF_MIN_M 100.0f
+
+/* ------------ State variables ------------ */
+
+static float g_s[EKF_STATE_DIM];
+static float g_P[EKF_STATE_DIM][EKF_STATE_DIM];
+static int64_t g_t_ms;
+static bool g_tracking;
+
+/* Updates fused since seeding, and outliers rejected back to back */
+static uint32_t g_updates;
+static uint32_t g_consec_gated;
+
+/* Bit n set if the measurement n checks ago was gated (divergence check) */
+static uint32_t g_gate_history;
+
+BUILD_ASSERT(EKF_DIVERGED_WINDOW < 32, "gate history is 32 bits");
+
+static K_MUTEX_DEFINE(ekf_mutex);
+
+/* ------------ Internal Helpers ------------ */
+
+static void symmetrize(float P[EKF_STATE_DIM][EKF_STATE_DIM])
+{
+    for (int i = 0; i < EKF_STATE_DIM; i++)
+    {
+        for (int j = i + 1; j < EKF_STATE_DIM; j++)
+        {
+            float avg = 0.5f * (P[i][j] + P[j][i]);
+            P[i][j] = avg;
+            P[j][i] = avg;
+        }
+    }
+}
+
+/**
+ * Propagate state and covariance by dt seconds.
+ *
+ * F is identity plus dt on the position/velocity couplings, so F P F^T is
+ * expanded by hand instead of with full 5x5 products.
+ */
+static void predict(float s[EKF_STATE_DIM],
+                    float P[EKF_STATE_DIM][EKF_STATE_DIM],
+                    float dt)
+{
+    if (dt <= 0.0f)
+    {
+        return;
+    }
+
+    s[S_X] += s[S_VX] * dt;
+    s[S_Y] += s[S_VY] * dt;
+
+    /* P <- F P: row p += dt * row v */
+    for (int j = 0; j < EKF_STATE_DIM; j++)
+    {
+        P[S_X][j] += dt * P[S_VX][j];
+        P[S_Y][j] += dt * P[S_VY][j];
+    }
+    /* P <- P F^T: col p += dt * col v */
+    for (int i = 0; i < EKF_STATE_DIM; i++)
+    {
+        P[i][S_X] += dt * P[i][S_VX];
+        P[i][S_Y] += dt * P[i][S_VY];
+    }
+
+    /* Discrete white-noise acceleration model, per axis */
+    float q = EKF_ACCEL_NOISE * EKF_ACCEL_NOISE;
+    float dt2 = dt * dt;
+    float q_pp = 0.25f * dt2 * dt2 * q;
+    float q_pv = 0.5f * dt2 * dt * q;
+    float q_vv = dt2 * q;
+
+    P[S_X][S_X] += q_pp;
+    P[S_Y][S_Y] += q_pp;
+    P[S_X][S_VX] += q_pv;
+    P[S_VX][S_X] += q_pv;
+    P[S_Y][S_VY] += q_pv;
+    P[S_VY][S_Y] += q_pv;
+    P[S_VX][S_VX] += q_vv;
+    P[S_VY][S_VY] += q_vv;
+
+    float m_std = EKF_MOMENT_DRIFT_REL * s[S_M];
+    P[S_M][S_M] += m_std * m_std * dt;
+}
+
+/**
+ * Invert a symmetric 3x3 matrix by cofactors (the innovation covariance).
+ */
+static bool invert_3x3(float A[3][3], float A_inv[3][3])
+{
+    float c00 = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+    float c01 = A[1][2] * A[2][0] - A[1][0] * A[2][2];
+    float c02 = A[1][0] * A[2][1] - A[1][1] * A[2][0];
+
+    float det = A[0][0] * c00 + A[0][1] * c01 + A[0][2] * c02;
+    if (!(fabsf(det) > 0.0f) || !isfinite(det))
+    {
+        return false;
+    }
+
+    float inv_det = 1.0f / det;
+
+    A_inv[0][0] = c00 * inv_det;
+    A_inv[1][0] = c01 * inv_det;
+    A_inv[2][0] = c02 * inv_det;
+    A_inv[0][1] = (A[0][2] * A[2][1] - A[0][1] * A[2][2]) * inv_det;
+    A_inv[1][1] = (A[0][0] * A[2][2] - A[0][2] * A[2][0]) * inv_det;
+    A_inv[2][1] = (A[0][1] * A[2][0] - A[0][0] * A[2][1]) * inv_det;
+    A_inv[0][2] = (A[0][1] * A[1][2] - A[0][2] * A[1][1]) * inv_det;
+    A_inv[1][2] = (A[0][2] * A[1][0] - A[0][0] * A[1][2]) * inv_det;
+    A_inv[2][2] = (A[0][0] * A[1][1] - A[0][1] * A[1][0]) * inv_det;
+    return true;
+}
+
+static float position_std(float P[EKF_STATE_DIM][EKF_STATE_DIM])
+{
+    return sqrtf(P[S_X][S_X] + P[S_Y][S_Y]);
+}
+
+static bool state_is_sane(void)
+{
+    for (int i = 0; i < EKF_STATE_DIM; i++)
+    {
+        if (!isfinite(g_s[i]) || !isfinite(g_P[i][i]) || g_P[i][i] < 0.0f)
+        {
+            return false;
+        }
+    }
+
+    if (g_s[S_X] < -100.0f || g_s[S_X] > 1100.0f ||
+        g_s[S_Y] < -100.0f || g_s[S_Y] > 1100.0f)
+    {
+        return false;
+    }
+
+    return position_std(g_P) <= EKF_MAX_POS_STD;
+}
+
+/* ------------ Public API ------------ */
+
+void ekf_init(void)
+{
+    k_mutex_lock(&ekf_mutex, K_FOREVER);
+    memset(g_s, 0, sizeof(g_s));
+    memset(g_P, 0, sizeof(g_P));
+    g_t_ms = 0;
+    g_tracking = false;
+    g_updates = 0;
+    g_consec_gated = 0;
+    g_gate_history = 0;
+    k_mutex_unlock(&ekf_mutex);
+
+    LOG_INF("EKF initialized (accel=%.1f meas=%.1f m-uT)",
+            (double)EKF_ACCEL_NOISE, (double)EKF_MEAS_NOISE_MUT);
+}
+
+void ekf_reset(void)
+{
+    k_mutex_lock(&ekf_mutex, K_FOREVER);
+    g_tracking = false;
+    k_mutex_unlock(&ekf_mutex);
+}
+
+bool ekf_is_tracking(void)
+{
+    bool tracking;
+    k_mutex_lock(&ekf_mutex, K_FOREVER);
+    tracking = g_tracking;
+    k_mutex_unlock(&ekf_mutex);
+    return tracking;
+}
+
+void ekf_seed(float x, float y, float M, int64_t t_ms)
+{
+    if (M < EKF_MIN_M)
+    {
+        M = EKF_MIN_M;
+    }
+
+    k_mutex_lock(&ekf_mutex, K_FOREVER);
+
+    memset(g_P, 0, sizeof(g_P));
+    g_s[S_X] = x;
+    g_s[S_Y] = y;
+    g_s[S_VX] = 0.0f;
+    g_s[S_VY] = 0.0f;
+    g_s[S_M] = M;
+
+    g_P[S_X][S_X] = EKF_INIT_POS_STD * EKF_INIT_POS_STD;
+    g_P[S_Y][S_Y] = EKF_INIT_POS_STD * EKF_INIT_POS_STD;
+    g_P[S_VX][S_VX] = EKF_INIT_VEL_STD * EKF_INIT_VEL_STD;
+    g_P[S_VY][S_VY] = EKF_INIT_VEL_STD * EKF_INIT_VEL_STD;
+    float m_std = EKF_INIT_M_REL_STD * M;
+    g_P[S_M][S_M] = m_std * m_std;
+
+    g_t_ms = t_ms;
+    g_tracking = true;
+    g_updates = 0;
+    g_consec_gated = 0;
+    g_gate_history = 0;
+
+    k_mutex_unlock(&ekf_mutex);
+
+    LOG_INF("EKF seeded at x=%.1f y=%.1f M=%.3g", (double)x, (double)y, (double)M);
+}
+
+int ekf_update_node(uint8_t node_id, const struct vec3_i32 *B_mag, int32_t noise_mut,
+                    int64_t t_ms)
+{
+    const struct sensor_pos *sensor = position_get_sensor_pos(node_id);
+    if (!sensor || !B_mag)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&ekf_mutex, K_FOREVER);
+
+    if (!g_tracking)
+    {
+        k_mutex_unlock(&ekf_mutex);
+        return -EAGAIN;
+    }
+
+    if (t_ms - g_t_ms > EKF_MAX_TRACK_AGE_MS)
+    {
+        LOG_INF("EKF: no update for %d s, dropping track", (int)((t_ms - g_t_ms) / 1000));
+        g_tracking = false;
+        k_mutex_unlock(&ekf_mutex);
+        return -ETIMEDOUT;
+    }
+
+    /* Time update (late or reordered measurements are fused at filter time) */
+    if (t_ms > g_t_ms)
+    {
+        predict(g_s, g_P, (float)(t_ms - g_t_ms) / 1000.0f);
+        g_t_ms = t_ms;
+    }
+
+    const float z[3] = {(float)B_mag->x, (float)B_mag->y, (float)B_mag->z};
+    const float R = EKF_MEAS_NOISE_MUT * EKF_MEAS_NOISE_MUT + (float)noise_mut * noise_mut;
+
+    float s_i[EKF_STATE_DIM];
+    float H[3][EKF_STATE_DIM];
+    float PHt[EKF_STATE_DIM][3];
+    float K[EKF_STATE_DIM][3];
+    memcpy(s_i, g_s, sizeof(s_i));
+
+    for (int iter = 0; iter < EKF_UPDATE_ITERATIONS; iter++)
+    {
+        /* Relinearize at the current iterate */
+        struct vec3_f h;
+        float J[3][3];
+        position_compute_field_and_jacobian(s_i[S_X], s_i[S_Y], s_i[S_M], sensor, &h, J);
+
+        for (int r = 0; r < 3; r++)
+        {
+            H[r][S_X] = J[r][0];
+            H[r][S_Y] = J[r][1];
+            H[r][S_VX] = 0.0f;
+            H[r][S_VY] = 0.0f;
+            H[r][S_M] = J[r][2];
+        }
+
+        /* y = z - h(s_i) - H (s_prior - s_i) */
+        const float h_arr[3] = {h.x, h.y, h.z};
+        float y[3];
+        for (int r = 0; r < 3; r++)
+        {
+            y[r] = z[r] - h_arr[r];
+            for (int k = 0; k < EKF_STATE_DIM; k++)
+            {
+                y[r] -= H[r][k] * (g_s[k] - s_i[k]);
+            }
+        }
+
+        /* PHt = P H^T (velocity columns of H are zero) */
+        for (int i = 0; i < EKF_STATE_DIM; i++)
+        {
+            for (int r = 0; r < 3; r++)
+            {
+                PHt[i][r] = g_P[i][S_X] * H[r][S_X] + g_P[i][S_Y] * H[r][S_Y] +
+                            g_P[i][S_M] * H[r][S_M];
+            }
+        }
+
+        /* S = H P H^T + R */
+        float S[3][3];
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                S[r][c] = H[r][S_X] * PHt[S_X][c] + H[r][S_Y] * PHt[S_Y][c] +
+                          H[r][S_M] * PHt[S_M][c];
+            }
+            S[r][r] += R;
+        }
+
+        float S_inv[3][3];
+        if (!invert_3x3(S, S_inv))
+        {
+            LOG_WRN("EKF: singular innovation covariance (node %u)", node_id);
+            k_mutex_unlock(&ekf_mutex);
+            return -EDOM;
+        }
+
+        /*
+         * Gate on the first linearization only, and only once the track has
+         * settled: right after seeding the prior is biased and the first
+         * few innovations are expected to be large.
+         */
+        if (iter == 0 && g_updates >= EKF_GATE_WARMUP)
+        {
+            float d2 = 0.0f;
+            for (int r = 0; r < 3; r++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    d2 += y[r] * S_inv[r][c] * y[c];
+                }
+            }
+            bool gated = d2 > EKF_GATE_CHI2;
+            g_gate_history = (g_gate_history << 1) | (gated ? 1u : 0u);
+            if (gated)
+            {
+                g_consec_gated++;
+                LOG_DBG("EKF: node %u gated (d2=%.1f)", node_id, (double)d2);
+
+                if (g_consec_gated >= EKF_MAX_CONSEC_GATED)
+                {
+                    LOG_WRN("EKF: %u outliers in a row, dropping track", g_consec_gated);
+                    g_tracking = false;
+                    k_mutex_unlock(&ekf_mutex);
+                    return -ERANGE;
+                }
+
+                uint32_t window = g_gate_history & ((1u << EKF_DIVERGED_WINDOW) - 1u);
+                if (__builtin_popcount(window) >= EKF_DIVERGED_GATED)
+                {
+                    LOG_WRN("EKF: %d of the last %d readings gated, dropping track",
+                            __builtin_popcount(window), EKF_DIVERGED_WINDOW);
+                    g_tracking = false;
+                    k_mutex_unlock(&ekf_mutex);
+                    return -ERANGE;
+                }
+
+                k_mutex_unlock(&ekf_mutex);
+                return -EBADMSG;
+            }
+        }
+
+        /* K = P H^T S^-1, s_i = s_prior + K y */
+        for (int i = 0; i < EKF_STATE_DIM; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                K[i][c] = PHt[i][0] * S_inv[0][c] + PHt[i][1] * S_inv[1][c] +
+                          PHt[i][2] * S_inv[2][c];
+            }
+            s_i[i] = g_s[i] + K[i][0] * y[0] + K[i][1] * y[1] + K[i][2] * y[2];
+        }
+
+        if (s_i[S_M] < EKF_MIN_M)
+        {
+            s_i[S_M] = EKF_MIN_M;
+        }
+    }
+
+    /* P <- P - K (H P), with H P = PHt^T by symmetry, at the final linearization */
+    for (int i = 0; i < EKF_STATE_DIM; i++)
+    {
+        for (int j = 0; j < EKF_STATE_DIM; j++)
+        {
+            g_P[i][j] -= K[i][0] * PHt[j][0] + K[i][1] * PHt[j][1] + K[i][2] * PHt[j][2];
+        }
+    }
+    symmetrize(g_P);
+    memcpy(g_s, s_i, sizeof(g_s));
+    g_updates++;
+    g_consec_gated = 0;
+
+    if (!state_is_sane())
+    {
+        LOG_WRN("EKF diverged (x=%.1f y=%.1f std=%.1f), dropping track",
+                (double)g_s[S_X], (double)g_s[S_Y], (double)position_std(g_P));
+        g_tracking = false;
+        k_mutex_unlock(&ekf_mutex);
+        return -ERANGE;
+    }
+
+    LOG_DBG("EKF node=%u x=%.1f y=%.1f v=(%.1f,%.1f) std=%.1f",
+            node_id, (double)g_s[S_X], (double)g_s[S_Y],
+            (double)g_s[S_VX], (double)g_s[S_VY], (double)position_std(g_P));
+
+    k_mutex_unlock(&ekf_mutex);
+    return 0;
+}
+
+bool ekf_get_estimate(int64_t t_ms, struct ekf_estimate *out)
+{
+    if (!out)
+    {
+        return false;
+    }
+
+    k_mutex_lock(&ekf_mutex, K_FOREVER);
+
+    if (g_tracking && t_ms - g_t_ms > EKF_MAX_TRACK_AGE_MS)
+    {
+        LOG_INF("EKF: no update for %d s, dropping track", (int)((t_ms - g_t_ms) / 1000));
+        g_tracking = false;
+    }
+
+    if (!g_tracking)
+    {
+        k_mutex_unlock(&ekf_mutex);
+        out->valid = false;
+        return false;
+    }
+
+    float s[EKF_STATE_DIM];
+    float P[EKF_STATE_DIM][EKF_STATE_DIM];
+    memcpy(s, g_s, sizeof(s));
+    memcpy(P, g_P, sizeof(P));
+    int64_t dt_ms = t_ms - g_t_ms;
+
+    k_mutex_unlock(&ekf_mutex);
+
+    /* Extrapolate a copy; the filter itself only advances on measurements */
+    if (dt_ms > EKF_MAX_PREDICT_MS)
+    {
+        dt_ms = EKF_MAX_PREDICT_MS;
+    }
+    predict(s, P, (float)dt_ms / 1000.0f);
+
+    out->x = s[S_X];
+    out->y = s[S_Y];
+    out->vx = s[S_VX];
+    out->vy = s[S_VY];
+    out->M = s[S_M];
+    out->pos_std = position_std(P);
+    out->valid = true;
+    return true;
+}
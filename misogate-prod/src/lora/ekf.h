@@ -0,0 +1,180 @@
+#ifndef EKF_H
+#define EKF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lora.h"
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief State vector layout: [x, y, vx, vy, M]
+ *
+ * Position in the 0-1000 tracking frame, velocity in units per second,
+ * and the dipole moment scale factor used by the position module.
+ */
+#define EKF_STATE_DIM 5
+
+/**
+ * @brief Process noise
+ *
+ * Constant-velocity model driven by white acceleration noise, plus a slow
+ * relative random walk on the dipole moment (temperature, demagnetization).
+ */
+#define EKF_ACCEL_NOISE 10.0f        /* Acceleration std dev (units/s^2) */
+#define EKF_MOMENT_DRIFT_REL 0.01f   /* Relative M drift std dev per sqrt(s) */
+
+/**
+ * @brief Measurement noise per field axis (m-uT, 1 sigma)
+ *
+ * Covers sensor noise plus residual baseline error, which dominates. Noise
+ * a node reports for its averaged readings is added on top.
+ */
+#define EKF_MEAS_NOISE_MUT 300.0f
+
+/**
+ * @brief Innovation gate: Mahalanobis distance^2 on the 3-axis residual
+ *
+ * 16.3 is the 99.9% point of chi-square with 3 degrees of freedom.
+ */
+#define EKF_GATE_CHI2 16.3f
+
+/**
+ * @brief Updates after seeding before the gate is applied
+ *
+ * Two rounds of the default three-node layout; larger arrays settle faster.
+ */
+#define EKF_GATE_WARMUP 6
+
+/**
+ * @brief Consecutive gated measurements after which the track is dropped
+ */
+#define EKF_MAX_CONSEC_GATED 6
+
+/**
+ * @brief Divergence check: gated measurements among the last updates
+ *
+ * A track that settled on a wrong solution (on three nodes, a mirror
+ * position with a smaller moment) still fits most nodes, so their updates
+ * keep resetting the run of outliers while one node is gated every round.
+ * Once EKF_DIVERGED_GATED of the last EKF_DIVERGED_WINDOW measurements
+ * after the warm-up were gated, the track is dropped so it can be seeded
+ * again. A settled track is gated at the chi-square tail rate, far below
+ * this.
+ */
+#define EKF_DIVERGED_WINDOW 24
+#define EKF_DIVERGED_GATED 8
+
+/**
+ * @brief Relinearizations per measurement update (iterated EKF)
+ */
+#define EKF_UPDATE_ITERATIONS 3
+
+/**
+ * @brief Initial state uncertainty when seeding from a coarse fix
+ */
+#define EKF_INIT_POS_STD 200.0f /* units */
+#define EKF_INIT_VEL_STD 20.0f  /* units/s */
+#define EKF_INIT_M_REL_STD 0.5f /* relative to the seeded M */
+
+/**
+ * @brief Track is dropped (and re-seeded) if position std dev exceeds this
+ */
+#define EKF_MAX_POS_STD 400.0f
+
+/**
+ * @brief Limits on extrapolation when reading the track between packets
+ */
+#define EKF_MAX_PREDICT_MS 2000
+
+/**
+ * @brief Track is dropped if no reading was fused for this long
+ *
+ * Matches TRACKER_MAX_NODE_AGE_MS: once every node is that old, the track
+ * only says where the magnet was.
+ */
+#define EKF_MAX_TRACK_AGE_MS 35000
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief Snapshot of the filter state at a given time
+ */
+struct ekf_estimate
+{
+    float x;       /* Position X (0-1000 frame) */
+    float y;       /* Position Y (0-1000 frame) */
+    float vx;      /* Velocity X (units/s) */
+    float vy;      /* Velocity Y (units/s) */
+    float M;       /* Dipole moment scale factor */
+    float pos_std; /* sqrt(P_xx + P_yy), 1-sigma position uncertainty */
+    bool valid;    /* Whether the filter is tracking */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Initialize the EKF (no track until seeded)
+ */
+void ekf_init(void);
+
+/**
+ * @brief Drop the current track
+ *
+ * The next call to ekf_seed() starts a new one.
+ */
+void ekf_reset(void);
+
+/**
+ * @brief Check if the filter currently holds a track
+ *
+ * @return true if seeded and not diverged
+ */
+bool ekf_is_tracking(void);
+
+/**
+ * @brief Start a track from a coarse position fix
+ *
+ * @param x Initial X position (e.g. from triangulation)
+ * @param y Initial Y position
+ * @param M Initial dipole moment (e.g. from position_estimate_moment())
+ * @param t_ms Timestamp of the fix (k_uptime_get() milliseconds)
+ */
+void ekf_seed(float x, float y, float M, int64_t t_ms);
+
+/**
+ * @brief Fuse one node's magnet-induced field into the track
+ *
+ * Predicts the state forward to t_ms, then applies an iterated update with
+ * the 3-axis field, linearized through the dipole model. Measurements older
+ * than the filter time are fused at the filter time. The node's position is
+ * read from the layout, so hold position_layout_lock() across the call.
+ *
+ * @param node_id Node ID (1 to the node count)
+ * @param B_mag Baseline-subtracted field measured by that node (m-uT)
+ * @param noise_mut 1-sigma noise the node reported for it (m-uT), 0 if unknown
+ * @param t_ms Arrival timestamp (k_uptime_get() milliseconds)
+ * @return 0 on success, -EAGAIN if no track, -EINVAL on bad input,
+ *         -EBADMSG if gated as an outlier, -EDOM on a singular update,
+ *         -ERANGE if the track diverged (too many outliers, see
+ *         EKF_DIVERGED_GATED, or an implausible state) and was dropped,
+ *         -ETIMEDOUT if the track was older than EKF_MAX_TRACK_AGE_MS and
+ *         was dropped
+ */
+int ekf_update_node(uint8_t node_id, const struct vec3_i32 *B_mag, int32_t noise_mut,
+                    int64_t t_ms);
+
+/**
+ * @brief Read the track extrapolated to a given time
+ *
+ * Does not advance the filter. Extrapolation is limited to
+ * EKF_MAX_PREDICT_MS past the last update; a track with no update for
+ * EKF_MAX_TRACK_AGE_MS before @p t_ms is dropped.
+ *
+ * @param t_ms Time to predict to (k_uptime_get() milliseconds)
+ * @param out Output estimate
+ * @return true if a current track exists, false otherwise
+ */
+bool ekf_get_estimate(int64_t t_ms, struct ekf_estimate *out);
+
+#endif /* EKF_H */
@@ -0,0 +1,87 @@
+/**
+ * @file frame_queue.c
+ * @brief Lock-free single-producer/single-consumer queue of raw LoRa frames
+ *
+ * The LoRa RX thread is the only producer and the frame processing thread
+ * the only consumer. head is written only by the producer and tail only by
+ * the consumer; both are free-running counters, so the slot index is the
+ * counter modulo the depth and head - tail is the fill level. Zephyr's
+ * atomic_get()/atomic_set() are full barriers, which orders the slot
+ * contents against the index update on each side.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <string.h>
+
+#include "frame_queue.h"
+
+BUILD_ASSERT((FRAME_QUEUE_DEPTH & (FRAME_QUEUE_DEPTH - 1)) == 0,
+             "CONFIG_MISOGATE_RX_QUEUE_DEPTH must be a power of two");
+
+static struct rx_frame slots[FRAME_QUEUE_DEPTH];
+
+static atomic_t head; /* Next slot the producer fills */
+static atomic_t tail; /* Next slot the consumer reads */
+
+/* Counters have a single writer (the producer); readers may see them stale */
+static struct frame_queue_stats stats;
+
+void frame_queue_init(void)
+{
+    atomic_set(&head, 0);
+    atomic_set(&tail, 0);
+    memset(&stats, 0, sizeof(stats));
+}
+
+struct rx_frame *frame_queue_claim(void)
+{
+    uint32_t h = (uint32_t)atomic_get(&head);
+    uint32_t t = (uint32_t)atomic_get(&tail);
+
+    if (h - t >= FRAME_QUEUE_DEPTH)
+    {
+        return NULL;
+    }
+    return &slots[h % FRAME_QUEUE_DEPTH];
+}
+
+void frame_queue_publish(void)
+{
+    uint32_t h = (uint32_t)atomic_get(&head) + 1;
+    uint32_t fill = h - (uint32_t)atomic_get(&tail);
+
+    atomic_set(&head, (atomic_val_t)h);
+
+    stats.enqueued++;
+    if (fill > stats.high_water)
+    {
+        stats.high_water = fill;
+    }
+}
+
+void frame_queue_count_drop(void)
+{
+    stats.dropped++;
+}
+
+const struct rx_frame *frame_queue_peek(void)
+{
+    uint32_t t = (uint32_t)atomic_get(&tail);
+
+    if ((uint32_t)atomic_get(&head) == t)
+    {
+        return NULL;
+    }
+    return &slots[t % FRAME_QUEUE_DEPTH];
+}
+
+void frame_queue_release(void)
+{
+    atomic_set(&tail, (atomic_val_t)((uint32_t)atomic_get(&tail) + 1));
+}
+
+void frame_queue_get_stats(struct frame_queue_stats *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,92 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Number of frame slots (power of two)
+ */
+#define FRAME_QUEUE_DEPTH CONFIG_MISOGATE_RX_QUEUE_DEPTH
+
+/**
+ * @brief Largest radio payload a slot can hold
+ */
+#define FRAME_QUEUE_MAX_LEN 64
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief One raw frame as received, before parse/decrypt
+ */
+struct rx_frame
+{
+    int64_t rx_ms; /* k_uptime_get() at reception */
+    int64_t tx_ms; /* Start of the sender's TDMA slot, else rx_ms */
+    int16_t rssi;
+    int8_t snr;
+    uint8_t len;   /* Bytes used in buf */
+    uint8_t buf[FRAME_QUEUE_MAX_LEN];
+};
+
+/**
+ * @brief Queue counters
+ */
+struct frame_queue_stats
+{
+    uint32_t enqueued;   /* Frames handed to the processing thread */
+    uint32_t dropped;    /* Frames received while the queue was full */
+    uint32_t high_water; /* Most frames ever waiting at once */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Empty the queue and clear its counters
+ *
+ * Only call while neither the producer nor the consumer is running.
+ */
+void frame_queue_init(void);
+
+/**
+ * @brief Producer: get the next free slot to receive into
+ *
+ * The radio writes straight into the slot, so a frame is never copied.
+ * Nothing is visible to the consumer until frame_queue_publish().
+ *
+ * @return Free slot, or NULL if the queue is full
+ */
+struct rx_frame *frame_queue_claim(void);
+
+/**
+ * @brief Producer: hand the slot from frame_queue_claim() to the consumer
+ */
+void frame_queue_publish(void);
+
+/**
+ * @brief Producer: count a frame that was received but had no slot
+ */
+void frame_queue_count_drop(void);
+
+/**
+ * @brief Consumer: get the oldest waiting frame
+ *
+ * The slot stays owned by the consumer until frame_queue_release().
+ *
+ * @return Oldest frame, or NULL if the queue is empty
+ */
+const struct rx_frame *frame_queue_peek(void);
+
+/**
+ * @brief Consumer: return the slot from frame_queue_peek() to the producer
+ */
+void frame_queue_release(void);
+
+/**
+ * @brief Read the queue counters (any thread)
+ */
+void frame_queue_get_stats(struct frame_queue_stats *stats);
+
+#endif /* FRAME_QUEUE_H */
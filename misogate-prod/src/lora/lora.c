@@ -16,6 +16,7 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/net/mqtt.h>
 
+#include <math.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -25,6 +26,12 @@
 #include "packet.h"
 #include "calibration.h"
 #include "position.h"
+#include "ekf.h"
+#include "frame_queue.h"
+#include "tdma.h"
+#include "boot_epoch.h"
+#include "telemetry.h"
+#include "tracker.h"
 #include "../mqtt/mqtt.h"
 
 LOG_MODULE_REGISTER(lora, LOG_LEVEL_INF);
@@ -34,167 +41,204 @@ LOG_MODULE_REGISTER(lora, LOG_LEVEL_INF);
 #define LORA_NODE DT_ALIAS(lora0)
 #define LORA_FREQ_HZ 915000000UL
 
-/* ------------ State variables ------------ */
+BUILD_ASSERT(SECURE_FRAME_MAX_LEN <= FRAME_QUEUE_MAX_LEN,
+             "largest frame does not fit a receive slot");
 
-/* Per-node running state */
-static struct node_state g_nodes[MAX_NODES + 1];
+/* ------------ State variables ------------ */
 
 /* LoRa device handle */
 static const struct device *lora_dev;
 
-/* Receiver thread */
-#define LORA_STACK_SIZE 4096
+/* Modem settings; only .tx changes, around each beacon */
+static struct lora_modem_config lora_cfg = {
+    .frequency = LORA_FREQ_HZ,
+    .bandwidth = BW_125_KHZ,
+    .datarate = SF_7,
+    .coding_rate = CR_4_5,
+    .preamble_len = 8,
+    .tx_power = 10,
+    .tx = false, /* RX gateway */
+    .iq_inverted = false,
+    .public_network = true,
+};
+
+/* Receiver thread: only moves frames from the radio into the queue */
+#define LORA_STACK_SIZE 2048
 #define LORA_PRIORITY 5
 
 static K_THREAD_STACK_DEFINE(lora_stack, LORA_STACK_SIZE);
 static struct k_thread lora_thread_data;
 static k_tid_t lora_thread_id;
 
+/* Processing thread: parse, calibration and position solve. Lower priority
+ * than the receiver so a completed reception always preempts processing. */
+#define LORA_PROC_STACK_SIZE 4096
+#define LORA_PROC_PRIORITY 7
+
+static K_THREAD_STACK_DEFINE(lora_proc_stack, LORA_PROC_STACK_SIZE);
+static struct k_thread lora_proc_thread_data;
+static k_tid_t lora_proc_thread_id;
+
 /* Semaphore to signal thread to start receiving */
 static K_SEM_DEFINE(lora_start_sem, 0, 1);
 
+/* Given once per queued frame, taken by the processing thread */
+static K_SEM_DEFINE(frame_ready_sem, 0, K_SEM_MAX_LIMIT);
+
 /* Statistics */
 static uint32_t rx_ok_count = 0;
 static int last_position_rel = -1;
 
 /* 2D position storage */
 static struct lora_position current_position = {.x = 0, .y = 0, .valid = false};
+static struct tracker_fix current_fix; /* Unclamped, moved along the track */
+static int64_t current_fix_ms;         /* Sample time of the solve behind it */
 static K_MUTEX_DEFINE(position_mutex);
 
+/* Node states for the detail of the binary position record, built by the
+ * publish work from a snapshot so the packet path does not pay for it */
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+static struct node_state pub_nodes[MAX_NODES + 1];
+static struct node_state pub_aligned[MAX_NODES + 1];
+#endif
+
 /* Position publish timer (100ms) */
 #define POSITION_PUBLISH_INTERVAL_MS 100
 static void position_publish_work_fn(struct k_work *work);
 static K_WORK_DELAYABLE_DEFINE(position_publish_work, position_publish_work_fn);
 
+/* Telemetry readout over MQTT */
+#define TELEMETRY_MQTT_DEFAULT_EVENTS 32
+#define TELEMETRY_MQTT_MSG_SIZE 768 /* Fits the MQTT client's 1 KB TX buffer */
+
 /* ------------ Internal Helpers ------------ */
 
 /**
- * Update node state with new 3D measurement and compute magnet-induced field.
+ * Clamp an estimate to the 0-1000 range.
  */
-static void update_node_state(struct node_state *ns, uint8_t node_id,
-                              const struct sensor_frame *f)
+static int clamp_coord(float v)
 {
-    /* Store raw 3D measurement */
-    ns->last_B.x = f->x_uT_milli;
-    ns->last_B.y = f->y_uT_milli;
-    ns->last_B.z = f->z_uT_milli;
+    int c = (int)v;
+    if (c < 0)
+        c = 0;
+    if (c > 1000)
+        c = 1000;
+    return c;
+}
 
-    /* Compute scalar magnitude for logging/legacy */
-    ns->last_absB = position_compute_absB(f->x_uT_milli, f->y_uT_milli, f->z_uT_milli);
-    ns->last_seq = f->tx_seq;
+/**
+ * Publish a position solved from a reading taken at fix_ms to readers.
+ */
+static void store_position(const struct tracker_fix *fix, int64_t fix_ms)
+{
+    int clamped_x = clamp_coord(fix->x);
+    int clamped_y = clamp_coord(fix->y);
+
+    /* Update position with mutex protection */
+    k_mutex_lock(&position_mutex, K_FOREVER);
+    current_position.x = clamped_x;
+    current_position.y = clamped_y;
+    current_position.valid = true;
+    current_fix = *fix;
+    current_fix_ms = fix_ms;
+    k_mutex_unlock(&position_mutex);
+
+    last_position_rel = clamped_x;
+}
 
-    /* Get baseline from calibration module */
-    const struct baseline_data *baseline = calibration_get_baseline(node_id);
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+/**
+ * Build the solver detail of the position about to be published: moment,
+ * RMS dipole model residual of the fix against the nodes fresh enough to
+ * enter a solve, their count and the magnet field at each node. The node
+ * readings are aligned to now, like the fix extrapolated along the track.
+ * Runs in the publish work, once per publish rather than per packet.
+ */
+static void build_detail(const struct tracker_fix *fix, int64_t now, struct pub_detail *d)
+{
+    float sq_sum = 0.0f;
+    int used = 0;
 
-    if (baseline && baseline->valid)
+    memset(d, 0, sizeof(*d));
+    d->M = fix->M;
+    d->pos_std = fix->pos_std;
+    if (fix->solver == TELEM_SOLVER_EKF)
     {
-        /* We have a valid baseline - compute magnet-induced field */
-        ns->have_baseline = true;
-
-        /* Copy baseline to node state for position estimation */
-        ns->baseline_B.x = baseline->B_ambient.x;
-        ns->baseline_B.y = baseline->B_ambient.y;
-        ns->baseline_B.z = baseline->B_ambient.z;
-
-        /* B_mag = B_raw - B_baseline */
-        ns->last_B_mag.x = f->x_uT_milli - baseline->B_ambient.x;
-        ns->last_B_mag.y = f->y_uT_milli - baseline->B_ambient.y;
-        ns->last_B_mag.z = f->z_uT_milli - baseline->B_ambient.z;
-
-        /* Scalar baseline difference for legacy code */
-        int32_t baseline_scalar = position_compute_absB(baseline->B_ambient.x,
-                                                        baseline->B_ambient.y,
-                                                        baseline->B_ambient.z);
-        ns->baseline_absB = baseline_scalar;
-        ns->last_dAbsB = abs(ns->last_absB - baseline_scalar);
+        d->flags = PUB_BIN_FLAG_EKF;
     }
-    else
+
+    tracker_snapshot(pub_nodes);
+
+    /* Sensor positions must not change under the model */
+    position_layout_lock();
+    position_align_nodes(pub_nodes, now, pub_aligned);
+
+    int count = MIN(position_get_node_count(), PUB_DETAIL_NODES);
+    d->node_count = (uint8_t)count;
+    for (int nid = 1; nid <= count; nid++)
     {
-        /* No baseline yet - just use first reading approach for compatibility */
-        if (!ns->have_baseline)
+        const struct node_state *ns = &pub_aligned[nid];
+        if (!ns->have_baseline || now - ns->last_sample_ms > TRACKER_MAX_NODE_AGE_MS)
         {
-            ns->have_baseline = true;
-            ns->baseline_B = ns->last_B;
-            ns->baseline_absB = ns->last_absB;
+            continue;
         }
 
-        /* Compute magnet field as difference from stored baseline */
-        ns->last_B_mag.x = f->x_uT_milli - ns->baseline_B.x;
-        ns->last_B_mag.y = f->y_uT_milli - ns->baseline_B.y;
-        ns->last_B_mag.z = f->z_uT_milli - ns->baseline_B.z;
-
-        ns->last_dAbsB = abs(ns->last_absB - ns->baseline_absB);
+        int32_t absB = position_compute_absB(ns->last_B_mag.x, ns->last_B_mag.y,
+                                             ns->last_B_mag.z);
+        d->absB[nid - 1] = (uint16_t)MIN(absB / PUB_BIN_FIELD_LSB, (int32_t)UINT16_MAX);
+
+        struct vec3_f model;
+        position_compute_dipole_field(fix->x, fix->y, d->M, position_get_sensor_pos(nid), &model);
+        float dx = (float)ns->last_B_mag.x - model.x;
+        float dy = (float)ns->last_B_mag.y - model.y;
+        float dz = (float)ns->last_B_mag.z - model.z;
+        sq_sum += dx * dx + dy * dy + dz * dz;
+        used++;
     }
+    position_layout_unlock();
+
+    d->residual = used ? sqrtf(sq_sum / (float)used) : 0.0f;
+    d->fresh_nodes = (uint8_t)used;
 }
+#endif
 
 /* ------------ Frame Processing ------------ */
 
 static void process_frame(const struct sensor_frame *f,
+                          int64_t sample_ms,
                           int16_t rssi,
                           int8_t snr,
                           int pkt_len)
 {
-    if (f->node_id == 0 || f->node_id > MAX_NODES)
+    if (f->node_id == 0 || f->node_id > position_get_node_count())
     {
-        LOG_WRN("Got frame from unexpected node_id=%u (MAX_NODES=%d)",
-                (unsigned)f->node_id, MAX_NODES);
+        LOG_WRN("Got frame from unexpected node_id=%u (node count=%d)",
+                (unsigned)f->node_id, position_get_node_count());
         return;
     }
 
-    struct node_state *ns = &g_nodes[f->node_id];
-
     /* Update node state with new measurement */
-    update_node_state(ns, f->node_id, f);
+    const struct node_state *ns = tracker_update_node(f, sample_ms);
 
     rx_ok_count++;
 
-    /* Get current calibration state */
-    calib_state_t current_state = calibration_get_state();
-
     /* ------------ Calibration Data Collection ------------ */
 
-    /* During baseline phase, send 3D readings to calibration module */
-    if (current_state == CALIB_STATE_BASELINE)
-    {
-        struct vec3_i32 B_raw = {
-            .x = f->x_uT_milli,
-            .y = f->y_uT_milli,
-            .z = f->z_uT_milli};
-        calibration_process_reading_3d(f->node_id, &B_raw);
-    }
-    /* During position calibration phase */
-    else if (current_state == CALIB_STATE_WAITING_INPUT)
-    {
-        struct vec3_i32 B_raw = {
-            .x = f->x_uT_milli,
-            .y = f->y_uT_milli,
-            .z = f->z_uT_milli};
-        calibration_process_reading_3d(f->node_id, &B_raw);
-    }
+    /* Baseline and position calibration collect readings; while running,
+     * a calibration restored from flash is checked against them */
+    struct vec3_i32 B_raw = {
+        .x = f->x_uT_milli,
+        .y = f->y_uT_milli,
+        .z = f->z_uT_milli};
+    calibration_process_reading_3d(f->node_id, &B_raw);
 
-    /* ------------ Logging ------------ */
+    /* Read after the reading was processed, it may have changed the state */
+    calib_state_t current_state = calibration_get_state();
 
-    /* Only log detailed packet info when in RUNNING state */
-    if (current_state == CALIB_STATE_RUNNING)
-    {
-        int16_t t_abs = abs(f->temp_c_times10 % 10);
-        LOG_INF("PKT rx=%u node=%u seq=%u "
-                "B=(%d,%d,%d) B_mag=(%d,%d,%d) m-uT "
-                "T=%d.%d C RSSI=%d SNR=%d",
-                (unsigned)rx_ok_count,
-                (unsigned)f->node_id,
-                (unsigned)f->tx_seq,
-                f->x_uT_milli,
-                f->y_uT_milli,
-                f->z_uT_milli,
-                ns->last_B_mag.x,
-                ns->last_B_mag.y,
-                ns->last_B_mag.z,
-                f->temp_c_times10 / 10,
-                t_abs,
-                rssi,
-                snr);
-    }
+    /* ------------ Telemetry ------------ */
+
+    /* Binary record only; decoded on demand (console TELEM, MQTT "telemetry") */
+    telemetry_record_packet(f, &ns->last_B_mag, rssi, snr);
 
     /* ------------ Position Estimation ------------ */
 
@@ -206,45 +250,59 @@ static void process_frame(const struct sensor_frame *f,
 
     int calib_count;
     const struct calib_point *calib_points = calibration_get_points(&calib_count);
+    struct tracker_fix fix;
 
-    float pos_x, pos_y;
-    if (position_estimate_2D(g_nodes, calib_points, calib_count, &pos_x, &pos_y))
-    {
-        LOG_INF("POS_2D x=%.1f y=%.1f", (double)pos_x, (double)pos_y);
-
-        /* Clamp to 0-1000 range */
-        int clamped_x = (int)pos_x;
-        int clamped_y = (int)pos_y;
-        if (clamped_x < 0)
-            clamped_x = 0;
-        if (clamped_x > 1000)
-            clamped_x = 1000;
-        if (clamped_y < 0)
-            clamped_y = 0;
-        if (clamped_y > 1000)
-            clamped_y = 1000;
-
-        /* Update position with mutex protection */
-        k_mutex_lock(&position_mutex, K_FOREVER);
-        current_position.x = clamped_x;
-        current_position.y = clamped_y;
-        current_position.valid = true;
-        k_mutex_unlock(&position_mutex);
-
-        last_position_rel = clamped_x;
-    }
-    else
+    position_layout_lock();
+    int err = tracker_solve(f->node_id, sample_ms, calib_points, calib_count, &fix);
+    position_layout_unlock();
+
+    if (!err)
     {
-        LOG_DBG("POS_2D unavailable (not enough data)");
+        store_position(&fix, sample_ms);
     }
 }
 
 /* ------------ Position Publish Work ------------ */
 
+/**
+ * Bring the stored position to now: withdraw it once its fix is older than
+ * a node stays fresh, otherwise move it along the EKF track, if any.
+ */
+static void refresh_position(int64_t now)
+{
+    struct ekf_estimate est;
+    bool extrapolate = IS_ENABLED(CONFIG_MISOGATE_POSITION_EKF) &&
+                       ekf_get_estimate(now, &est);
+
+    k_mutex_lock(&position_mutex, K_FOREVER);
+    if (current_position.valid && now - current_fix_ms > TRACKER_MAX_NODE_AGE_MS)
+    {
+        /* The last fix only says where the magnet was */
+        LOG_INF("No fix for %d s, position withdrawn", (int)((now - current_fix_ms) / 1000));
+        current_position.valid = false;
+    }
+    else if (current_position.valid && extrapolate)
+    {
+        current_fix.x = est.x;
+        current_fix.y = est.y;
+        current_fix.M = est.M;
+        current_fix.pos_std = est.pos_std;
+        current_position.x = clamp_coord(est.x);
+        current_position.y = clamp_coord(est.y);
+        last_position_rel = current_position.x;
+    }
+    k_mutex_unlock(&position_mutex);
+}
+
 static void position_publish_work_fn(struct k_work *work)
 {
     ARG_UNUSED(work);
 
+    /* Between packets, the track extrapolated to now; lora_get_position()
+     * readers see it too, so this runs whether or not MQTT publishes */
+    int64_t now = k_uptime_get();
+    refresh_position(now);
+
     /* Only publish if enabled */
     if (!calibration_mqtt_publish_enabled())
     {
@@ -253,41 +311,142 @@ static void position_publish_work_fn(struct k_work *work)
     }
 
     struct lora_position pos;
+    struct tracker_fix fix;
 
     k_mutex_lock(&position_mutex, K_FOREVER);
     pos = current_position;
+    fix = current_fix;
     k_mutex_unlock(&position_mutex);
 
-    if (pos.valid && mqtt_is_connected())
+    /* Only queued here; the MQTT network thread formats, batches and sends */
+    if (pos.valid)
     {
-        char json_buf[64];
-        int len = snprintf(json_buf, sizeof(json_buf), "{\"x\":%d,\"y\":%d}", pos.x, pos.y);
+        const struct pub_detail *detail = NULL;
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+        struct pub_detail detail_buf;
+        build_detail(&fix, now, &detail_buf);
+        detail = &detail_buf;
+#else
+        ARG_UNUSED(fix);
+#endif
+        int err = mqtt_queue_position(pos.x, pos.y, detail);
+        telemetry_record_publish(pos.x, pos.y, err);
+    }
+
+    k_work_reschedule(&position_publish_work, K_MSEC(POSITION_PUBLISH_INTERVAL_MS));
+}
+
+/* ------------ Telemetry Readout ------------ */
+
+static int flush_telemetry_msg(char *msg, size_t *used)
+{
+    if (*used == 0)
+    {
+        return 0;
+    }
+    msg[(*used)++] = ']';
+    int err = mqtt_publish_topic(MISOGATE_TELEMETRY, msg, *used, MQTT_QOS_0_AT_MOST_ONCE);
+    *used = 0;
+    return err;
+}
+
+/**
+ * Handle "telemetry [N]" received on MISOGATE_SUB: decode the last N events
+ * and publish them to MISOGATE_TELEMETRY as JSON arrays, as many events per
+ * message as fit.
+ */
+static void mqtt_command(const char *payload, size_t len)
+{
+    ARG_UNUSED(len);
 
-        if (len > 0 && len < (int)sizeof(json_buf))
+    if (strncmp(payload, "telemetry", 9) != 0)
+    {
+        LOG_WRN("Unknown MQTT command: %s", payload);
+        return;
+    }
+
+    int count = atoi(payload + 9);
+    if (count <= 0 || count > TELEMETRY_EVENTS)
+    {
+        count = MIN(TELEMETRY_MQTT_DEFAULT_EVENTS, TELEMETRY_EVENTS);
+    }
+
+    static char msg[TELEMETRY_MQTT_MSG_SIZE];
+    size_t used = 0;
+    uint32_t cursor = telemetry_cursor_latest((uint32_t)count);
+    struct telem_event ev;
+
+    /* Only the events present when asked; newer ones wait for the next request */
+    while (count-- > 0 && telemetry_read(&cursor, &ev, 1) == 1)
+    {
+        char line[192];
+        int n = telemetry_format_json(&ev, line, sizeof(line));
+        if (n <= 0 || n >= (int)sizeof(line))
         {
-            int err = mqtt_publish_json(json_buf, len, MQTT_QOS_0_AT_MOST_ONCE);
+            continue;
+        }
+
+        /* Room for the separator and closing bracket */
+        if (used + (size_t)n + 2 > sizeof(msg))
+        {
+            int err = flush_telemetry_msg(msg, &used);
             if (err)
             {
-                LOG_WRN("Position publish failed: %d", err);
-            }
-            else
-            {
-                LOG_DBG("Published position: %s", json_buf);
+                LOG_WRN("Telemetry publish failed: %d", err);
+                return;
             }
         }
+
+        char sep = (used == 0) ? '[' : ',';
+        msg[used++] = sep;
+        memcpy(&msg[used], line, (size_t)n);
+        used += (size_t)n;
     }
 
-    k_work_reschedule(&position_publish_work, K_MSEC(POSITION_PUBLISH_INTERVAL_MS));
+    int err = flush_telemetry_msg(msg, &used);
+    if (err)
+    {
+        LOG_WRN("Telemetry publish failed: %d", err);
+    }
 }
 
 /* ------------ LoRa Receiver Thread ------------ */
 
+#if defined(CONFIG_MISOGATE_TDMA)
+/* Open the next superframe: switch to TX, broadcast the beacon, back to RX */
+static void send_beacon(void)
+{
+    uint8_t frame[SECURE_FRAME_MAX_LEN];
+    int64_t now = k_uptime_get();
+    size_t len = tdma_build_beacon(now, position_get_node_count(), frame, sizeof(frame));
+    if (len == 0)
+    {
+        return;
+    }
+
+    lora_cfg.tx = true;
+    int err = lora_config(lora_dev, &lora_cfg);
+    if (!err)
+    {
+        err = lora_send(lora_dev, frame, len);
+    }
+    lora_cfg.tx = false;
+    if (lora_config(lora_dev, &lora_cfg) < 0 || err < 0)
+    {
+        LOG_ERR("Beacon not sent (%d)", err);
+    }
+}
+#endif
+
 static void lora_receiver_thread(void *p1, void *p2, void *p3)
 {
     ARG_UNUSED(p1);
     ARG_UNUSED(p2);
     ARG_UNUSED(p3);
 
+    /* Frames that arrive while the queue is full land here and are counted */
+    static struct rx_frame overflow_slot;
+
     /* Wait for start signal */
     k_sem_take(&lora_start_sem, K_FOREVER);
 
@@ -295,32 +454,100 @@ static void lora_receiver_thread(void *p1, void *p2, void *p3)
 
     while (1)
     {
-        uint8_t buf[64];
-        int16_t rssi = 0;
-        int8_t snr = 0;
+        k_timeout_t timeout = K_SECONDS(10);
+
+#if defined(CONFIG_MISOGATE_TDMA)
+        /* Beacon first when it is due, then listen until the next one */
+        int64_t now = k_uptime_get();
+        if (now >= tdma_next_beacon_ms())
+        {
+            send_beacon();
+            now = k_uptime_get();
+        }
+        int64_t next = tdma_next_beacon_ms();
+        /* No schedule yet (no nodes configured): try again shortly */
+        timeout = next > now ? K_MSEC(next - now) : K_SECONDS(1);
+#endif
+
+        struct rx_frame *slot = frame_queue_claim();
+        struct rx_frame *dst = slot ? slot : &overflow_slot;
 
-        int len = lora_recv(lora_dev, buf, sizeof(buf),
-                            K_SECONDS(10), &rssi, &snr);
+        int len = lora_recv(lora_dev, dst->buf, sizeof(dst->buf),
+                            timeout, &dst->rssi, &dst->snr);
 
         if (len > 0)
         {
-            struct sensor_frame f;
-            if (packet_parse_secure_frame_encmac(buf, (size_t)len, &f) == 0)
+            if (!slot)
             {
-                process_frame(&f, rssi, snr, len);
+                frame_queue_count_drop();
+                continue;
+            }
+
+            /* Timestamp at reception, before parse/decrypt. The sender's
+             * node ID is in the clear, so its slot is known already. */
+            slot->rx_ms = k_uptime_get();
+            slot->tx_ms = slot->rx_ms;
+#if defined(CONFIG_MISOGATE_TDMA)
+            (void)tdma_slot_start(slot->buf[0], slot->rx_ms, &slot->tx_ms);
+#endif
+            slot->len = (uint8_t)len;
+            frame_queue_publish();
+            k_sem_give(&frame_ready_sem);
+        }
+        else if (len < 0 && len != -EAGAIN)
+        {
+            LOG_ERR("LoRa recv error: %d", len);
+        }
+    }
+}
+
+static void lora_process_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    uint32_t dropped_reported = 0;
+
+    while (1)
+    {
+        k_sem_take(&frame_ready_sem, K_FOREVER);
+
+        const struct rx_frame *fr;
+        while ((fr = frame_queue_peek()) != NULL)
+        {
+            struct sensor_frame f[PACKET_SAMPLES_MAX];
+            int n = packet_parse_secure_frames(fr->buf, fr->len, f);
+            if (n > 0)
+            {
+                /* Batch samples go in oldest first, each at the time it was
+                 * taken rather than when the frame arrived */
+                for (int i = 0; i < n; i++)
+                {
+                    process_frame(&f[i], fr->tx_ms - f[i].age_ms,
+                                  fr->rssi, fr->snr, fr->len);
+                }
             }
             else
             {
                 /* Only log security drops when running (not during calibration) */
                 if (calibration_is_running())
                 {
-                    LOG_WRN("SECURITY DROP len=%d RSSI=%d SNR=%d", len, rssi, snr);
+                    LOG_WRN("SECURITY DROP len=%u RSSI=%d SNR=%d",
+                            (unsigned)fr->len, fr->rssi, fr->snr);
                 }
             }
+            frame_queue_release();
         }
-        else if (len < 0 && len != -EAGAIN)
+
+        /* Overflow is counted by the receiver, reported from here */
+        struct frame_queue_stats qs;
+        frame_queue_get_stats(&qs);
+        if (qs.dropped != dropped_reported)
         {
-            LOG_ERR("LoRa recv error: %d", len);
+            LOG_WRN("RX queue overflow: %u frames dropped (%u total)",
+                    (unsigned)(qs.dropped - dropped_reported), (unsigned)qs.dropped);
+            dropped_reported = qs.dropped;
         }
     }
 }
@@ -330,11 +557,24 @@ static void lora_receiver_thread(void *p1, void *p2, void *p3)
 int lora_receiver_init(void)
 {
     /* Initialize node state */
-    memset(g_nodes, 0, sizeof(g_nodes));
+    tracker_init();
+    frame_queue_init();
+    telemetry_init();
+    mqtt_set_command_handler(mqtt_command);
 
     /* Initialize submodules */
     calibration_init();
     position_init();
+    ekf_init();
+
+    uint16_t beacon_epoch = 0;
+#if defined(CONFIG_MISOGATE_TDMA)
+    if (boot_epoch_next(&beacon_epoch) < 0)
+    {
+        LOG_ERR("No boot epoch, nodes will transmit unscheduled");
+    }
+#endif
+    tdma_init(beacon_epoch);
 
     lora_dev = DEVICE_DT_GET(LORA_NODE);
     if (!device_is_ready(lora_dev))
@@ -343,19 +583,7 @@ int lora_receiver_init(void)
         return -ENODEV;
     }
 
-    struct lora_modem_config cfg = {
-        .frequency = LORA_FREQ_HZ,
-        .bandwidth = BW_125_KHZ,
-        .datarate = SF_7,
-        .coding_rate = CR_4_5,
-        .preamble_len = 8,
-        .tx_power = 10,
-        .tx = false, /* RX gateway */
-        .iq_inverted = false,
-        .public_network = true,
-    };
-
-    if (lora_config(lora_dev, &cfg) < 0)
+    if (lora_config(lora_dev, &lora_cfg) < 0)
     {
         LOG_ERR("lora_config failed");
         return -EIO;
@@ -373,6 +601,15 @@ int lora_receiver_init(void)
                                      LORA_PRIORITY, 0, K_NO_WAIT);
     k_thread_name_set(lora_thread_id, "lora_rx");
 
+    /* Processing thread idles until the receiver queues a frame */
+    lora_proc_thread_id = k_thread_create(&lora_proc_thread_data,
+                                          lora_proc_stack,
+                                          K_THREAD_STACK_SIZEOF(lora_proc_stack),
+                                          lora_process_thread,
+                                          NULL, NULL, NULL,
+                                          LORA_PROC_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(lora_proc_thread_id, "lora_proc");
+
     return 0;
 }
 
@@ -418,3 +655,19 @@ uint32_t lora_get_rx_count(void)
 {
     return rx_ok_count;
 }
+
+void lora_get_rx_stats(struct lora_rx_stats *stats)
+{
+    struct frame_queue_stats qs;
+    frame_queue_get_stats(&qs);
+
+    stats->received = qs.enqueued + qs.dropped;
+    stats->valid = rx_ok_count;
+    stats->queue_dropped = qs.dropped;
+    stats->queue_high_water = qs.high_water;
+
+    struct tdma_stats ts;
+    tdma_get_stats(&ts);
+    stats->beacons = ts.beacons;
+    stats->out_of_slot = ts.out_of_slot;
+}
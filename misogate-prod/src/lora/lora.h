@@ -7,8 +7,11 @@
 
 /**
  * @brief Maximum number of sensor nodes supported
+ *
+ * Capacity only; the number of deployed nodes is set at runtime
+ * (see position_set_node_count()).
  */
-#define MAX_NODES 3
+#define MAX_NODES CONFIG_MISOGATE_MAX_NODES
 
 /**
  * @brief Number of packets to learn baseline per node
@@ -63,7 +66,13 @@ struct node_state
     struct vec3_i32 last_B_mag; /* Last magnet-only B (measured - baseline) */
     int32_t last_absB;          /* Last |B| in m-uT */
     int32_t last_dAbsB;         /* Last anomaly |B|-baseline in m-uT (for compatibility) */
+    int32_t last_noise_mut;     /* 1-sigma noise the node reported, 0 if unknown */
     uint32_t last_seq;
+    int64_t last_sample_ms;     /* Gateway time the last measurement was taken */
+
+    /* Measurement before it, for the rate of change of the field */
+    struct vec3_i32 prev_B_mag;
+    int64_t prev_sample_ms;
 };
 
 /**
@@ -120,6 +129,9 @@ bool lora_is_running(void);
 /**
  * @brief Get the estimated 2D position
  *
+ * The position is withdrawn (not available) once no solve has produced a
+ * fix for TRACKER_MAX_NODE_AGE_MS.
+ *
  * @param[out] pos Pointer to position struct to fill
  * @return 0 on success (valid position), -1 if not available
  */
@@ -138,4 +150,22 @@ int lora_get_position_rel(void);
  */
 uint32_t lora_get_rx_count(void);
 
+/**
+ * @brief Receive path counters
+ */
+struct lora_rx_stats
+{
+    uint32_t received;         /* Frames taken off the radio */
+    uint32_t valid;            /* Frames that passed MAC/replay checks */
+    uint32_t queue_dropped;    /* Frames lost because the queue was full */
+    uint32_t queue_high_water; /* Deepest the RX queue has been */
+    uint32_t beacons;          /* TDMA beacons sent */
+    uint32_t out_of_slot;      /* Frames not sent in their TDMA slot */
+};
+
+/**
+ * @brief Get receive path counters
+ */
+void lora_get_rx_stats(struct lora_rx_stats *stats);
+
 #endif /* LORA_H */
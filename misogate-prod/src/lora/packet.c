@@ -1,53 +1,169 @@
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "packet.h"
 #include "crypto_min.h"
 #include "siphash.h"
 
-/* Same per-node master key as node */
-static const uint8_t NODE_MASTER_KEY[16] = {
+/* Same per-node master key as node (replaced by packet_rekey()) */
+static uint8_t master_key[16] = {
     0x4d,0x69,0x73,0x6f,0x4b,0x65,0x79,0x21, 0x10,0x22,0x33,0x44,0x55,0x66,0x77,0x88
 };
 
-static uint32_t last_seq_seen[256];
+/* Replay window per node: the newest boot epoch heard, its highest frame
+ * counter and which of the PACKET_REPLAY_WINDOW counters up to it arrived */
+struct replay_window {
+    uint64_t seen;      /* Bit i: counter top - i accepted */
+    uint32_t top;
+    uint16_t epoch;
+    bool     valid;
+};
 
-int packet_parse_secure_frame_encmac(const uint8_t *in, size_t in_len, struct sensor_frame *out)
+static struct replay_window replay[256];
+
+/* Derived K_enc/K_mac per node. Direct-mapped on node_id; IDs below
+ * PACKET_KEY_CACHE_SLOTS never collide, others just re-derive on a miss. */
+struct node_keys {
+    uint8_t node_id;
+    bool    valid;
+    uint8_t K_enc[16];
+    uint8_t K_mac[16];
+};
+
+static struct node_keys key_cache[PACKET_KEY_CACHE_SLOTS];
+
+static const struct node_keys *node_keys_get(uint8_t node_id)
+{
+    struct node_keys *e = &key_cache[node_id % PACKET_KEY_CACHE_SLOTS];
+    if (!e->valid || e->node_id != node_id) {
+        kdf_split_keys(master_key, node_id, e->K_enc, e->K_mac);
+        e->node_id = node_id;
+        e->valid = true;
+    }
+    return e;
+}
+
+/* Accept each (epoch, tx_seq) of a node once; O(1) per frame */
+static bool replay_accept(uint8_t node_id, uint16_t epoch, uint32_t tx_seq)
+{
+    struct replay_window *w = &replay[node_id];
+
+    if (!w->valid || epoch > w->epoch) {
+        // First frame, or the node rebooted: start a window at this frame
+        w->valid = true;
+        w->epoch = epoch;
+        w->top   = tx_seq;
+        w->seen  = 1;
+        return true;
+    }
+    if (epoch < w->epoch) return false;
+
+    if (tx_seq > w->top) {
+        uint32_t shift = tx_seq - w->top;
+        w->seen = shift < PACKET_REPLAY_WINDOW ? (w->seen << shift) | 1 : 1;
+        w->top  = tx_seq;
+        return true;
+    }
+
+    uint32_t back = w->top - tx_seq;
+    if (back >= PACKET_REPLAY_WINDOW) return false;
+    uint64_t bit = (uint64_t)1 << back;
+    if (w->seen & bit) return false;
+    w->seen |= bit;
+    return true;
+}
+
+void packet_key_cache_clear(void)
+{
+    memset(key_cache, 0, sizeof(key_cache));
+}
+
+void packet_rekey(const uint8_t new_master[16])
 {
-    if (in_len < SECURE_FRAME_LEN) return -1;
+    memcpy(master_key, new_master, sizeof(master_key));
+    packet_key_cache_clear();
+}
 
-    uint8_t  node_id = in[0];
-    uint32_t tx_seq  = (uint32_t)in[1] | ((uint32_t)in[2]<<8)
-                     | ((uint32_t)in[3]<<16) | ((uint32_t)in[4]<<24);
+int packet_parse_secure_frames(const uint8_t *in, size_t in_len, struct sensor_frame *out)
+{
+    if (in_len < SECURE_FRAME_LEN || in_len > SECURE_FRAME_MAX_LEN) return -1;
 
-    const uint8_t *ct  = &in[5];
-    const uint8_t *tag = &in[5 + SENSOR_PLAINTEXT_LEN];
+    uint8_t  node_id;
+    uint16_t epoch;
+    uint32_t tx_seq;
+    unpack_secure_header(in, &node_id, &epoch, &tx_seq);
+    if (node_id == BEACON_NODE_ID) return -1;
 
-    uint8_t K_enc[16], K_mac[16];
-    kdf_split_keys(NODE_MASTER_KEY, node_id, K_enc, K_mac);
+    size_t ct_len = in_len - (SECURE_HDR_LEN + TAG_LEN);
+    const uint8_t *ct  = &in[SECURE_HDR_LEN];
+    const uint8_t *tag = &in[SECURE_HDR_LEN + ct_len];
 
-    // MAC check first (Encrypt-then-MAC)
-    uint8_t mac_input[1 + 4 + SENSOR_PLAINTEXT_LEN];
-    mac_input[0] = node_id;
-    mac_input[1] = in[1]; mac_input[2] = in[2];
-    mac_input[3] = in[3]; mac_input[4] = in[4];
-    memcpy(&mac_input[5], ct, SENSOR_PLAINTEXT_LEN);
+    const struct node_keys *keys = node_keys_get(node_id);
+    const uint8_t *K_enc = keys->K_enc;
+    const uint8_t *K_mac = keys->K_mac;
 
+    // MAC check first (Encrypt-then-MAC); header and ciphertext are contiguous
     uint8_t calc[TAG_LEN];
-    siphash24(calc, mac_input, sizeof(mac_input), K_mac);
+    siphash24(calc, in, SECURE_HDR_LEN + ct_len, K_mac);
     if (memcmp(calc, tag, TAG_LEN) != 0) return -1;
 
-    // Replay protection per node
-    if (tx_seq <= last_seq_seen[node_id]) return -1;
-    last_seq_seen[node_id] = tx_seq;
+    // Replay protection per node, only for authentic headers
+    if (!replay_accept(node_id, epoch, tx_seq)) return -1;
 
     // Decrypt
 
-    uint8_t ks[SENSOR_PLAINTEXT_LEN], pt[SENSOR_PLAINTEXT_LEN];
-    keystream_from_seq(ks, sizeof(ks), K_enc, tx_seq);
-    for (size_t i = 0; i < SENSOR_PLAINTEXT_LEN; ++i) pt[i] = ct[i] ^ ks[i];
+    // pt has zeroed slack for the packed bit reader's 4-byte loads
+    uint8_t ks[SENSOR_PACKED_PLAINTEXT_MAX];
+    uint8_t pt[SENSOR_PACKED_PLAINTEXT_MAX + 3];
+    keystream_from_seq(ks, ct_len, K_enc, epoch, tx_seq);
+    for (size_t i = 0; i < ct_len; ++i) pt[i] = ct[i] ^ ks[i];
+    memset(&pt[ct_len], 0, 3);
+
+    int n;
+    if (pt[0] == MSG_TYPE_SENSOR && ct_len == SENSOR_PLAINTEXT_LEN) {
+        out[0].age_ms = 0;
+        out[0].noise_mut = 0;
+        n = unpack_sensor_payload(pt, &out[0]) == 0 ? 1 : -1;
+    } else if (pt[0] == MSG_TYPE_SENSOR_PACKED) {
+        n = unpack_sensor_packed(pt, ct_len, out);
+    } else {
+        n = unpack_sensor_batch(pt, ct_len, out);
+    }
+
+    for (int i = 0; i < n; i++) {
+        out[i].node_id = node_id;
+        out[i].epoch   = epoch;
+        out[i].tx_seq  = tx_seq;
+    }
+    return n;
+}
+
+size_t packet_build_beacon(const struct beacon *b, uint16_t epoch, uint32_t seq,
+                           uint8_t *out, size_t out_max)
+{
+    if (epoch == 0 || b->slots < 2 || b->slots > BEACON_SLOTS_MAX) return 0;
+
+    size_t pt_len = BEACON_PLAINTEXT_LEN(b->slots);
+    if (out_max < SECURE_HDR_LEN + pt_len + TAG_LEN) return 0;
+
+    uint8_t pt[BEACON_PLAINTEXT_LEN(BEACON_SLOTS_MAX)];
+    uint8_t ks[BEACON_PLAINTEXT_LEN(BEACON_SLOTS_MAX)];
+    pack_beacon(pt, b);
+
+    const struct node_keys *keys = node_keys_get(BEACON_NODE_ID);
+    keystream_from_seq(ks, pt_len, keys->K_enc, epoch, seq);
 
-    out->node_id = node_id;
-    out->tx_seq  = tx_seq;
-    return unpack_sensor_payload(pt, out);
+    pack_secure_header(out, BEACON_NODE_ID, epoch, seq);
+    for (size_t i = 0; i < pt_len; ++i) out[SECURE_HDR_LEN + i] = pt[i] ^ ks[i];
+    siphash24(&out[SECURE_HDR_LEN + pt_len], out, SECURE_HDR_LEN + pt_len, keys->K_mac);
+    return SECURE_HDR_LEN + pt_len + TAG_LEN;
 }
 
+int packet_parse_secure_frame_encmac(const uint8_t *in, size_t in_len, struct sensor_frame *out)
+{
+    struct sensor_frame s[PACKET_SAMPLES_MAX];
+
+    if (packet_parse_secure_frames(in, in_len, s) != 1) return -1;
+    *out = s[0];
+    return 0;
+}
@@ -1,24 +1,90 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
-/* Frame & payload layout (unchanged size: 28 bytes) */
+/*
+ * Secure frame: header, payload encrypted with the header as nonce, and a
+ * SipHash-2-4 tag over both.
+ *
+ *   0  u8   node ID
+ *   1  u16  boot epoch: the node's boot count
+ *   3  u32  frame counter, from 0 at every boot
+ *   7  payload, then TAG_LEN bytes of tag
+ *
+ * Epoch and counter together never repeat for a node, so neither does its
+ * keystream, and the gateway can tell a reboot from a replay.
+ */
+#define SECURE_HDR_LEN          7
+
+/* Single-sample payload (30-byte frame) */
 #define MSG_TYPE_SENSOR         0x01
 #define SENSOR_PLAINTEXT_LEN    15
 #define TAG_LEN                 8
-#define SECURE_FRAME_LEN        (1 + 4 + SENSOR_PLAINTEXT_LEN + TAG_LEN)
+#define SECURE_FRAME_LEN        (SECURE_HDR_LEN + SENSOR_PLAINTEXT_LEN + TAG_LEN)
+
+/*
+ * Batch payload: several samples under one header and one tag.
+ *
+ *   0  u8   MSG_TYPE_SENSOR_BATCH
+ *   1  u8   sample count n (1..SENSOR_BATCH_MAX)
+ *   2  i16  temperature (C x10) at transmission
+ *   4  n x { u16 age_ms, i24 x, i24 y, i24 z }, oldest first
+ *
+ * age_ms is how long before transmission the sample was taken; fields are
+ * m-uT (+-8.3 T, saturated by the node). Four samples make a 63-byte frame.
+ */
+#define MSG_TYPE_SENSOR_BATCH       0x02
+#define SENSOR_BATCH_MAX            4
+#define SENSOR_BATCH_HDR_LEN        4
+#define SENSOR_BATCH_SAMPLE_LEN     11
+#define SENSOR_BATCH_PLAINTEXT_LEN(n) (SENSOR_BATCH_HDR_LEN + (n) * SENSOR_BATCH_SAMPLE_LEN)
+#define SECURE_BATCH_FRAME_LEN(n)   (SECURE_HDR_LEN + SENSOR_BATCH_PLAINTEXT_LEN(n) + TAG_LEN)
+
+/* Largest frame accepted (one gateway receive slot) */
+#define SECURE_FRAME_MAX_LEN        64
+
+/* Derived-key cache size (node IDs below this never evict each other) */
+#define PACKET_KEY_CACHE_SLOTS  32
+
+/* Replay window: frames up to this many counters behind the newest one
+ * from the same node and boot are still accepted, once each */
+#define PACKET_REPLAY_WINDOW    64
 
 /* Sensor struct used at the app edges */
 struct sensor_frame {
     uint8_t  node_id;
+    uint16_t epoch;             /* Sender's boot epoch */
     uint32_t tx_seq;
     int32_t  x_uT_milli;
     int32_t  y_uT_milli;
     int32_t  z_uT_milli;
     int16_t  temp_c_times10;
+    uint16_t age_ms;            /* Sample age at transmission (batch frames) */
+    uint16_t noise_mut;         /* 1-sigma noise of x/y/z (m-uT), 0 if unknown */
 };
 
 
+/* --- secure frame header --- */
+static inline void pack_secure_header(uint8_t *buf, uint8_t node_id, uint16_t epoch,
+                                      uint32_t tx_seq) {
+    buf[0] = node_id;
+    buf[1] = (uint8_t)(epoch >> 0);
+    buf[2] = (uint8_t)(epoch >> 8);
+    buf[3] = (uint8_t)(tx_seq >> 0);
+    buf[4] = (uint8_t)(tx_seq >> 8);
+    buf[5] = (uint8_t)(tx_seq >> 16);
+    buf[6] = (uint8_t)(tx_seq >> 24);
+}
+
+static inline void unpack_secure_header(const uint8_t *p, uint8_t *node_id, uint16_t *epoch,
+                                        uint32_t *tx_seq) {
+    *node_id = p[0];
+    *epoch   = (uint16_t)((uint16_t)p[1] | ((uint16_t)p[2] << 8));
+    *tx_seq  = (uint32_t)p[3] | ((uint32_t)p[4] << 8) |
+               ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 24);
+}
+
 /* --- helpers to pack/unpack 15B sensor payload --- */
 static inline void pack_sensor_payload(uint8_t *buf, const struct sensor_frame *m) {
     buf[0] = MSG_TYPE_SENSOR;
@@ -66,9 +132,324 @@ static inline int unpack_sensor_payload(const uint8_t *p, struct sensor_frame *o
     return 0;
 }
 
+/* --- helpers to pack/unpack the batch payload --- */
+static inline void put_i24(uint8_t *p, int32_t v) {
+    if (v > 0x7fffff)  v = 0x7fffff;
+    if (v < -0x800000) v = -0x800000;
+    uint32_t u = (uint32_t)v;
+    p[0] = (uint8_t)(u >> 0);
+    p[1] = (uint8_t)(u >> 8);
+    p[2] = (uint8_t)(u >> 16);
+}
+
+static inline int32_t get_i24(const uint8_t *p) {
+    uint32_t u = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (int32_t)(u << 8) >> 8;
+}
+
+static inline size_t pack_sensor_batch(uint8_t *buf, const struct sensor_frame *m, size_t n) {
+    buf[0] = MSG_TYPE_SENSOR_BATCH;
+    buf[1] = (uint8_t)n;
+
+    uint16_t t = (uint16_t)m[n - 1].temp_c_times10;
+    buf[2] = (uint8_t)(t >> 0);
+    buf[3] = (uint8_t)(t >> 8);
+
+    uint8_t *p = &buf[SENSOR_BATCH_HDR_LEN];
+    for (size_t i = 0; i < n; i++, p += SENSOR_BATCH_SAMPLE_LEN) {
+        p[0] = (uint8_t)(m[i].age_ms >> 0);
+        p[1] = (uint8_t)(m[i].age_ms >> 8);
+        put_i24(&p[2], m[i].x_uT_milli);
+        put_i24(&p[5], m[i].y_uT_milli);
+        put_i24(&p[8], m[i].z_uT_milli);
+    }
+    return SENSOR_BATCH_PLAINTEXT_LEN(n);
+}
+
+/* Returns the sample count, or -1 if p is not a batch of exactly len bytes */
+static inline int unpack_sensor_batch(const uint8_t *p, size_t len, struct sensor_frame *out) {
+    if (p[0] != MSG_TYPE_SENSOR_BATCH) return -1;
+    size_t n = p[1];
+    if (n == 0 || n > SENSOR_BATCH_MAX || len != SENSOR_BATCH_PLAINTEXT_LEN(n)) return -1;
+
+    int16_t temp = (int16_t)((uint16_t)p[2] | ((uint16_t)p[3] << 8));
+
+    const uint8_t *s = &p[SENSOR_BATCH_HDR_LEN];
+    for (size_t i = 0; i < n; i++, s += SENSOR_BATCH_SAMPLE_LEN) {
+        out[i].age_ms         = (uint16_t)((uint16_t)s[0] | ((uint16_t)s[1] << 8));
+        out[i].x_uT_milli     = get_i24(&s[2]);
+        out[i].y_uT_milli     = get_i24(&s[5]);
+        out[i].z_uT_milli     = get_i24(&s[8]);
+        out[i].temp_c_times10 = temp;
+        out[i].noise_mut      = 0;
+    }
+    return (int)n;
+}
+
+/*
+ * Packed payload: consecutive samples as MMC5983MA counts, 18-bit keyframe
+ * plus fixed-width deltas. Every frame starts with its own keyframe, so a
+ * lost frame never corrupts the next one.
+ *
+ *   0  u8   MSG_TYPE_SENSOR_PACKED
+ *   1  u8   sample count n (1..SENSOR_PACKED_MAX)
+ *   2  u8   delta width w in bits (0..SENSOR_PACKED_DELTA_BITS_MAX)
+ *   3  i16  temperature (C x10) at transmission
+ *   5  u16  interval between samples (ms)
+ *   7  u16  age of the newest sample at transmission (ms)
+ *   9  u8   noise: largest 1-sigma of any sample and axis, quarter counts
+ *           (saturating at 255, 0 if unknown)
+ *  10  bit stream, LSB first, zero padded to a byte:
+ *        x, y, z of the oldest sample, 18-bit two's complement counts
+ *        n-1 times x, y, z difference to the previous sample, w bits each
+ *
+ * One count is 6.25 m-uT (0.0625 mG). Eight samples of a still magnet
+ * (w around 6) take 33 bytes of payload against 48 for four batch samples.
+ * The noise lets the receiver weight readings the node averaged down.
+ */
+#define MSG_TYPE_SENSOR_PACKED          0x03
+#define SENSOR_PACKED_MAX               16
+#define SENSOR_PACKED_HDR_LEN           10
+#define SENSOR_PACKED_KEY_BITS          18
+#define SENSOR_PACKED_DELTA_BITS_MAX    19
+#define SENSOR_PACKED_PLAINTEXT_MAX     (SECURE_FRAME_MAX_LEN - (SECURE_HDR_LEN + TAG_LEN))
+#define SENSOR_PACKED_BITS_MAX          ((SENSOR_PACKED_PLAINTEXT_MAX - SENSOR_PACKED_HDR_LEN) * 8)
+#define SENSOR_PACKED_BITS(n, w)        (3 * SENSOR_PACKED_KEY_BITS + 3 * (w) * ((n) - 1))
+#define SENSOR_PACKED_PLAINTEXT_LEN(n, w) (SENSOR_PACKED_HDR_LEN + (SENSOR_PACKED_BITS(n, w) + 7) / 8)
+
+/* m-uT to counts, rounded and saturated to 18 bits */
+static inline int32_t packed_counts(int32_t mut) {
+    if (mut > 819200)  mut = 819200;
+    if (mut < -819200) mut = -819200;
+    int32_t c = (mut >= 0 ? mut * 4 + 12 : mut * 4 - 12) / 25;
+    if (c > 131071)  c = 131071;
+    return c;
+}
+
+/* Bits for a signed delta: -2^(w-1) <= d < 2^(w-1), 0 for no change */
+static inline unsigned packed_delta_bits(int32_t d) {
+    uint32_t u = d < 0 ? ~(uint32_t)d : (uint32_t)d;
+    unsigned w = d ? 1 : 0;
+    while (u) { w++; u >>= 1; }
+    return w;
+}
+
+/* m-uT to quarter counts, rounded up and saturated to a byte */
+static inline uint8_t packed_noise_code(uint32_t mut) {
+    uint32_t q = (mut * 16 + 24) / 25;
+    return (uint8_t)(q > 255 ? 255 : q);
+}
+
+static inline void put_bits(uint8_t *buf, size_t *pos, uint32_t v, unsigned w) {
+    for (unsigned i = 0; i < w; i++, (*pos)++) {
+        if ((v >> i) & 1u) buf[*pos >> 3] |= (uint8_t)(1u << (*pos & 7));
+    }
+}
+
+/*
+ * How many of the newest samples in m[0..total) fit one frame, growing the
+ * delta width as needed. *w_out is the width those samples need.
+ */
+static inline size_t sensor_packed_fit(const struct sensor_frame *m, size_t total, unsigned *w_out) {
+    size_t n = total < SENSOR_PACKED_MAX ? total : SENSOR_PACKED_MAX;
+    size_t k = n ? 1 : 0;
+    unsigned w = 0;
+
+    /* Grow from the newest sample backwards while the stream still fits */
+    while (k < n) {
+        const struct sensor_frame *a = &m[total - k - 1], *b = &m[total - k];
+        unsigned wk = w;
+        int32_t d[3] = {
+            packed_counts((int32_t)b->x_uT_milli) - packed_counts((int32_t)a->x_uT_milli),
+            packed_counts((int32_t)b->y_uT_milli) - packed_counts((int32_t)a->y_uT_milli),
+            packed_counts((int32_t)b->z_uT_milli) - packed_counts((int32_t)a->z_uT_milli),
+        };
+        for (int i = 0; i < 3; i++) {
+            unsigned bits = packed_delta_bits(d[i]);
+            if (bits > wk) wk = bits;
+        }
+        if (SENSOR_PACKED_BITS(k + 1, wk) > SENSOR_PACKED_BITS_MAX) break;
+        w = wk;
+        k++;
+    }
+    *w_out = w;
+    return k;
+}
+
+/*
+ * Pack n samples (oldest first) with delta width w from sensor_packed_fit().
+ * buf must hold SENSOR_PACKED_PLAINTEXT_LEN(n, w) bytes.
+ */
+static inline size_t pack_sensor_packed(uint8_t *buf, const struct sensor_frame *m, size_t n,
+                                        unsigned w, uint16_t interval_ms) {
+    size_t len = SENSOR_PACKED_PLAINTEXT_LEN(n, w);
+    memset(buf, 0, len);
+
+    buf[0] = MSG_TYPE_SENSOR_PACKED;
+    buf[1] = (uint8_t)n;
+    buf[2] = (uint8_t)w;
+
+    uint16_t t = (uint16_t)m[n - 1].temp_c_times10;
+    buf[3] = (uint8_t)(t >> 0);
+    buf[4] = (uint8_t)(t >> 8);
+    buf[5] = (uint8_t)(interval_ms >> 0);
+    buf[6] = (uint8_t)(interval_ms >> 8);
+    buf[7] = (uint8_t)(m[n - 1].age_ms >> 0);
+    buf[8] = (uint8_t)(m[n - 1].age_ms >> 8);
+
+    uint16_t noise = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (m[i].noise_mut > noise) noise = m[i].noise_mut;
+    }
+    buf[9] = packed_noise_code(noise);
+
+    uint8_t *bs = &buf[SENSOR_PACKED_HDR_LEN];
+    size_t pos = 0;
+    int32_t prev[3] = {0, 0, 0};
+    for (size_t i = 0; i < n; i++) {
+        int32_t c[3] = {
+            packed_counts((int32_t)m[i].x_uT_milli),
+            packed_counts((int32_t)m[i].y_uT_milli),
+            packed_counts((int32_t)m[i].z_uT_milli),
+        };
+        for (int a = 0; a < 3; a++) {
+            if (i == 0) put_bits(bs, &pos, (uint32_t)c[a], SENSOR_PACKED_KEY_BITS);
+            else        put_bits(bs, &pos, (uint32_t)(c[a] - prev[a]), w);
+            prev[a] = c[a];
+        }
+    }
+    return len;
+}
+
+/*
+ * Beacon: gateway to nodes, once per TDMA superframe. Sealed like a sensor
+ * frame from BEACON_NODE_ID, which no node uses, with the gateway's boot
+ * epoch and the beacon count of that boot as tx_seq. Nodes take a beacon
+ * only if its (epoch, count) is newer than the last one they took.
+ *
+ *   0  u8   MSG_TYPE_BEACON
+ *   1  u8   slots per superframe n (2..BEACON_SLOTS_MAX), slot 0 is the beacon
+ *   2  u16  slot length (ms)
+ *   4  u32  gateway time at the start of the beacon (ms)
+ *   8  n-1 x u8 node ID that owns slot 1..n-1, 0 if none
+ *
+ * Slot k starts k slot lengths after the beacon. A node transmits only at
+ * the start of its own slot, so frames from different nodes never overlap.
+ */
+#define MSG_TYPE_BEACON         0x10
+#define BEACON_NODE_ID          0
+#define BEACON_HDR_LEN          8
+#define BEACON_SLOTS_MAX        (1 + 32)
+#define BEACON_PLAINTEXT_LEN(n) (BEACON_HDR_LEN + (n) - 1)
+
+struct beacon {
+    uint8_t  slots;                     /* Slots per superframe, beacon included */
+    uint16_t slot_ms;
+    uint32_t epoch_ms;                  /* Gateway time at the beacon start */
+    uint8_t  owner[BEACON_SLOTS_MAX];   /* Node ID per slot, owner[0] unused */
+};
+
+static inline size_t pack_beacon(uint8_t *buf, const struct beacon *b) {
+    buf[0] = MSG_TYPE_BEACON;
+    buf[1] = b->slots;
+    buf[2] = (uint8_t)(b->slot_ms >> 0);
+    buf[3] = (uint8_t)(b->slot_ms >> 8);
+    buf[4] = (uint8_t)(b->epoch_ms >> 0);
+    buf[5] = (uint8_t)(b->epoch_ms >> 8);
+    buf[6] = (uint8_t)(b->epoch_ms >> 16);
+    buf[7] = (uint8_t)(b->epoch_ms >> 24);
+    memcpy(&buf[BEACON_HDR_LEN], &b->owner[1], b->slots - 1);
+    return BEACON_PLAINTEXT_LEN(b->slots);
+}
+
+/* Returns 0, or -1 if p is not a beacon of exactly len bytes */
+static inline int unpack_beacon(const uint8_t *p, size_t len, struct beacon *out) {
+    if (p[0] != MSG_TYPE_BEACON) return -1;
+    uint8_t n = p[1];
+    if (n < 2 || n > BEACON_SLOTS_MAX || len != (size_t)BEACON_PLAINTEXT_LEN(n)) return -1;
+
+    out->slots    = n;
+    out->slot_ms  = (uint16_t)((uint16_t)p[2] | ((uint16_t)p[3] << 8));
+    out->epoch_ms = (uint32_t)p[4] | ((uint32_t)p[5] << 8) |
+                    ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+    out->owner[0] = BEACON_NODE_ID;
+    memcpy(&out->owner[1], &p[BEACON_HDR_LEN], n - 1);
+    return out->slot_ms ? 0 : -1;
+}
+
+/* Read w (<= 25) bits at bit pos; buf must be readable 3 bytes past the stream */
+static inline uint32_t get_bits(const uint8_t *buf, size_t pos, unsigned w) {
+    const uint8_t *p = &buf[pos >> 3];
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                 ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return (v >> (pos & 7)) & ((1u << w) - 1u);
+}
+
+static inline int32_t sign_extend(uint32_t v, unsigned w) {
+    uint32_t m = (1u << w) >> 1;
+    return (int32_t)((v ^ m) - m);
+}
+
+/* Counts back to m-uT */
+static inline int32_t packed_mut(int32_t c) {
+    return c * 25 / 4;
+}
+
+/* Quarter counts back to m-uT */
+static inline uint16_t packed_noise_mut(uint8_t q) {
+    return (uint16_t)(q * 25u / 16u);
+}
+
+/*
+ * Returns the sample count, or -1 if p is not a packed payload of exactly
+ * len bytes. p must be readable 3 bytes past len. No branches depend on
+ * the sample data: every delta is the same width.
+ */
+static inline int unpack_sensor_packed(const uint8_t *p, size_t len, struct sensor_frame *out) {
+    if (p[0] != MSG_TYPE_SENSOR_PACKED) return -1;
+    size_t   n = p[1];
+    unsigned w = p[2];
+    if (n == 0 || n > SENSOR_PACKED_MAX || w > SENSOR_PACKED_DELTA_BITS_MAX ||
+        len != SENSOR_PACKED_PLAINTEXT_LEN(n, w)) return -1;
+
+    int16_t  temp     = (int16_t)((uint16_t)p[3] | ((uint16_t)p[4] << 8));
+    uint32_t interval = (uint32_t)p[5] | ((uint32_t)p[6] << 8);
+    uint32_t age      = (uint32_t)p[7] | ((uint32_t)p[8] << 8);
+    uint16_t noise    = packed_noise_mut(p[9]);
+
+    const uint8_t *bs = &p[SENSOR_PACKED_HDR_LEN];
+    size_t pos = 0;
+    int32_t c[3];
+    for (int a = 0; a < 3; a++, pos += SENSOR_PACKED_KEY_BITS) {
+        c[a] = sign_extend(get_bits(bs, pos, SENSOR_PACKED_KEY_BITS), SENSOR_PACKED_KEY_BITS);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (i) {
+            for (int a = 0; a < 3; a++, pos += w) {
+                c[a] += sign_extend(get_bits(bs, pos, w), w);
+            }
+        }
+        uint32_t a_ms = age + (uint32_t)(n - 1 - i) * interval;
+        out[i].age_ms         = (uint16_t)(a_ms > UINT16_MAX ? UINT16_MAX : a_ms);
+        out[i].x_uT_milli     = packed_mut(c[0]);
+        out[i].y_uT_milli     = packed_mut(c[1]);
+        out[i].z_uT_milli     = packed_mut(c[2]);
+        out[i].temp_c_times10 = temp;
+        out[i].noise_mut      = noise;
+    }
+    return (int)n;
+}
+
+/* Most samples packet_parse_secure_frames() returns */
+#define PACKET_SAMPLES_MAX  SENSOR_PACKED_MAX
+
 /**
  * @brief Parse and decrypt a secure LoRa frame using Encrypt-then-MAC
  *
+ * Accepts single-sample frames only; see packet_parse_secure_frames() for
+ * batch frames.
+ *
  * @param in Input buffer containing the encrypted frame
  * @param in_len Length of input buffer
  * @param out Pointer to sensor_frame structure to populate
@@ -77,3 +458,53 @@ static inline int unpack_sensor_payload(const uint8_t *p, struct sensor_frame *o
  */
 int packet_parse_secure_frame_encmac(const uint8_t *in, size_t in_len, struct sensor_frame *out);
 
+/**
+ * @brief Parse and decrypt a single-sample, batch or packed frame
+ *
+ * The frame length is the received length: the tag covers everything
+ * before it. All samples of a batch share the frame's tx_seq and differ in
+ * age_ms (0 for a single-sample frame).
+ *
+ * @param in Input buffer containing the encrypted frame
+ * @param in_len Length of the frame
+ * @param out Samples, oldest first (PACKET_SAMPLES_MAX entries)
+ *
+ * Replays are rejected per node: a frame from an older boot epoch, one
+ * PACKET_REPLAY_WINDOW or more counters behind the newest of its epoch, or
+ * one already accepted. Frames reordered within the window still pass,
+ * and a node that rebooted is accepted again at once.
+ *
+ * @return Number of samples, negative on failure (auth fail, replay, etc.)
+ */
+int packet_parse_secure_frames(const uint8_t *in, size_t in_len, struct sensor_frame *out);
+
+/**
+ * @brief Seal a beacon for broadcast
+ *
+ * @param b Beacon contents
+ * @param epoch Gateway boot epoch, never 0
+ * @param seq Beacon count within the epoch (the nodes' replay check)
+ * @param out Frame
+ * @param out_max Size of @p out
+ *
+ * @return Frame length, 0 if @p b is invalid or the frame does not fit
+ */
+size_t packet_build_beacon(const struct beacon *b, uint16_t epoch, uint32_t seq,
+                           uint8_t *out, size_t out_max);
+
+/**
+ * @brief Drop all cached per-node K_enc/K_mac
+ *
+ * Keys are re-derived from the master key on the next frame from each node.
+ */
+void packet_key_cache_clear(void);
+
+/**
+ * @brief Replace the master key and clear the derived-key cache
+ *
+ * Not synchronized with packet_parse_secure_frame_encmac(); call it from the
+ * receive thread or while reception is stopped.
+ *
+ * @param new_master New 16-byte master key
+ */
+void packet_rekey(const uint8_t new_master[16]);
@@ -3,8 +3,9 @@
  * @brief Magnetic dipole-based position estimation using 3-axis magnetometers
  *
  * This module implements position estimation of a permanent magnet using the
- * magnetic dipole field model. Given measurements from 3 three-axis magnetometers,
- * it solves for the magnet position (x, y) in a known plane.
+ * magnetic dipole field model. Given measurements from an array of three-axis
+ * magnetometers (the strongest few of which are used per solve), it solves
+ * for the magnet position (x, y) in a known plane.
  *
  * The approach:
  * 1. Each sensor measures B_total = B_earth + B_offsets + B_magnet
@@ -22,7 +23,9 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
 
+#include <errno.h>
 #include <math.h>
 #include <string.h>
 
@@ -36,6 +39,9 @@ LOG_MODULE_REGISTER(position, LOG_LEVEL_INF);
  * Sensor positions in the coordinate frame.
  * Sensors are in the z=0 plane. Positions are in the 0-1000 coordinate system.
  *
+ * The first three entries are the default three-corner layout; the rest
+ * are configured at runtime (see position_set_sensor()).
+ *
  * IMPORTANT: Update these values to match your actual physical setup!
  */
 static struct sensor_pos g_sensor_pos[MAX_NODES + 1] = {
@@ -53,6 +59,17 @@ static struct node_pos g_node_pos[MAX_NODES + 1] = {
     {0.0f, 0.0f},
 };
 
+/**
+ * Number of deployed nodes (IDs 1 to g_node_count).
+ *
+ * The console thread changes the layout while the processing thread
+ * solves over it; layout_mutex serialises the two (see
+ * position_layout_lock()). The count alone is read lock-free, e.g. by the
+ * receiver thread for the beacon.
+ */
+static atomic_t g_node_count = ATOMIC_INIT(POSITION_DEFAULT_NODE_COUNT);
+static K_MUTEX_DEFINE(layout_mutex);
+
 /**
  * Dipole orientation unit vector.
  * Assumes magnet is oriented with north pole pointing up (+Z).
@@ -158,8 +175,9 @@ void position_compute_dipole_field(float magnet_x, float magnet_y, float M,
 }
 
 /**
- * Compute numerical Jacobian using finite differences.
- * More robust than analytical derivatives for this application.
+ * Compute numerical Jacobian using central finite differences.
+ * Reference for the closed-form version below, and its fallback inside the
+ * r < 1 clamp where the model stops being smooth.
  */
 void position_compute_jacobian(float magnet_x, float magnet_y, float M,
                                const struct sensor_pos *sensor,
@@ -193,6 +211,105 @@ void position_compute_jacobian(float magnet_x, float magnet_y, float M,
     J_out[2][2] = (B_plus.z - B_minus.z) / (2.0f * eps_M_actual);
 }
 
+/**
+ * Closed-form field and Jacobian of the dipole model in one pass.
+ *
+ * With r = sensor - magnet and m the orientation unit vector:
+ *   B_i       = M * (3 (m.r) r_i / |r|^5 - m_i / |r|^3)
+ *   dB_i/dr_j = M * (3 (m_j r_i + (m.r) d_ij + m_i r_j) / |r|^5
+ *                    - 15 (m.r) r_i r_j / |r|^7)
+ * The magnet sits at -r, so dB/dx = -dB/dr_x and dB/dy = -dB/dr_y, and
+ * dB/dM is simply B / M.
+ *
+ * Returns false inside the r < 1 clamp of position_compute_dipole_field(),
+ * where the model is flat and the closed form no longer matches it.
+ */
+static bool dipole_field_and_jacobian(float magnet_x, float magnet_y, float M,
+                                      const struct sensor_pos *sensor,
+                                      struct vec3_f *B_out,
+                                      float J_out[3][3])
+{
+    const float r[3] = {sensor->x - magnet_x,
+                        sensor->y - magnet_y,
+                        sensor->z - g_z0};
+    const float m[3] = {g_m_hat.mx, g_m_hat.my, g_m_hat.mz};
+
+    float r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+    if (r2 < 1.0f)
+    {
+        return false;
+    }
+
+    float inv_r2 = 1.0f / r2;
+    float inv_r3 = inv_r2 / sqrtf(r2);
+    float inv_r5 = inv_r3 * inv_r2;
+    float m_dot_r = m[0] * r[0] + m[1] * r[1] + m[2] * r[2];
+
+    /* Unit-moment field; B = M * f and dB/dM = f */
+    float f[3];
+    for (int i = 0; i < 3; i++)
+    {
+        f[i] = 3.0f * m_dot_r * r[i] * inv_r5 - m[i] * inv_r3;
+    }
+
+    const float a = 3.0f * M * inv_r5;
+    const float b = 15.0f * M * m_dot_r * inv_r5 * inv_r2;
+
+    for (int i = 0; i < 3; i++)
+    {
+        /* Columns 0 and 1 are d/dx and d/dy, i.e. -d/dr_x and -d/dr_y */
+        for (int j = 0; j < 2; j++)
+        {
+            float dB_dr = a * (m[j] * r[i] + m[i] * r[j]) - b * r[i] * r[j];
+            if (i == j)
+            {
+                dB_dr += a * m_dot_r;
+            }
+            J_out[i][j] = -dB_dr;
+        }
+        J_out[i][2] = f[i];
+    }
+
+    if (B_out)
+    {
+        B_out->x = M * f[0];
+        B_out->y = M * f[1];
+        B_out->z = M * f[2];
+    }
+
+    return true;
+}
+
+void position_compute_jacobian_analytic(float magnet_x, float magnet_y, float M,
+                                        const struct sensor_pos *sensor,
+                                        float J_out[3][3])
+{
+    if (!dipole_field_and_jacobian(magnet_x, magnet_y, M, sensor, NULL, J_out))
+    {
+        position_compute_jacobian(magnet_x, magnet_y, M, sensor, J_out);
+    }
+}
+
+/**
+ * Model field plus Jacobian for one sensor, shared by the solver and EKF.
+ * CONFIG_MISOGATE_POSITION_ANALYTIC_JACOBIAN selects the closed form (one
+ * pass) over central differences (seven field evaluations).
+ */
+void position_compute_field_and_jacobian(float magnet_x, float magnet_y, float M,
+                                         const struct sensor_pos *sensor,
+                                         struct vec3_f *B_out,
+                                         float J_out[3][3])
+{
+#if defined(CONFIG_MISOGATE_POSITION_ANALYTIC_JACOBIAN)
+    if (dipole_field_and_jacobian(magnet_x, magnet_y, M, sensor, B_out, J_out))
+    {
+        return;
+    }
+#endif
+    position_compute_dipole_field(magnet_x, magnet_y, M, sensor, B_out);
+    position_compute_jacobian(magnet_x, magnet_y, M, sensor, J_out);
+}
+
 /* ------------ Gauss-Newton Solver ------------ */
 
 /**
@@ -243,15 +360,9 @@ bool position_estimate_dipole(const struct node_state *nodes,
                               const struct position_estimate *initial_guess,
                               struct position_estimate *result)
 {
-    /* Count valid sensors */
-    int valid_sensors = 0;
-    for (int i = 1; i <= MAX_NODES; i++)
-    {
-        if (nodes[i].have_baseline)
-        {
-            valid_sensors++;
-        }
-    }
+    /* Strongest sensors first; the rest add cost but little information */
+    uint8_t ids[POSITION_SOLVER_NODES];
+    int valid_sensors = position_select_nodes(nodes, ids);
 
     if (valid_sensors < 2)
     {
@@ -276,38 +387,13 @@ bool position_estimate_dipole(const struct node_state *nodes,
     else
     {
         /* Smart initialization: Start at the sensor with the strongest signal */
-        float max_B2 = -1.0f;
-        int max_node = 0;
-
-        for (int i = 1; i <= MAX_NODES; i++)
-        {
-            if (nodes[i].have_baseline)
-            {
-                float B2 = (float)nodes[i].last_B_mag.x * nodes[i].last_B_mag.x +
-                           (float)nodes[i].last_B_mag.y * nodes[i].last_B_mag.y +
-                           (float)nodes[i].last_B_mag.z * nodes[i].last_B_mag.z;
-                if (B2 > max_B2)
-                {
-                    max_B2 = B2;
-                    max_node = i;
-                }
-            }
-        }
+        int max_node = ids[0];
 
-        if (max_node > 0)
-        {
-            theta[0] = g_sensor_pos[max_node].x;
-            theta[1] = g_sensor_pos[max_node].y;
-            /* Offset slightly to avoid singularity if r=0 */
-            theta[0] += 0.1f;
-            theta[1] += 0.1f;
-        }
-        else
-        {
-            /* Default: center of region */
-            theta[0] = 500.0f;
-            theta[1] = 500.0f;
-        }
+        theta[0] = g_sensor_pos[max_node].x;
+        theta[1] = g_sensor_pos[max_node].y;
+        /* Offset slightly to avoid singularity if r=0 */
+        theta[0] += 0.1f;
+        theta[1] += 0.1f;
 
         theta[2] = 1.0e10f; /* Improved initial M guess */
     }
@@ -327,22 +413,19 @@ bool position_estimate_dipole(const struct node_state *nodes,
         float Jtr[3] = {0};
         float total_error = 0.0f;
 
-        for (int nid = 1; nid <= MAX_NODES; nid++)
+        for (int k = 0; k < valid_sensors; k++)
         {
-            if (!nodes[nid].have_baseline)
-            {
-                continue;
-            }
-
+            int nid = ids[k];
             const struct sensor_pos *sensor = &g_sensor_pos[nid];
 
             /* Get measured magnet-induced field (already baseline-subtracted) */
             struct vec3_f B_measured;
             vec3_i32_to_f(&B_measured, &nodes[nid].last_B_mag);
 
-            /* Compute model prediction */
+            /* Compute model prediction and Jacobian for this sensor */
             struct vec3_f B_model;
-            position_compute_dipole_field(theta[0], theta[1], theta[2], sensor, &B_model);
+            float J[3][3]; /* J[component][parameter] = dB_component/d_parameter */
+            position_compute_field_and_jacobian(theta[0], theta[1], theta[2], sensor, &B_model, J);
 
             /* Residual: r = B_measured - B_model */
             struct vec3_f r;
@@ -351,10 +434,6 @@ bool position_estimate_dipole(const struct node_state *nodes,
             /* Accumulate error */
             total_error += r.x * r.x + r.y * r.y + r.z * r.z;
 
-            /* Compute Jacobian for this sensor */
-            float J[3][3]; /* J[component][parameter] = dB_component/d_parameter */
-            position_compute_jacobian(theta[0], theta[1], theta[2], sensor, J);
-
             /* Accumulate J^T J */
             for (int i = 0; i < 3; i++)
             {
@@ -435,13 +514,46 @@ bool position_estimate_dipole(const struct node_state *nodes,
         g_last_estimate = *result;
     }
 
-    LOG_INF("GN result: x=%.1f y=%.1f M=%.1f err=%.1f iter=%d",
+    LOG_DBG("GN result: x=%.1f y=%.1f M=%.1f err=%.1f iter=%d",
             (double)result->x, (double)result->y, (double)result->M,
             (double)result->error, result->iterations);
 
     return true;
 }
 
+/**
+ * Linear least-squares fit of M for a fixed magnet position.
+ *
+ * The field is linear in M (B = M * f), so the best fit over the sensors is
+ * M = sum(f . B) / sum(f . f) with f evaluated at unit moment.
+ */
+float position_estimate_moment(const struct node_state *nodes, float x, float y)
+{
+    uint8_t ids[POSITION_SOLVER_NODES];
+    int count = position_select_nodes(nodes, ids);
+    float num = 0.0f;
+    float den = 0.0f;
+
+    for (int k = 0; k < count; k++)
+    {
+        int nid = ids[k];
+        struct vec3_f f;
+        position_compute_dipole_field(x, y, 1.0f, &g_sensor_pos[nid], &f);
+
+        struct vec3_f B;
+        vec3_i32_to_f(&B, &nodes[nid].last_B_mag);
+
+        num += vec3_dot(&f, &B);
+        den += vec3_dot(&f, &f);
+    }
+
+    if (den <= 0.0f)
+    {
+        return 0.0f;
+    }
+    return num / den;
+}
+
 /* ------------ Lookup Table Method (Fallback) ------------ */
 
 /**
@@ -459,6 +571,9 @@ bool position_estimate_lookup(const struct node_state *nodes,
         return false;
     }
 
+    uint8_t ids[POSITION_SOLVER_NODES];
+    int id_count = position_select_nodes(nodes, ids);
+
     float sum_w = 0.0f;
     float wx = 0.0f;
     float wy = 0.0f;
@@ -471,17 +586,19 @@ bool position_estimate_lookup(const struct node_state *nodes,
         float dist_sq = 0.0f;
         int valid_nodes = 0;
 
-        for (int nid = 1; nid <= MAX_NODES; nid++)
+        for (int k = 0; k < id_count; k++)
         {
-            if (!cp->node_valid[nid] || !nodes[nid].have_baseline)
+            int nid = ids[k];
+            if (!(cp->valid_mask & BIT(nid - 1)))
             {
                 continue;
             }
 
             /* Use 3D field difference */
-            float dx = (float)(nodes[nid].last_B_mag.x - cp->node_B_mag[nid].x);
-            float dy = (float)(nodes[nid].last_B_mag.y - cp->node_B_mag[nid].y);
-            float dz = (float)(nodes[nid].last_B_mag.z - cp->node_B_mag[nid].z);
+            const struct vec3_i32 *B_cal = &cp->node_B_mag[nid - 1];
+            float dx = (float)(nodes[nid].last_B_mag.x - B_cal->x);
+            float dy = (float)(nodes[nid].last_B_mag.y - B_cal->y);
+            float dz = (float)(nodes[nid].last_B_mag.z - B_cal->z);
 
             dist_sq += dx * dx + dy * dy + dz * dz;
             valid_nodes++;
@@ -538,17 +655,17 @@ bool position_estimate_triangulation(const struct node_state *nodes,
                                      float *out_x,
                                      float *out_y)
 {
+    uint8_t ids[POSITION_SOLVER_NODES];
+    int count = position_select_nodes(nodes, ids);
+
     float sum_weights = 0.0f;
     float weighted_x = 0.0f;
     float weighted_y = 0.0f;
     int valid_sensors = 0;
 
-    for (int i = 1; i <= MAX_NODES; i++)
+    for (int k = 0; k < count; k++)
     {
-        if (!nodes[i].have_baseline)
-        {
-            continue;
-        }
+        int i = ids[k];
 
         /* Compute magnitude of magnet-induced field */
         float Bx = (float)nodes[i].last_B_mag.x;
@@ -610,7 +727,7 @@ bool position_estimate_triangulation(const struct node_state *nodes,
     if (*out_y > 1000.0f)
         *out_y = 1000.0f;
 
-    LOG_INF("Triangulation result: x=%.1f y=%.1f (from %d sensors)",
+    LOG_DBG("Triangulation result: x=%.1f y=%.1f (from %d sensors)",
             (double)*out_x, (double)*out_y, valid_sensors);
 
     return true;
@@ -659,13 +776,13 @@ bool position_estimate_2D(const struct node_state *nodes,
 void position_init(void)
 {
     /* Initialize with default sensor positions */
-    LOG_INF("Position module initialized");
-    LOG_INF("Sensor 1: (%.0f, %.0f, %.0f)", (double)g_sensor_pos[1].x,
-            (double)g_sensor_pos[1].y, (double)g_sensor_pos[1].z);
-    LOG_INF("Sensor 2: (%.0f, %.0f, %.0f)", (double)g_sensor_pos[2].x,
-            (double)g_sensor_pos[2].y, (double)g_sensor_pos[2].z);
-    LOG_INF("Sensor 3: (%.0f, %.0f, %.0f)", (double)g_sensor_pos[3].x,
-            (double)g_sensor_pos[3].y, (double)g_sensor_pos[3].z);
+    LOG_INF("Position module initialized (%d of %d nodes, %d per solve)",
+            position_get_node_count(), MAX_NODES, POSITION_SOLVER_NODES);
+    for (int i = 1; i <= position_get_node_count(); i++)
+    {
+        LOG_INF("Sensor %d: (%.0f, %.0f, %.0f)", i, (double)g_sensor_pos[i].x,
+                (double)g_sensor_pos[i].y, (double)g_sensor_pos[i].z);
+    }
     LOG_INF("Magnet plane height z0=%.1f", (double)g_z0);
     LOG_INF("Dipole orientation m_hat=(%.2f, %.2f, %.2f)",
             (double)g_m_hat.mx, (double)g_m_hat.my, (double)g_m_hat.mz);
@@ -673,12 +790,141 @@ void position_init(void)
 
 void position_set_sensor_positions(const struct sensor_pos *positions)
 {
-    for (int i = 1; i <= MAX_NODES; i++)
+    k_mutex_lock(&layout_mutex, K_FOREVER);
+    for (int i = 1; i <= position_get_node_count(); i++)
     {
         g_sensor_pos[i] = positions[i];
         g_node_pos[i].x = positions[i].x;
         g_node_pos[i].y = positions[i].y;
     }
+    g_last_estimate.converged = false;
+    k_mutex_unlock(&layout_mutex);
+}
+
+int position_set_node_count(int count)
+{
+    if (count < 2 || count > MAX_NODES)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&layout_mutex, K_FOREVER);
+    atomic_set(&g_node_count, count);
+    g_last_estimate.converged = false;
+    k_mutex_unlock(&layout_mutex);
+
+    LOG_INF("Node count set to %d", count);
+    return 0;
+}
+
+int position_get_node_count(void)
+{
+    return (int)atomic_get(&g_node_count);
+}
+
+int position_set_sensor(int node_id, const struct sensor_pos *pos)
+{
+    if (node_id < 1 || node_id > position_get_node_count() || !pos)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&layout_mutex, K_FOREVER);
+    g_sensor_pos[node_id] = *pos;
+    g_node_pos[node_id].x = pos->x;
+    g_node_pos[node_id].y = pos->y;
+    g_last_estimate.converged = false;
+    k_mutex_unlock(&layout_mutex);
+
+    LOG_INF("Sensor %d: (%.0f, %.0f, %.0f)", node_id,
+            (double)pos->x, (double)pos->y, (double)pos->z);
+    return 0;
+}
+
+void position_layout_lock(void)
+{
+    k_mutex_lock(&layout_mutex, K_FOREVER);
+}
+
+void position_layout_unlock(void)
+{
+    k_mutex_unlock(&layout_mutex);
+}
+
+int position_select_nodes(const struct node_state *nodes,
+                          uint8_t ids[POSITION_SOLVER_NODES])
+{
+    float strength[POSITION_SOLVER_NODES];
+    int count = 0;
+    int node_count = position_get_node_count();
+
+    /* Insertion into a short sorted list: O(nodes * k), no allocation */
+    for (int nid = 1; nid <= node_count; nid++)
+    {
+        if (!nodes[nid].have_baseline)
+        {
+            continue;
+        }
+
+        float B2 = (float)nodes[nid].last_B_mag.x * nodes[nid].last_B_mag.x +
+                   (float)nodes[nid].last_B_mag.y * nodes[nid].last_B_mag.y +
+                   (float)nodes[nid].last_B_mag.z * nodes[nid].last_B_mag.z;
+
+        if (count == POSITION_SOLVER_NODES && B2 <= strength[count - 1])
+        {
+            continue;
+        }
+
+        int pos = (count < POSITION_SOLVER_NODES) ? count++ : count - 1;
+        while (pos > 0 && strength[pos - 1] < B2)
+        {
+            strength[pos] = strength[pos - 1];
+            ids[pos] = ids[pos - 1];
+            pos--;
+        }
+        strength[pos] = B2;
+        ids[pos] = (uint8_t)nid;
+    }
+
+    return count;
+}
+
+void position_align_nodes(const struct node_state *nodes, int64_t epoch_ms,
+                          struct node_state *aligned)
+{
+    int node_count = position_get_node_count();
+
+    for (int nid = 1; nid <= node_count; nid++)
+    {
+        const struct node_state *ns = &nodes[nid];
+        aligned[nid] = *ns;
+
+        int64_t span = ns->last_sample_ms - ns->prev_sample_ms;
+        int64_t ahead = epoch_ms - ns->last_sample_ms;
+        if (!ns->have_baseline || ns->prev_sample_ms == 0 || span <= 0 ||
+            span > POSITION_ALIGN_MAX_SPAN_MS || ahead <= 0)
+        {
+            continue;
+        }
+
+        float dx = (float)(ns->last_B_mag.x - ns->prev_B_mag.x);
+        float dy = (float)(ns->last_B_mag.y - ns->prev_B_mag.y);
+        float dz = (float)(ns->last_B_mag.z - ns->prev_B_mag.z);
+
+        /* The difference of two samples carries sqrt(2) times their noise;
+         * below three sigma of that the change is not followed */
+        float min_step = fmaxf(POSITION_ALIGN_MIN_STEP_MUT,
+                               4.24f * (float)ns->last_noise_mut);
+        if (dx * dx + dy * dy + dz * dz <= min_step * min_step)
+        {
+            continue;
+        }
+
+        float k = (float)MIN(ahead, POSITION_ALIGN_MAX_PREDICT_MS) / (float)span;
+        aligned[nid].last_B_mag.x = ns->last_B_mag.x + (int32_t)lrintf(k * dx);
+        aligned[nid].last_B_mag.y = ns->last_B_mag.y + (int32_t)lrintf(k * dy);
+        aligned[nid].last_B_mag.z = ns->last_B_mag.z + (int32_t)lrintf(k * dz);
+    }
 }
 
 void position_set_dipole_orientation(float mx, float my, float mz)
@@ -709,7 +955,7 @@ int32_t position_compute_absB(int32_t x_uT_milli, int32_t y_uT_milli, int32_t z_
 
 const struct node_pos *position_get_node_pos(int node_id)
 {
-    if (node_id < 1 || node_id > MAX_NODES)
+    if (node_id < 1 || node_id > position_get_node_count())
     {
         return NULL;
     }
@@ -718,7 +964,7 @@ const struct node_pos *position_get_node_pos(int node_id)
 
 const struct sensor_pos *position_get_sensor_pos(int node_id)
 {
-    if (node_id < 1 || node_id > MAX_NODES)
+    if (node_id < 1 || node_id > position_get_node_count())
     {
         return NULL;
     }
@@ -24,6 +24,33 @@
 #define GN_CONVERGENCE_THRESHOLD 0.1f /* Position change threshold to stop */
 #define GN_DAMPING_FACTOR 0.5f        /* Damping for stability */
 
+/**
+ * @brief Upper bound on the nodes used by a single solve
+ *
+ * Only the nodes with the strongest magnet-induced field are used.
+ */
+#define POSITION_SOLVER_NODES                                        \
+    (CONFIG_MISOGATE_POSITION_SOLVER_NODES < MAX_NODES               \
+         ? CONFIG_MISOGATE_POSITION_SOLVER_NODES                     \
+         : MAX_NODES)
+
+/**
+ * @brief Time alignment of the node readings (see position_align_nodes())
+ *
+ * A node's field is only carried forward along the change between its last
+ * two samples if they are at most MAX_SPAN_MS apart and the change stands
+ * clear of the sensor noise; it is carried forward by at most
+ * MAX_PREDICT_MS, past which a straight line no longer follows the field.
+ */
+#define POSITION_ALIGN_MAX_SPAN_MS 2000
+#define POSITION_ALIGN_MAX_PREDICT_MS 1500
+#define POSITION_ALIGN_MIN_STEP_MUT 200.0f /* Smallest change followed (m-uT) */
+
+/**
+ * @brief Number of nodes deployed at boot (the three-corner layout)
+ */
+#define POSITION_DEFAULT_NODE_COUNT 3
+
 /* ------------ Sensor and Magnet Configuration ------------ */
 
 /**
@@ -86,10 +113,85 @@ void position_init(void);
 /**
  * @brief Set the sensor positions in 3D space
  *
- * @param positions Array of sensor positions (indexed 1 to MAX_NODES)
+ * @param positions Array of sensor positions (indexed 1 to the node count)
  */
 void position_set_sensor_positions(const struct sensor_pos *positions);
 
+/**
+ * @brief Set the number of deployed nodes
+ *
+ * Nodes 1 to count are active. Newly activated nodes keep whatever position
+ * they were last given (the origin if never set), so configure them with
+ * position_set_sensor() before tracking starts.
+ *
+ * @param count Node count (2 to MAX_NODES)
+ * @return 0 on success, -EINVAL if out of range
+ */
+int position_set_node_count(int count);
+
+/**
+ * @brief Get the number of deployed nodes
+ *
+ * Safe to call from any thread without the layout lock.
+ *
+ * @return Active node count
+ */
+int position_get_node_count(void);
+
+/**
+ * @brief Lock the node layout against changes
+ *
+ * The setters above take the lock themselves. A thread other than the one
+ * changing the layout holds it across anything that reads the sensor
+ * positions - the solvers, the EKF update and pointers from
+ * position_get_sensor_pos() - so a solve sees one consistent layout.
+ * The lock may be nested.
+ */
+void position_layout_lock(void);
+
+/**
+ * @brief Release the node layout lock
+ */
+void position_layout_unlock(void);
+
+/**
+ * @brief Set the position of a single sensor
+ *
+ * @param node_id Node ID (1 to the node count)
+ * @param pos Sensor position
+ * @return 0 on success, -EINVAL if the node is not active
+ */
+int position_set_sensor(int node_id, const struct sensor_pos *pos);
+
+/**
+ * @brief Pick the nodes a solve should use
+ *
+ * Selects up to POSITION_SOLVER_NODES active nodes with a baseline, ordered
+ * by decreasing magnet-induced field magnitude.
+ *
+ * @param nodes Array of node states (indexed by node ID)
+ * @param ids Output node IDs, strongest first
+ * @return Number of IDs written
+ */
+int position_select_nodes(const struct node_state *nodes,
+                          uint8_t ids[POSITION_SOLVER_NODES]);
+
+/**
+ * @brief Bring the node readings to a common time before a full solve
+ *
+ * Nodes report at different times, so while the magnet moves the newest
+ * reading of one node and a second-old reading of another describe two
+ * different positions. Each active node's magnet field is predicted at
+ * @p epoch_ms from the change between its last two samples, within the
+ * POSITION_ALIGN_* limits; otherwise its last field is kept as it is.
+ *
+ * @param nodes Array of node states (indexed by node ID)
+ * @param epoch_ms Gateway time to align to, normally the newest sample
+ * @param aligned Output copy of @p nodes with last_B_mag aligned
+ */
+void position_align_nodes(const struct node_state *nodes, int64_t epoch_ms,
+                          struct node_state *aligned);
+
 /**
  * @brief Set the dipole orientation unit vector
  *
@@ -189,7 +291,7 @@ bool position_estimate_2D(const struct node_state *nodes,
 /**
  * @brief Get the physical position of a sensor node
  *
- * @param node_id Node ID (1 to MAX_NODES)
+ * @param node_id Node ID (1 to the node count)
  * @return Pointer to node position, or NULL if invalid ID
  */
 const struct node_pos *position_get_node_pos(int node_id);
@@ -197,7 +299,10 @@ const struct node_pos *position_get_node_pos(int node_id);
 /**
  * @brief Get the 3D position of a sensor
  *
- * @param node_id Node ID (1 to MAX_NODES)
+ * The pointer is only stable while the layout lock is held (see
+ * position_layout_lock()).
+ *
+ * @param node_id Node ID (1 to the node count)
  * @return Pointer to sensor position, or NULL if invalid ID
  */
 const struct sensor_pos *position_get_sensor_pos(int node_id);
@@ -241,4 +346,57 @@ void position_compute_jacobian(float magnet_x, float magnet_y, float M,
                                const struct sensor_pos *sensor,
                                float J_out[3][3]);
 
+/**
+ * @brief Closed-form Jacobian of the dipole field w.r.t. parameters (x, y, M)
+ *
+ * Same layout as position_compute_jacobian() but evaluated analytically from
+ * the dipole equation instead of by central differences. Falls back to the
+ * finite-difference version inside the r < 1 clamp of the field model.
+ *
+ * The Gauss-Newton solver uses this path (fused with the field evaluation,
+ * see position_compute_field_and_jacobian()) when
+ * CONFIG_MISOGATE_POSITION_ANALYTIC_JACOBIAN is enabled.
+ *
+ * @param magnet_x Magnet X position
+ * @param magnet_y Magnet Y position
+ * @param M Dipole moment scale factor
+ * @param sensor Sensor position
+ * @param J_out Output: 3x3 Jacobian matrix [dBx/dx, dBx/dy, dBx/dM; ...]
+ */
+void position_compute_jacobian_analytic(float magnet_x, float magnet_y, float M,
+                                        const struct sensor_pos *sensor,
+                                        float J_out[3][3]);
+
+/**
+ * @brief Compute the model field and its Jacobian in one call
+ *
+ * Uses the closed-form Jacobian when CONFIG_MISOGATE_POSITION_ANALYTIC_JACOBIAN
+ * is enabled, otherwise the field model plus central differences. This is the
+ * linearization used by both the Gauss-Newton solver and the EKF.
+ *
+ * @param magnet_x Magnet X position
+ * @param magnet_y Magnet Y position
+ * @param M Dipole moment scale factor
+ * @param sensor Sensor position
+ * @param B_out Output: computed field at sensor location
+ * @param J_out Output: 3x3 Jacobian matrix [dBx/dx, dBx/dy, dBx/dM; ...]
+ */
+void position_compute_field_and_jacobian(float magnet_x, float magnet_y, float M,
+                                         const struct sensor_pos *sensor,
+                                         struct vec3_f *B_out,
+                                         float J_out[3][3]);
+
+/**
+ * @brief Least-squares dipole moment for a known magnet position
+ *
+ * The dipole field is linear in M, so this is a closed-form fit over all
+ * sensors with a baseline. Used to seed M from a triangulated position.
+ *
+ * @param nodes Array of node states with baseline-subtracted 3D fields
+ * @param x Magnet X position
+ * @param y Magnet Y position
+ * @return Best-fit M, or 0 if no sensor carries information
+ */
+float position_estimate_moment(const struct node_state *nodes, float x, float y);
+
 #endif /* POSITION_H */
@@ -5,3 +5,8 @@
 /* SipHash-2-4, 64-bit tag */
 void siphash24(uint8_t tag[8], const uint8_t *msg, size_t msg_len, const uint8_t key[16]);
 
+/* SipHash-2-4 tags of the 9-byte messages prefix || i, i = 0, 1, ...,
+ * written back to back as n bytes (at most 2048). Same output as calling
+ * siphash24() per block, but the key setup and the prefix word are done
+ * once for all of them. */
+void siphash24_ctr(uint8_t *out, size_t n, const uint8_t prefix[8], const uint8_t key[16]);
@@ -0,0 +1,102 @@
+/**
+ * @file tdma.c
+ * @brief Beacon-scheduled slots for the node uplinks
+ *
+ * All nodes share one channel. Left to free-run, their frames collide more
+ * often the more nodes there are, and most often when several of them see
+ * the magnet and report at their highest rate. Instead the gateway opens
+ * every superframe with a beacon carrying its clock and a slot map; each
+ * node transmits only at the start of its own slot.
+ *
+ * The schedule is static: node k owns slot k. Nodes that have not heard a
+ * beacon yet keep transmitting whenever they like, and their frames are
+ * still accepted, only timed by their arrival.
+ *
+ * Beacons are sealed with the gateway's boot epoch and numbered from 1
+ * within it, the same (epoch, counter) scheme as the node frames, so no
+ * keystream is used twice and the nodes can drop replayed beacons.
+ *
+ * Only the LoRa RX thread calls in here, apart from tdma_get_stats().
+ */
+
+#include <string.h>
+
+#include "packet.h"
+#include "tdma.h"
+
+static uint16_t beacon_epoch;
+static uint32_t beacon_seq;
+static int64_t sf_start_ms; /* Start of the current superframe's beacon */
+static int sf_slots;        /* Slots in it, 0 before the first beacon */
+static struct tdma_stats stats;
+
+void tdma_init(uint16_t epoch)
+{
+    beacon_epoch = epoch;
+    beacon_seq = 0;
+    sf_start_ms = 0;
+    sf_slots = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+size_t tdma_build_beacon(int64_t now_ms, int node_count, uint8_t *out, size_t out_max)
+{
+    if (beacon_epoch == 0 || node_count < 1 || node_count > BEACON_SLOTS_MAX - 1)
+    {
+        return 0;
+    }
+
+    struct beacon b = {
+        .slots = (uint8_t)(node_count + 1),
+        .slot_ms = TDMA_SLOT_MS,
+        .epoch_ms = (uint32_t)now_ms,
+    };
+    for (int k = 1; k <= node_count; k++)
+    {
+        b.owner[k] = (uint8_t)k;
+    }
+
+    size_t len = packet_build_beacon(&b, beacon_epoch, beacon_seq + 1, out, out_max);
+    if (len)
+    {
+        beacon_seq++;
+        sf_start_ms = now_ms;
+        sf_slots = b.slots;
+        stats.beacons++;
+    }
+    return len;
+}
+
+int64_t tdma_next_beacon_ms(void)
+{
+    if (sf_slots == 0)
+    {
+        return INT64_MIN;
+    }
+    return sf_start_ms + (int64_t)sf_slots * TDMA_SLOT_MS;
+}
+
+bool tdma_slot_start(uint8_t node_id, int64_t rx_ms, int64_t *tx_ms)
+{
+    if (node_id == BEACON_NODE_ID || node_id >= sf_slots)
+    {
+        stats.out_of_slot++;
+        return false;
+    }
+
+    int64_t start = sf_start_ms + (int64_t)node_id * TDMA_SLOT_MS;
+    if (rx_ms < start || rx_ms > start + TDMA_SLOT_MS)
+    {
+        stats.out_of_slot++;
+        return false;
+    }
+
+    *tx_ms = start;
+    stats.in_slot++;
+    return true;
+}
+
+void tdma_get_stats(struct tdma_stats *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,86 @@
+#ifndef TDMA_H
+#define TDMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Length of one TDMA slot (ms)
+ *
+ * Slot 0 of each superframe carries the beacon, slot k the frame of the
+ * node the beacon assigns to it.
+ */
+#define TDMA_SLOT_MS CONFIG_MISOGATE_TDMA_SLOT_MS
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief Beacon counters
+ */
+struct tdma_stats
+{
+    uint32_t beacons;     /* Beacons sent */
+    uint32_t in_slot;     /* Frames received inside their sender's slot */
+    uint32_t out_of_slot; /* Frames from nodes not (yet) following the schedule */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Forget the schedule and clear the counters
+ *
+ * Beacons are sealed with @p epoch and counted from 1, so their keystreams
+ * never repeat across boots as long as every boot has a new epoch (see
+ * boot_epoch_next()). With epoch 0 no beacons are built and the nodes
+ * transmit unscheduled.
+ *
+ * @param epoch This boot's epoch, 0 if none could be stored
+ */
+void tdma_init(uint16_t epoch);
+
+/**
+ * @brief Build the beacon that opens a superframe
+ *
+ * Nodes 1 to @p node_count get slots 1 to @p node_count, so a superframe
+ * is node_count + 1 slots long. The superframe is remembered for
+ * tdma_slot_start().
+ *
+ * @param now_ms Gateway time the beacon goes out (k_uptime_get())
+ * @param node_count Nodes in the array
+ * @param out Frame
+ * @param out_max Size of @p out
+ * @return Frame length, 0 if it could not be built or there is no epoch
+ */
+size_t tdma_build_beacon(int64_t now_ms, int node_count, uint8_t *out, size_t out_max);
+
+/**
+ * @brief Gateway time the next beacon is due
+ *
+ * @return End of the current superframe, or INT64_MIN before the first beacon
+ */
+int64_t tdma_next_beacon_ms(void);
+
+/**
+ * @brief When a frame was sent
+ *
+ * A node that follows the schedule starts transmitting exactly at its slot
+ * start, and stamps its samples against that instant. Call from the thread
+ * that builds the beacons, as frames come off the radio.
+ *
+ * @param node_id Sender (cleartext frame header)
+ * @param rx_ms Gateway time the reception completed
+ * @param tx_ms Output start of the sender's slot
+ * @return true if the frame ended inside the sender's slot of the current
+ *         superframe, false otherwise (*tx_ms untouched)
+ */
+bool tdma_slot_start(uint8_t node_id, int64_t rx_ms, int64_t *tx_ms);
+
+/**
+ * @brief Get the counters
+ */
+void tdma_get_stats(struct tdma_stats *stats);
+
+#endif /* TDMA_H */
@@ -0,0 +1,197 @@
+/**
+ * @file telemetry.c
+ * @brief Binary event ring for per-packet observability
+ *
+ * Recording an event is a fixed-size copy under a spinlock, so packet,
+ * solve and failed publish events can be kept at any packet rate without
+ * the cost of formatting a log line in the frame processing path. Events
+ * are decoded to text only when someone asks for them (console or MQTT).
+ * Successful publishes, one per publish period, are only counted.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+BUILD_ASSERT((TELEMETRY_EVENTS & (TELEMETRY_EVENTS - 1)) == 0,
+             "CONFIG_MISOGATE_TELEMETRY_EVENTS must be a power of two");
+
+static struct telem_event ring[TELEMETRY_EVENTS];
+static uint32_t next_seq; /* Sequence number of the next event recorded */
+static uint32_t published; /* Successful publishes, not kept as events */
+static struct k_spinlock ring_lock;
+
+/* ------------ Internal Helpers ------------ */
+
+static uint32_t oldest_seq(void)
+{
+    return next_seq > TELEMETRY_EVENTS ? next_seq - TELEMETRY_EVENTS : 0;
+}
+
+static void record(struct telem_event *ev)
+{
+    ev->t_ms = k_uptime_get_32();
+
+    k_spinlock_key_t key = k_spin_lock(&ring_lock);
+    ev->seq = next_seq++;
+    ring[ev->seq % TELEMETRY_EVENTS] = *ev;
+    k_spin_unlock(&ring_lock, key);
+}
+
+static int16_t to_x10(float v)
+{
+    float s = v * 10.0f;
+    if (s > 32767.0f)
+        return 32767;
+    if (s < -32768.0f)
+        return -32768;
+    return (int16_t)s;
+}
+
+/* ------------ Public API ------------ */
+
+void telemetry_init(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&ring_lock);
+    memset(ring, 0, sizeof(ring));
+    next_seq = 0;
+    published = 0;
+    k_spin_unlock(&ring_lock, key);
+}
+
+void telemetry_record_packet(const struct sensor_frame *f,
+                             const struct vec3_i32 *B_mag,
+                             int16_t rssi,
+                             int8_t snr)
+{
+    struct telem_event ev = {
+        .type = TELEM_EV_PACKET,
+        .node_id = f->node_id,
+        .status = rssi,
+        .packet = {
+            .tx_seq = f->tx_seq,
+            .B_mag = *B_mag,
+            .temp_c_times10 = f->temp_c_times10,
+            .snr = snr,
+        },
+    };
+    record(&ev);
+}
+
+void telemetry_record_solve(uint8_t solver, uint8_t node_id, int status,
+                            float x, float y, float pos_std, uint32_t solve_us)
+{
+    struct telem_event ev = {
+        .type = TELEM_EV_SOLVE,
+        .node_id = node_id,
+        .status = (int16_t)status,
+        .solve = {
+            .solver = solver,
+            .solve_us = solve_us,
+        },
+    };
+
+    if (status == 0)
+    {
+        ev.solve.x_x10 = to_x10(x);
+        ev.solve.y_x10 = to_x10(y);
+        ev.solve.std_x10 = (uint16_t)to_x10(pos_std < 0.0f ? 0.0f : pos_std);
+    }
+    record(&ev);
+}
+
+void telemetry_record_publish(int x, int y, int status)
+{
+    if (status == 0)
+    {
+        k_spinlock_key_t key = k_spin_lock(&ring_lock);
+        published++;
+        k_spin_unlock(&ring_lock, key);
+        return;
+    }
+
+    struct telem_event ev = {
+        .type = TELEM_EV_PUBLISH,
+        .status = (int16_t)status,
+        .publish = {
+            .x = (int16_t)x,
+            .y = (int16_t)y,
+        },
+    };
+    record(&ev);
+}
+
+uint32_t telemetry_cursor_latest(uint32_t count)
+{
+    k_spinlock_key_t key = k_spin_lock(&ring_lock);
+    uint32_t cursor = next_seq > count ? next_seq - count : 0;
+    if (cursor < oldest_seq())
+    {
+        cursor = oldest_seq();
+    }
+    k_spin_unlock(&ring_lock, key);
+
+    return cursor;
+}
+
+size_t telemetry_read(uint32_t *cursor, struct telem_event *out, size_t max)
+{
+    size_t n = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&ring_lock);
+    uint32_t seq = *cursor < oldest_seq() ? oldest_seq() : *cursor;
+    while (n < max && seq < next_seq)
+    {
+        out[n++] = ring[seq % TELEMETRY_EVENTS];
+        seq++;
+    }
+    k_spin_unlock(&ring_lock, key);
+
+    *cursor = seq;
+    return n;
+}
+
+int telemetry_format_json(const struct telem_event *ev, char *buf, size_t len)
+{
+    switch (ev->type)
+    {
+    /* Decoding is off the hot path, float formatting is fine here */
+    case TELEM_EV_PACKET:
+        return snprintf(buf, len,
+                        "{\"n\":%u,\"t\":%u,\"ev\":\"pkt\",\"node\":%u,\"seq\":%u,"
+                        "\"B_mag\":[%d,%d,%d],\"T\":%.1f,\"rssi\":%d,\"snr\":%d}",
+                        (unsigned)ev->seq, (unsigned)ev->t_ms, (unsigned)ev->node_id,
+                        (unsigned)ev->packet.tx_seq, ev->packet.B_mag.x,
+                        ev->packet.B_mag.y, ev->packet.B_mag.z,
+                        ev->packet.temp_c_times10 / 10.0, ev->status,
+                        ev->packet.snr);
+    case TELEM_EV_SOLVE:
+        return snprintf(buf, len,
+                        "{\"n\":%u,\"t\":%u,\"ev\":\"solve\",\"node\":%u,"
+                        "\"solver\":\"%s\",\"rc\":%d,\"x\":%.1f,\"y\":%.1f,"
+                        "\"std\":%.1f,\"us\":%u}",
+                        (unsigned)ev->seq, (unsigned)ev->t_ms, (unsigned)ev->node_id,
+                        ev->solve.solver == TELEM_SOLVER_EKF ? "ekf" : "2d",
+                        ev->status, ev->solve.x_x10 / 10.0, ev->solve.y_x10 / 10.0,
+                        ev->solve.std_x10 / 10.0, (unsigned)ev->solve.solve_us);
+    case TELEM_EV_PUBLISH:
+        return snprintf(buf, len,
+                        "{\"n\":%u,\"t\":%u,\"ev\":\"pub\",\"x\":%d,\"y\":%d,\"rc\":%d}",
+                        (unsigned)ev->seq, (unsigned)ev->t_ms, ev->publish.x,
+                        ev->publish.y, ev->status);
+    default:
+        return -EINVAL;
+    }
+}
+
+void telemetry_get_stats(struct telemetry_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&ring_lock);
+    stats->recorded = next_seq;
+    stats->overwritten = oldest_seq();
+    stats->published = published;
+    k_spin_unlock(&ring_lock, key);
+}
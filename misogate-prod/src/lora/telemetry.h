@@ -0,0 +1,162 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "lora.h"
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Events kept in the ring (power of two); oldest are overwritten
+ */
+#define TELEMETRY_EVENTS CONFIG_MISOGATE_TELEMETRY_EVENTS
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief Event types
+ */
+enum telem_type
+{
+    TELEM_EV_PACKET = 1, /* Valid frame received from a node */
+    TELEM_EV_SOLVE,      /* Position estimate after a frame */
+    TELEM_EV_PUBLISH,    /* Position dropped or left out of the backlog */
+};
+
+/**
+ * @brief Estimator that produced a solve event
+ */
+enum telem_solver
+{
+    TELEM_SOLVER_EKF = 1, /* EKF single-node update */
+    TELEM_SOLVER_2D,      /* position_estimate_2D() */
+};
+
+/**
+ * @brief One fixed-size binary event record
+ *
+ * Values are stored as the integers they were computed as, or as fixed
+ * point where noted, so recording never formats anything.
+ */
+struct telem_event
+{
+    uint32_t seq;  /* Running event number, gaps mean overwritten events */
+    uint32_t t_ms; /* k_uptime_get_32() when recorded */
+    uint8_t type;  /* enum telem_type */
+    uint8_t node_id;
+    int16_t status; /* Packet: RSSI; solve/publish: 0 or negative errno */
+
+    union
+    {
+        struct
+        {
+            uint32_t tx_seq;
+            struct vec3_i32 B_mag; /* Baseline-subtracted field (m-uT) */
+            int16_t temp_c_times10;
+            int8_t snr;
+        } packet;
+
+        struct
+        {
+            int16_t x_x10;     /* Position, 0.1 units */
+            int16_t y_x10;
+            uint16_t std_x10;  /* EKF 1-sigma position std, 0.1 units (0 if n/a) */
+            uint8_t solver;    /* enum telem_solver */
+            uint32_t solve_us; /* Time spent in the solve */
+        } solve;
+
+        struct
+        {
+            int16_t x; /* Published position (0-1000) */
+            int16_t y;
+        } publish;
+    };
+};
+
+/**
+ * @brief Ring counters
+ */
+struct telemetry_stats
+{
+    uint32_t recorded;    /* Events ever recorded */
+    uint32_t overwritten; /* Events pushed out of the ring by newer ones */
+    uint32_t published;   /* Positions queued without a problem (no event) */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Clear the ring
+ */
+void telemetry_init(void);
+
+/**
+ * @brief Record a received frame
+ */
+void telemetry_record_packet(const struct sensor_frame *f,
+                             const struct vec3_i32 *B_mag,
+                             int16_t rssi,
+                             int8_t snr);
+
+/**
+ * @brief Record a position solve
+ *
+ * @param solver enum telem_solver
+ * @param node_id Node whose frame triggered the solve
+ * @param status 0 if a position was produced, negative errno otherwise
+ * @param x, y Estimated position (ignored if status != 0)
+ * @param pos_std 1-sigma position uncertainty, or 0 if not available
+ * @param solve_us Time spent solving
+ */
+void telemetry_record_solve(uint8_t solver, uint8_t node_id, int status,
+                            float x, float y, float pos_std, uint32_t solve_us);
+
+/**
+ * @brief Record a position queued for publishing
+ *
+ * Positions are queued every publish period, so a successful one is only
+ * counted (telemetry_stats.published) and does not push the packet and
+ * solve events out of the ring; only a failure is recorded as an event.
+ *
+ * @param x, y Queued position
+ * @param status Result of mqtt_queue_position() (0, -ENOBUFS if an older
+ *               one was dropped, -EAGAIN if left out of the backlog)
+ */
+void telemetry_record_publish(int x, int y, int status);
+
+/**
+ * @brief Cursor pointing at the newest @p count events
+ *
+ * @param count How many of the most recent events to read
+ * @return Cursor for telemetry_read()
+ */
+uint32_t telemetry_cursor_latest(uint32_t count);
+
+/**
+ * @brief Copy events out of the ring, oldest first
+ *
+ * Starts at *cursor (or the oldest event still held, if it was already
+ * overwritten) and advances the cursor past the events returned.
+ *
+ * @param cursor In/out event sequence number to read from
+ * @param out Destination
+ * @param max Capacity of out
+ * @return Number of events copied
+ */
+size_t telemetry_read(uint32_t *cursor, struct telem_event *out, size_t max);
+
+/**
+ * @brief Decode one event into a single-line JSON object
+ *
+ * @return Length written (as snprintf), or negative on error
+ */
+int telemetry_format_json(const struct telem_event *ev, char *buf, size_t len);
+
+/**
+ * @brief Get ring counters
+ */
+void telemetry_get_stats(struct telemetry_stats *stats);
+
+#endif /* TELEMETRY_H */
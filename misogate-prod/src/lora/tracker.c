@@ -0,0 +1,322 @@
+/**
+ * @file tracker.c
+ * @brief Per-node running state and the per-frame position solve
+ *
+ * Everything the gateway does with a node's reading once the frame is
+ * parsed: subtract the baseline, keep the previous field for time
+ * alignment, and turn the node states into a position - the EKF track
+ * when enabled, the 2D solvers while there is none. lora.c calls this
+ * from its processing thread; the host simulator (tests/host/sim) drives
+ * the same code, so what it scores is what the gateway publishes.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracker.h"
+#include "ekf.h"
+#include "position.h"
+#include "telemetry.h"
+
+LOG_MODULE_REGISTER(tracker, LOG_LEVEL_INF);
+
+/* ------------ State variables ------------ */
+
+/* Per-node running state, written by the processing thread only;
+ * tracker_mutex keeps tracker_snapshot() readers off a half-written node */
+static struct node_state g_nodes[MAX_NODES + 1];
+static K_MUTEX_DEFINE(tracker_mutex);
+
+/* g_nodes brought to the time of the sample being processed, for the
+ * solves that use every node at once */
+static struct node_state g_aligned[MAX_NODES + 1];
+
+/* ------------ Internal Helpers ------------ */
+
+/**
+ * Update node state with new 3D measurement and compute magnet-induced field.
+ * The previous magnet field is kept with its time for position_align_nodes().
+ */
+static void update_node_state(struct node_state *ns, uint8_t node_id,
+                              const struct sensor_frame *f, int64_t sample_ms)
+{
+    ns->prev_B_mag = ns->last_B_mag;
+    ns->prev_sample_ms = ns->last_sample_ms;
+    ns->last_sample_ms = sample_ms;
+
+    /* Store raw 3D measurement */
+    ns->last_B.x = f->x_uT_milli;
+    ns->last_B.y = f->y_uT_milli;
+    ns->last_B.z = f->z_uT_milli;
+
+    /* Compute scalar magnitude for logging/legacy */
+    ns->last_absB = position_compute_absB(f->x_uT_milli, f->y_uT_milli, f->z_uT_milli);
+    ns->last_seq = f->tx_seq;
+    ns->last_noise_mut = f->noise_mut;
+
+    /* Get baseline from calibration module */
+    const struct baseline_data *baseline = calibration_get_baseline(node_id);
+
+    if (baseline && baseline->valid)
+    {
+        /* We have a valid baseline - compute magnet-induced field */
+        ns->have_baseline = true;
+
+        /* Copy baseline to node state for position estimation */
+        ns->baseline_B.x = baseline->B_ambient.x;
+        ns->baseline_B.y = baseline->B_ambient.y;
+        ns->baseline_B.z = baseline->B_ambient.z;
+
+        /* B_mag = B_raw - B_baseline */
+        ns->last_B_mag.x = f->x_uT_milli - baseline->B_ambient.x;
+        ns->last_B_mag.y = f->y_uT_milli - baseline->B_ambient.y;
+        ns->last_B_mag.z = f->z_uT_milli - baseline->B_ambient.z;
+
+        /* Scalar baseline difference for legacy code */
+        int32_t baseline_scalar = position_compute_absB(baseline->B_ambient.x,
+                                                        baseline->B_ambient.y,
+                                                        baseline->B_ambient.z);
+        ns->baseline_absB = baseline_scalar;
+        ns->last_dAbsB = abs(ns->last_absB - baseline_scalar);
+    }
+    else
+    {
+        /* No baseline yet - just use first reading approach for compatibility */
+        if (!ns->have_baseline)
+        {
+            ns->have_baseline = true;
+            ns->baseline_B = ns->last_B;
+            ns->baseline_absB = ns->last_absB;
+        }
+
+        /* Compute magnet field as difference from stored baseline */
+        ns->last_B_mag.x = f->x_uT_milli - ns->baseline_B.x;
+        ns->last_B_mag.y = f->y_uT_milli - ns->baseline_B.y;
+        ns->last_B_mag.z = f->z_uT_milli - ns->baseline_B.z;
+
+        ns->last_dAbsB = abs(ns->last_absB - ns->baseline_absB);
+    }
+}
+
+/**
+ * Leave the nodes that have not reported within TRACKER_MAX_NODE_AGE_MS
+ * out of the solves over g_aligned. Their last field describes where the
+ * magnet was then, so their baseline flag is cleared there and the solvers
+ * skip them. Returns the number of fresh nodes with a baseline.
+ */
+static int drop_stale_nodes(int64_t now)
+{
+    int fresh = 0;
+
+    for (int i = 1; i <= position_get_node_count(); i++)
+    {
+        struct node_state *ns = &g_aligned[i];
+        if (!ns->have_baseline)
+        {
+            continue;
+        }
+        if (now - ns->last_sample_ms > TRACKER_MAX_NODE_AGE_MS)
+        {
+            ns->have_baseline = false;
+            continue;
+        }
+        fresh++;
+    }
+
+    return fresh;
+}
+
+/**
+ * Seed an EKF track from the full solve over the fresh nodes of g_aligned,
+ * once at least TRACKER_SEED_MIN_NODES of them are fresh. A seed from the
+ * solve alone settles slowly and, with three nodes, can lock onto a mirror
+ * solution, so the new track then takes each fresh node's reading.
+ *
+ * Returns 0 with a track held, -EAGAIN if none could be seeded, or the
+ * ekf_update_node() error.
+ */
+static int seed_track(int64_t sample_ms, int fresh,
+                      const struct calib_point *calib_points, int calib_count)
+{
+    if (fresh < MIN(TRACKER_SEED_MIN_NODES, position_get_node_count()))
+    {
+        LOG_DBG("EKF seed deferred (%d fresh nodes)", fresh);
+        return -EAGAIN;
+    }
+
+    float pos_x, pos_y;
+    if (!position_estimate_2D(g_aligned, calib_points, calib_count, &pos_x, &pos_y))
+    {
+        LOG_DBG("EKF seed unavailable (not enough data)");
+        return -EAGAIN;
+    }
+
+    float M = position_estimate_moment(g_aligned, pos_x, pos_y);
+    if (M <= 0.0f)
+    {
+        LOG_DBG("EKF seed rejected: moment fit %.3g", (double)M);
+        return -EAGAIN;
+    }
+
+    ekf_seed(pos_x, pos_y, M, sample_ms);
+
+    for (int i = 1; i <= position_get_node_count(); i++)
+    {
+        const struct node_state *an = &g_aligned[i];
+        if (!an->have_baseline)
+        {
+            continue;
+        }
+        int err = ekf_update_node(i, &an->last_B_mag, an->last_noise_mut, sample_ms);
+        if (err)
+        {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Fuse the node that just reported into the EKF track.
+ *
+ * While a track is held, only the newly arrived vector and the time it was
+ * taken are consumed, so the cost per packet is one fixed-size measurement
+ * update regardless of the node count. Only without a track - none yet, or
+ * this reading showed it diverged or went stale and it was dropped - are
+ * the nodes aligned (*aligned is set) and a track seeded from them.
+ *
+ * Returns 0 with the updated track in est, -EAGAIN if no track could be
+ * seeded, or the ekf_update_node() error.
+ */
+static int track_with_ekf(uint8_t node_id, int64_t sample_ms,
+                          const struct calib_point *calib_points,
+                          int calib_count,
+                          struct ekf_estimate *est, bool *aligned)
+{
+    const struct node_state *ns = &g_nodes[node_id];
+    int err = -EAGAIN;
+
+    if (ekf_is_tracking())
+    {
+        err = ekf_update_node(node_id, &ns->last_B_mag, ns->last_noise_mut, sample_ms);
+    }
+
+    if (!ekf_is_tracking())
+    {
+        int fresh = tracker_align(sample_ms);
+        *aligned = true;
+        err = seed_track(sample_ms, fresh, calib_points, calib_count);
+    }
+
+    if (err)
+    {
+        return err;
+    }
+
+    return ekf_get_estimate(sample_ms, est) ? 0 : -EAGAIN;
+}
+
+/* ------------ Public API ------------ */
+
+void tracker_init(void)
+{
+    k_mutex_lock(&tracker_mutex, K_FOREVER);
+    memset(g_nodes, 0, sizeof(g_nodes));
+    k_mutex_unlock(&tracker_mutex);
+    memset(g_aligned, 0, sizeof(g_aligned));
+}
+
+const struct node_state *tracker_update_node(const struct sensor_frame *f,
+                                             int64_t sample_ms)
+{
+    struct node_state *ns = &g_nodes[f->node_id];
+
+    k_mutex_lock(&tracker_mutex, K_FOREVER);
+    update_node_state(ns, f->node_id, f, sample_ms);
+    k_mutex_unlock(&tracker_mutex);
+    return ns;
+}
+
+void tracker_snapshot(struct node_state nodes[MAX_NODES + 1])
+{
+    k_mutex_lock(&tracker_mutex, K_FOREVER);
+    memcpy(nodes, g_nodes, sizeof(g_nodes));
+    k_mutex_unlock(&tracker_mutex);
+}
+
+int tracker_align(int64_t t_ms)
+{
+    /* The other nodes' last readings are older than t_ms: predict them at
+     * that time so a moving magnet does not bias the solve */
+    position_align_nodes(g_nodes, t_ms, g_aligned);
+    return drop_stale_nodes(t_ms);
+}
+
+int tracker_solve(uint8_t node_id, int64_t sample_ms,
+                  const struct calib_point *calib_points, int calib_count,
+                  struct tracker_fix *fix)
+{
+    uint32_t t0 = k_cycle_get_32();
+    bool aligned = false;
+
+    if (IS_ENABLED(CONFIG_MISOGATE_POSITION_EKF))
+    {
+        struct ekf_estimate est = {0};
+        int err = track_with_ekf(node_id, sample_ms, calib_points, calib_count,
+                                 &est, &aligned);
+        uint32_t solve_us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+
+        telemetry_record_solve(TELEM_SOLVER_EKF, node_id, err,
+                               est.x, est.y, est.pos_std, solve_us);
+        if (!err)
+        {
+            fix->x = est.x;
+            fix->y = est.y;
+            fix->M = est.M;
+            fix->pos_std = est.pos_std;
+            fix->solver = TELEM_SOLVER_EKF;
+            return 0;
+        }
+
+        /* A gated reading leaves the track as it was; without a track,
+         * the per-packet estimate stands in until one is seeded */
+        if (ekf_is_tracking())
+        {
+            return err;
+        }
+        t0 = k_cycle_get_32();
+    }
+
+    if (!aligned)
+    {
+        tracker_align(sample_ms);
+    }
+
+    float pos_x = 0.0f, pos_y = 0.0f;
+    bool ok = position_estimate_2D(g_aligned, calib_points, calib_count, &pos_x, &pos_y);
+    uint32_t solve_us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+
+    telemetry_record_solve(TELEM_SOLVER_2D, node_id, ok ? 0 : -EAGAIN,
+                           pos_x, pos_y, 0.0f, solve_us);
+    if (!ok)
+    {
+        return -EAGAIN;
+    }
+
+    fix->x = pos_x;
+    fix->y = pos_y;
+    fix->M = position_estimate_moment(g_aligned, pos_x, pos_y);
+    fix->pos_std = 0.0f;
+    fix->solver = TELEM_SOLVER_2D;
+    return 0;
+}
+
+const struct node_state *tracker_get_aligned(void)
+{
+    return g_aligned;
+}
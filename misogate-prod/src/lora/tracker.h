@@ -0,0 +1,127 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lora.h"
+#include "calibration.h"
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Oldest node reading used by the solves over all nodes
+ *
+ * Nodes far from the magnet only send a 15 s heartbeat (their field is not
+ * changing), so a node is stale after two missed heartbeats.
+ */
+#define TRACKER_MAX_NODE_AGE_MS 35000
+
+/**
+ * @brief Fresh nodes needed to seed an EKF track
+ *
+ * Fewer if fewer are deployed. Nodes beyond these that are dead, out of
+ * range or still booting do not hold seeding up.
+ */
+#define TRACKER_SEED_MIN_NODES 3
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief Position produced by a solve
+ */
+struct tracker_fix
+{
+    float x;
+    float y;
+    float M;        /* Dipole moment: EKF state, or fitted to the 2D fix */
+    float pos_std;  /* 1-sigma position uncertainty, 0 for the 2D solver */
+    uint8_t solver; /* enum telem_solver */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Forget every node's readings
+ *
+ * Only call while no frame is being processed.
+ */
+void tracker_init(void);
+
+/**
+ * @brief Take a node's reading into its running state
+ *
+ * Subtracts the node's baseline from the calibration module to get the
+ * magnet-induced field and keeps the previous one, with its time, for
+ * position_align_nodes().
+ *
+ * @param f Parsed frame (node ID 1 to the node count)
+ * @param sample_ms Gateway time the reading was taken
+ * @return The node's updated state
+ */
+const struct node_state *tracker_update_node(const struct sensor_frame *f,
+                                             int64_t sample_ms);
+
+/**
+ * @brief Copy every node's running state
+ *
+ * For readers off the processing thread, e.g. the publish work. Safe
+ * against a concurrent tracker_update_node().
+ *
+ * @param nodes Output array indexed by node ID
+ */
+void tracker_snapshot(struct node_state nodes[MAX_NODES + 1]);
+
+/**
+ * @brief Align every node's reading for a solve over all nodes
+ *
+ * Predicts each node's last reading at @p t_ms (position_align_nodes())
+ * and leaves out the nodes older than TRACKER_MAX_NODE_AGE_MS. The work
+ * grows with the node count.
+ *
+ * Call with the layout lock held (position_layout_lock()).
+ *
+ * @param t_ms Gateway time to align to
+ * @return Number of fresh nodes with a baseline
+ */
+int tracker_align(int64_t t_ms);
+
+/**
+ * @brief Solve for the magnet after a node reported
+ *
+ * With CONFIG_MISOGATE_POSITION_EKF and a track held, only the node's
+ * reading is fused into the EKF track, at a cost independent of the node
+ * count. The nodes are aligned (tracker_align()) only to seed a track,
+ * from the full solve once TRACKER_SEED_MIN_NODES nodes are fresh, which
+ * also happens at once if the reading shows the track diverged or had gone
+ * stale (EKF_MAX_TRACK_AGE_MS); while there is no track,
+ * position_estimate_2D() over the aligned nodes gives the fix instead.
+ * Each solve is recorded in the telemetry.
+ *
+ * Call with the layout lock held (position_layout_lock()).
+ *
+ * @param node_id Node that just reported
+ * @param sample_ms Gateway time of its reading
+ * @param calib_points Calibration points for the lookup-table estimator
+ * @param calib_count Number of calibration points
+ * @param fix Output position
+ * @return 0 on success, -EAGAIN if no position could be produced, or the
+ *         ekf_update_node() error while a track is held (the track's own
+ *         estimate stands)
+ */
+int tracker_solve(uint8_t node_id, int64_t sample_ms,
+                  const struct calib_point *calib_points, int calib_count,
+                  struct tracker_fix *fix);
+
+/**
+ * @brief Node states as aligned by the last tracker_align()
+ *
+ * Stale nodes are marked as having no baseline. tracker_solve() aligns
+ * only when it seeds a track or falls back to the 2D solve, so while a
+ * track is held these may be older than the last reading. Only valid on
+ * the thread that calls tracker_solve() and tracker_align().
+ *
+ * @return Array indexed by node ID
+ */
+const struct node_state *tracker_get_aligned(void);
+
+#endif /* TRACKER_H */
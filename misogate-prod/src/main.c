@@ -34,19 +34,22 @@ static struct net_mgmt_event_callback conn_cb;
 
 /* Forward declarations. */
 static void connect_work_fn(struct k_work *work);
-static void mqtt_process_work_fn(struct k_work *work);
+static void mqtt_up_work_fn(struct k_work *work);
 
-static K_WORK_DELAYABLE_DEFINE(connect_work, connect_work_fn);
-static K_WORK_DELAYABLE_DEFINE(mqtt_process_work, mqtt_process_work_fn);
+static K_WORK_DEFINE(connect_work, connect_work_fn);
+static K_WORK_DEFINE(mqtt_up_work, mqtt_up_work_fn);
 
 static bool mqtt_initialized = false;
 static bool lora_initialized = false;
 static bool lora_started = false;
 
-static void mqtt_process_work_fn(struct k_work *work)
+/* From the MQTT network thread: defer the follow-up to the workqueue */
+static void on_mqtt_conn_changed(bool connected)
 {
-    mqtt_app_input();
-    k_work_reschedule(&mqtt_process_work, K_MSEC(100)); // Poll every 100ms
+    if (connected)
+    {
+        (void)k_work_submit(&mqtt_up_work);
+    }
 }
 
 static void connect_work_fn(struct k_work *work)
@@ -62,36 +65,24 @@ static void connect_work_fn(struct k_work *work)
             FATAL_ERROR();
             return;
         }
+        mqtt_set_conn_handler(on_mqtt_conn_changed);
         mqtt_initialized = true;
     }
 
+    /* The network thread connects (and reconnects with backoff) on its own */
     LOG_INF("Connecting to MQTT broker...");
+    mqtt_net_start();
+}
 
-    err = mqtt_app_connect_with_retries();
-    if (err)
-    {
-        LOG_ERR("mqtt_app_connect_with_retries failed: %d. Retrying...", err);
-        (void)k_work_reschedule(&connect_work, K_SECONDS(5));
-        return;
-    }
-
-    /* Wait for MQTT connection to be fully established (CONNACK received) */
-    err = mqtt_wait_connected(10000); /* 10 second timeout */
-    if (err)
-    {
-        LOG_ERR("mqtt_wait_connected failed: %d. Retrying...", err);
-        mqtt_app_disconnect();
-        (void)k_work_reschedule(&connect_work, K_SECONDS(5));
-        return;
-    }
-
-    /* Now MQTT is fully connected - start processing input for keepalive/subscriptions */
-    k_work_reschedule(&mqtt_process_work, K_NO_WAIT);
-
+static void mqtt_up_work_fn(struct k_work *work)
+{
     /* Mark image as working to avoid reverting to the former image after a reboot. */
 #if defined(CONFIG_BOOTLOADER_MCUBOOT)
-    LOG_INF("Confirming image");
-    boot_write_img_confirmed();
+    if (!boot_is_img_confirmed())
+    {
+        LOG_INF("Confirming image");
+        boot_write_img_confirmed();
+    }
 #endif
 
     /* Start LoRa receiver and calibration now that MQTT is FULLY connected */
@@ -110,14 +101,12 @@ static void connect_work_fn(struct k_work *work)
 
 static void on_net_event_l4_connected(void)
 {
-    (void)k_work_reschedule(&connect_work, K_SECONDS(5));
+    (void)k_work_submit(&connect_work);
 }
 
 static void on_net_event_l4_disconnected(void)
 {
-    mqtt_app_disconnect();
-    (void)k_work_cancel_delayable(&connect_work);
-    (void)k_work_cancel_delayable(&mqtt_process_work);
+    mqtt_net_stop();
 }
 
 static void l4_event_handler(struct net_mgmt_event_callback *cb,
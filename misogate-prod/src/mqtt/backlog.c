@@ -0,0 +1,390 @@
+/**
+ * @file backlog.c
+ * @brief Store-and-forward of positions across MQTT disconnects
+ *
+ * While the broker is unreachable, positions go into a RAM ring instead of
+ * being dropped. After reconnecting, the network thread replays them on
+ * MISOGATE_REPLAY at a throttled rate, behind the live feed. Every record
+ * carries its position sequence number, and every replay message the boot
+ * it came from, so the backend can de-duplicate (boot, seq) pairs; a record
+ * may be sent twice (e.g. reboot during replay) but is not silently lost
+ * until RAM and flash are both full.
+ *
+ * With CONFIG_MISOGATE_MQTT_BACKLOG_FLASH, the network thread moves each
+ * full BACKLOG_BATCH of RAM records to a flash circular buffer (FCB) as
+ * soon as it is complete, so a reboot loses at most the last partial
+ * batch. Flash records are always older than RAM ones and are replayed
+ * first; they survive a reboot.
+ *
+ * RAM ring: free-running head/tail under a spinlock. The producer (the
+ * position work) only appends and may push the tail forward when full; the
+ * network thread peeks and consumes, tracking where its batch started so
+ * records overwritten meanwhile are not consumed twice. Flash is only
+ * touched from the network thread.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+#include <zephyr/fs/fcb.h>
+#include <zephyr/storage/flash_map.h>
+#endif
+
+#include "backlog.h"
+
+LOG_MODULE_REGISTER(backlog, CONFIG_MISOGATE_LOG_LEVEL);
+
+BUILD_ASSERT((BACKLOG_RECORDS & (BACKLOG_RECORDS - 1)) == 0,
+             "CONFIG_MISOGATE_MQTT_BACKLOG_RECORDS must be a power of two");
+BUILD_ASSERT(BACKLOG_RECORDS >= 4 * BACKLOG_BATCH,
+             "CONFIG_MISOGATE_MQTT_BACKLOG_RECORDS is too small");
+
+static struct pub_sample ring[BACKLOG_RECORDS];
+static uint32_t head;       /* Next record written */
+static uint32_t tail;       /* Oldest record held */
+static uint32_t batch_tail; /* tail when the RAM batch in flight was taken */
+static uint32_t this_boot;
+static struct backlog_stats stats;
+static struct k_spinlock lock;
+
+/* ------------ Flash spill ------------ */
+
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+
+#define BACKLOG_FCB_MAGIC 0x4d424c47 /* "MBLG" */
+#define BACKLOG_FCB_VERSION 1
+#define BACKLOG_FLASH_ID FIXED_PARTITION_ID(backlog_storage)
+
+/* One flash entry: a run of records from a single boot */
+struct spill_chunk
+{
+    uint32_t boot_id;
+    uint16_t count;
+    uint16_t reserved;
+    struct pub_sample rec[BACKLOG_BATCH];
+};
+
+static struct fcb fcb;
+static struct flash_sector sectors[CONFIG_MISOGATE_MQTT_BACKLOG_FLASH_SECTORS];
+static bool flash_ready;
+static struct fcb_entry read_loc;  /* Last chunk consumed (zeroed: none yet) */
+static struct fcb_entry peek_loc;  /* Chunk returned by the last peek */
+static bool peeked_flash;
+static uint32_t flash_chunks;      /* Chunks not yet replayed */
+static struct spill_chunk chunk;   /* Network thread only */
+
+static uint32_t count_flash_chunks(void)
+{
+    struct fcb_entry loc = {0};
+    uint32_t n = 0;
+
+    while (fcb_getnext(&fcb, &loc) == 0)
+    {
+        n++;
+    }
+    return n;
+}
+
+static int flash_init(void)
+{
+    uint32_t cnt = ARRAY_SIZE(sectors);
+    int err = flash_area_get_sectors(BACKLOG_FLASH_ID, &cnt, sectors);
+    if (err)
+    {
+        return err;
+    }
+
+    fcb.f_magic = BACKLOG_FCB_MAGIC;
+    fcb.f_version = BACKLOG_FCB_VERSION;
+    fcb.f_sector_cnt = (uint16_t)cnt;
+    fcb.f_scratch_cnt = 0;
+    fcb.f_sectors = sectors;
+
+    err = fcb_init(BACKLOG_FLASH_ID, &fcb);
+    if (err)
+    {
+        /* Wrong format or corrupt: start over */
+        err = flash_area_erase(fcb.fap, 0, fcb.fap->fa_size);
+        if (!err)
+        {
+            err = fcb_init(BACKLOG_FLASH_ID, &fcb);
+        }
+        if (err)
+        {
+            return err;
+        }
+    }
+
+    memset(&read_loc, 0, sizeof(read_loc));
+    flash_chunks = count_flash_chunks();
+    flash_ready = true;
+
+    if (flash_chunks)
+    {
+        LOG_INF("%u backlog chunks from flash waiting for replay", (unsigned)flash_chunks);
+    }
+    return 0;
+}
+
+static int flash_append(const struct spill_chunk *c)
+{
+    struct fcb_entry loc;
+    int err = fcb_append(&fcb, sizeof(*c), &loc);
+
+    if (err == -ENOSPC)
+    {
+        /* Full: the oldest sector's records are lost, re-read from the start */
+        uint32_t before = flash_chunks;
+        err = fcb_rotate(&fcb);
+        if (err)
+        {
+            return err;
+        }
+        memset(&read_loc, 0, sizeof(read_loc));
+        flash_chunks = count_flash_chunks();
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        stats.dropped += (before - flash_chunks) * BACKLOG_BATCH;
+        k_spin_unlock(&lock, key);
+        err = fcb_append(&fcb, sizeof(*c), &loc);
+    }
+    if (err)
+    {
+        return err;
+    }
+
+    err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), c, sizeof(*c));
+    if (err)
+    {
+        return err;
+    }
+    err = fcb_append_finish(&fcb, &loc);
+    if (!err)
+    {
+        flash_chunks++;
+    }
+    return err;
+}
+
+static size_t flash_peek(struct pub_sample *out, uint32_t *boot_id)
+{
+    peek_loc = read_loc;
+    while (fcb_getnext(&fcb, &peek_loc) == 0)
+    {
+        if (flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(peek_loc), &chunk,
+                            sizeof(chunk)) == 0 &&
+            peek_loc.fe_data_len == sizeof(chunk) &&
+            chunk.count > 0 && chunk.count <= BACKLOG_BATCH)
+        {
+            memcpy(out, chunk.rec, chunk.count * sizeof(chunk.rec[0]));
+            *boot_id = chunk.boot_id;
+            peeked_flash = true;
+            return chunk.count;
+        }
+
+        /* Unreadable chunk: skip it */
+        read_loc = peek_loc;
+        flash_chunks = flash_chunks ? flash_chunks - 1 : 0;
+    }
+
+    /* Nothing readable left */
+    flash_chunks = 0;
+    return 0;
+}
+
+static void flash_consume(void)
+{
+    read_loc = peek_loc;
+    peeked_flash = false;
+    if (flash_chunks)
+    {
+        flash_chunks--;
+    }
+    if (flash_chunks == 0)
+    {
+        /* Everything replayed: erase so a reboot does not replay it again */
+        (void)fcb_clear(&fcb);
+        memset(&read_loc, 0, sizeof(read_loc));
+    }
+}
+
+#endif /* CONFIG_MISOGATE_MQTT_BACKLOG_FLASH */
+
+/* ------------ Public API ------------ */
+
+int backlog_init(uint32_t boot_id)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    head = 0;
+    tail = 0;
+    batch_tail = 0;
+    this_boot = boot_id;
+    memset(&stats, 0, sizeof(stats));
+    k_spin_unlock(&lock, key);
+
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+    int err = flash_init();
+    if (err)
+    {
+        LOG_ERR("Backlog flash unavailable (%d), keeping backlog in RAM only", err);
+    }
+    return err;
+#else
+    return 0;
+#endif
+}
+
+void backlog_store(const struct pub_sample *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (head - tail == BACKLOG_RECORDS)
+    {
+        tail++;
+        stats.dropped++;
+    }
+    ring[head % BACKLOG_RECORDS] = *s;
+    head++;
+    stats.stored++;
+    k_spin_unlock(&lock, key);
+}
+
+void backlog_service(void)
+{
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+    if (!flash_ready)
+    {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (head - tail < BACKLOG_BATCH)
+    {
+        k_spin_unlock(&lock, key);
+        return;
+    }
+    uint32_t start = tail;
+    for (int i = 0; i < BACKLOG_BATCH; i++)
+    {
+        chunk.rec[i] = ring[(start + i) % BACKLOG_RECORDS];
+    }
+    k_spin_unlock(&lock, key);
+
+    chunk.boot_id = this_boot;
+    chunk.count = BACKLOG_BATCH;
+    chunk.reserved = 0;
+
+    int err = flash_append(&chunk);
+    if (err)
+    {
+        LOG_ERR("Backlog spill failed (%d), keeping backlog in RAM only", err);
+        flash_ready = false;
+        return;
+    }
+
+    key = k_spin_lock(&lock);
+    /* Remove what was written, minus anything the producer already overwrote */
+    uint32_t end = start + BACKLOG_BATCH;
+    if ((int32_t)(end - tail) > 0)
+    {
+        tail = end;
+    }
+    stats.spilled += BACKLOG_BATCH;
+    k_spin_unlock(&lock, key);
+#endif
+}
+
+size_t backlog_peek(struct pub_sample *out, uint32_t *boot_id)
+{
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+    peeked_flash = false;
+    if (flash_ready && flash_chunks)
+    {
+        size_t n = flash_peek(out, boot_id);
+        if (n)
+        {
+            return n;
+        }
+    }
+#endif
+
+    size_t n = 0;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    batch_tail = tail;
+    for (uint32_t i = tail; i != head && n < BACKLOG_BATCH; i++)
+    {
+        out[n++] = ring[i % BACKLOG_RECORDS];
+    }
+    *boot_id = this_boot;
+    k_spin_unlock(&lock, key);
+
+    return n;
+}
+
+void backlog_consume(size_t count)
+{
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+    if (peeked_flash)
+    {
+        flash_consume();
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        stats.replayed += (uint32_t)count;
+        k_spin_unlock(&lock, key);
+        return;
+    }
+#endif
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t end = batch_tail + (uint32_t)count;
+    if ((int32_t)(end - tail) > 0)
+    {
+        tail = end;
+    }
+    stats.replayed += (uint32_t)count;
+    k_spin_unlock(&lock, key);
+}
+
+bool backlog_pending(void)
+{
+#if defined(CONFIG_MISOGATE_MQTT_BACKLOG_FLASH)
+    if (flash_ready && flash_chunks)
+    {
+        return true;
+    }
+#endif
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool pending = head != tail;
+    k_spin_unlock(&lock, key);
+
+    return pending;
+}
+
+int backlog_format_json(uint32_t boot_id, const struct pub_sample *batch,
+                        size_t count, char *buf, size_t len)
+{
+    int used = snprintf(buf, len, "{\"boot\":%u,\"pts\":[", (unsigned)boot_id);
+
+    for (size_t i = 0; i < count && used > 0 && (size_t)used < len; i++)
+    {
+        used += snprintf(buf + used, len - used, "%s[%u,%u,%d,%d]",
+                         i ? "," : "", (unsigned)batch[i].seq,
+                         (unsigned)batch[i].t_ms, batch[i].x, batch[i].y);
+    }
+    if (used > 0 && (size_t)used < len)
+    {
+        used += snprintf(buf + used, len - used, "]}");
+    }
+
+    return (used > 0 && (size_t)used < len) ? used : -ENOSPC;
+}
+
+void backlog_get_stats(struct backlog_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
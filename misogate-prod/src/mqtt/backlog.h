@@ -0,0 +1,101 @@
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pub_queue.h"
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Position records kept in RAM while MQTT is down (power of two)
+ */
+#define BACKLOG_RECORDS CONFIG_MISOGATE_MQTT_BACKLOG_RECORDS
+
+/**
+ * @brief Records per replayed message (and per flash spill chunk)
+ */
+#define BACKLOG_BATCH 16
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief Backlog counters
+ */
+struct backlog_stats
+{
+    uint32_t stored;   /* Records taken while disconnected */
+    uint32_t replayed; /* Records sent after reconnecting */
+    uint32_t spilled;  /* Records moved from RAM to flash */
+    uint32_t dropped;  /* Records lost (RAM full without flash, or flash full) */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Set up the backlog
+ *
+ * With CONFIG_MISOGATE_MQTT_BACKLOG_FLASH, records spilled to flash by an
+ * earlier boot are kept and replayed first.
+ *
+ * @param boot_id Identifies this boot in replayed messages
+ * @return 0 on success, negative errno if flash could not be set up (the
+ *         RAM backlog works regardless)
+ */
+int backlog_init(uint32_t boot_id);
+
+/**
+ * @brief Keep a position that could not be published live
+ *
+ * Never blocks or touches flash. When RAM is full the oldest record is
+ * dropped; with flash spill enabled backlog_service() normally moves
+ * records out before that happens.
+ */
+void backlog_store(const struct pub_sample *s);
+
+/**
+ * @brief Housekeeping from the network thread: spill the oldest
+ *        BACKLOG_BATCH RAM records to flash once that many are held
+ */
+void backlog_service(void);
+
+/**
+ * @brief Copy out the oldest records, without removing them
+ *
+ * Flash records (older) come before RAM records. One batch never mixes
+ * records from different boots.
+ *
+ * @param out Destination (BACKLOG_BATCH entries)
+ * @param boot_id Output boot the records belong to
+ * @return Number of records copied, 0 if the backlog is empty
+ */
+size_t backlog_peek(struct pub_sample *out, uint32_t *boot_id);
+
+/**
+ * @brief Remove the records returned by the last backlog_peek()
+ */
+void backlog_consume(size_t count);
+
+/**
+ * @brief Whether anything is waiting for replay
+ */
+bool backlog_pending(void);
+
+/**
+ * @brief Format a replay message (MISOGATE_REPLAY)
+ *
+ *   {"boot":B,"pts":[[seq,t,x,y],...]}
+ *
+ * @return Length written, or -ENOSPC if it does not fit
+ */
+int backlog_format_json(uint32_t boot_id, const struct pub_sample *batch,
+                        size_t count, char *buf, size_t len);
+
+/**
+ * @brief Get backlog counters
+ */
+void backlog_get_stats(struct backlog_stats *stats);
+
+#endif /* BACKLOG_H */
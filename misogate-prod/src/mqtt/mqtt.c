@@ -1,10 +1,13 @@
 #include "mqtt.h"
+#include "pub_queue.h"
+#include "backlog.h"
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/mqtt.h>
 #include <zephyr/random/random.h>
 #include <stdio.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(mqtt, CONFIG_MISOGATE_LOG_LEVEL);
 
@@ -21,25 +24,75 @@ static uint8_t tx_buffer[1024];
 /* The mqtt client struct */
 static struct mqtt_client client_ctx;
 
-/* MQTT Broker details. */
+/* MQTT Broker details. The resolved address is reused for
+ * MQTT_DNS_CACHE_TTL_MS; a failed connect forgets it. Reconnecting to the
+ * same address also lets the TLS layer find its cached session. */
+#define MQTT_DNS_CACHE_TTL_MS (CONFIG_MISOGATE_MQTT_DNS_CACHE_TTL_S * 1000LL)
 static struct sockaddr_storage broker;
-
-/* Connected flag */
-static bool connected = false;
-static bool connecting = false;
-
-/* Reconnect work */
-static void mqtt_reconnect_work_fn(struct k_work *work);
-static K_WORK_DELAYABLE_DEFINE(mqtt_reconnect_work, mqtt_reconnect_work_fn);
-
-/* Retry configuration */
-#define MQTT_MAX_RETRIES 3
-#define MQTT_RETRY_DELAY_MS 2000
-static int connection_retries = 0;
+static bool broker_cached;
+static int64_t broker_expires_ms;
+
+/* Connection state machine, run by the network thread:
+ *
+ *   IDLE -> (mqtt_net_start) -> BACKOFF -> (attempt due) -> CONNECTING
+ *   CONNECTING -> (CONNACK ok) -> CONNECTED
+ *   CONNECTING -> (refused, timeout, socket error) -> BACKOFF
+ *   CONNECTED -> (disconnect, socket error) -> BACKOFF
+ *   any -> (mqtt_net_stop) -> IDLE
+ *
+ * BACKOFF waits an exponentially growing, jittered delay between attempts
+ * so a broker outage is not hammered by every gateway at once. */
+enum conn_state
+{
+    CONN_IDLE,
+    CONN_BACKOFF,
+    CONN_CONNECTING,
+    CONN_CONNECTED,
+};
+
+#define MQTT_BACKOFF_MIN_MS CONFIG_MISOGATE_MQTT_BACKOFF_MIN_MS
+#define MQTT_BACKOFF_MAX_MS CONFIG_MISOGATE_MQTT_BACKOFF_MAX_MS
+#define MQTT_CONNACK_TIMEOUT_MS CONFIG_MISOGATE_MQTT_CONNACK_TIMEOUT_MS
+
+static volatile enum conn_state conn_state = CONN_IDLE;
+static volatile bool connected; /* conn_state == CONN_CONNECTED, for other threads */
+static int conn_attempts;       /* Failed attempts since the last CONNACK */
+static int64_t conn_started_ms;  /* When the current attempt began */
+static int64_t conn_deadline_ms; /* BACKOFF: next attempt; CONNECTING: CONNACK timeout */
+static bool conn_refused;        /* CONNACK carried an error */
+static mqtt_conn_handler_t conn_handler;
 
 /* File descriptor */
 static struct pollfd fds[1];
 
+/* Commands received on MISOGATE_SUB */
+#define MQTT_COMMAND_MAX_LEN 64
+static mqtt_command_handler_t command_handler;
+
+/* Network thread: socket input, keepalive and the position publish queue.
+ * Runs off the system workqueue so a slow TLS write stalls nothing else. */
+#define MQTT_NET_STACK_SIZE 4096
+#define MQTT_NET_PRIORITY 8
+#define MQTT_NET_POLL_MS 20          /* Socket poll timeout, bounds queue latency */
+#define MQTT_NET_BACKOFF_MAX_MS 640  /* Longest wait while the client is busy */
+#define MQTT_NET_DROP_LOG_MS 1000    /* Drop warnings at most this often */
+#define MQTT_PUB_PAYLOAD_MAX 512
+
+static K_THREAD_STACK_DEFINE(net_stack, MQTT_NET_STACK_SIZE);
+static struct k_thread net_thread_data;
+static k_tid_t net_thread_id;
+static K_SEM_DEFINE(net_start_sem, 0, 1);
+static volatile bool net_running;
+
+/* Position numbering and store-and-forward (see backlog.h) */
+#define MQTT_BACKLOG_INTERVAL_MS CONFIG_MISOGATE_MQTT_BACKLOG_INTERVAL_MS
+#define MQTT_REPLAY_INTERVAL_MS CONFIG_MISOGATE_MQTT_REPLAY_INTERVAL_MS
+#define MQTT_BACKLOG_LOG_MS 10000
+static uint32_t boot_id;
+static uint32_t pos_seq;
+static uint32_t last_backlog_ms;
+static bool queues_ready;
+
 static struct mqtt_utf8 username;
 static struct mqtt_utf8 password;
 
@@ -78,6 +131,194 @@ static void wait(int timeout)
     }
 }
 
+/**
+ * Read a received payload off the socket and pass it to the command handler.
+ * Anything past MQTT_COMMAND_MAX_LEN is read and discarded.
+ */
+static void handle_command_payload(struct mqtt_client *client, size_t len)
+{
+    char cmd[MQTT_COMMAND_MAX_LEN + 1];
+    size_t keep = MIN(len, (size_t)MQTT_COMMAND_MAX_LEN);
+
+    if (mqtt_readall_publish_payload(client, (uint8_t *)cmd, keep) < 0)
+    {
+        return;
+    }
+    cmd[keep] = '\0';
+
+    for (size_t left = len - keep; left > 0;)
+    {
+        uint8_t discard[32];
+        size_t chunk = MIN(left, sizeof(discard));
+        if (mqtt_readall_publish_payload(client, discard, chunk) < 0)
+        {
+            return;
+        }
+        left -= chunk;
+    }
+
+    if (command_handler)
+    {
+        command_handler(cmd, keep);
+    }
+}
+
+/* ------------ Connection State Machine ------------ */
+
+static int broker_init(void);
+static void broker_forget(void);
+
+static void set_state(enum conn_state state)
+{
+    bool was_connected = connected;
+
+    conn_state = state;
+    connected = (state == CONN_CONNECTED);
+    if (was_connected && !connected && conn_handler)
+    {
+        conn_handler(false);
+    }
+}
+
+/**
+ * Wait before the next connection attempt: MQTT_BACKOFF_MIN_MS doubled per
+ * failed attempt up to MQTT_BACKOFF_MAX_MS, of which a random half is
+ * taken ("equal jitter") so gateways that lost the broker together do not
+ * come back in lockstep.
+ */
+static void schedule_retry(void)
+{
+    int shift = MIN(conn_attempts, 16);
+    uint32_t backoff = MIN((uint32_t)MQTT_BACKOFF_MIN_MS << shift,
+                           (uint32_t)MQTT_BACKOFF_MAX_MS);
+    uint32_t delay = backoff / 2 + sys_rand32_get() % (backoff / 2 + 1);
+
+    conn_attempts++;
+    conn_deadline_ms = k_uptime_get() + delay;
+    set_state(CONN_BACKOFF);
+    LOG_INF("MQTT reconnect in %u ms (attempt %d)", (unsigned)delay, conn_attempts + 1);
+}
+
+/**
+ * Start a connection attempt: resolve the broker, open the transport and
+ * send CONNECT. The CONNACK arrives through mqtt_input() like any other
+ * packet; nothing here waits for it.
+ */
+static void start_connect(void)
+{
+    conn_started_ms = k_uptime_get();
+
+    int err = broker_init();
+    if (err)
+    {
+        LOG_ERR("Failed to resolve broker hostname %s, error: %d", SERVER_HOST, err);
+        schedule_retry();
+        return;
+    }
+
+    LOG_INF("Connecting to MQTT broker %s:%d as %s", SERVER_HOST, SERVER_PORT, MQTT_CLIENTID);
+    err = mqtt_connect(&client_ctx);
+    if (err)
+    {
+        LOG_ERR("mqtt_connect failed: %d", err);
+        broker_forget(); /* The broker may have moved */
+        schedule_retry();
+        return;
+    }
+
+    prepare_fds(&client_ctx);
+    conn_refused = false;
+    conn_deadline_ms = k_uptime_get() + MQTT_CONNACK_TIMEOUT_MS;
+    set_state(CONN_CONNECTING);
+}
+
+/**
+ * Drop the session without a DISCONNECT packet (network gone, broker
+ * silent or refusing). The client normally reports MQTT_EVT_DISCONNECT,
+ * which moves on to BACKOFF or IDLE.
+ */
+static void abort_connection(void)
+{
+    (void)mqtt_abort(&client_ctx);
+    clear_fds();
+    if (conn_state == CONN_CONNECTING || conn_state == CONN_CONNECTED)
+    {
+        /* No event (transport was not up): move on regardless */
+        if (net_running)
+        {
+            schedule_retry();
+        }
+        else
+        {
+            set_state(CONN_IDLE);
+        }
+    }
+}
+
+/**
+ * One step of the connection state machine, from the network thread.
+ */
+static void conn_step(void)
+{
+    switch (conn_state)
+    {
+    case CONN_BACKOFF:
+        if (k_uptime_get() >= conn_deadline_ms)
+        {
+            start_connect();
+        }
+        break;
+
+    case CONN_CONNECTING:
+        if (k_uptime_get() >= conn_deadline_ms)
+        {
+            LOG_ERR("No CONNACK within %d ms", MQTT_CONNACK_TIMEOUT_MS);
+            broker_forget();
+            abort_connection();
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * Socket input and keepalive; waits up to MQTT_NET_POLL_MS for the socket
+ * to become readable.
+ */
+static void poll_input(void)
+{
+    wait(MQTT_NET_POLL_MS);
+    if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+    {
+        LOG_WRN("MQTT socket error (revents 0x%x)", fds[0].revents);
+        abort_connection();
+        return;
+    }
+
+    int err = mqtt_input(&client_ctx);
+    if (err && err != -EAGAIN)
+    {
+        LOG_WRN("mqtt_input: %d", err);
+    }
+
+    if (conn_refused && conn_state == CONN_CONNECTING)
+    {
+        abort_connection();
+        return;
+    }
+
+    if (conn_state == CONN_CONNECTED)
+    {
+        err = mqtt_live(&client_ctx);
+        if (err && err != -EAGAIN)
+        {
+            LOG_WRN("mqtt_live: %d", err);
+        }
+    }
+}
+
 void mqtt_evt_handler(struct mqtt_client *const client,
                       const struct mqtt_evt *evt)
 {
@@ -88,15 +329,16 @@ void mqtt_evt_handler(struct mqtt_client *const client,
     case MQTT_EVT_CONNACK:
         if (evt->result != 0)
         {
+            /* Dropped by the network thread once input returns */
             LOG_ERR("MQTT connect failed with result code: %d", evt->result);
-            connected = false;
-            connecting = false;
+            conn_refused = true;
             break;
         }
 
-        connected = true;
-        connecting = false;
-        LOG_INF("MQTT client connected successfully!");
+        set_state(CONN_CONNECTED);
+        conn_attempts = 0;
+        LOG_INF("MQTT client connected in %u ms",
+                (unsigned)(k_uptime_get() - conn_started_ms));
 
         // Subscribe to topic
         struct mqtt_topic subscribe_topic = {
@@ -121,16 +363,24 @@ void mqtt_evt_handler(struct mqtt_client *const client,
             LOG_INF("Subscribed to %s", MISOGATE_SUB);
         }
 
+        if (conn_handler)
+        {
+            conn_handler(true);
+        }
+
         break;
 
     case MQTT_EVT_DISCONNECT:
         LOG_INF("MQTT client disconnected %d", evt->result);
-        connected = false;
-        connecting = false;
         clear_fds();
-        /* Schedule reconnection attempt */
-        connection_retries = 0; /* Reset retries for reconnect */
-        k_work_reschedule(&mqtt_reconnect_work, K_MSEC(MQTT_RETRY_DELAY_MS));
+        if (net_running)
+        {
+            schedule_retry();
+        }
+        else
+        {
+            set_state(CONN_IDLE);
+        }
         break;
 
     case MQTT_EVT_PUBLISH:
@@ -138,20 +388,19 @@ void mqtt_evt_handler(struct mqtt_client *const client,
         const struct mqtt_publish_param *p = &evt->param.publish;
 
         LOG_INF("MQTT PUBLISH result=%d len=%d", evt->result, p->message.payload.len);
-        if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE)
-        {
-            struct mqtt_puback_param puback = {
-                .message_id = p->message_id};
-            mqtt_publish_qos1_ack(client, &puback);
-        }
-        // Handle payload (log it for now)
+        /* Payload must be read off the socket before anything else */
         if (p->message.payload.len > 0)
         {
-            // In a real app we might need to buffer this if it's fragmented
-            // For now assume small messages
             LOG_INF("Received on topic \"%.*s\"",
                     p->message.topic.topic.size,
                     p->message.topic.topic.utf8);
+            handle_command_payload(client, p->message.payload.len);
+        }
+        if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE)
+        {
+            struct mqtt_puback_param puback = {
+                .message_id = p->message_id};
+            mqtt_publish_qos1_ack(client, &puback);
         }
         break;
     }
@@ -171,11 +420,21 @@ void mqtt_evt_handler(struct mqtt_client *const client,
     }
 }
 
+/**
+ * Resolve the broker, unless the address from an earlier lookup is still
+ * within MQTT_DNS_CACHE_TTL_MS. getaddrinfo() does not report the record's
+ * TTL, so a fixed lifetime is used instead.
+ */
 static int broker_init(void)
 {
     int err;
     struct sockaddr_in *broker4 = (struct sockaddr_in *)&broker;
 
+    if (broker_cached && k_uptime_get() < broker_expires_ms)
+    {
+        return 0;
+    }
+
     // Use DNS lookup since we have a hostname
     struct zsock_addrinfo hints, *res;
 
@@ -186,6 +445,7 @@ static int broker_init(void)
     char port_str[6];
     sprintf(port_str, "%d", SERVER_PORT);
 
+    LOG_INF("Resolving broker hostname: %s", SERVER_HOST);
     err = zsock_getaddrinfo(SERVER_HOST, port_str, &hints, &res);
     if (err)
     {
@@ -205,15 +465,21 @@ static int broker_init(void)
     }
 
     zsock_freeaddrinfo(res);
+
+    broker_cached = MQTT_DNS_CACHE_TTL_MS > 0;
+    broker_expires_ms = k_uptime_get() + MQTT_DNS_CACHE_TTL_MS;
     return 0;
 }
 
+static void broker_forget(void)
+{
+    broker_cached = false;
+}
+
 static void client_init(struct mqtt_client *client)
 {
     mqtt_client_init(client);
 
-    broker_init();
-
     /* MQTT client configuration */
     client->broker = &broker;
     client->evt_cb = mqtt_evt_handler;
@@ -240,221 +506,408 @@ static void client_init(struct mqtt_client *client)
     client->transport.tls.config.sec_tag_list = NULL; // We'll add this if we have certs
     client->transport.tls.config.sec_tag_count = 0;
     client->transport.tls.config.hostname = SERVER_HOST;
+#if defined(CONFIG_MISOGATE_MQTT_TLS_SESSION_CACHE)
+    /* Resume the previous session on reconnect: an abbreviated handshake
+     * instead of the full certificate exchange and key agreement */
+    client->transport.tls.config.session_cache = TLS_SESSION_CACHE_ENABLED;
+#endif
 #else
     client->transport.type = MQTT_TRANSPORT_NON_SECURE;
 #endif
 }
 
-int mqtt_app_init(void)
+/* ------------ Network Thread ------------ */
+
+/**
+ * Handle a publish result for the live or replay feed.
+ *
+ * A full or busy client (-EAGAIN, -ENOMEM) is backpressure: the batch
+ * stays queued and the next attempt waits twice as long, up to
+ * MQTT_NET_BACKOFF_MAX_MS. Returns true if the batch is finished (sent or
+ * refused for good).
+ */
+static bool publish_done(int err, int64_t *retry_at, int *backoff_ms)
 {
-    client_init(&client_ctx);
-    return 0;
+    if (err == -EAGAIN || err == -ENOMEM)
+    {
+        *backoff_ms = *backoff_ms ? MIN(*backoff_ms * 2, MQTT_NET_BACKOFF_MAX_MS)
+                                  : MQTT_NET_POLL_MS;
+        *retry_at = k_uptime_get() + *backoff_ms;
+        return false;
+    }
+
+    *backoff_ms = 0;
+    return true;
 }
 
-int mqtt_app_connect(void)
+BUILD_ASSERT(IS_ENABLED(CONFIG_MISOGATE_MQTT_JSON_PAYLOAD) ||
+                 IS_ENABLED(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD),
+             "enable at least one position payload format");
+
+/**
+ * Publish one batch in the enabled formats.
+ *
+ * Returns -EAGAIN/-ENOMEM on backpressure (retry the same batch later),
+ * otherwise 0 or the first hard error. Samples already sent as binary
+ * records are not sent again when the JSON publish is retried.
+ */
+static int publish_batch(const struct pub_sample *batch,
+                         const struct pub_detail *details, size_t n)
 {
-    int err;
+    int ret = 0;
 
-    if (connected)
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+    static uint8_t records[PUB_QUEUE_BATCH_MAX * PUB_BIN_RECORD_MAX];
+    static uint32_t bin_next_seq; /* First sequence number not yet sent */
+
+    size_t skip = 0;
+    while (skip < n && (int32_t)(batch[skip].seq - bin_next_seq) < 0)
     {
-        LOG_INF("Already connected to MQTT broker");
-        return 0;
+        skip++;
+    }
+    if (skip < n)
+    {
+        int len = pub_queue_format_binary(&batch[skip], &details[skip], n - skip,
+                                          records, sizeof(records));
+        int err = len < 0 ? len
+                          : mqtt_publish_topic(MISOGATE_POS_BIN, records, len,
+                                               MQTT_QOS_0_AT_MOST_ONCE);
+        if (err == -EAGAIN || err == -ENOMEM)
+        {
+            return err;
+        }
+        bin_next_seq = batch[n - 1].seq + 1;
+        if (err)
+        {
+            LOG_WRN("Binary position publish failed: %d", err);
+            ret = err;
+        }
     }
+#else
+    ARG_UNUSED(details);
+#endif
 
-    if (connecting)
+#if defined(CONFIG_MISOGATE_MQTT_JSON_PAYLOAD)
+    static char payload[MQTT_PUB_PAYLOAD_MAX];
+
+    int len = pub_queue_format_json(batch, n, payload, sizeof(payload));
+    if (len < 0)
     {
-        LOG_DBG("Connection already in progress");
-        return -EALREADY;
+        LOG_ERR("Position batch of %u does not fit", (unsigned)n);
+        return ret ? ret : len;
     }
 
-    LOG_INF("Resolving broker hostname: %s", SERVER_HOST);
-    err = broker_init(); // Re-resolve in case IP changed
-    if (err)
+    int err = mqtt_publish_json(payload, len, MQTT_QOS_0_AT_MOST_ONCE);
+    if (err == -EAGAIN || err == -ENOMEM)
     {
-        LOG_ERR("Failed to resolve broker hostname, error: %d", err);
         return err;
     }
-
-    LOG_INF("Initiating MQTT connection to %s:%d (attempt %d/%d)",
-            SERVER_HOST, SERVER_PORT, connection_retries + 1, MQTT_MAX_RETRIES);
-    LOG_INF("Client ID: %s, Username: %s", MQTT_CLIENTID, MQTT_USERNAME);
-
-    connecting = true;
-    err = mqtt_connect(&client_ctx);
     if (err)
     {
-        LOG_ERR("mqtt_connect failed: %d", err);
-        connecting = false;
-        return err;
+        LOG_WRN("Position publish failed: %d", err);
+        ret = ret ? ret : err;
     }
+#endif
 
-    prepare_fds(&client_ctx);
-    LOG_INF("MQTT connection initiated, waiting for CONNACK...");
-    return 0;
+    return ret;
 }
 
-int mqtt_app_connect_with_retries(void)
+/**
+ * Send the next batch of queued positions.
+ *
+ * While the client is backing off, new samples keep pushing the oldest
+ * ones out of the queue. Any error other than backpressure drops the
+ * batch. While disconnected, queued samples move to the backlog instead.
+ */
+static void publish_queued(int64_t *retry_at, int *backoff_ms)
 {
-    int err;
-
-    connection_retries = 0;
+    static struct pub_sample batch[PUB_QUEUE_BATCH_MAX];
+    static struct pub_detail details[PUB_QUEUE_BATCH_MAX];
 
-    while (connection_retries < MQTT_MAX_RETRIES)
+    if (!connected)
     {
-        err = mqtt_app_connect();
-        if (err == 0)
+        size_t n = pub_queue_peek_batch(batch, NULL, k_uptime_get_32());
+        for (size_t i = 0; i < n; i++)
         {
-            /* Connection initiated successfully */
-            return 0;
+            backlog_store(&batch[i]);
         }
-
-        connection_retries++;
-        if (connection_retries < MQTT_MAX_RETRIES)
+        if (n)
         {
-            LOG_WRN("MQTT connect attempt %d/%d failed, retrying in %d ms...",
-                    connection_retries, MQTT_MAX_RETRIES, MQTT_RETRY_DELAY_MS);
-            k_sleep(K_MSEC(MQTT_RETRY_DELAY_MS));
+            pub_queue_complete(n, PUB_DEFERRED);
         }
+        return;
     }
 
-    LOG_ERR("MQTT connection failed after %d attempts", MQTT_MAX_RETRIES);
-    return err;
-}
+    if (k_uptime_get() < *retry_at)
+    {
+        return;
+    }
 
-void mqtt_app_disconnect(void)
-{
-    if (connected || connecting)
+    size_t n = pub_queue_peek_batch(batch,
+                                    IS_ENABLED(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD) ? details : NULL,
+                                    k_uptime_get_32());
+    if (n == 0)
     {
-        LOG_INF("Disconnecting from MQTT broker");
-        mqtt_disconnect(&client_ctx, NULL);
-        connected = false;
-        connecting = false;
+        return;
     }
-}
 
-bool mqtt_is_connected(void)
-{
-    return connected;
+    int err = publish_batch(batch, details, n);
+    if (!publish_done(err, retry_at, backoff_ms))
+    {
+        return;
+    }
+
+    pub_queue_complete(n, err == 0 ? PUB_SENT : PUB_FAILED);
 }
 
-bool mqtt_is_connecting(void)
+/**
+ * Replay one batch of the backlog on MISOGATE_REPLAY.
+ *
+ * Only when the live queue is empty, and at most every
+ * MQTT_REPLAY_INTERVAL_MS, so catching up never delays live positions or
+ * floods the link right after a reconnect. Shares the live feed's
+ * backoff. A failed replay is retried: the backlog is only consumed once
+ * the client took the message.
+ */
+static void replay_backlog(int64_t *retry_at, int *backoff_ms, int64_t *next_replay_ms)
 {
-    return connecting;
+    static struct pub_sample batch[BACKLOG_BATCH];
+    static char payload[MQTT_PUB_PAYLOAD_MAX];
+
+    if (!connected || k_uptime_get() < *retry_at || k_uptime_get() < *next_replay_ms ||
+        pub_queue_count() > 0 || !backlog_pending())
+    {
+        return;
+    }
+
+    uint32_t batch_boot;
+    size_t n = backlog_peek(batch, &batch_boot);
+    if (n == 0)
+    {
+        return;
+    }
+
+    int len = backlog_format_json(batch_boot, batch, n, payload, sizeof(payload));
+    if (len < 0)
+    {
+        LOG_ERR("Replay batch of %u does not fit", (unsigned)n);
+        backlog_consume(n);
+        return;
+    }
+
+    int err = mqtt_publish_topic(MISOGATE_REPLAY, payload, len, MQTT_QOS_0_AT_MOST_ONCE);
+    if (!publish_done(err, retry_at, backoff_ms))
+    {
+        return;
+    }
+
+    *next_replay_ms = k_uptime_get() + MQTT_REPLAY_INTERVAL_MS;
+    if (err)
+    {
+        LOG_WRN("Replay publish failed: %d", err);
+        return;
+    }
+    backlog_consume(n);
 }
 
-int mqtt_wait_connected(uint32_t timeout_ms)
+static void log_backlog(int64_t *next_log_ms, struct backlog_stats *last)
 {
-    if (connected)
+    if (k_uptime_get() < *next_log_ms)
     {
-        return 0;
+        return;
     }
 
-    if (!connecting)
+    struct backlog_stats st;
+    backlog_get_stats(&st);
+    if (memcmp(&st, last, sizeof(st)) != 0)
     {
-        LOG_ERR("mqtt_wait_connected called but not connecting");
-        return -EINVAL;
+        LOG_INF("Backlog: stored %u, replayed %u, spilled %u, dropped %u",
+                (unsigned)st.stored, (unsigned)st.replayed,
+                (unsigned)st.spilled, (unsigned)st.dropped);
+        *last = st;
     }
+    *next_log_ms = k_uptime_get() + MQTT_BACKLOG_LOG_MS;
+}
 
-    uint32_t elapsed = 0;
-    const uint32_t poll_interval = 50; /* ms */
-
-    LOG_INF("Waiting for MQTT CONNACK (timeout=%u ms)...", timeout_ms);
+static void log_queue_drops(int64_t *next_log_ms, uint32_t *last_dropped)
+{
+    if (k_uptime_get() < *next_log_ms)
+    {
+        return;
+    }
 
-    while (elapsed < timeout_ms)
+    struct pub_queue_stats st;
+    pub_queue_get_stats(&st);
+    uint32_t dropped = st.dropped_full + st.dropped_stale + st.dropped_error;
+    if (dropped != *last_dropped)
     {
-        /* Process MQTT events to receive CONNACK */
-        wait(poll_interval);
-        mqtt_input(&client_ctx);
+        LOG_WRN("Publish queue dropped %u positions (full %u, stale %u, error %u)",
+                (unsigned)(dropped - *last_dropped), (unsigned)st.dropped_full,
+                (unsigned)st.dropped_stale, (unsigned)st.dropped_error);
+        *last_dropped = dropped;
+    }
+    *next_log_ms = k_uptime_get() + MQTT_NET_DROP_LOG_MS;
+}
 
-        if (connected)
+static void mqtt_net_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    int64_t retry_at = 0;
+    int backoff_ms = 0;
+    int64_t next_log_ms = 0;
+    uint32_t last_dropped = 0;
+    int64_t next_replay_ms = 0;
+    int64_t next_backlog_log_ms = 0;
+    struct backlog_stats last_backlog = {0};
+
+    while (1)
+    {
+        if (!net_running)
         {
-            LOG_INF("MQTT connection established after %u ms", elapsed);
-            return 0;
+            if (conn_state != CONN_IDLE)
+            {
+                abort_connection();
+                set_state(CONN_IDLE);
+            }
+            k_sem_take(&net_start_sem, K_FOREVER);
+            if (net_running && conn_state == CONN_IDLE)
+            {
+                /* First attempt right away */
+                conn_attempts = 0;
+                conn_deadline_ms = k_uptime_get();
+                set_state(CONN_BACKOFF);
+            }
+            continue;
         }
 
-        if (!connecting)
+        conn_step();
+        if (conn_state == CONN_CONNECTING || conn_state == CONN_CONNECTED)
         {
-            /* Connection failed (got error in event handler) */
-            LOG_ERR("MQTT connection failed during wait");
-            return -ECONNREFUSED;
+            poll_input();
+        }
+        else
+        {
+            k_sleep(K_MSEC(MQTT_NET_POLL_MS));
         }
 
-        elapsed += poll_interval;
+        publish_queued(&retry_at, &backoff_ms);
+        replay_backlog(&retry_at, &backoff_ms, &next_replay_ms);
+        backlog_service();
+        log_queue_drops(&next_log_ms, &last_dropped);
+        log_backlog(&next_backlog_log_ms, &last_backlog);
     }
+}
 
-    LOG_ERR("MQTT connection timeout after %u ms", timeout_ms);
-    return -ETIMEDOUT;
+int mqtt_app_init(void)
+{
+    client_init(&client_ctx);
+    pub_queue_init();
+
+    /* Lets the backend tell this boot's sequence numbers from the last one's */
+    boot_id = sys_rand32_get();
+    (void)backlog_init(boot_id);
+    queues_ready = true;
+
+    net_thread_id = k_thread_create(&net_thread_data,
+                                    net_stack,
+                                    K_THREAD_STACK_SIZEOF(net_stack),
+                                    mqtt_net_thread,
+                                    NULL, NULL, NULL,
+                                    MQTT_NET_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(net_thread_id, "mqtt_net");
+    return 0;
 }
 
-void mqtt_app_input(void)
+void mqtt_net_start(void)
 {
-    // Process MQTT events regardless of connection state
-    // This is necessary to receive CONNACK and complete the handshake
-    if (connecting || connected)
-    {
-        wait(10); // Short wait
-        mqtt_input(&client_ctx);
+    /* The network thread owns the connection state from here */
+    net_running = true;
+    k_sem_give(&net_start_sem);
+}
 
-        // Handle keepalive
-        if (connected)
-        {
-            mqtt_live(&client_ctx);
-        }
-    }
+void mqtt_net_stop(void)
+{
+    /* The network thread drops the connection and parks */
+    net_running = false;
 }
 
-static void mqtt_reconnect_work_fn(struct k_work *work)
+void mqtt_set_conn_handler(mqtt_conn_handler_t handler)
 {
-    ARG_UNUSED(work);
+    conn_handler = handler;
+}
 
-    if (connected || connecting)
+int mqtt_queue_position(int x, int y, const struct pub_detail *detail)
+{
+    if (!queues_ready)
     {
-        return; /* Already connected or connecting */
+        return -ENODEV;
     }
 
-    LOG_INF("Attempting MQTT reconnection (attempt %d/%d)...",
-            connection_retries + 1, MQTT_MAX_RETRIES);
+    struct pub_sample s = {
+        .seq = pos_seq++,
+        .t_ms = k_uptime_get_32(),
+        .x = (int16_t)x,
+        .y = (int16_t)y,
+    };
 
-    int err = mqtt_app_connect();
-    if (err)
+    if (connected)
     {
-        connection_retries++;
-        if (connection_retries < MQTT_MAX_RETRIES)
-        {
-            LOG_WRN("Reconnect attempt failed, scheduling retry...");
-            k_work_reschedule(&mqtt_reconnect_work, K_MSEC(MQTT_RETRY_DELAY_MS));
-        }
-        else
-        {
-            LOG_ERR("MQTT reconnection failed after %d attempts", MQTT_MAX_RETRIES);
-        }
+        return pub_queue_push(&s, detail);
     }
-    else
+
+    /* Disconnected: keep a downsampled track, enough to replay the path
+     * without filling the backlog in minutes */
+    if (s.t_ms - last_backlog_ms < MQTT_BACKLOG_INTERVAL_MS)
     {
-        /* Wait for CONNACK (non-blocking, let mqtt_app_input handle it) */
-        LOG_INF("Reconnection initiated, waiting for CONNACK...");
+        return -EAGAIN;
     }
+    last_backlog_ms = s.t_ms;
+    backlog_store(&s);
+    return 0;
 }
 
-int mqtt_publish_json(const char *json_message, size_t len, enum mqtt_qos qos)
+bool mqtt_is_connected(void)
+{
+    return connected;
+}
+
+bool mqtt_is_connecting(void)
+{
+    return conn_state == CONN_BACKOFF || conn_state == CONN_CONNECTING;
+}
+
+int mqtt_publish_topic(const char *topic, const void *data, size_t len, enum mqtt_qos qos)
 {
     struct mqtt_publish_param param;
 
     if (!connected)
     {
-        LOG_WRN("Cannot publish: MQTT not connected (connecting=%d)", connecting);
+        LOG_WRN("Cannot publish: MQTT not connected (state %d)", conn_state);
         return -ENOTCONN;
     }
 
     param.message.topic.qos = qos;
-    param.message.topic.topic.utf8 = (uint8_t *)MISOGATE_PUB;
-    param.message.topic.topic.size = strlen(MISOGATE_PUB);
-    param.message.payload.data = (uint8_t *)json_message;
+    param.message.topic.topic.utf8 = (uint8_t *)topic;
+    param.message.topic.topic.size = strlen(topic);
+    param.message.payload.data = (uint8_t *)data;
     param.message.payload.len = len;
     param.message_id = sys_rand32_get();
     param.dup_flag = 0;
     param.retain_flag = 0;
 
-    LOG_DBG("Publishing %d bytes to %s", len, MISOGATE_PUB);
+    LOG_DBG("Publishing %d bytes to %s", len, topic);
     return mqtt_publish(&client_ctx, &param);
 }
+
+int mqtt_publish_json(const char *json_message, size_t len, enum mqtt_qos qos)
+{
+    return mqtt_publish_topic(MISOGATE_PUB, json_message, len, qos);
+}
+
+void mqtt_set_command_handler(mqtt_command_handler_t handler)
+{
+    command_handler = handler;
+}
@@ -4,68 +4,97 @@
 #include <zephyr/net/mqtt.h>
 #include <stdbool.h>
 
+#include "pub_queue.h"
+
 /**
  * @brief MQTT topic definitions
  */
 #define MISOGATE_PUB "misogate/pub"
 #define MISOGATE_SUB "misogate/sub"
+#define MISOGATE_TELEMETRY "misogate/telemetry"
+#define MISOGATE_REPLAY "misogate/replay"
+#define MISOGATE_POS_BIN "misogate/pos/bin"
 
 /**
- * @brief Initialize MQTT client
+ * @brief Handler for messages received on MISOGATE_SUB
  *
- * @return 0 on success, negative errno on failure
+ * Called from the MQTT input context with the (NUL-terminated, possibly
+ * truncated) payload.
  */
-int mqtt_app_init(void);
+typedef void (*mqtt_command_handler_t)(const char *payload, size_t len);
 
 /**
- * @brief Connect to the MQTT broker (non-blocking, initiates connection)
+ * @brief Handler for MQTT session changes (see mqtt_set_conn_handler())
+ */
+typedef void (*mqtt_conn_handler_t)(bool connected);
+
+/**
+ * @brief Initialize MQTT client
  *
  * @return 0 on success, negative errno on failure
  */
-int mqtt_app_connect(void);
+int mqtt_app_init(void);
 
 /**
- * @brief Connect to the MQTT broker with retries (up to 3 attempts)
+ * @brief Check if MQTT is fully connected (CONNACK received)
  *
- * @return 0 on success, negative errno on failure after all retries
+ * @return true if connected, false otherwise
  */
-int mqtt_app_connect_with_retries(void);
+bool mqtt_is_connected(void);
 
 /**
- * @brief Wait for MQTT connection to be fully established
- *
- * This function blocks until CONNACK is received or timeout expires.
- * Must be called after mqtt_app_connect() returns successfully.
- *
- * @param timeout_ms Maximum time to wait in milliseconds
+ * @brief Check if the network thread is trying to connect
  *
- * @return 0 if connected, -ETIMEDOUT if timeout, other negative errno on error
+ * @return true while waiting to retry or for CONNACK, false otherwise
  */
-int mqtt_wait_connected(uint32_t timeout_ms);
+bool mqtt_is_connecting(void);
 
 /**
- * @brief Check if MQTT is fully connected (CONNACK received)
+ * @brief Start the network thread and connect
  *
- * @return true if connected, false otherwise
+ * The thread connects, reconnects with exponential backoff and jitter
+ * after failures, polls the socket (input, keepalive) and publishes
+ * queued positions. Returns immediately; connection progress is reported
+ * through the handler set with mqtt_set_conn_handler().
  */
-bool mqtt_is_connected(void);
+void mqtt_net_start(void);
 
 /**
- * @brief Check if MQTT connection is in progress
- *
- * @return true if connecting, false otherwise
+ * @brief Drop the connection and pause the network thread (e.g. when the
+ *        network goes down)
  */
-bool mqtt_is_connecting(void);
+void mqtt_net_stop(void);
 
 /**
- * @brief Disconnect from the MQTT broker
+ * @brief Set the handler told about connection changes
+ *
+ * Called from the network thread with true once CONNACK is received and
+ * the command topic subscribed, and with false when the session is lost.
+ * Must not block.
  */
-void mqtt_app_disconnect(void);
+void mqtt_set_conn_handler(mqtt_conn_handler_t handler);
 
 /**
- * @brief Process MQTT input (call this regularly or from a thread)
+ * @brief Queue a position for publishing on MISOGATE_PUB
+ *
+ * Never blocks; the network thread sends whatever has accumulated as
+ * one message (see pub_queue.h for the payload and drop policy). Every
+ * position gets a sequence number. With CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD
+ * it also goes out as a compact record with the solver detail on
+ * MISOGATE_POS_BIN; CONFIG_MISOGATE_MQTT_JSON_PAYLOAD keeps the JSON
+ * message on MISOGATE_PUB.
+ *
+ * While the broker is unreachable, one position per
+ * CONFIG_MISOGATE_MQTT_BACKLOG_INTERVAL_MS goes to the backlog instead
+ * and is replayed on MISOGATE_REPLAY after reconnecting (see backlog.h).
+ *
+ * @param x, y Position (0-1000)
+ * @param detail Solver detail for the binary record, or NULL
+ * @return 0, -ENOBUFS if the oldest queued position was dropped, -EAGAIN
+ *         if the position was skipped by backlog downsampling, -ENODEV
+ *         before mqtt_app_init()
  */
-void mqtt_app_input(void);
+int mqtt_queue_position(int x, int y, const struct pub_detail *detail);
 
 /**
  * @brief Publish a JSON message to MISOGATE_PUB topic
@@ -78,4 +107,23 @@ void mqtt_app_input(void);
  */
 int mqtt_publish_json(const char *json_message, size_t len, enum mqtt_qos qos);
 
+/**
+ * @brief Publish a message to a given topic
+ *
+ * @param topic Topic name
+ * @param data Payload
+ * @param len Payload length
+ * @param qos Quality of Service level
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int mqtt_publish_topic(const char *topic, const void *data, size_t len, enum mqtt_qos qos);
+
+/**
+ * @brief Set the handler for commands received on MISOGATE_SUB
+ *
+ * @param handler Handler, or NULL to ignore commands
+ */
+void mqtt_set_command_handler(mqtt_command_handler_t handler);
+
 #endif /* MQTT_H */
@@ -0,0 +1,253 @@
+/**
+ * @file pub_queue.c
+ * @brief Bounded queue of position samples between the publisher and the
+ *        MQTT network thread
+ *
+ * The 100 ms position work only appends here; the network thread takes
+ * everything that accumulated and sends it as one message. On a good link
+ * that is one sample per publish, as before. When a TLS write stalls,
+ * samples pile up and go out together once the link recovers, so the
+ * number of publishes (and their per-message overhead) drops exactly when
+ * the link is short on capacity.
+ *
+ * head and tail are free-running counters under a spinlock. The producer
+ * may push the tail forward when the queue is full, so a batch the
+ * consumer is still sending is tracked by its starting position and only
+ * the part that was not already overwritten is removed on completion.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pub_queue.h"
+
+BUILD_ASSERT((PUB_QUEUE_DEPTH & (PUB_QUEUE_DEPTH - 1)) == 0,
+             "CONFIG_MISOGATE_MQTT_PUB_QUEUE_DEPTH must be a power of two");
+BUILD_ASSERT(PUB_QUEUE_BATCH_MAX <= PUB_QUEUE_DEPTH,
+             "CONFIG_MISOGATE_MQTT_PUB_BATCH_MAX exceeds the queue depth");
+
+BUILD_ASSERT(PUB_DETAIL_NODES < 64, "node count is stored in 6 bits");
+
+static struct pub_sample ring[PUB_QUEUE_DEPTH];
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+static struct pub_detail detail_ring[PUB_QUEUE_DEPTH];
+#endif
+static uint32_t head;       /* Next sample written */
+static uint32_t tail;       /* Oldest sample held */
+static uint32_t batch_tail; /* tail when the batch in flight was taken */
+static struct pub_queue_stats stats;
+static struct k_spinlock lock;
+
+void pub_queue_init(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    head = 0;
+    tail = 0;
+    batch_tail = 0;
+    memset(&stats, 0, sizeof(stats));
+    k_spin_unlock(&lock, key);
+}
+
+int pub_queue_push(const struct pub_sample *s, const struct pub_detail *d)
+{
+    int ret = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (head - tail == PUB_QUEUE_DEPTH)
+    {
+        tail++;
+        stats.dropped_full++;
+        ret = -ENOBUFS;
+    }
+    ring[head % PUB_QUEUE_DEPTH] = *s;
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+    if (d)
+    {
+        detail_ring[head % PUB_QUEUE_DEPTH] = *d;
+    }
+    else
+    {
+        memset(&detail_ring[head % PUB_QUEUE_DEPTH], 0, sizeof(*d));
+    }
+#else
+    ARG_UNUSED(d);
+#endif
+    head++;
+    stats.queued++;
+    k_spin_unlock(&lock, key);
+
+    return ret;
+}
+
+size_t pub_queue_peek_batch(struct pub_sample *out, struct pub_detail *details,
+                            uint32_t now_ms)
+{
+    size_t n = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    while (tail != head &&
+           (int32_t)(now_ms - ring[tail % PUB_QUEUE_DEPTH].t_ms) > PUB_QUEUE_MAX_AGE_MS)
+    {
+        tail++;
+        stats.dropped_stale++;
+    }
+
+    batch_tail = tail;
+    for (uint32_t i = tail; i != head && n < PUB_QUEUE_BATCH_MAX; i++, n++)
+    {
+        out[n] = ring[i % PUB_QUEUE_DEPTH];
+#if defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+        if (details)
+        {
+            details[n] = detail_ring[i % PUB_QUEUE_DEPTH];
+        }
+#endif
+    }
+    k_spin_unlock(&lock, key);
+
+#if !defined(CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+    if (details)
+    {
+        memset(details, 0, n * sizeof(*details));
+    }
+#endif
+
+    return n;
+}
+
+void pub_queue_complete(size_t count, enum pub_result result)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t end = batch_tail + (uint32_t)count;
+
+    /* Only the part of the batch the producer has not overwritten meanwhile */
+    if ((int32_t)(end - tail) > 0)
+    {
+        tail = end;
+    }
+
+    switch (result)
+    {
+    case PUB_SENT:
+        stats.published += (uint32_t)count;
+        stats.batches++;
+        break;
+    case PUB_DEFERRED:
+        stats.deferred += (uint32_t)count;
+        break;
+    default:
+        stats.dropped_error += (uint32_t)count;
+        break;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+size_t pub_queue_count(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    size_t n = head - tail;
+    k_spin_unlock(&lock, key);
+
+    return n;
+}
+
+int pub_queue_format_json(const struct pub_sample *batch, size_t count,
+                          char *buf, size_t len)
+{
+    if (count == 0)
+    {
+        return -EINVAL;
+    }
+
+    const struct pub_sample *last = &batch[count - 1];
+    int used = snprintf(buf, len, "{\"x\":%d,\"y\":%d,\"seq\":%u",
+                        last->x, last->y, (unsigned)last->seq);
+
+    if (count > 1 && used > 0 && (size_t)used < len)
+    {
+        used += snprintf(buf + used, len - used, ",\"pts\":[");
+        for (size_t i = 0; i < count && used > 0 && (size_t)used < len; i++)
+        {
+            used += snprintf(buf + used, len - used, "%s[%u,%u,%d,%d]",
+                             i ? "," : "", (unsigned)batch[i].seq,
+                             (unsigned)batch[i].t_ms, batch[i].x, batch[i].y);
+        }
+        if (used > 0 && (size_t)used < len)
+        {
+            used += snprintf(buf + used, len - used, "]");
+        }
+    }
+    if (used > 0 && (size_t)used < len)
+    {
+        used += snprintf(buf + used, len - used, "}");
+    }
+
+    return (used > 0 && (size_t)used < len) ? used : -ENOSPC;
+}
+
+static uint8_t *put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v)
+{
+    p = put_le16(p, (uint16_t)v);
+    return put_le16(p, (uint16_t)(v >> 16));
+}
+
+static uint16_t saturate_u16(float v)
+{
+    return v <= 0.0f ? 0 : (v >= (float)UINT16_MAX ? UINT16_MAX : (uint16_t)(v + 0.5f));
+}
+
+int pub_queue_format_binary(const struct pub_sample *batch,
+                            const struct pub_detail *details, size_t count,
+                            uint8_t *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct pub_sample *s = &batch[i];
+        const struct pub_detail *d = &details[i];
+        uint8_t n = MIN(d->node_count, (uint8_t)PUB_DETAIL_NODES);
+
+        if ((size_t)(p - buf) + PUB_BIN_HEADER_LEN + 2u * n > len)
+        {
+            return -ENOSPC;
+        }
+
+        uint32_t M_bits;
+        memcpy(&M_bits, &d->M, sizeof(M_bits));
+
+        *p++ = PUB_BIN_VERSION;
+        *p++ = n | (d->flags & PUB_BIN_FLAG_EKF);
+        p = put_le16(p, (uint16_t)s->seq);
+        p = put_le32(p, s->t_ms);
+        p = put_le16(p, (uint16_t)s->x);
+        p = put_le16(p, (uint16_t)s->y);
+        p = put_le32(p, M_bits);
+        p = put_le16(p, saturate_u16(d->residual / PUB_BIN_FIELD_LSB));
+        *p++ = d->fresh_nodes;
+        *p++ = (uint8_t)MIN(saturate_u16(d->pos_std), UINT8_MAX);
+        for (uint8_t k = 0; k < n; k++)
+        {
+            p = put_le16(p, d->absB[k]);
+        }
+    }
+
+    return (int)(p - buf);
+}
+
+void pub_queue_get_stats(struct pub_queue_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,189 @@
+#ifndef PUB_QUEUE_H
+#define PUB_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ------------ Configuration ------------ */
+
+/**
+ * @brief Position samples held for the network thread (power of two)
+ */
+#define PUB_QUEUE_DEPTH CONFIG_MISOGATE_MQTT_PUB_QUEUE_DEPTH
+
+/**
+ * @brief Most samples coalesced into one publish
+ */
+#define PUB_QUEUE_BATCH_MAX CONFIG_MISOGATE_MQTT_PUB_BATCH_MAX
+
+/**
+ * @brief Samples older than this when the network thread gets to them are
+ *        dropped instead of published
+ */
+#define PUB_QUEUE_MAX_AGE_MS CONFIG_MISOGATE_MQTT_PUB_MAX_AGE_MS
+
+/**
+ * @brief Nodes carried in a binary position record
+ */
+#define PUB_DETAIL_NODES CONFIG_MISOGATE_MAX_NODES
+
+/**
+ * @brief Binary position record layout (MISOGATE_POS_BIN), little-endian
+ *
+ *   0  u8   version (PUB_BIN_VERSION)
+ *   1  u8   bits 0-5 node count n, bit 6 set if tracked by the EKF
+ *   2  u16  position sequence number (low 16 bits)
+ *   4  u32  uptime (ms)
+ *   8  u16  x (0-1000)
+ *  10  u16  y (0-1000)
+ *  12  f32  dipole moment M
+ *  16  u16  RMS dipole model residual over the nodes (PUB_BIN_FIELD_LSB)
+ *  18  u8   nodes in the residual (fresh, with a baseline)
+ *  19  u8   1-sigma position uncertainty (0-1000 units, 0 if unknown)
+ *  20  u16  |B| of the magnet field at node 1..n (PUB_BIN_FIELD_LSB)
+ *
+ * 20 + 2n bytes, 32 for six nodes. Saturating fields read 0xffff / 0xff.
+ * A message is one or more records back to back.
+ */
+#define PUB_BIN_VERSION 2
+#define PUB_BIN_HEADER_LEN 20
+#define PUB_BIN_RECORD_MAX (PUB_BIN_HEADER_LEN + 2 * PUB_DETAIL_NODES)
+#define PUB_BIN_FIELD_LSB 10 /* m-uT per count (10 nT, up to 655 uT) */
+#define PUB_BIN_FLAG_EKF 0x40
+
+/* ------------ Data structures ------------ */
+
+/**
+ * @brief One position sample waiting to be published
+ */
+struct pub_sample
+{
+    uint32_t seq;  /* Position sequence number, per boot */
+    uint32_t t_ms; /* k_uptime_get_32() when queued */
+    int16_t x;     /* Position (0-1000) */
+    int16_t y;
+};
+
+/**
+ * @brief Solver detail carried with a live sample (binary payload only)
+ */
+struct pub_detail
+{
+    float M;                           /* Dipole moment fit */
+    float residual;                    /* RMS dipole model residual (m-uT) */
+    float pos_std;                     /* 1-sigma uncertainty, 0 if unknown */
+    uint8_t fresh_nodes;               /* Fresh nodes the residual used */
+    uint8_t flags;                     /* PUB_BIN_FLAG_* */
+    uint8_t node_count;                /* Entries used in absB */
+    uint16_t absB[PUB_DETAIL_NODES];   /* Per-node |B| (PUB_BIN_FIELD_LSB) */
+};
+
+/**
+ * @brief Queue counters
+ */
+struct pub_queue_stats
+{
+    uint32_t queued;        /* Samples accepted */
+    uint32_t published;     /* Samples sent (in any batch) */
+    uint32_t batches;       /* Publishes carrying them */
+    uint32_t dropped_full;  /* Oldest samples overwritten by newer ones */
+    uint32_t dropped_stale; /* Samples too old by the time they were sent */
+    uint32_t dropped_error; /* Samples in a batch the client refused */
+    uint32_t deferred;      /* Samples handed to the backlog instead */
+};
+
+/**
+ * @brief What became of a batch from pub_queue_peek_batch()
+ */
+enum pub_result
+{
+    PUB_SENT,     /* Published */
+    PUB_FAILED,   /* Given up on */
+    PUB_DEFERRED, /* Kept elsewhere for later (store-and-forward) */
+};
+
+/* ------------ Public API ------------ */
+
+/**
+ * @brief Empty the queue and reset counters
+ */
+void pub_queue_init(void);
+
+/**
+ * @brief Queue a position sample
+ *
+ * Never blocks. If the queue is full the oldest sample is dropped: for a
+ * live position feed the newest value is the one worth sending.
+ *
+ * @param s Sample
+ * @param d Solver detail for the binary payload, or NULL (kept only with
+ *          CONFIG_MISOGATE_MQTT_BINARY_PAYLOAD)
+ * @return 0, or -ENOBUFS if an older sample was dropped to make room
+ */
+int pub_queue_push(const struct pub_sample *s, const struct pub_detail *d);
+
+/**
+ * @brief Copy out the next batch to publish, without removing it
+ *
+ * Samples older than PUB_QUEUE_MAX_AGE_MS relative to @p now_ms are
+ * discarded first.
+ *
+ * @param out Destination (PUB_QUEUE_BATCH_MAX entries)
+ * @param details Destination for the solver details (PUB_QUEUE_BATCH_MAX
+ *                entries), or NULL
+ * @param now_ms Current k_uptime_get_32()
+ * @return Number of samples copied, 0 if the queue is empty
+ */
+size_t pub_queue_peek_batch(struct pub_sample *out, struct pub_detail *details,
+                            uint32_t now_ms);
+
+/**
+ * @brief Finish a batch returned by pub_queue_peek_batch()
+ *
+ * @param count Samples in the batch
+ * @param result What happened to it (only affects the counters)
+ */
+void pub_queue_complete(size_t count, enum pub_result result);
+
+/**
+ * @brief Samples currently queued
+ */
+size_t pub_queue_count(void);
+
+/**
+ * @brief Format a batch as the MISOGATE_PUB JSON payload
+ *
+ * One sample keeps the original {"x":X,"y":Y} message plus its sequence
+ * number. Several samples add them oldest first, with their sequence
+ * number and uptime in ms, while x/y/seq stay the newest position, so
+ * existing subscribers keep working:
+ *
+ *   {"x":X,"y":Y,"seq":N}
+ *   {"x":X,"y":Y,"seq":N,"pts":[[seq,t,x,y],...]}
+ *
+ * @return Length written, or -ENOSPC if it does not fit
+ */
+int pub_queue_format_json(const struct pub_sample *batch, size_t count,
+                          char *buf, size_t len);
+
+/**
+ * @brief Format a batch as MISOGATE_POS_BIN records (see PUB_BIN_VERSION)
+ *
+ * @param batch Samples
+ * @param details Their solver details
+ * @param count Samples in the batch
+ * @param buf Destination
+ * @param len Size of @p buf
+ * @return Length written, or -ENOSPC if it does not fit
+ */
+int pub_queue_format_binary(const struct pub_sample *batch,
+                            const struct pub_detail *details, size_t count,
+                            uint8_t *buf, size_t len);
+
+/**
+ * @brief Get queue counters
+ */
+void pub_queue_get_stats(struct pub_queue_stats *stats);
+
+#endif /* PUB_QUEUE_H */
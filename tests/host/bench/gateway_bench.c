@@ -0,0 +1,1000 @@
+/*
+ * Gateway Signal-Chain Benchmark
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Times the per-packet gateway work on the host and reports ns/op:
+ * secure frame parse + decrypt (single-sample, batch and packed frames, the
+ * latter two also checked to round-trip every sample), the keystream and
+ * MAC of one frame against a byte-wise reference, the dipole Gauss-Newton
+ * solver, the calibration lookup table, weighted triangulation and one EKF
+ * update. Recording a packet telemetry event is timed next to formatting the
+ * text log line it replaced. The RX frame queue is exercised with a real
+ * producer and consumer thread, which also checks it delivers frames in
+ * order and counts overflow. The MQTT publish queue is timed queueing and
+ * draining positions in batches, and checked to drop the oldest positions
+ * when full.
+ *
+ * Inputs are synthetic dipole fields, so numbers are comparable between
+ * runs on the same machine; they are not a substitute for on-target timing.
+ *
+ * Usage: gateway_bench [--quick] [--nodes N]
+ *
+ * --nodes lays N sensors out evenly around the edge of the tracking area
+ * instead of the default three corners.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#include "calibration.h"
+#include "crypto_min.h"
+#include "ekf.h"
+#include "frame_queue.h"
+#include "magsim.h"
+#include "packet.h"
+#include "position.h"
+#include "pub_queue.h"
+#include "siphash.h"
+#include "backlog.h"
+#include "tdma.h"
+#include "telemetry.h"
+
+/* Dipole strength for synthetic fields (m-uT at unit distance) */
+#define BENCH_DIPOLE_M 1.0e12f
+
+/* Frames generated per batch; sequence numbers keep rising across batches */
+#define FRAME_BATCH 1024
+
+/* Sink so the compiler cannot drop benchmarked work */
+static volatile float g_sink;
+
+static const uint8_t BENCH_MASTER_KEY[16] = {
+    0x62, 0x65, 0x6e, 0x63, 0x68, 0x2d, 0x6b, 0x65,
+    0x79, 0x2d, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35};
+
+/* =============================================================================
+ * Helpers
+ * =============================================================================
+ */
+
+struct bench_result {
+  const char *name;
+  long iterations;
+  double ns_per_op;
+};
+
+static void report(const struct bench_result *r) {
+  printf("%-32s %10ld iters %12.1f ns/op\n", r->name, r->iterations,
+         r->ns_per_op);
+}
+
+/**
+ * @brief Fill node states with the ideal field of a magnet at (x, y)
+ */
+static void synth_nodes(struct node_state *nodes, float x, float y) {
+  memset(nodes, 0, sizeof(struct node_state) * (MAX_NODES + 1));
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    struct vec3_f B;
+    position_compute_dipole_field(x, y, BENCH_DIPOLE_M,
+                                  position_get_sensor_pos(nid), &B);
+    nodes[nid].have_baseline = true;
+    nodes[nid].last_B_mag.x = (int32_t)lrintf(B.x);
+    nodes[nid].last_B_mag.y = (int32_t)lrintf(B.y);
+    nodes[nid].last_B_mag.z = (int32_t)lrintf(B.z);
+  }
+}
+
+/* =============================================================================
+ * Benchmarks
+ * =============================================================================
+ */
+
+static int bench_frame_parse(long batches, struct bench_result *r) {
+  static uint8_t frames[FRAME_BATCH][SECURE_FRAME_LEN];
+  static uint32_t seq[MAX_NODES + 1];
+  struct node_state nodes[MAX_NODES + 1];
+  int64_t total_ns = 0;
+  long ok = 0;
+
+  synth_nodes(nodes, 420.0f, 380.0f);
+  packet_rekey(BENCH_MASTER_KEY);
+
+  for (long b = 0; b < batches; b++) {
+    /* Untimed: fresh sequence numbers so the replay check passes */
+    for (int i = 0; i < FRAME_BATCH; i++) {
+      uint8_t nid = (uint8_t)(1 + i % position_get_node_count());
+      magsim_encode_frame(BENCH_MASTER_KEY, nid, MAGSIM_BOOT_EPOCH,
+                          ++seq[nid], &nodes[nid].last_B_mag, frames[i]);
+    }
+
+    int64_t t0 = host_monotonic_ns();
+    for (int i = 0; i < FRAME_BATCH; i++) {
+      struct sensor_frame f;
+      if (packet_parse_secure_frame_encmac(frames[i], SECURE_FRAME_LEN, &f) ==
+          0) {
+        ok++;
+        g_sink += (float)f.x_uT_milli;
+      }
+    }
+    total_ns += host_monotonic_ns() - t0;
+  }
+
+  r->name = "frame_parse_decrypt";
+  r->iterations = batches * FRAME_BATCH;
+  r->ns_per_op = (double)total_ns / (double)r->iterations;
+
+  if (ok != r->iterations) {
+    fprintf(stderr, "frame_parse_decrypt: %ld of %ld frames rejected\n",
+            r->iterations - ok, r->iterations);
+    return -1;
+  }
+
+  /* Untimed: the replay window, on a node ID no other benchmark uses.
+   * Reordered frames pass once, a reboot (next epoch, counter back to 0)
+   * is accepted at once, the old epoch and frames too far back are not. */
+  static const struct {
+    uint16_t epoch;
+    uint32_t seq;
+    bool accept;
+  } replay[] = {
+      {5, 100, true}, {5, 102, true},  {5, 101, true}, {5, 101, false},
+      {5, 102, false}, {5, 38, false}, {5, 39, true},  {5, 200, true},
+      {5, 137, true}, {6, 0, true},   {5, 201, false}, {6, 0, false},
+  };
+  const uint8_t nid = (uint8_t)(MAX_NODES + 1);
+  for (size_t i = 0; i < sizeof(replay) / sizeof(replay[0]); i++) {
+    struct sensor_frame f;
+    magsim_encode_frame(BENCH_MASTER_KEY, nid, replay[i].epoch, replay[i].seq,
+                        &nodes[1].last_B_mag, frames[0]);
+    bool accepted =
+        packet_parse_secure_frame_encmac(frames[0], SECURE_FRAME_LEN, &f) == 0;
+    if (accepted != replay[i].accept) {
+      fprintf(stderr, "frame_parse_decrypt: epoch %u seq %u %s\n",
+              (unsigned)replay[i].epoch, (unsigned)replay[i].seq,
+              accepted ? "accepted" : "rejected");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int bench_batch_parse(long batches, struct bench_result *r) {
+  static uint8_t frames[FRAME_BATCH][SECURE_FRAME_MAX_LEN];
+  static size_t lens[FRAME_BATCH];
+  /* Above anything bench_frame_parse used, so the replay check passes */
+  static uint32_t seq[MAX_NODES + 1] = {[0 ... MAX_NODES] = 0x80000000u};
+  static const uint16_t age_ms[SENSOR_BATCH_MAX] = {3750, 2500, 1250, 0};
+  struct node_state nodes[MAX_NODES + 1];
+  struct vec3_i32 B[MAX_NODES + 1][SENSOR_BATCH_MAX];
+  int64_t total_ns = 0;
+  long ok = 0;
+
+  synth_nodes(nodes, 420.0f, 380.0f);
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    for (int k = 0; k < SENSOR_BATCH_MAX; k++) {
+      B[nid][k] = nodes[nid].last_B_mag;
+      B[nid][k].x += 100 * k - 150; /* Distinct and negative too */
+    }
+  }
+  packet_rekey(BENCH_MASTER_KEY);
+
+  for (long b = 0; b < batches; b++) {
+    for (int i = 0; i < FRAME_BATCH; i++) {
+      uint8_t nid = (uint8_t)(1 + i % position_get_node_count());
+      lens[i] = magsim_encode_batch(BENCH_MASTER_KEY, nid, MAGSIM_BOOT_EPOCH,
+                                    ++seq[nid], B[nid], age_ms,
+                                    SENSOR_BATCH_MAX, frames[i]);
+    }
+
+    int64_t t0 = host_monotonic_ns();
+    for (int i = 0; i < FRAME_BATCH; i++) {
+      struct sensor_frame f[PACKET_SAMPLES_MAX];
+      int n = packet_parse_secure_frames(frames[i], lens[i], f);
+      for (int k = 0; k < n; k++) {
+        g_sink += (float)f[k].x_uT_milli;
+      }
+      ok += n;
+    }
+    total_ns += host_monotonic_ns() - t0;
+  }
+
+  /* Untimed: one frame decoded sample by sample */
+  struct sensor_frame f[PACKET_SAMPLES_MAX];
+  int n = packet_parse_secure_frames(
+      frames[0],
+      magsim_encode_batch(BENCH_MASTER_KEY, 1, MAGSIM_BOOT_EPOCH, ++seq[1],
+                          B[1], age_ms, SENSOR_BATCH_MAX, frames[0]),
+      f);
+  bool match = n == SENSOR_BATCH_MAX;
+  for (int k = 0; match && k < n; k++) {
+    match = f[k].node_id == 1 && f[k].age_ms == age_ms[k] &&
+            f[k].x_uT_milli == B[1][k].x && f[k].y_uT_milli == B[1][k].y &&
+            f[k].z_uT_milli == B[1][k].z;
+  }
+
+  r->name = "batch_parse_decrypt (/sample)";
+  r->iterations = batches * FRAME_BATCH * SENSOR_BATCH_MAX;
+  r->ns_per_op = (double)total_ns / (double)r->iterations;
+
+  if (ok != r->iterations || !match) {
+    fprintf(stderr, "batch_parse_decrypt: %ld of %ld samples rejected%s\n",
+            r->iterations - ok, r->iterations,
+            match ? "" : ", decoded batch differs");
+    return -1;
+  }
+  return 0;
+}
+
+/* Samples per packed frame, as the node sends them */
+#define PACKED_SAMPLES 8
+#define PACKED_INTERVAL_MS 625
+/* 1-sigma of a still magnet's reading averaged over 62 measurements */
+#define PACKED_NOISE_MUT 9
+
+static bool packed_matches(const struct sensor_frame *f, int n,
+                           const struct vec3_i32 *B, size_t used,
+                           uint16_t newest_age_ms, uint16_t noise_mut) {
+  if (n != (int)used) {
+    return false;
+  }
+  for (int k = 0; k < n; k++) {
+    uint32_t age = newest_age_ms + (uint32_t)(n - 1 - k) * PACKED_INTERVAL_MS;
+    if (f[k].age_ms != age ||
+        f[k].noise_mut != packed_noise_mut(packed_noise_code(noise_mut)) ||
+        f[k].x_uT_milli != packed_mut(packed_counts(B[k].x)) ||
+        f[k].y_uT_milli != packed_mut(packed_counts(B[k].y)) ||
+        f[k].z_uT_milli != packed_mut(packed_counts(B[k].z))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int bench_packed_parse(long batches, struct bench_result *r,
+                              double *bytes_per_sample) {
+  static uint8_t frames[FRAME_BATCH][SECURE_FRAME_MAX_LEN];
+  static size_t lens[FRAME_BATCH];
+  /* Above anything the other parse benchmarks used */
+  static uint32_t seq[MAX_NODES + 1] = {[0 ... MAX_NODES] = 0xc0000000u};
+  struct node_state nodes[MAX_NODES + 1];
+  struct vec3_i32 B[MAX_NODES + 1][PACKED_SAMPLES];
+  int64_t total_ns = 0;
+  long ok = 0, bytes = 0;
+
+  /* A still magnet: readings wander by sensor noise (a few counts) */
+  synth_nodes(nodes, 420.0f, 380.0f);
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    for (int k = 0; k < PACKED_SAMPLES; k++) {
+      B[nid][k] = nodes[nid].last_B_mag;
+      B[nid][k].x += 37 * ((k * 5 + nid) % 7) - 111;
+      B[nid][k].y -= 29 * ((k * 3 + nid) % 5);
+      B[nid][k].z += 41 * (k % 3);
+    }
+  }
+  packet_rekey(BENCH_MASTER_KEY);
+
+  for (long b = 0; b < batches; b++) {
+    for (int i = 0; i < FRAME_BATCH; i++) {
+      uint8_t nid = (uint8_t)(1 + i % position_get_node_count());
+      size_t used;
+      lens[i] = magsim_encode_packed(BENCH_MASTER_KEY, nid, MAGSIM_BOOT_EPOCH,
+                                     ++seq[nid], B[nid], PACKED_SAMPLES,
+                                     PACKED_INTERVAL_MS, 20, PACKED_NOISE_MUT,
+                                     &used, frames[i]);
+      bytes += (long)lens[i];
+    }
+
+    int64_t t0 = host_monotonic_ns();
+    for (int i = 0; i < FRAME_BATCH; i++) {
+      struct sensor_frame f[PACKET_SAMPLES_MAX];
+      int n = packet_parse_secure_frames(frames[i], lens[i], f);
+      for (int k = 0; k < n; k++) {
+        g_sink += (float)f[k].x_uT_milli;
+      }
+      ok += n;
+    }
+    total_ns += host_monotonic_ns() - t0;
+  }
+
+  /* Untimed: decode a still frame, then one where the magnet moves so fast
+   * that only the newest samples fit */
+  struct sensor_frame f[PACKET_SAMPLES_MAX];
+  size_t used;
+  size_t len = magsim_encode_packed(BENCH_MASTER_KEY, 1, MAGSIM_BOOT_EPOCH,
+                                    ++seq[1], B[1], PACKED_SAMPLES,
+                                    PACKED_INTERVAL_MS, 20, PACKED_NOISE_MUT,
+                                    &used, frames[0]);
+  bool match = used == PACKED_SAMPLES &&
+               packed_matches(f, packet_parse_secure_frames(frames[0], len, f),
+                              B[1], used, 20, PACKED_NOISE_MUT);
+
+  struct vec3_i32 fast[PACKED_SAMPLES];
+  for (int k = 0; k < PACKED_SAMPLES; k++) {
+    fast[k].x = (k & 1) ? 700000 : -700000;
+    fast[k].y = -3 * k;
+    fast[k].z = 6250 * k;
+  }
+  len = magsim_encode_packed(BENCH_MASTER_KEY, 1, MAGSIM_BOOT_EPOCH, ++seq[1],
+                             fast, PACKED_SAMPLES, PACKED_INTERVAL_MS, 20, 0,
+                             &used, frames[0]);
+  match = match && used > 1 && used < PACKED_SAMPLES &&
+          packed_matches(f, packet_parse_secure_frames(frames[0], len, f),
+                         &fast[PACKED_SAMPLES - used], used, 20, 0);
+
+  r->name = "packed_parse_decrypt (/sample)";
+  r->iterations = batches * FRAME_BATCH * PACKED_SAMPLES;
+  r->ns_per_op = (double)total_ns / (double)r->iterations;
+  *bytes_per_sample = (double)bytes / (double)r->iterations;
+
+  if (ok != r->iterations || !match) {
+    fprintf(stderr, "packed_parse_decrypt: %ld of %ld samples rejected%s\n",
+            r->iterations - ok, r->iterations,
+            match ? "" : ", decoded frame differs");
+    return -1;
+  }
+  return 0;
+}
+
+static int bench_beacon(long iters, struct bench_result *r) {
+  uint8_t frame[SECURE_FRAME_MAX_LEN];
+  const uint16_t epoch = 7;
+  int nodes = position_get_node_count();
+  size_t len = 0;
+
+  tdma_init(epoch);
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    len = tdma_build_beacon(1000 + i * TDMA_SLOT_MS * (nodes + 1), nodes,
+                            frame, sizeof(frame));
+    g_sink += frame[len - 1];
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "tdma_build_beacon";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+
+  /* Untimed: a node decodes the last beacon, and frames are placed in the
+   * sender's slot only if they ended inside it */
+  int64_t sf = 1000 + (iters - 1) * TDMA_SLOT_MS * (nodes + 1);
+  struct beacon b;
+  uint16_t b_epoch;
+  uint32_t seq;
+  bool match = magsim_decode_beacon(BENCH_MASTER_KEY, frame, len, &b_epoch,
+                                    &seq, &b) &&
+               b_epoch == epoch && seq == (uint32_t)iters &&
+               b.slots == nodes + 1 &&
+               b.slot_ms == TDMA_SLOT_MS && b.epoch_ms == (uint32_t)sf;
+  for (int k = 1; k <= nodes; k++) {
+    match = match && b.owner[k] == k;
+  }
+  int64_t tx_ms = -1;
+  match = match && tdma_next_beacon_ms() == sf + (nodes + 1) * TDMA_SLOT_MS &&
+          tdma_slot_start(2, sf + 2 * TDMA_SLOT_MS + 90, &tx_ms) &&
+          tx_ms == sf + 2 * TDMA_SLOT_MS &&
+          !tdma_slot_start(2, sf + 3 * TDMA_SLOT_MS + 90, &tx_ms) &&
+          !tdma_slot_start((uint8_t)(nodes + 1), sf + TDMA_SLOT_MS, &tx_ms);
+
+  /* Without a stored boot epoch no beacon may go out */
+  tdma_init(0);
+  match = match && tdma_build_beacon(sf, nodes, frame, sizeof(frame)) == 0;
+
+  if (!match) {
+    fprintf(stderr, "tdma_build_beacon: decoded beacon or slot timing differs\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int bench_kdf(long iters, struct bench_result *r) {
+  uint8_t K_enc[16], K_mac[16];
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    kdf_split_keys(BENCH_MASTER_KEY, (uint8_t)(1 + i % MAX_NODES), K_enc,
+                   K_mac);
+    g_sink += K_enc[0];
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "kdf_split_keys (reference)";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+  return 0;
+}
+
+/* siphash24() as it was before word loads, for comparison */
+static uint64_t ref_load_le64(const uint8_t *p) {
+  return ((uint64_t)p[0]) | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+         ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) |
+         ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) |
+         ((uint64_t)p[7] << 56);
+}
+
+#define REF_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define REF_SIPROUND                                                           \
+  do {                                                                         \
+    v0 += v1; v1 = REF_ROTL(v1, 13) ^ v0; v0 = REF_ROTL(v0, 32);               \
+    v2 += v3; v3 = REF_ROTL(v3, 16) ^ v2;                                      \
+    v0 += v3; v3 = REF_ROTL(v3, 21) ^ v0;                                      \
+    v2 += v1; v1 = REF_ROTL(v1, 17) ^ v2; v2 = REF_ROTL(v2, 32);               \
+  } while (0)
+
+static void ref_siphash24(uint8_t out[8], const uint8_t *m, size_t len,
+                          const uint8_t key[16]) {
+  uint64_t k0 = ref_load_le64(key), k1 = ref_load_le64(key + 8);
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0, v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0, v3 = 0x7465646279746573ULL ^ k1;
+  size_t whole = len & ~(size_t)7;
+
+  for (size_t i = 0; i < whole; i += 8) {
+    uint64_t mi = ref_load_le64(&m[i]);
+    v3 ^= mi;
+    REF_SIPROUND;
+    REF_SIPROUND;
+    v0 ^= mi;
+  }
+  uint64_t b = (uint64_t)len << 56;
+  for (size_t i = whole; i < len; i++) {
+    b |= (uint64_t)m[i] << (8 * (i - whole));
+  }
+  v3 ^= b;
+  REF_SIPROUND;
+  REF_SIPROUND;
+  v0 ^= b;
+  v2 ^= 0xff;
+  REF_SIPROUND;
+  REF_SIPROUND;
+  REF_SIPROUND;
+  REF_SIPROUND;
+  uint64_t tag = v0 ^ v1 ^ v2 ^ v3;
+  for (int i = 0; i < 8; i++) {
+    out[i] = (uint8_t)(tag >> (8 * i));
+  }
+}
+
+/* keystream_from_seq() as it was: one full siphash24() per block */
+static void ref_keystream(uint8_t *out, size_t n, const uint8_t K_enc[16],
+                          uint16_t epoch, uint32_t tx_seq) {
+  uint8_t in[9] = {'S',
+                   (uint8_t)tx_seq,
+                   (uint8_t)(tx_seq >> 8),
+                   (uint8_t)(tx_seq >> 16),
+                   (uint8_t)(tx_seq >> 24),
+                   (uint8_t)epoch,
+                   (uint8_t)(epoch >> 8),
+                   0,
+                   0};
+  for (size_t off = 0; off < n; off += 8) {
+    uint8_t tag[8];
+    in[8] = (uint8_t)(off / 8);
+    ref_siphash24(tag, in, sizeof(in), K_enc);
+    memcpy(&out[off], tag, n - off < 8 ? n - off : 8);
+  }
+}
+
+/*
+ * Crypto per packed frame of eight still samples: the keystream for its
+ * 33-byte payload and the tag over header and ciphertext. Timed for the
+ * current code and the byte-wise reference; untimed, both must agree for
+ * every length a frame can have, and with the published SipHash-2-4 test
+ * vectors.
+ */
+static int bench_frame_crypto(long iters, struct bench_result *cur,
+                              struct bench_result *ref) {
+  enum { PT_LEN = 33, MAC_LEN = SECURE_HDR_LEN + PT_LEN };
+  static const uint8_t vec_key[16] = {0, 1, 2,  3,  4,  5,  6,  7,
+                                      8, 9, 10, 11, 12, 13, 14, 15};
+  static const uint8_t vec_tag0[8] = {0x31, 0x0e, 0x0e, 0xdd,
+                                      0x47, 0xdb, 0x6f, 0x72};
+  static const uint8_t vec_tag15[8] = {0xe5, 0x45, 0xbe, 0x49,
+                                       0x61, 0xca, 0x29, 0xa1};
+  uint8_t K_enc[16], K_mac[16];
+  uint8_t frame[SECURE_FRAME_MAX_LEN], ks[SECURE_FRAME_MAX_LEN];
+  uint8_t tag[TAG_LEN], tag_ref[TAG_LEN], ks_ref[SECURE_FRAME_MAX_LEN];
+
+  kdf_split_keys(BENCH_MASTER_KEY, 1, K_enc, K_mac);
+  for (int i = 0; i < SECURE_FRAME_MAX_LEN; i++) {
+    frame[i] = (uint8_t)(i * 37 + 11);
+  }
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    keystream_from_seq(ks, PT_LEN, K_enc, 1, (uint32_t)i);
+    frame[SECURE_HDR_LEN] ^= ks[0];
+    siphash24(tag, frame, MAC_LEN, K_mac);
+    g_sink += tag[0];
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+  cur->name = "frame crypto (packed, 40 B)";
+  cur->iterations = iters;
+  cur->ns_per_op = (double)dt / (double)iters;
+
+  t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    ref_keystream(ks, PT_LEN, K_enc, 1, (uint32_t)i);
+    frame[SECURE_HDR_LEN] ^= ks[0];
+    ref_siphash24(tag, frame, MAC_LEN, K_mac);
+    g_sink += tag[0];
+  }
+  dt = host_monotonic_ns() - t0;
+  ref->name = "frame crypto bytewise (reference)";
+  ref->iterations = iters;
+  ref->ns_per_op = (double)dt / (double)iters;
+
+  bool match = true;
+  for (size_t len = 0; len <= SECURE_FRAME_MAX_LEN; len++) {
+    siphash24(tag, frame, len, K_mac);
+    ref_siphash24(tag_ref, frame, len, K_mac);
+    keystream_from_seq(ks, len, K_enc, 7, 0x12345678u);
+    ref_keystream(ks_ref, len, K_enc, 7, 0x12345678u);
+    match = match && memcmp(tag, tag_ref, TAG_LEN) == 0 &&
+            memcmp(ks, ks_ref, len) == 0;
+  }
+  uint8_t msg[15];
+  for (int i = 0; i < 15; i++) {
+    msg[i] = (uint8_t)i;
+  }
+  siphash24(tag, msg, 0, vec_key);
+  match = match && memcmp(tag, vec_tag0, 8) == 0;
+  siphash24(tag, msg, 15, vec_key);
+  match = match && memcmp(tag, vec_tag15, 8) == 0;
+
+  if (!match) {
+    fprintf(stderr, "frame crypto: output differs from the reference\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int bench_dipole(long iters, struct bench_result *r) {
+  struct node_state nodes[MAX_NODES + 1];
+  struct position_estimate guess = {
+      .x = 430.0f, .y = 370.0f, .M = BENCH_DIPOLE_M, .converged = true};
+  struct position_estimate est;
+  int failures = 0;
+
+  synth_nodes(nodes, 420.0f, 380.0f);
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    if (!position_estimate_dipole(nodes, &guess, &est)) {
+      failures++;
+    }
+    g_sink += est.x;
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "position_estimate_dipole";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+  return failures ? -1 : 0;
+}
+
+static int bench_lookup(long iters, struct bench_result *r) {
+  static struct calib_point points[MAX_CALIB_POINTS];
+  struct node_state nodes[MAX_NODES + 1];
+  int failures = 0;
+
+  /* Calibration grid from the same model, 5 x 4 points */
+  for (int i = 0; i < MAX_CALIB_POINTS; i++) {
+    struct calib_point *cp = &points[i];
+    memset(cp, 0, sizeof(*cp));
+    cp->x = 100 + (i % 5) * 200;
+    cp->y = 125 + (i / 5) * 250;
+
+    synth_nodes(nodes, (float)cp->x, (float)cp->y);
+    for (int nid = 1; nid <= position_get_node_count(); nid++) {
+      cp->node_B_mag[nid - 1] = nodes[nid].last_B_mag;
+      cp->valid_mask |= BIT(nid - 1);
+    }
+  }
+
+  synth_nodes(nodes, 420.0f, 380.0f);
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    float x, y;
+    if (!position_estimate_lookup(nodes, points, MAX_CALIB_POINTS, &x, &y)) {
+      failures++;
+    }
+    g_sink += x;
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "position_estimate_lookup";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+  return failures ? -1 : 0;
+}
+
+static int bench_triangulation(long iters, struct bench_result *r) {
+  struct node_state nodes[MAX_NODES + 1];
+  int failures = 0;
+
+  synth_nodes(nodes, 420.0f, 380.0f);
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    float x, y;
+    if (!position_estimate_triangulation(nodes, &x, &y)) {
+      failures++;
+    }
+    g_sink += x;
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "position_estimate_triangulation";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+  return failures ? -1 : 0;
+}
+
+static int bench_ekf_update(long iters, struct bench_result *r) {
+  struct node_state nodes[MAX_NODES + 1];
+  int failures = 0;
+
+  synth_nodes(nodes, 420.0f, 380.0f);
+  ekf_init();
+  ekf_seed(420.0f, 380.0f, BENCH_DIPOLE_M, 0);
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    int nid = 1 + (int)(i % position_get_node_count());
+    /* 100 ms between packets keeps the filter in its normal regime */
+    if (ekf_update_node((uint8_t)nid, &nodes[nid].last_B_mag, 0,
+                        (int64_t)(i + 1) * 100) != 0) {
+      failures++;
+    }
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "ekf_update_node";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+  return failures ? -1 : 0;
+}
+
+static int bench_telemetry(long iters, struct bench_result *rec,
+                           struct bench_result *fmt) {
+  struct sensor_frame f = {
+      .node_id = 2, .x_uT_milli = 21034, .y_uT_milli = -1830,
+      .z_uT_milli = -43710, .temp_c_times10 = 215};
+  struct vec3_i32 B_mag = {.x = 1034, .y = -830, .z = 2290};
+  char line[192];
+
+  telemetry_init();
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    f.tx_seq = (uint32_t)i;
+    telemetry_record_packet(&f, &B_mag, -87, 9);
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  rec->name = "telemetry_record_packet";
+  rec->iterations = iters;
+  rec->ns_per_op = (double)dt / (double)iters;
+
+  /* The per-packet LOG_INF this replaced, formatting cost only */
+  t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    int n = snprintf(line, sizeof(line),
+                     "PKT rx=%u node=%u seq=%u B=(%d,%d,%d) B_mag=(%d,%d,%d) "
+                     "m-uT T=%d.%d C RSSI=%d SNR=%d",
+                     (unsigned)i, (unsigned)f.node_id, (unsigned)i,
+                     f.x_uT_milli, f.y_uT_milli, f.z_uT_milli, B_mag.x,
+                     B_mag.y, B_mag.z, f.temp_c_times10 / 10,
+                     f.temp_c_times10 % 10, -87, 9);
+    g_sink += (float)n;
+  }
+  dt = host_monotonic_ns() - t0;
+
+  fmt->name = "snprintf PKT log line (old)";
+  fmt->iterations = iters;
+  fmt->ns_per_op = (double)dt / (double)iters;
+
+  /* Newest event must decode back to what was recorded */
+  struct telem_event ev;
+  uint32_t cursor = telemetry_cursor_latest(1);
+  if (telemetry_read(&cursor, &ev, 1) != 1 || ev.type != TELEM_EV_PACKET ||
+      ev.packet.tx_seq != (uint32_t)(iters - 1) ||
+      telemetry_format_json(&ev, line, sizeof(line)) <= 0) {
+    fprintf(stderr, "telemetry: newest event did not read back\n");
+    return -1;
+  }
+  return 0;
+}
+
+struct queue_run {
+  long frames;
+  long received;
+  long out_of_order;
+};
+
+/* Consumer side: frames carry their index, which must keep rising */
+static void *queue_consumer(void *arg) {
+  struct queue_run *run = arg;
+  long expect_min = 0;
+
+  for (;;) {
+    const struct rx_frame *fr = frame_queue_peek();
+    if (!fr) {
+      continue;
+    }
+    long idx;
+    memcpy(&idx, fr->buf, sizeof(idx));
+    frame_queue_release();
+    if (idx < 0) {
+      return NULL;
+    }
+    if (idx < expect_min) {
+      run->out_of_order++;
+    }
+    expect_min = idx + 1;
+    run->received++;
+  }
+}
+
+static int bench_frame_queue(long frames, struct bench_result *r) {
+  struct queue_run run = {.frames = frames};
+  struct frame_queue_stats qs;
+  pthread_t consumer;
+
+  frame_queue_init();
+  pthread_create(&consumer, NULL, queue_consumer, &run);
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i <= frames; i++) {
+    /* Last frame (index -1) stops the consumer; it must not be dropped */
+    long idx = i < frames ? i : -1;
+    struct rx_frame *slot;
+    while ((slot = frame_queue_claim()) == NULL && idx < 0) {
+    }
+    if (!slot) {
+      frame_queue_count_drop();
+      continue;
+    }
+    memcpy(slot->buf, &idx, sizeof(idx));
+    slot->len = SECURE_FRAME_LEN;
+    frame_queue_publish();
+  }
+  pthread_join(consumer, NULL);
+  int64_t dt = host_monotonic_ns() - t0;
+
+  frame_queue_get_stats(&qs);
+
+  r->name = "frame_queue (2 threads)";
+  r->iterations = frames;
+  r->ns_per_op = (double)dt / (double)frames;
+
+  /* Every frame is either delivered or counted as dropped, in order */
+  if (run.out_of_order || run.received + (long)qs.dropped != frames ||
+      qs.high_water > FRAME_QUEUE_DEPTH) {
+    fprintf(stderr,
+            "frame_queue: %ld delivered + %u dropped != %ld, %ld out of "
+            "order\n",
+            run.received, (unsigned)qs.dropped, frames, run.out_of_order);
+    return -1;
+  }
+  return 0;
+}
+
+static int bench_pub_queue(long iters, struct bench_result *r) {
+  struct pub_sample batch[PUB_QUEUE_BATCH_MAX];
+  struct pub_queue_stats st;
+  char payload[512];
+  long sent = 0;
+
+  /* Positions arrive every 100 ms; drain once per PUB_QUEUE_BATCH_MAX */
+  pub_queue_init();
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    uint32_t t_ms = (uint32_t)i * 100u;
+    struct pub_sample s = {(uint32_t)i, t_ms, (int16_t)(i % 1001), 500};
+    pub_queue_push(&s, NULL);
+    if ((i + 1) % PUB_QUEUE_BATCH_MAX == 0) {
+      size_t n = pub_queue_peek_batch(batch, NULL, t_ms);
+      int len = pub_queue_format_json(batch, n, payload, sizeof(payload));
+      g_sink += (float)len;
+      pub_queue_complete(n, len > 0 ? PUB_SENT : PUB_FAILED);
+      sent += len > 0 ? (long)n : 0;
+    }
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+
+  r->name = "pub_queue push + batch json";
+  r->iterations = iters;
+  r->ns_per_op = (double)dt / (double)iters;
+
+  pub_queue_get_stats(&st);
+  if (st.published != (uint32_t)sent || st.dropped_full || st.dropped_stale) {
+    fprintf(stderr, "pub_queue: %u published, %u dropped while draining\n",
+            (unsigned)st.published,
+            (unsigned)(st.dropped_full + st.dropped_stale));
+    return -1;
+  }
+
+  /* Overfill with the consumer holding a batch: oldest go, newest stay */
+  pub_queue_init();
+  pub_queue_push(&(struct pub_sample){0, 0, 0, 0}, NULL);
+  size_t n = pub_queue_peek_batch(batch, NULL, 0);
+  for (int i = 1; i < PUB_QUEUE_DEPTH + 3; i++) {
+    pub_queue_push(&(struct pub_sample){(uint32_t)i, 0, (int16_t)i, 0}, NULL);
+  }
+  pub_queue_complete(n, PUB_SENT);
+  pub_queue_get_stats(&st);
+  n = pub_queue_peek_batch(batch, NULL, 0);
+  if (st.dropped_full != 3 || pub_queue_count() != PUB_QUEUE_DEPTH ||
+      n == 0 || batch[0].x != 3) {
+    fprintf(stderr, "pub_queue: overflow kept %u, dropped %u, oldest %d\n",
+            (unsigned)pub_queue_count(), (unsigned)st.dropped_full,
+            n ? batch[0].x : -1);
+    return -1;
+  }
+
+  /* Backlog: overfilled RAM drops the oldest, replay starts after them */
+  struct pub_sample replay[BACKLOG_BATCH];
+  struct backlog_stats bs;
+  uint32_t boot;
+  backlog_init(7);
+  for (uint32_t i = 0; i < BACKLOG_RECORDS + 5; i++) {
+    backlog_store(&(struct pub_sample){i, i * 1000u, 1, 2});
+  }
+  n = backlog_peek(replay, &boot);
+  int len = backlog_format_json(boot, replay, n, payload, sizeof(payload));
+  backlog_consume(n);
+  backlog_get_stats(&bs);
+  if (n != BACKLOG_BATCH || boot != 7 || replay[0].seq != 5 || len < 0 ||
+      strncmp(payload, "{\"boot\":7,\"pts\":[[5,5000,1,2],", 30) != 0 ||
+      bs.dropped != 5 || bs.replayed != BACKLOG_BATCH) {
+    fprintf(stderr, "backlog: peeked %u from seq %u, dropped %u: %s\n",
+            (unsigned)n, n ? (unsigned)replay[0].seq : 0u,
+            (unsigned)bs.dropped, payload);
+    return -1;
+  }
+  return 0;
+}
+
+static int bench_pos_payload(long iters, struct bench_result *bin,
+                             struct bench_result *json) {
+  struct pub_sample s = {.seq = 70000, .t_ms = 123456, .x = 412, .y = 873};
+  struct pub_detail d = {.M = 1.25e12f, .residual = 512.0f, .pos_std = 7.4f,
+                         .fresh_nodes = 6, .flags = PUB_BIN_FLAG_EKF,
+                         .node_count = 6};
+  uint8_t rec[PUB_BIN_RECORD_MAX];
+  char text[512];
+  int len = 0;
+
+  for (int k = 0; k < d.node_count; k++) {
+    d.absB[k] = (uint16_t)(100 * (k + 1));
+  }
+
+  int64_t t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    s.seq = (uint32_t)i;
+    len = pub_queue_format_binary(&s, &d, 1, rec, sizeof(rec));
+    g_sink += (float)len;
+  }
+  int64_t dt = host_monotonic_ns() - t0;
+  bin->name = "pos record binary (per sample)";
+  bin->iterations = iters;
+  bin->ns_per_op = (double)dt / (double)iters;
+
+  /* The JSON feed, plus the same detail as the binary record */
+  int text_len = 0;
+  t0 = host_monotonic_ns();
+  for (long i = 0; i < iters; i++) {
+    text_len = snprintf(
+        text, sizeof(text),
+        "{\"x\":%d,\"y\":%d,\"seq\":%u,\"t\":%u,\"M\":%g,\"res\":%g,"
+        "\"n\":%u,\"std\":%g,\"B\":[%u,%u,%u,%u,%u,%u]}",
+        s.x, s.y, (unsigned)i, (unsigned)s.t_ms, (double)d.M,
+        (double)d.residual, d.fresh_nodes, (double)d.pos_std, d.absB[0],
+        d.absB[1], d.absB[2], d.absB[3], d.absB[4], d.absB[5]);
+    g_sink += (float)text_len;
+  }
+  dt = host_monotonic_ns() - t0;
+  json->name = "pos record as JSON (reference)";
+  json->iterations = iters;
+  json->ns_per_op = (double)dt / (double)iters;
+
+  /* Six nodes: 32 bytes, fields where the layout says */
+  float M;
+  uint32_t M_bits = rec[12] | rec[13] << 8 | rec[14] << 16 | (uint32_t)rec[15] << 24;
+  memcpy(&M, &M_bits, sizeof(M));
+  if (len != 32 || rec[0] != PUB_BIN_VERSION || rec[1] != (6 | PUB_BIN_FLAG_EKF) ||
+      (rec[8] | rec[9] << 8) != 412 || (rec[10] | rec[11] << 8) != 873 ||
+      M != d.M || (rec[16] | rec[17] << 8) != 512 / PUB_BIN_FIELD_LSB ||
+      rec[19] != 7 || (rec[30] | rec[31] << 8) != 600) {
+    fprintf(stderr, "pos record: %d bytes, layout mismatch\n", len);
+    return -1;
+  }
+  printf("pos record: %d bytes binary, %d bytes JSON\n", len, text_len);
+  return 0;
+}
+
+/* =============================================================================
+ * Main
+ * =============================================================================
+ */
+
+int main(int argc, char **argv) {
+  bool quick = false;
+  int node_count = 0;
+  struct bench_result r;
+  int failed = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+      node_count = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--nodes N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  long scale = quick ? 1 : 100;
+
+  position_init();
+  if (node_count && magsim_layout_perimeter(node_count) != 0) {
+    fprintf(stderr, "node count must be 2-%d\n", MAX_NODES);
+    return 2;
+  }
+
+  printf("Gateway benchmark (%d nodes, %d per solve%s)\n",
+         position_get_node_count(), POSITION_SOLVER_NODES,
+         quick ? ", quick" : "");
+
+  failed |= bench_frame_parse(2 * scale, &r);
+  report(&r);
+  failed |= bench_batch_parse(2 * scale, &r);
+  report(&r);
+  double packed_bytes;
+  failed |= bench_packed_parse(2 * scale, &r, &packed_bytes);
+  report(&r);
+  printf("  frame bytes per sample: single %.1f, batch %.2f, packed %.2f\n",
+         (double)SECURE_FRAME_LEN,
+         (double)SECURE_BATCH_FRAME_LEN(SENSOR_BATCH_MAX) / SENSOR_BATCH_MAX,
+         packed_bytes);
+  failed |= bench_beacon(200 * scale, &r);
+  report(&r);
+  failed |= bench_kdf(2000 * scale, &r);
+  report(&r);
+
+  struct bench_result r_ref;
+  failed |= bench_frame_crypto(2000 * scale, &r, &r_ref);
+  report(&r);
+  report(&r_ref);
+  failed |= bench_dipole(200 * scale, &r);
+  report(&r);
+  failed |= bench_lookup(2000 * scale, &r);
+  report(&r);
+  failed |= bench_triangulation(2000 * scale, &r);
+  report(&r);
+  failed |= bench_ekf_update(2000 * scale, &r);
+  report(&r);
+  failed |= bench_frame_queue(20000 * scale, &r);
+  report(&r);
+
+  struct bench_result r_fmt;
+  failed |= bench_telemetry(2000 * scale, &r, &r_fmt);
+  report(&r);
+  report(&r_fmt);
+  failed |= bench_pub_queue(20000 * scale, &r);
+  report(&r);
+  failed |= bench_pos_payload(20000 * scale, &r, &r_fmt);
+  report(&r);
+  report(&r_fmt);
+
+  if (failed) {
+    fprintf(stderr, "benchmark inputs were rejected; numbers are invalid\n");
+    return 1;
+  }
+  return 0;
+}
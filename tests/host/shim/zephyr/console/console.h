@@ -0,0 +1,19 @@
+/*
+ * Minimal host stand-in for <zephyr/console/console.h>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * The calibration console thread is never started on the host.
+ */
+
+#ifndef HOST_SHIM_ZEPHYR_CONSOLE_CONSOLE_H
+#define HOST_SHIM_ZEPHYR_CONSOLE_CONSOLE_H
+
+#include <stddef.h>
+
+static inline void console_getline_init(void) {}
+
+static inline char *console_getline(void) {
+  return NULL;
+}
+
+#endif /* HOST_SHIM_ZEPHYR_CONSOLE_CONSOLE_H */
@@ -0,0 +1,171 @@
+/*
+ * Minimal host stand-in for <zephyr/kernel.h>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Just enough of the kernel API for the gateway signal-chain modules
+ * (position, EKF, calibration, packet) to build as a plain host library.
+ * The host build is single-threaded: mutexes and semaphores are no-ops and
+ * threads are never started.
+ */
+
+#ifndef HOST_SHIM_ZEPHYR_KERNEL_H
+#define HOST_SHIM_ZEPHYR_KERNEL_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* ------------ Utility macros ------------ */
+
+/* Console chatter (calibration progress etc.) only with HOST_LOG_VERBOSE */
+#ifdef HOST_LOG_VERBOSE
+#define printk printf
+#else
+static inline void host_printk_discard(const char *fmt, ...) { (void)fmt; }
+#define printk(...) host_printk_discard(__VA_ARGS__)
+#endif
+
+#define ARG_UNUSED(x) (void)(x)
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define CLAMP(v, lo, hi) MIN(MAX(v, lo), hi)
+
+#define BIT(n) (1UL << (n))
+
+#define BUILD_ASSERT(cond, msg) _Static_assert(cond, msg)
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/* Same trick as <zephyr/sys/util_macro.h>: 1 if defined to 1, else 0 */
+#define Z_IS_ENABLED_PROBE_1 Z_IS_ENABLED_DUMMY,
+#define IS_ENABLED(config_macro) Z_IS_ENABLED1(config_macro)
+#define Z_IS_ENABLED1(config_macro) Z_IS_ENABLED2(Z_IS_ENABLED_PROBE_##config_macro)
+#define Z_IS_ENABLED2(one_or_two_args) Z_IS_ENABLED3(one_or_two_args 1, 0)
+#define Z_IS_ENABLED3(ignore_this, val, ...) val
+
+/* ------------ Time ------------ */
+
+typedef int64_t k_timeout_t;
+
+#define K_FOREVER ((k_timeout_t)-1)
+#define K_NO_WAIT ((k_timeout_t)0)
+#define K_MSEC(ms) ((k_timeout_t)(ms))
+#define K_SECONDS(s) ((k_timeout_t)(s) * 1000)
+
+static inline int64_t host_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int64_t k_uptime_get(void) {
+  return host_monotonic_ns() / 1000000LL;
+}
+
+static inline uint32_t k_uptime_get_32(void) {
+  return (uint32_t)k_uptime_get();
+}
+
+static inline uint64_t k_cycle_get_64(void) {
+  return (uint64_t)host_monotonic_ns();
+}
+
+static inline uint32_t k_cycle_get_32(void) {
+  return (uint32_t)k_cycle_get_64();
+}
+
+/* Host cycles are nanoseconds */
+static inline uint32_t k_cyc_to_us_floor32(uint64_t cyc) {
+  return (uint32_t)(cyc / 1000u);
+}
+
+static inline int32_t k_sleep(k_timeout_t timeout) {
+  ARG_UNUSED(timeout);
+  return 0;
+}
+
+/* ------------ Synchronization (single-threaded host) ------------ */
+
+struct k_mutex {
+  int unused;
+};
+
+#define K_MUTEX_DEFINE(name) struct k_mutex name
+
+static inline int k_mutex_lock(struct k_mutex *mutex, k_timeout_t timeout) {
+  ARG_UNUSED(mutex);
+  ARG_UNUSED(timeout);
+  return 0;
+}
+
+static inline int k_mutex_unlock(struct k_mutex *mutex) {
+  ARG_UNUSED(mutex);
+  return 0;
+}
+
+struct k_sem {
+  unsigned int count;
+};
+
+#define K_SEM_DEFINE(name, initial, limit)                                     \
+  struct k_sem name = {.count = (initial)}
+
+static inline int k_sem_take(struct k_sem *sem, k_timeout_t timeout) {
+  ARG_UNUSED(timeout);
+  if (sem->count == 0) {
+    return -EAGAIN;
+  }
+  sem->count--;
+  return 0;
+}
+
+static inline void k_sem_give(struct k_sem *sem) {
+  sem->count++;
+}
+
+/* ------------ Threads (never started on the host) ------------ */
+
+typedef struct k_thread *k_tid_t;
+
+struct k_thread {
+  int unused;
+};
+
+typedef void (*k_thread_entry_t)(void *p1, void *p2, void *p3);
+
+#define K_THREAD_STACK_DEFINE(name, size) char name[size]
+#define K_THREAD_STACK_SIZEOF(name) sizeof(name)
+
+static inline k_tid_t k_thread_create(struct k_thread *thread, char *stack,
+                                      size_t stack_size, k_thread_entry_t entry,
+                                      void *p1, void *p2, void *p3, int prio,
+                                      uint32_t options, k_timeout_t delay) {
+  ARG_UNUSED(stack);
+  ARG_UNUSED(stack_size);
+  ARG_UNUSED(entry);
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+  ARG_UNUSED(prio);
+  ARG_UNUSED(options);
+  ARG_UNUSED(delay);
+  return thread;
+}
+
+static inline int k_thread_name_set(k_tid_t thread, const char *name) {
+  ARG_UNUSED(thread);
+  ARG_UNUSED(name);
+  return 0;
+}
+
+#endif /* HOST_SHIM_ZEPHYR_KERNEL_H */
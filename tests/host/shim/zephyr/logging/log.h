@@ -0,0 +1,48 @@
+/*
+ * Minimal host stand-in for <zephyr/logging/log.h>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Warnings and errors go to stderr; info and debug are compiled out unless
+ * HOST_LOG_VERBOSE is defined, so they do not distort benchmark timings.
+ */
+
+#ifndef HOST_SHIM_ZEPHYR_LOGGING_LOG_H
+#define HOST_SHIM_ZEPHYR_LOGGING_LOG_H
+
+#include <stdio.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERR 1
+#define LOG_LEVEL_WRN 2
+#define LOG_LEVEL_INF 3
+#define LOG_LEVEL_DBG 4
+
+#define LOG_MODULE_REGISTER(...)
+#define LOG_MODULE_DECLARE(...)
+
+#define HOST_LOG(lvl, ...)                                                     \
+  do {                                                                         \
+    fprintf(stderr, "<" lvl "> ");                                             \
+    fprintf(stderr, __VA_ARGS__);                                              \
+    fprintf(stderr, "\n");                                                     \
+  } while (0)
+
+#define LOG_ERR(...) HOST_LOG("err", __VA_ARGS__)
+
+#ifdef HOST_LOG_VERBOSE
+#define LOG_WRN(...) HOST_LOG("wrn", __VA_ARGS__)
+#define LOG_INF(...) HOST_LOG("inf", __VA_ARGS__)
+#define LOG_DBG(...) HOST_LOG("dbg", __VA_ARGS__)
+#else
+#define LOG_WRN(...)                                                           \
+  do {                                                                         \
+  } while (0)
+#define LOG_INF(...)                                                           \
+  do {                                                                         \
+  } while (0)
+#define LOG_DBG(...)                                                           \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif /* HOST_SHIM_ZEPHYR_LOGGING_LOG_H */
@@ -0,0 +1,26 @@
+/*
+ * Minimal host stand-in for <zephyr/spinlock.h>
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HOST_SHIM_ZEPHYR_SPINLOCK_H
+#define HOST_SHIM_ZEPHYR_SPINLOCK_H
+
+struct k_spinlock {
+  volatile int locked;
+};
+
+typedef int k_spinlock_key_t;
+
+static inline k_spinlock_key_t k_spin_lock(struct k_spinlock *l) {
+  while (__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE)) {
+  }
+  return 0;
+}
+
+static inline void k_spin_unlock(struct k_spinlock *l, k_spinlock_key_t key) {
+  (void)key;
+  __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* HOST_SHIM_ZEPHYR_SPINLOCK_H */
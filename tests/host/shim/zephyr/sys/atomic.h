@@ -0,0 +1,29 @@
+/*
+ * Minimal host stand-in for <zephyr/sys/atomic.h>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Same sequentially consistent semantics as Zephyr's builtin-based
+ * implementation.
+ */
+
+#ifndef HOST_SHIM_ZEPHYR_SYS_ATOMIC_H
+#define HOST_SHIM_ZEPHYR_SYS_ATOMIC_H
+
+typedef long atomic_t;
+typedef long atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+static inline atomic_val_t atomic_get(const atomic_t *target) {
+  return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_inc(atomic_t *target) {
+  return __atomic_fetch_add(target, 1, __ATOMIC_SEQ_CST);
+}
+
+#endif /* HOST_SHIM_ZEPHYR_SYS_ATOMIC_H */
@@ -0,0 +1,85 @@
+/*
+ * Minimal host stand-in for <zephyr/ztest.h>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Lets the gateway's ztest suites (tests/position_test) build as plain
+ * host executables under ctest. Only the parts those suites use: ZTEST,
+ * ZTEST_SUITE with setup/before/after/teardown, and the zassert macros.
+ * A failed assertion reports and ends the test, as on target. The runner
+ * is in ztest.c.
+ */
+
+#ifndef HOST_SHIM_ZEPHYR_ZTEST_H
+#define HOST_SHIM_ZEPHYR_ZTEST_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <zephyr/kernel.h>
+
+struct ztest_host_test {
+  const char *suite;
+  const char *name;
+  void (*fn)(void);
+  struct ztest_host_test *next;
+};
+
+struct ztest_host_suite {
+  const char *name;
+  void *(*setup)(void);
+  void (*before)(void *fixture);
+  void (*after)(void *fixture);
+  void (*teardown)(void *fixture);
+  struct ztest_host_suite *next;
+};
+
+void ztest_host_add_test(struct ztest_host_test *t);
+void ztest_host_add_suite(struct ztest_host_suite *s);
+void ztest_host_fail(const char *file, int line, const char *cond);
+
+/* Registered before main() runs */
+#define ZTEST(suite, fn)                                                       \
+  static void suite##_##fn(void);                                              \
+  __attribute__((constructor)) static void ztest_host_reg_##suite##_##fn(      \
+      void) {                                                                  \
+    static struct ztest_host_test t = {#suite, #fn, suite##_##fn, NULL};       \
+    ztest_host_add_test(&t);                                                   \
+  }                                                                            \
+  static void suite##_##fn(void)
+
+#define ZTEST_SUITE(suite, predicate, setup_fn, before_fn, after_fn,           \
+                    teardown_fn)                                               \
+  __attribute__((constructor)) static void ztest_host_reg_suite_##suite(       \
+      void) {                                                                  \
+    static struct ztest_host_suite s = {#suite,    setup_fn,    before_fn,     \
+                                        after_fn, teardown_fn, NULL};          \
+    ztest_host_add_suite(&s);                                                  \
+  }                                                                            \
+  extern int ztest_host_suite_unused_##suite
+
+/* The message is optional; when given it is a format string and arguments */
+#define zassert(cond, cond_str, ...)                                           \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      ztest_host_fail(__FILE__, __LINE__, cond_str);                           \
+      fprintf(stderr, "    " __VA_ARGS__);                                     \
+      fprintf(stderr, "\n");                                                   \
+      return;                                                                  \
+    }                                                                          \
+  } while (0)
+
+#define zassert_true(cond, ...) zassert(cond, #cond, __VA_ARGS__)
+#define zassert_false(cond, ...) zassert(!(cond), "!(" #cond ")", __VA_ARGS__)
+#define zassert_ok(cond, ...) zassert(!(cond), #cond " == 0", __VA_ARGS__)
+#define zassert_is_null(ptr, ...)                                              \
+  zassert((ptr) == NULL, #ptr " is NULL", __VA_ARGS__)
+#define zassert_not_null(ptr, ...)                                             \
+  zassert((ptr) != NULL, #ptr " is not NULL", __VA_ARGS__)
+#define zassert_equal(a, b, ...)                                               \
+  zassert((a) == (b), #a " == " #b, __VA_ARGS__)
+#define zassert_not_equal(a, b, ...)                                           \
+  zassert((a) != (b), #a " != " #b, __VA_ARGS__)
+#define zassert_within(a, b, delta, ...)                                       \
+  zassert(((a) >= ((b) - (delta))) && ((a) <= ((b) + (delta))),                \
+          #a " within " #b " +/- " #delta, __VA_ARGS__)
+
+#endif /* HOST_SHIM_ZEPHYR_ZTEST_H */
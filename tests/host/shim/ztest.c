@@ -0,0 +1,70 @@
+/*
+ * Host runner for the ztest stand-in
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Runs every registered suite: setup once, then before, the test and after
+ * around each test, then teardown. Output follows the ztest summary lines;
+ * the exit status is non-zero if any test failed.
+ */
+
+#include <string.h>
+#include <zephyr/ztest.h>
+
+static struct ztest_host_test *tests;
+static struct ztest_host_test **tests_tail = &tests;
+static struct ztest_host_suite *suites;
+static struct ztest_host_suite **suites_tail = &suites;
+static bool current_failed;
+
+void ztest_host_add_test(struct ztest_host_test *t) {
+  *tests_tail = t;
+  tests_tail = &t->next;
+}
+
+void ztest_host_add_suite(struct ztest_host_suite *s) {
+  *suites_tail = s;
+  suites_tail = &s->next;
+}
+
+void ztest_host_fail(const char *file, int line, const char *cond) {
+  current_failed = true;
+  fprintf(stderr, "\n    Assertion failed at %s:%d: %s\n", file, line, cond);
+}
+
+int main(void) {
+  int passed = 0, failed = 0;
+
+  for (struct ztest_host_suite *s = suites; s; s = s->next) {
+    printf("Running TESTSUITE %s\n", s->name);
+    void *fixture = s->setup ? s->setup() : NULL;
+
+    for (struct ztest_host_test *t = tests; t; t = t->next) {
+      if (strcmp(t->suite, s->name) != 0) {
+        continue;
+      }
+      current_failed = false;
+      if (s->before) {
+        s->before(fixture);
+      }
+      t->fn();
+      if (s->after) {
+        s->after(fixture);
+      }
+      printf(" %s - %s.%s\n", current_failed ? "FAIL" : "PASS", s->name,
+             t->name);
+      if (current_failed) {
+        failed++;
+      } else {
+        passed++;
+      }
+    }
+
+    if (s->teardown) {
+      s->teardown(fixture);
+    }
+  }
+
+  printf("PROJECT EXECUTION %s (%d passed, %d failed)\n",
+         failed ? "FAILED" : "SUCCESSFUL", passed, failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * Synthetic Dipole Trajectory Simulator
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "magsim.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "crypto_min.h"
+#include "mmc5983ma.h"
+#include "position.h"
+#include "siphash.h"
+
+/* One MMC5983MA LSB in m-uT (1 G = 100 uT) */
+#define MMC_LSB_MUT (MMC5983MA_LSB_TO_GAUSS * 100.0f * 1000.0f)
+
+/* 18-bit output range in counts */
+#define MMC_MAX_COUNT ((2 * MMC5983MA_OFFSET) - 1)
+
+#define PI_F 3.14159265f
+
+const uint8_t MAGSIM_MASTER_KEY[16] = {0x73, 0x69, 0x6d, 0x2d, 0x6b, 0x65,
+                                       0x79, 0x2d, 0x30, 0x31, 0x32, 0x33,
+                                       0x34, 0x35, 0x36, 0x37};
+
+/* =============================================================================
+ * Paths
+ * =============================================================================
+ */
+
+static float lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+/* Constant-speed diagonal drive across the array */
+static void path_straight(float t_s, float *x, float *y) {
+  float u = t_s / 120.0f;
+  *x = lerp(150.0f, 850.0f, u);
+  *y = lerp(300.0f, 600.0f, u);
+}
+
+/* Half circle around the middle of the array */
+static void path_arc(float t_s, float *x, float *y) {
+  float a = PI_F * t_s / 150.0f;
+  *x = 500.0f + 250.0f * cosf(a);
+  *y = 350.0f + 250.0f * sinf(a);
+}
+
+/* Drive 200 units, stop 15 s, three times (TBM advance/ring build cycle) */
+static void path_stop_go(float t_s, float *x, float *y) {
+  const float move_s = 20.0f;
+  const float stop_s = 15.0f;
+  float cycle = move_s + stop_s;
+  int leg = (int)(t_s / cycle);
+  float in_leg = t_s - (float)leg * cycle;
+  float done = (float)leg + fminf(in_leg / move_s, 1.0f);
+
+  if (done > 3.0f) {
+    done = 3.0f;
+  }
+  *x = 200.0f + 200.0f * done;
+  *y = 250.0f;
+}
+
+static const struct magsim_path g_paths[] = {
+    {.name = "straight", .duration_s = 120.0f, .pos = path_straight},
+    {.name = "arc", .duration_s = 150.0f, .pos = path_arc},
+    {.name = "stop_go", .duration_s = 95.0f, .pos = path_stop_go},
+};
+
+const struct magsim_path *magsim_paths(int *count) {
+  *count = (int)(sizeof(g_paths) / sizeof(g_paths[0]));
+  return g_paths;
+}
+
+int magsim_layout_perimeter(int count) {
+  if (position_set_node_count(count) != 0) {
+    return -1;
+  }
+  for (int nid = 1; nid <= count; nid++) {
+    float t = 4000.0f * (float)(nid - 1) / (float)count;
+    struct sensor_pos sp = {.z = 0.0f};
+    if (t < 1000.0f) {
+      sp.x = t;
+      sp.y = 0.0f;
+    } else if (t < 2000.0f) {
+      sp.x = 1000.0f;
+      sp.y = t - 1000.0f;
+    } else if (t < 3000.0f) {
+      sp.x = 3000.0f - t;
+      sp.y = 1000.0f;
+    } else {
+      sp.x = 0.0f;
+      sp.y = 4000.0f - t;
+    }
+    position_set_sensor(nid, &sp);
+  }
+  return 0;
+}
+
+/* =============================================================================
+ * Random numbers (deterministic per seed)
+ * =============================================================================
+ */
+
+static uint32_t rng_next(struct magsim *sim) {
+  /* xorshift32 */
+  uint32_t v = sim->rng;
+  v ^= v << 13;
+  v ^= v >> 17;
+  v ^= v << 5;
+  sim->rng = v;
+  return v;
+}
+
+/* Uniform in (0, 1] */
+static float rng_uniform(struct magsim *sim) {
+  return ((float)(rng_next(sim) >> 8) + 1.0f) / 16777216.0f;
+}
+
+/* Standard normal (Box-Muller, one value per call) */
+static float rng_gauss(struct magsim *sim) {
+  float u1 = rng_uniform(sim);
+  float u2 = rng_uniform(sim);
+  return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * PI_F * u2);
+}
+
+/* =============================================================================
+ * Sensor model
+ * =============================================================================
+ */
+
+void magsim_default_config(struct magsim_config *cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->M = 1.0e12f;
+  cfg->noise_mut = 40.0f; /* ~0.4 mG RMS at the fastest bandwidth */
+  cfg->loss_rate = 0.1f;
+  cfg->hard_iron_mut = 2000.0f;
+  cfg->earth_mut = (struct vec3_f){.x = 20000.0f, .y = 1500.0f, .z = -44000.0f};
+  cfg->sample_interval_ms = 625; /* As misonode */
+  cfg->tx_interval_ms = 1250;    /* misonode's active rate, two samples */
+  cfg->seed = 1;
+}
+
+void magsim_init(struct magsim *sim, const struct magsim_config *cfg) {
+  memset(sim, 0, sizeof(*sim));
+  sim->cfg = *cfg;
+  sim->rng = cfg->seed ? cfg->seed : 1;
+
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    float h = cfg->hard_iron_mut;
+    sim->offset_mut[nid].x = h * (2.0f * rng_uniform(sim) - 1.0f);
+    sim->offset_mut[nid].y = h * (2.0f * rng_uniform(sim) - 1.0f);
+    sim->offset_mut[nid].z = h * (2.0f * rng_uniform(sim) - 1.0f);
+    if (cfg->drift_mut_per_h != 0.0f) {
+      float d = cfg->drift_mut_per_h / 3.6e6f;
+      sim->drift_mut_per_ms[nid].x = d * (2.0f * rng_uniform(sim) - 1.0f);
+      sim->drift_mut_per_ms[nid].y = d * (2.0f * rng_uniform(sim) - 1.0f);
+      sim->drift_mut_per_ms[nid].z = d * (2.0f * rng_uniform(sim) - 1.0f);
+    }
+    /* Nodes are not synchronized: random phase within one period */
+    sim->next_tx_ms[nid] =
+        (int64_t)(rng_uniform(sim) * (float)cfg->tx_interval_ms);
+  }
+}
+
+void magsim_begin_path(struct magsim *sim) { sim->path_t0_ms = sim->t_ms; }
+
+/* Round to the sensor LSB and clip to its 18-bit range, back in m-uT */
+static int32_t quantize(float mut) {
+  long counts = lrintf(mut / MMC_LSB_MUT) + MMC5983MA_OFFSET;
+  if (counts < 0) {
+    counts = 0;
+  }
+  if (counts > MMC_MAX_COUNT) {
+    counts = MMC_MAX_COUNT;
+  }
+  return (int32_t)lrintf((float)(counts - MMC5983MA_OFFSET) * MMC_LSB_MUT);
+}
+
+/* Field a node reads at time t_ms (sensor model as for magsim_sample()) */
+static void sample_at(struct magsim *sim, uint8_t node_id, bool present,
+                      float x, float y, int64_t t_ms, struct vec3_i32 *out) {
+  struct vec3_f B = {0};
+  if (present) {
+    position_compute_dipole_field(x, y, sim->cfg.M,
+                                  position_get_sensor_pos(node_id), &B);
+  }
+
+  const struct vec3_f *off = &sim->offset_mut[node_id];
+  const struct vec3_f *drift = &sim->drift_mut_per_ms[node_id];
+  const struct vec3_f *e = &sim->cfg.earth_mut;
+  float n = sim->cfg.noise_mut;
+  float t = (float)t_ms;
+
+  out->x = quantize(B.x + e->x + off->x + drift->x * t + n * rng_gauss(sim));
+  out->y = quantize(B.y + e->y + off->y + drift->y * t + n * rng_gauss(sim));
+  out->z = quantize(B.z + e->z + off->z + drift->z * t + n * rng_gauss(sim));
+}
+
+void magsim_sample(struct magsim *sim, uint8_t node_id, bool present, float x,
+                   float y, struct vec3_i32 *out) {
+  sample_at(sim, node_id, present, x, y, sim->t_ms, out);
+}
+
+bool magsim_path_pos(const struct magsim *sim, const struct magsim_path *path,
+                     int64_t t_ms, float *x, float *y) {
+  float path_s = (float)(t_ms - sim->path_t0_ms) / 1000.0f;
+  if (path_s > path->duration_s) {
+    return false;
+  }
+  path->pos(fmaxf(path_s, 0.0f), x, y);
+  return true;
+}
+
+/* =============================================================================
+ * Radio
+ * =============================================================================
+ */
+
+void magsim_encode_frame(const uint8_t master_key[16], uint8_t node_id,
+                         uint16_t epoch, uint32_t tx_seq,
+                         const struct vec3_i32 *B,
+                         uint8_t out[SECURE_FRAME_LEN]) {
+  uint8_t K_enc[16], K_mac[16];
+  kdf_split_keys(master_key, node_id, K_enc, K_mac);
+
+  struct sensor_frame f = {
+      .node_id = node_id,
+      .epoch = epoch,
+      .tx_seq = tx_seq,
+      .x_uT_milli = B->x,
+      .y_uT_milli = B->y,
+      .z_uT_milli = B->z,
+      .temp_c_times10 = 215,
+  };
+  uint8_t pt[SENSOR_PLAINTEXT_LEN];
+  uint8_t ks[SENSOR_PLAINTEXT_LEN];
+  pack_sensor_payload(pt, &f);
+  keystream_from_seq(ks, sizeof(ks), K_enc, epoch, tx_seq);
+
+  pack_secure_header(out, node_id, epoch, tx_seq);
+  for (int i = 0; i < SENSOR_PLAINTEXT_LEN; i++) {
+    out[SECURE_HDR_LEN + i] = pt[i] ^ ks[i];
+  }
+  siphash24(&out[SECURE_HDR_LEN + SENSOR_PLAINTEXT_LEN], out,
+            SECURE_HDR_LEN + SENSOR_PLAINTEXT_LEN, K_mac);
+}
+
+/* Header, encrypted payload and tag around pt, as the node builds them */
+static size_t seal_frame(const uint8_t master_key[16], uint8_t node_id,
+                         uint16_t epoch, uint32_t tx_seq, const uint8_t *pt,
+                         size_t pt_len, uint8_t *out) {
+  uint8_t K_enc[16], K_mac[16];
+  uint8_t ks[SENSOR_PACKED_PLAINTEXT_MAX];
+  kdf_split_keys(master_key, node_id, K_enc, K_mac);
+  keystream_from_seq(ks, pt_len, K_enc, epoch, tx_seq);
+
+  pack_secure_header(out, node_id, epoch, tx_seq);
+  for (size_t i = 0; i < pt_len; i++) {
+    out[SECURE_HDR_LEN + i] = pt[i] ^ ks[i];
+  }
+  siphash24(&out[SECURE_HDR_LEN + pt_len], out, SECURE_HDR_LEN + pt_len,
+            K_mac);
+  return SECURE_HDR_LEN + pt_len + TAG_LEN;
+}
+
+bool magsim_decode_beacon(const uint8_t master_key[16], const uint8_t *frame,
+                          size_t len, uint16_t *epoch, uint32_t *seq,
+                          struct beacon *out) {
+  if (len < SECURE_HDR_LEN + BEACON_PLAINTEXT_LEN(2) + TAG_LEN ||
+      len > SECURE_HDR_LEN + BEACON_PLAINTEXT_LEN(BEACON_SLOTS_MAX) + TAG_LEN ||
+      frame[0] != BEACON_NODE_ID) {
+    return false;
+  }
+
+  uint8_t K_enc[16], K_mac[16], tag[TAG_LEN];
+  size_t pt_len = len - (SECURE_HDR_LEN + TAG_LEN);
+  kdf_split_keys(master_key, BEACON_NODE_ID, K_enc, K_mac);
+  siphash24(tag, frame, SECURE_HDR_LEN + pt_len, K_mac);
+  if (memcmp(tag, &frame[SECURE_HDR_LEN + pt_len], TAG_LEN) != 0) {
+    return false;
+  }
+
+  uint8_t id;
+  unpack_secure_header(frame, &id, epoch, seq);
+  uint8_t pt[BEACON_PLAINTEXT_LEN(BEACON_SLOTS_MAX)];
+  keystream_from_seq(pt, pt_len, K_enc, *epoch, *seq);
+  for (size_t i = 0; i < pt_len; i++) {
+    pt[i] ^= frame[SECURE_HDR_LEN + i];
+  }
+  return unpack_beacon(pt, pt_len, out) == 0;
+}
+
+size_t magsim_encode_batch(const uint8_t master_key[16], uint8_t node_id,
+                           uint16_t epoch, uint32_t tx_seq,
+                           const struct vec3_i32 *B,
+                           const uint16_t *age_ms, size_t n, uint8_t *out) {
+  if (n == 0 || n > SENSOR_BATCH_MAX) {
+    return 0;
+  }
+
+  struct sensor_frame f[SENSOR_BATCH_MAX];
+  for (size_t i = 0; i < n; i++) {
+    f[i] = (struct sensor_frame){
+        .node_id = node_id,
+        .epoch = epoch,
+        .tx_seq = tx_seq,
+        .x_uT_milli = B[i].x,
+        .y_uT_milli = B[i].y,
+        .z_uT_milli = B[i].z,
+        .temp_c_times10 = 215,
+        .age_ms = age_ms[i],
+    };
+  }
+  uint8_t pt[SENSOR_BATCH_PLAINTEXT_LEN(SENSOR_BATCH_MAX)];
+  size_t pt_len = pack_sensor_batch(pt, f, n);
+  return seal_frame(master_key, node_id, epoch, tx_seq, pt, pt_len, out);
+}
+
+size_t magsim_encode_packed(const uint8_t master_key[16], uint8_t node_id,
+                            uint16_t epoch, uint32_t tx_seq,
+                            const struct vec3_i32 *B,
+                            size_t n, uint16_t interval_ms,
+                            uint16_t newest_age_ms, uint16_t noise_mut,
+                            size_t *used, uint8_t *out) {
+  *used = 0;
+  if (n == 0 || n > SENSOR_PACKED_MAX) {
+    return 0;
+  }
+
+  struct sensor_frame f[SENSOR_PACKED_MAX];
+  for (size_t i = 0; i < n; i++) {
+    f[i] = (struct sensor_frame){
+        .node_id = node_id,
+        .epoch = epoch,
+        .tx_seq = tx_seq,
+        .x_uT_milli = B[i].x,
+        .y_uT_milli = B[i].y,
+        .z_uT_milli = B[i].z,
+        .temp_c_times10 = 215,
+        .noise_mut = noise_mut,
+    };
+  }
+  f[n - 1].age_ms = newest_age_ms;
+
+  unsigned w;
+  size_t k = sensor_packed_fit(f, n, &w);
+  uint8_t pt[SENSOR_PACKED_PLAINTEXT_MAX];
+  size_t pt_len = pack_sensor_packed(pt, &f[n - k], k, w, interval_ms);
+  *used = k;
+  return seal_frame(master_key, node_id, epoch, tx_seq, pt, pt_len, out);
+}
+
+bool magsim_next_frame(struct magsim *sim, const struct magsim_path *path,
+                       uint8_t out[SECURE_FRAME_MAX_LEN], size_t *len,
+                       int64_t *tx_ms) {
+  uint32_t interval = sim->cfg.sample_interval_ms;
+  size_t n = interval ? sim->cfg.tx_interval_ms / interval : 1;
+  n = n < 1 ? 1 : (n > SENSOR_PACKED_MAX ? SENSOR_PACKED_MAX : n);
+
+  for (;;) {
+    uint8_t nid = 1;
+    for (int i = 2; i <= position_get_node_count(); i++) {
+      if (sim->next_tx_ms[i] < sim->next_tx_ms[nid]) {
+        nid = (uint8_t)i;
+      }
+    }
+
+    sim->t_ms = sim->next_tx_ms[nid];
+    float mx = 0.0f, my = 0.0f;
+    if (path && !magsim_path_pos(sim, path, sim->t_ms, &mx, &my)) {
+      return false;
+    }
+
+    /* Small jitter so nodes slowly drift against each other */
+    sim->next_tx_ms[nid] +=
+        sim->cfg.tx_interval_ms + (int64_t)(rng_next(sim) % 21) - 10;
+    sim->tx_seq[nid]++;
+    sim->frames_sent++;
+
+    /* The samples taken since the last frame, oldest first; the newest is
+     * taken as the frame goes out */
+    struct vec3_i32 B[SENSOR_PACKED_MAX];
+    for (size_t i = 0; i < n; i++) {
+      int64_t t = sim->t_ms - (int64_t)(n - 1 - i) * interval;
+      if (path) {
+        magsim_path_pos(sim, path, t, &mx, &my);
+      }
+      sample_at(sim, nid, path != NULL, mx, my, t, &B[i]);
+    }
+
+    if (rng_uniform(sim) <= sim->cfg.loss_rate) {
+      sim->frames_lost++;
+      continue;
+    }
+
+    size_t used;
+    *len = magsim_encode_packed(MAGSIM_MASTER_KEY, nid, MAGSIM_BOOT_EPOCH,
+                                sim->tx_seq[nid], B, n, (uint16_t)interval, 0,
+                                (uint16_t)lrintf(sim->cfg.noise_mut), &used,
+                                out);
+    *tx_ms = sim->t_ms;
+    return true;
+  }
+}
@@ -0,0 +1,205 @@
+/*
+ * Synthetic Dipole Trajectory Simulator
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Generates the radio traffic a node array would produce while a magnet
+ * follows a scripted path: ideal dipole field from the position module,
+ * plus Earth field, per-node hard-iron offsets (optionally drifting
+ * linearly over time, as with temperature), Gaussian noise, MMC5983MA
+ * 18-bit quantization and random packet loss. Output is encrypted
+ * packed frames (MSG_TYPE_SENSOR_PACKED) exactly as a node sends them,
+ * each carrying the samples taken since the node's previous frame.
+ */
+
+#ifndef MAGSIM_H
+#define MAGSIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lora.h"
+#include "packet.h"
+
+/* ------------ Paths ------------ */
+
+/**
+ * @brief Scripted magnet path in the 0-1000 tracking frame
+ */
+struct magsim_path {
+  const char *name;
+  float duration_s;
+  /** Magnet position at time t_s (0 to duration_s) */
+  void (*pos)(float t_s, float *x, float *y);
+};
+
+/**
+ * @brief Built-in paths: straight drive, arc, stop-and-go
+ *
+ * @param count Output number of paths
+ * @return Array of paths
+ */
+const struct magsim_path *magsim_paths(int *count);
+
+/**
+ * @brief Place nodes evenly around the perimeter of the 0-1000 square
+ *
+ * @param count Node count (2 to MAX_NODES)
+ * @return 0 on success, -1 if the count is out of range
+ */
+int magsim_layout_perimeter(int count);
+
+/* ------------ Simulator ------------ */
+
+/**
+ * @brief Simulation parameters
+ */
+struct magsim_config {
+  float M;                 /* Dipole moment scale factor */
+  float noise_mut;         /* Sensor noise per axis (m-uT, 1 sigma) */
+  float loss_rate;         /* Probability a frame is lost (0-1) */
+  float hard_iron_mut;     /* Max per-node offset per axis (m-uT) */
+  float drift_mut_per_h;   /* Max per-node offset drift per axis (m-uT/h) */
+  struct vec3_f earth_mut; /* Ambient field common to all nodes (m-uT) */
+  uint32_t sample_interval_ms; /* Per-node sample period */
+  uint32_t tx_interval_ms;     /* Per-node transmit period */
+  uint32_t seed;           /* RNG seed, same seed gives the same run */
+};
+
+/**
+ * @brief Defaults close to a field deployment
+ */
+void magsim_default_config(struct magsim_config *cfg);
+
+/**
+ * @brief Simulator state
+ */
+struct magsim {
+  struct magsim_config cfg;
+  uint32_t rng;
+  int64_t t_ms;                          /* Current simulation time */
+  int64_t path_t0_ms;                    /* Simulation time the path began */
+  int64_t next_tx_ms[MAX_NODES + 1];     /* Next transmit time per node */
+  uint32_t tx_seq[MAX_NODES + 1];        /* Last sequence number per node */
+  struct vec3_f offset_mut[MAX_NODES + 1]; /* Hard-iron offset per node */
+  struct vec3_f drift_mut_per_ms[MAX_NODES + 1]; /* Offset drift per node */
+  uint32_t frames_sent;
+  uint32_t frames_lost;
+};
+
+/**
+ * @brief Start a simulation for the current position module node layout
+ */
+void magsim_init(struct magsim *sim, const struct magsim_config *cfg);
+
+/**
+ * @brief Restart path time at the current simulation time
+ *
+ * Call after a baseline phase so the path starts from its beginning.
+ */
+void magsim_begin_path(struct magsim *sim);
+
+/**
+ * @brief Field one node reads with the magnet at (x, y)
+ *
+ * Includes ambient field, offset, noise and sensor quantization.
+ *
+ * @param present false to simulate the magnet being absent (baseline)
+ */
+void magsim_sample(struct magsim *sim, uint8_t node_id, bool present, float x,
+                   float y, struct vec3_i32 *out);
+
+/**
+ * @brief True magnet position on a path at a simulation time
+ *
+ * Times before the path began give its start position.
+ *
+ * @return false if the path has ended by t_ms
+ */
+bool magsim_path_pos(const struct magsim *sim, const struct magsim_path *path,
+                     int64_t t_ms, float *x, float *y);
+
+/**
+ * @brief Produce the next frame that reaches the gateway
+ *
+ * Advances simulation time to the next transmission, skipping (and
+ * counting) lost frames. The frame packs tx_interval_ms /
+ * sample_interval_ms samples, sample_interval_ms apart, the newest taken
+ * at the transmission time.
+ *
+ * @param path Magnet path, or NULL for the magnet being absent
+ * @param out Encrypted frame
+ * @param len Output frame length
+ * @param tx_ms Output transmission time
+ * @return true if a frame was produced, false once the path has ended
+ */
+bool magsim_next_frame(struct magsim *sim, const struct magsim_path *path,
+                       uint8_t out[SECURE_FRAME_MAX_LEN], size_t *len,
+                       int64_t *tx_ms);
+
+/**
+ * @brief Master key frames are encrypted with (load into packet_rekey())
+ */
+extern const uint8_t MAGSIM_MASTER_KEY[16];
+
+/**
+ * @brief Boot epoch of the simulated nodes, which never reboot
+ */
+#define MAGSIM_BOOT_EPOCH 1
+
+/**
+ * @brief Build one encrypted frame the way a node does
+ */
+void magsim_encode_frame(const uint8_t master_key[16], uint8_t node_id,
+                         uint16_t epoch, uint32_t tx_seq,
+                         const struct vec3_i32 *B,
+                         uint8_t out[SECURE_FRAME_LEN]);
+
+/**
+ * @brief Build one encrypted batch frame (MSG_TYPE_SENSOR_BATCH)
+ *
+ * @param B Field samples, oldest first
+ * @param age_ms Age of each sample at transmission
+ * @param n Samples (1..SENSOR_BATCH_MAX)
+ * @param out Encrypted frame (SECURE_BATCH_FRAME_LEN(n) bytes)
+ * @return Frame length, 0 if n is out of range
+ */
+size_t magsim_encode_batch(const uint8_t master_key[16], uint8_t node_id,
+                           uint16_t epoch, uint32_t tx_seq,
+                           const struct vec3_i32 *B,
+                           const uint16_t *age_ms, size_t n, uint8_t *out);
+
+/**
+ * @brief Build one encrypted packed frame (MSG_TYPE_SENSOR_PACKED)
+ *
+ * Like the node, packs as many of the newest samples as fit one frame.
+ *
+ * @param B Field samples, oldest first, interval_ms apart
+ * @param n Samples (1..SENSOR_PACKED_MAX)
+ * @param newest_age_ms Age of the newest sample at transmission
+ * @param noise_mut 1-sigma noise of the samples (m-uT), 0 if unknown
+ * @param used Output samples packed (the newest ones)
+ * @param out Encrypted frame (SECURE_FRAME_MAX_LEN bytes)
+ * @return Frame length, 0 if n is out of range
+ */
+size_t magsim_encode_packed(const uint8_t master_key[16], uint8_t node_id,
+                            uint16_t epoch, uint32_t tx_seq,
+                            const struct vec3_i32 *B,
+                            size_t n, uint16_t interval_ms,
+                            uint16_t newest_age_ms, uint16_t noise_mut,
+                            size_t *used, uint8_t *out);
+
+/**
+ * @brief Authenticate and decode a gateway beacon the way a node does
+ *
+ * @param frame Beacon frame
+ * @param len Its length
+ * @param epoch Output gateway boot epoch
+ * @param seq Output beacon count within the epoch
+ * @param out Output beacon contents
+ * @return true if the tag matches and the contents are a valid beacon
+ */
+bool magsim_decode_beacon(const uint8_t master_key[16], const uint8_t *frame,
+                          size_t len, uint16_t *epoch, uint32_t *seq,
+                          struct beacon *out);
+
+#endif /* MAGSIM_H */
@@ -0,0 +1,495 @@
+/*
+ * Trajectory Simulation Runner
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Drives the gateway signal chain with simulated node traffic along each
+ * scripted magnet path and reports, per estimator, how close and how often
+ * it tracks the true position and how long each solve takes.
+ *
+ * Nodes send packed frames of the samples taken since their last frame,
+ * as misonode does. Every received frame goes through the real parser,
+ * and each of its samples, at the time it was taken, through the same
+ * per-node state, baseline handling (including drift tracking while
+ * running) and solve the gateway runs (tracker.c). The other estimators
+ * are then run on the node states that solve used, aligned to the time
+ * of the sample:
+ *
+ *   tracker        tracker_solve(), the position lora.c publishes
+ *   triangulation  position_estimate_triangulation()
+ *   lookup         position_estimate_lookup() on a 5 x 4 calibration grid
+ *   blend_2d       position_estimate_2D(), the non-EKF production path
+ *   dipole_gn      position_estimate_dipole() from the blend_2d fix
+ *
+ * Usage: sim_runner [--nodes N] [--seed S] [--noise MUT] [--loss P]
+ *                   [--drift MUT_PER_H] [--repeat N] [--away S] [--check]
+ *
+ * --drift makes each node's offset drift linearly by up to that much per
+ * hour and axis; --repeat drives the path set N times so the drift builds
+ * up, with the magnet out of range for --away seconds before each round.
+ * Results are summed over the repeats.
+ *
+ * --check compares the results against the regression limits below and
+ * exits non-zero if any estimator got worse.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#include "calibration.h"
+#include "ekf.h"
+#include "magsim.h"
+#include "packet.h"
+#include "position.h"
+#include "tracker.h"
+
+/* Fixes in the first seconds of a path are not scored (seeding, warm-up) */
+#define SETTLE_MS 10000
+
+/* Results are kept per path; magsim_paths() has fewer than this */
+#define MAX_PATHS 8
+
+enum estimator_id {
+  EST_TRACKER,
+  EST_TRIANGULATION,
+  EST_LOOKUP,
+  EST_BLEND_2D,
+  EST_DIPOLE_GN,
+  EST_COUNT,
+};
+
+static const char *const EST_NAMES[EST_COUNT] = {
+    "tracker", "triangulation", "lookup", "blend_2d", "dipole_gn",
+};
+
+/**
+ * @brief Regression limits, checked with --check
+ *
+ * Worst path over seeds 1-10 with some margin, so they catch real
+ * regressions rather than noise from an unrelated change. The three-node
+ * default layout and the perimeter layout (--nodes) have separate limits.
+ * On three nodes the dipole solver does not converge for up to a tenth of
+ * the packets. The tracker is what the gateway publishes, so its limit is
+ * never looser than that of blend_2d, the 2D solve it falls back on; on
+ * three nodes it is set from the worst path over seeds 1-30 (96), as a
+ * track that locks onto a wrong solution shows on only a few seeds.
+ */
+struct est_limit {
+  float max_rmse;     /* units */
+  float min_fix_rate; /* fraction of scored packets with a fix */
+};
+
+static const struct est_limit LIMITS_DEFAULT[EST_COUNT] = {
+    [EST_TRACKER] = {.max_rmse = 125.0f, .min_fix_rate = 0.95f},
+    [EST_TRIANGULATION] = {.max_rmse = 200.0f, .min_fix_rate = 0.95f},
+    [EST_LOOKUP] = {.max_rmse = 175.0f, .min_fix_rate = 0.95f},
+    [EST_BLEND_2D] = {.max_rmse = 150.0f, .min_fix_rate = 0.95f},
+    [EST_DIPOLE_GN] = {.max_rmse = 150.0f, .min_fix_rate = 0.85f},
+};
+
+static const struct est_limit LIMITS_PERIMETER[EST_COUNT] = {
+    [EST_TRACKER] = {.max_rmse = 40.0f, .min_fix_rate = 0.95f},
+    [EST_TRIANGULATION] = {.max_rmse = 175.0f, .min_fix_rate = 0.95f},
+    [EST_LOOKUP] = {.max_rmse = 300.0f, .min_fix_rate = 0.95f},
+    [EST_BLEND_2D] = {.max_rmse = 100.0f, .min_fix_rate = 0.95f},
+    [EST_DIPOLE_GN] = {.max_rmse = 100.0f, .min_fix_rate = 0.95f},
+};
+
+struct est_stats {
+  long attempts;
+  long fixes;
+  double sq_err_sum;
+  float max_err;
+  int64_t solve_ns;
+};
+
+/* Calibration grid and the time each node's newest sample was taken */
+static struct calib_point g_calib[MAX_CALIB_POINTS];
+static int g_calib_count;
+static int64_t g_heard_ms[MAX_NODES + 1];
+
+/* =============================================================================
+ * Gateway emulation
+ * =============================================================================
+ */
+
+/* Parse one received frame; returns its sample count, or -1 if rejected */
+static int receive(const uint8_t *frame, size_t len,
+                   struct sensor_frame f[PACKET_SAMPLES_MAX]) {
+  int n = packet_parse_secure_frames(frame, len, f);
+  for (int i = 0; i < n; i++) {
+    if (f[i].node_id == 0 || f[i].node_id > position_get_node_count()) {
+      return -1;
+    }
+  }
+  return n > 0 ? n : -1;
+}
+
+/*
+ * One sample through process_frame(): node state, then calibration, then
+ * the solve while running. Returns the tracker_solve() result, or -EAGAIN
+ * if nothing was solved.
+ */
+static int gateway_sample(const struct sensor_frame *f, int64_t sample_ms,
+                          struct tracker_fix *fix) {
+  tracker_update_node(f, sample_ms);
+  g_heard_ms[f->node_id] = sample_ms;
+
+  struct vec3_i32 B_raw = {
+      .x = f->x_uT_milli, .y = f->y_uT_milli, .z = f->z_uT_milli};
+  calibration_process_reading_3d(f->node_id, &B_raw);
+
+  if (calibration_get_state() != CALIB_STATE_RUNNING) {
+    return -EAGAIN;
+  }
+
+  position_layout_lock();
+  int err = tracker_solve(f->node_id, sample_ms, g_calib, g_calib_count, fix);
+  position_layout_unlock();
+  return err;
+}
+
+static bool all_reported_since(int64_t t_ms) {
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    if (g_heard_ms[nid] < t_ms) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool run_estimator(enum estimator_id id, float *x, float *y) {
+  const struct node_state *aligned = tracker_get_aligned();
+  struct position_estimate guess = {.converged = true};
+  struct position_estimate pe;
+
+  switch (id) {
+  case EST_TRIANGULATION:
+    return position_estimate_triangulation(aligned, x, y);
+  case EST_LOOKUP:
+    return position_estimate_lookup(aligned, g_calib, g_calib_count, x, y);
+  case EST_BLEND_2D:
+    return position_estimate_2D(aligned, g_calib, g_calib_count, x, y);
+  case EST_DIPOLE_GN:
+    if (!position_estimate_2D(aligned, g_calib, g_calib_count, &guess.x,
+                              &guess.y)) {
+      return false;
+    }
+    guess.M = position_estimate_moment(aligned, guess.x, guess.y);
+    if (guess.M <= 0.0f || !position_estimate_dipole(aligned, &guess, &pe) ||
+        !pe.converged) {
+      return false;
+    }
+    *x = pe.x;
+    *y = pe.y;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* =============================================================================
+ * Setup phases
+ * =============================================================================
+ */
+
+/* Learn baselines through the calibration module with the magnet absent */
+static int learn_baselines(struct magsim *sim) {
+  uint8_t frame[SECURE_FRAME_MAX_LEN];
+  size_t len;
+  int64_t tx_ms;
+
+  calibration_set_state(CALIB_STATE_BASELINE);
+
+  for (int i = 0; i < 1000; i++) {
+    struct sensor_frame f[PACKET_SAMPLES_MAX];
+    int n;
+    if (!magsim_next_frame(sim, NULL, frame, &len, &tx_ms) ||
+        (n = receive(frame, len, f)) < 0) {
+      return -1;
+    }
+    for (int k = 0; k < n; k++) {
+      struct tracker_fix fix;
+      gateway_sample(&f[k], tx_ms - f[k].age_ms, &fix);
+    }
+
+    bool done = true;
+    for (int nid = 1; nid <= position_get_node_count(); nid++) {
+      const struct baseline_data *bl = calibration_get_baseline(nid);
+      done = done && bl && bl->valid;
+    }
+    if (done) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Record a 5 x 4 grid of calibration points as an operator would */
+static void record_calibration(struct magsim *sim) {
+  g_calib_count = 0;
+
+  for (int i = 0; i < MAX_CALIB_POINTS; i++) {
+    struct calib_point *cp = &g_calib[g_calib_count++];
+    memset(cp, 0, sizeof(*cp));
+    cp->x = 100 + (i % 5) * 200;
+    cp->y = 125 + (i / 5) * 250;
+
+    for (int nid = 1; nid <= position_get_node_count(); nid++) {
+      const struct baseline_data *bl = calibration_get_baseline(nid);
+      int64_t sum[3] = {0};
+      for (int k = 0; k < CALIB_READINGS_PER_POINT; k++) {
+        struct vec3_i32 B;
+        magsim_sample(sim, (uint8_t)nid, true, (float)cp->x, (float)cp->y, &B);
+        sum[0] += B.x - bl->B_ambient.x;
+        sum[1] += B.y - bl->B_ambient.y;
+        sum[2] += B.z - bl->B_ambient.z;
+      }
+      struct vec3_i32 *B_mag = &cp->node_B_mag[nid - 1];
+      B_mag->x = (int32_t)(sum[0] / CALIB_READINGS_PER_POINT);
+      B_mag->y = (int32_t)(sum[1] / CALIB_READINGS_PER_POINT);
+      B_mag->z = (int32_t)(sum[2] / CALIB_READINGS_PER_POINT);
+      cp->node_absB[nid - 1] =
+          position_compute_absB(B_mag->x, B_mag->y, B_mag->z);
+      cp->valid_mask |= BIT(nid - 1);
+    }
+  }
+}
+
+/* =============================================================================
+ * Path run
+ * =============================================================================
+ */
+
+/* Magnet out of range: the gateway keeps receiving, nothing is scored */
+static int run_away(struct magsim *sim, int64_t duration_ms) {
+  uint8_t frame[SECURE_FRAME_MAX_LEN];
+  size_t len;
+  int64_t tx_ms;
+  int64_t end_ms = sim->t_ms + duration_ms;
+
+  while (sim->t_ms < end_ms) {
+    struct sensor_frame f[PACKET_SAMPLES_MAX];
+    int n;
+    if (!magsim_next_frame(sim, NULL, frame, &len, &tx_ms) ||
+        (n = receive(frame, len, f)) < 0) {
+      return -1;
+    }
+    for (int k = 0; k < n; k++) {
+      struct tracker_fix fix;
+      gateway_sample(&f[k], tx_ms - f[k].age_ms, &fix);
+    }
+  }
+  return 0;
+}
+
+static void score(struct est_stats *s, int64_t dt, bool ok, float x, float y,
+                  float true_x, float true_y) {
+  s->attempts++;
+  s->solve_ns += dt;
+  if (ok) {
+    float err = hypotf(x - true_x, y - true_y);
+    s->fixes++;
+    s->sq_err_sum += (double)err * err;
+    s->max_err = fmaxf(s->max_err, err);
+  }
+}
+
+/* Drive one path and add its results to stats */
+static int run_path(struct magsim *sim, const struct magsim_path *path,
+                    struct est_stats stats[EST_COUNT]) {
+  uint8_t frame[SECURE_FRAME_MAX_LEN];
+  size_t len;
+  int64_t tx_ms;
+  int rejected = 0;
+
+  /* The magnet jumps to the start of the path: start as if it had just
+   * come into range, without node readings or a track */
+  tracker_init();
+  ekf_reset();
+  magsim_begin_path(sim);
+  int64_t start_ms = sim->t_ms;
+
+  while (magsim_next_frame(sim, path, frame, &len, &tx_ms)) {
+    struct sensor_frame f[PACKET_SAMPLES_MAX];
+    int n = receive(frame, len, f);
+    if (n < 0) {
+      rejected++;
+      continue;
+    }
+
+    /* Oldest first, each at the time it was taken, as lora.c does */
+    for (int k = 0; k < n; k++) {
+      int64_t sample_ms = tx_ms - f[k].age_ms;
+      struct tracker_fix fix = {0};
+      float true_x, true_y;
+      magsim_path_pos(sim, path, sample_ms, &true_x, &true_y);
+
+      int64_t t0 = host_monotonic_ns();
+      int err = gateway_sample(&f[k], sample_ms, &fix);
+      int64_t dt = host_monotonic_ns() - t0;
+
+      /* A gated reading leaves the EKF track to the publisher */
+      struct ekf_estimate est;
+      if (err && ekf_is_tracking() && ekf_get_estimate(sample_ms, &est)) {
+        fix.x = est.x;
+        fix.y = est.y;
+        err = 0;
+      }
+
+      /* The full solves need one reading from every node on this path */
+      if (!all_reported_since(start_ms)) {
+        continue;
+      }
+      bool scored = sample_ms - start_ms >= SETTLE_MS;
+      if (scored) {
+        score(&stats[EST_TRACKER], dt, !err, fix.x, fix.y, true_x, true_y);
+      }
+
+      /* The tracker only aligns the nodes when it seeds a track; the
+       * full solves compared with it get every sample's alignment */
+      position_layout_lock();
+      tracker_align(sample_ms);
+      position_layout_unlock();
+
+      for (int e = EST_TRACKER + 1; e < EST_COUNT; e++) {
+        float x, y;
+        t0 = host_monotonic_ns();
+        bool ok = run_estimator((enum estimator_id)e, &x, &y);
+        dt = host_monotonic_ns() - t0;
+        if (scored) {
+          score(&stats[e], dt, ok, x, y, true_x, true_y);
+        }
+      }
+    }
+  }
+
+  return rejected ? -1 : 0;
+}
+
+static float rmse(const struct est_stats *s) {
+  return s->fixes ? (float)sqrt(s->sq_err_sum / (double)s->fixes) : INFINITY;
+}
+
+static float fix_rate(const struct est_stats *s) {
+  return s->attempts ? (float)s->fixes / (float)s->attempts : 0.0f;
+}
+
+/* =============================================================================
+ * Main
+ * =============================================================================
+ */
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--nodes N] [--seed S] [--noise MUT] [--loss P] "
+          "[--drift MUT_PER_H] [--repeat N] [--away S] [--check]\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  struct magsim_config cfg;
+  int node_count = 0;
+  int repeat = 1;
+  int64_t away_ms = 0;
+  bool check = false;
+
+  magsim_default_config(&cfg);
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+      node_count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      cfg.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+      cfg.noise_mut = strtof(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+      cfg.loss_rate = strtof(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--drift") == 0 && i + 1 < argc) {
+      cfg.drift_mut_per_h = strtof(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--away") == 0 && i + 1 < argc) {
+      away_ms = (int64_t)(strtof(argv[++i], NULL) * 1000.0f);
+    } else if (strcmp(argv[i], "--check") == 0) {
+      check = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  position_init();
+  if (node_count && magsim_layout_perimeter(node_count) != 0) {
+    fprintf(stderr, "node count must be 2-%d\n", MAX_NODES);
+    return 2;
+  }
+  calibration_init();
+  tracker_init();
+  ekf_init();
+  packet_rekey(MAGSIM_MASTER_KEY);
+
+  struct magsim sim;
+  magsim_init(&sim, &cfg);
+
+  if (learn_baselines(&sim) != 0) {
+    fprintf(stderr, "baseline phase failed\n");
+    return 1;
+  }
+  record_calibration(&sim);
+  calibration_set_state(CALIB_STATE_RUNNING);
+
+  printf("Trajectory simulation (%d nodes, noise %.0f m-uT, loss %.0f%%, "
+         "drift %.0f m-uT/h, %d rounds, seed %u)\n",
+         position_get_node_count(), (double)cfg.noise_mut,
+         (double)(cfg.loss_rate * 100.0f), (double)cfg.drift_mut_per_h, repeat,
+         (unsigned)cfg.seed);
+  printf("%-10s %-14s %8s %8s %8s %8s %10s\n", "path", "estimator", "scored",
+         "fix%", "rmse", "max", "ns/solve");
+
+  const struct est_limit *limits =
+      node_count ? LIMITS_PERIMETER : LIMITS_DEFAULT;
+  int path_count;
+  const struct magsim_path *paths = magsim_paths(&path_count);
+  int failed = 0;
+
+  static struct est_stats stats[MAX_PATHS][EST_COUNT];
+  if (path_count > MAX_PATHS) {
+    path_count = MAX_PATHS;
+  }
+
+  for (int r = 0; r < repeat; r++) {
+    if (away_ms && run_away(&sim, away_ms) != 0) {
+      fprintf(stderr, "gateway rejected simulated frames\n");
+      failed = 1;
+    }
+    for (int p = 0; p < path_count; p++) {
+      if (run_path(&sim, &paths[p], stats[p]) != 0) {
+        fprintf(stderr, "%s: gateway rejected simulated frames\n",
+                paths[p].name);
+        failed = 1;
+      }
+    }
+  }
+
+  for (int p = 0; p < path_count; p++) {
+    for (int e = 0; e < EST_COUNT; e++) {
+      const struct est_stats *s = &stats[p][e];
+      bool bad = check && (rmse(s) > limits[e].max_rmse ||
+                           fix_rate(s) < limits[e].min_fix_rate);
+      printf("%-10s %-14s %8ld %7.1f%% %8.1f %8.1f %10.0f%s\n", paths[p].name,
+             EST_NAMES[e], s->attempts, (double)(fix_rate(s) * 100.0f),
+             (double)rmse(s), (double)s->max_err,
+             s->attempts ? (double)s->solve_ns / (double)s->attempts : 0.0,
+             bad ? "  << REGRESSION" : "");
+      failed |= bad;
+    }
+  }
+
+  printf("frames sent %u, lost %u\n", (unsigned)sim.frames_sent,
+         (unsigned)sim.frames_lost);
+  return failed ? 1 : 0;
+}
@@ -293,6 +293,58 @@ ZTEST(mmc5983ma_suite, test_earth_field_range) {
                (double)data.magnitude);
 }
 
+/* =============================================================================
+ * Continuous Mode Configuration Tests
+ * =============================================================================
+ */
+
+/**
+ * @brief Test that every supported rate maps to its Cm_freq field value
+ */
+ZTEST(mmc5983ma_suite, test_cm_freq_bits_supported) {
+  zassert_equal(mmc5983ma_cm_freq_bits(1), 1, "1 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(10), 2, "10 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(20), 3, "20 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(50), 4, "50 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(100), 5, "100 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(200), 6, "200 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(1000), 7, "1000 Hz");
+}
+
+/**
+ * @brief Test that unsupported rates (including 0, which means off) are
+ *        rejected
+ */
+ZTEST(mmc5983ma_suite, test_cm_freq_bits_unsupported) {
+  zassert_equal(mmc5983ma_cm_freq_bits(0), -1, "0 Hz is not a rate");
+  zassert_equal(mmc5983ma_cm_freq_bits(150), -1, "150 Hz");
+  zassert_equal(mmc5983ma_cm_freq_bits(400), -1, "400 Hz");
+}
+
+/**
+ * @brief Test bandwidth field values and the bandwidth each rate needs
+ */
+ZTEST(mmc5983ma_suite, test_bandwidth_for_rate) {
+  zassert_equal(mmc5983ma_bw_bits(100), MMC5983MA_CTRL1_BW_100HZ, "100 Hz");
+  zassert_equal(mmc5983ma_bw_bits(800), MMC5983MA_CTRL1_BW_800HZ, "800 Hz");
+  zassert_equal(mmc5983ma_bw_bits(300), -1, "300 Hz is not a bandwidth");
+
+  /* 8 ms measurements fit 100 Hz; faster rates need shorter ones */
+  zassert_equal(mmc5983ma_min_bw_hz(100), 100, "100 Hz rate");
+  zassert_equal(mmc5983ma_min_bw_hz(200), 200, "200 Hz rate");
+  zassert_equal(mmc5983ma_min_bw_hz(1000), 800, "1000 Hz rate");
+}
+
+/**
+ * @brief Test periodic SET interval field values
+ */
+ZTEST(mmc5983ma_suite, test_prd_set_bits) {
+  zassert_equal(mmc5983ma_prd_set_bits(1), 0, "every measurement");
+  zassert_equal(mmc5983ma_prd_set_bits(100), 3, "every 100");
+  zassert_equal(mmc5983ma_prd_set_bits(2000), 7, "every 2000");
+  zassert_equal(mmc5983ma_prd_set_bits(50), -1, "50 is not supported");
+}
+
 /* =============================================================================
  * Register Test Suite
  * =============================================================================
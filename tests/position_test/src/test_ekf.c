@@ -0,0 +1,295 @@
+/*
+ * EKF Tracking Stage Unit Tests
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * These tests feed the filter noise-free dipole fields of a magnet at a
+ * known position and check that the track converges, that measurement
+ * updates shrink the covariance, and that outliers are gated until the
+ * track is dropped - after a run of them, or when one node keeps being
+ * refused - and can be seeded again.
+ */
+
+#include "ekf.h"
+#include "position.h"
+#include <math.h>
+#include <zephyr/ztest.h>
+
+/* Dipole strength of the simulated deployment (tests/host/sim) */
+#define TEST_DIPOLE_M 1.0e12f
+
+/* True magnet position, and a seed as coarse as triangulation gives */
+#define TRUE_X 400.0f
+#define TRUE_Y 450.0f
+#define SEED_X 520.0f
+#define SEED_Y 360.0f
+
+/* Nodes report one after another, this far apart */
+#define STEP_MS 300
+
+/* =============================================================================
+ * Helpers
+ * =============================================================================
+ */
+
+static void field_at(uint8_t nid, float x, float y, float M,
+                     struct vec3_i32 *out) {
+  struct vec3_f B;
+  position_compute_dipole_field(x, y, M, position_get_sensor_pos(nid), &B);
+  out->x = (int32_t)lrintf(B.x);
+  out->y = (int32_t)lrintf(B.y);
+  out->z = (int32_t)lrintf(B.z);
+}
+
+/**
+ * @brief Fuse rounds of every node's field of the magnet at the true spot
+ *
+ * @return Time of the last update, or -1 if an update failed
+ */
+static int64_t feed_rounds(int64_t t_ms, int rounds) {
+  for (int r = 0; r < rounds; r++) {
+    for (int nid = 1; nid <= position_get_node_count(); nid++) {
+      struct vec3_i32 B;
+      field_at((uint8_t)nid, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &B);
+      t_ms += STEP_MS;
+      if (ekf_update_node((uint8_t)nid, &B, 0, t_ms) != 0) {
+        return -1;
+      }
+    }
+  }
+  return t_ms;
+}
+
+/* =============================================================================
+ * Test Suite Setup
+ * =============================================================================
+ */
+
+static void ekf_before(void *fixture) {
+  ARG_UNUSED(fixture);
+  position_set_dipole_orientation(0.0f, 0.0f, 1.0f);
+  position_set_node_count(POSITION_DEFAULT_NODE_COUNT);
+  ekf_init();
+}
+
+/* =============================================================================
+ * Tests
+ * =============================================================================
+ */
+
+/**
+ * @brief Nothing is fused or reported before a track is seeded
+ */
+ZTEST(ekf_suite, test_no_track_until_seeded) {
+  struct vec3_i32 B = {.x = 1000, .y = 0, .z = -2000};
+  struct ekf_estimate est;
+
+  zassert_false(ekf_is_tracking(), "No track after init");
+  zassert_equal(ekf_update_node(1, &B, 0, 1000), -EAGAIN,
+                "Update without a track should be refused");
+  zassert_false(ekf_get_estimate(1000, &est), "No estimate without a track");
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 1000);
+  zassert_equal(ekf_update_node(POSITION_DEFAULT_NODE_COUNT + 1, &B, 0, 1000),
+                -EINVAL, "Inactive node should be rejected");
+  zassert_equal(ekf_update_node(1, NULL, 0, 1000), -EINVAL,
+                "Missing field should be rejected");
+}
+
+/**
+ * @brief A static magnet is found from a coarse seed and a wrong moment
+ */
+ZTEST(ekf_suite, test_converges_on_static_magnet) {
+  struct ekf_estimate est;
+
+  ekf_seed(SEED_X, SEED_Y, 0.6f * TEST_DIPOLE_M, 0);
+  int64_t t_ms = feed_rounds(0, 20);
+  zassert_true(t_ms > 0, "Every update should be accepted");
+  zassert_true(ekf_get_estimate(t_ms, &est), "Track should be held");
+
+  zassert_within(est.x, TRUE_X, 5.0f, "x=%.1f expected %.1f", (double)est.x,
+                 (double)TRUE_X);
+  zassert_within(est.y, TRUE_Y, 5.0f, "y=%.1f expected %.1f", (double)est.y,
+                 (double)TRUE_Y);
+  zassert_within(est.M, TEST_DIPOLE_M, 0.05f * TEST_DIPOLE_M,
+                 "M=%.3g expected %.3g", (double)est.M, (double)TEST_DIPOLE_M);
+  zassert_true(hypotf(est.vx, est.vy) < 2.0f, "v=(%.2f, %.2f) should be ~0",
+               (double)est.vx, (double)est.vy);
+}
+
+/**
+ * @brief Each measurement update shrinks the position uncertainty
+ *
+ * Updates at the seed time carry no process noise, so pos_std must drop
+ * with every one; over time it settles far below the seed uncertainty.
+ */
+ZTEST(ekf_suite, test_covariance_shrinks) {
+  struct ekf_estimate est;
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 5000);
+  zassert_true(ekf_get_estimate(5000, &est), "Track should exist");
+  float seed_std = est.pos_std;
+  zassert_within(seed_std, sqrtf(2.0f) * EKF_INIT_POS_STD, 1.0f,
+                 "Seed std %.1f", (double)seed_std);
+
+  float prev_std = seed_std;
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    struct vec3_i32 B;
+    field_at((uint8_t)nid, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &B);
+    zassert_ok(ekf_update_node((uint8_t)nid, &B, 0, 5000),
+               "Update from node %d failed", nid);
+    zassert_true(ekf_get_estimate(5000, &est), "Track should be held");
+    zassert_true(est.pos_std < prev_std, "node %d: std %.2f after %.2f", nid,
+                 (double)est.pos_std, (double)prev_std);
+    prev_std = est.pos_std;
+  }
+
+  int64_t t_ms = feed_rounds(5000, 20);
+  zassert_true(t_ms > 0, "Every update should be accepted");
+  zassert_true(ekf_get_estimate(t_ms, &est), "Track should be held");
+  zassert_true(est.pos_std < 0.1f * seed_std, "std %.2f of seed %.2f",
+               (double)est.pos_std, (double)seed_std);
+
+  /* A node reporting more noise moves the settled track less */
+  struct vec3_i32 B;
+  struct ekf_estimate settled, quiet, noisy;
+  field_at(1, TRUE_X + 30.0f, TRUE_Y, TEST_DIPOLE_M, &B);
+  ekf_get_estimate(t_ms, &settled);
+  zassert_ok(ekf_update_node(1, &B, 0, t_ms), "Update failed");
+  ekf_get_estimate(t_ms, &quiet);
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 5000);
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    struct vec3_i32 B_true;
+    field_at((uint8_t)nid, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &B_true);
+    ekf_update_node((uint8_t)nid, &B_true, 0, 5000);
+  }
+  zassert_equal(feed_rounds(5000, 20), t_ms, "Same history expected");
+  zassert_ok(ekf_update_node(1, &B, 2000, t_ms), "Update failed");
+  ekf_get_estimate(t_ms, &noisy);
+
+  float quiet_step = fabsf(quiet.x - settled.x);
+  float noisy_step = fabsf(noisy.x - settled.x);
+  zassert_true(quiet_step > 0.0f, "Update should move the track");
+  zassert_true(noisy_step < 0.5f * quiet_step, "step %.3f noisy, %.3f quiet",
+               (double)noisy_step, (double)quiet_step);
+}
+
+/**
+ * @brief Outliers are gated, and a run of them drops the track
+ *
+ * Once warmed up, a field that matches a magnet far away is refused with
+ * the track left as it was; EKF_MAX_CONSEC_GATED in a row end the track,
+ * after which it can be seeded again.
+ */
+ZTEST(ekf_suite, test_gating_and_reseed) {
+  struct ekf_estimate before, after;
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 0);
+  int64_t t_ms = feed_rounds(0, 20);
+  zassert_true(t_ms > 0, "Every update should be accepted");
+  zassert_true(ekf_get_estimate(t_ms, &before), "Track should be held");
+
+  struct vec3_i32 outlier;
+  field_at(1, 900.0f, 100.0f, TEST_DIPOLE_M, &outlier);
+  zassert_equal(ekf_update_node(1, &outlier, 0, t_ms), -EBADMSG,
+                "Outlier should be gated");
+  zassert_true(ekf_get_estimate(t_ms, &after), "Track should survive");
+  zassert_equal(after.x, before.x, "Gated update must not move the track");
+  zassert_equal(after.y, before.y, "Gated update must not move the track");
+
+  /* A good reading in between resets the run of outliers */
+  struct vec3_i32 good;
+  field_at(2, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &good);
+  zassert_ok(ekf_update_node(2, &good, 0, t_ms), "Good reading refused");
+
+  for (int i = 1; i < EKF_MAX_CONSEC_GATED; i++) {
+    zassert_equal(ekf_update_node(1, &outlier, 0, t_ms), -EBADMSG,
+                  "Outlier %d should be gated", i);
+    zassert_true(ekf_is_tracking(), "Track dropped after %d outliers", i);
+  }
+  zassert_equal(ekf_update_node(1, &outlier, 0, t_ms), -ERANGE,
+                "Last outlier in the run should drop the track");
+  zassert_false(ekf_is_tracking(), "Track should be dropped");
+  zassert_equal(ekf_update_node(2, &good, 0, t_ms), -EAGAIN,
+                "Nothing is fused without a track");
+
+  /* Re-seeded where the magnet now is, the new track accepts it at once */
+  ekf_seed(900.0f, 100.0f, TEST_DIPOLE_M, t_ms);
+  zassert_true(ekf_is_tracking(), "Seeding should start a new track");
+  zassert_ok(ekf_update_node(1, &outlier, 0, t_ms + STEP_MS),
+             "New track should take the reading");
+  zassert_true(ekf_get_estimate(t_ms + STEP_MS, &after), "Track held");
+  zassert_true(hypotf(after.x - 900.0f, after.y - 100.0f) < 50.0f,
+               "track at (%.1f, %.1f)", (double)after.x, (double)after.y);
+}
+
+/**
+ * @brief One node gated round after round ends the track
+ *
+ * The other nodes' readings fit, so the outliers never run back to back;
+ * the track is dropped once EKF_DIVERGED_GATED of the recent readings were
+ * refused.
+ */
+ZTEST(ekf_suite, test_persistent_outlier_drops_track) {
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 0);
+  int64_t t_ms = feed_rounds(0, 20);
+  zassert_true(t_ms > 0, "Every update should be accepted");
+
+  struct vec3_i32 outlier, good2, good3;
+  field_at(1, 900.0f, 100.0f, TEST_DIPOLE_M, &outlier);
+  field_at(2, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &good2);
+  field_at(3, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &good3);
+
+  for (int i = 1; i < EKF_DIVERGED_GATED; i++) {
+    zassert_equal(ekf_update_node(1, &outlier, 0, t_ms), -EBADMSG,
+                  "Outlier %d should be gated", i);
+    zassert_ok(ekf_update_node(2, &good2, 0, t_ms), "Good reading refused");
+    zassert_ok(ekf_update_node(3, &good3, 0, t_ms), "Good reading refused");
+    zassert_true(ekf_is_tracking(), "Track dropped after %d outliers", i);
+  }
+  zassert_equal(ekf_update_node(1, &outlier, 0, t_ms), -ERANGE,
+                "Outlier %d should drop the track", EKF_DIVERGED_GATED);
+  zassert_false(ekf_is_tracking(), "Track should be dropped");
+}
+
+/**
+ * @brief Reading the track extrapolates a copy, the filter stays put
+ */
+ZTEST(ekf_suite, test_estimate_does_not_advance_filter) {
+  struct ekf_estimate est, later, again;
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 0);
+  int64_t t_ms = feed_rounds(0, 5);
+  zassert_true(ekf_get_estimate(t_ms, &est), "Track should be held");
+  zassert_true(ekf_get_estimate(t_ms + 10 * EKF_MAX_PREDICT_MS, &later),
+               "Track should be held");
+  zassert_true(later.pos_std > est.pos_std,
+               "Uncertainty should grow when extrapolating");
+  zassert_true(ekf_get_estimate(t_ms, &again), "Track should be held");
+  zassert_equal(again.pos_std, est.pos_std, "Filter state was changed");
+}
+
+/**
+ * @brief A track with no update for EKF_MAX_TRACK_AGE_MS is dropped
+ */
+ZTEST(ekf_suite, test_stale_track_expires) {
+  struct ekf_estimate est;
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 0);
+  int64_t t_ms = feed_rounds(0, 5);
+  zassert_true(ekf_get_estimate(t_ms + EKF_MAX_TRACK_AGE_MS, &est),
+               "Track should be held up to the limit");
+  zassert_false(ekf_get_estimate(t_ms + EKF_MAX_TRACK_AGE_MS + 1, &est),
+                "Stale track should not be reported");
+  zassert_false(est.valid, "Estimate should be marked invalid");
+  zassert_false(ekf_is_tracking(), "Stale track should be dropped");
+
+  ekf_seed(SEED_X, SEED_Y, TEST_DIPOLE_M, 0);
+  struct vec3_i32 B;
+  field_at(1, TRUE_X, TRUE_Y, TEST_DIPOLE_M, &B);
+  zassert_equal(ekf_update_node(1, &B, 0, EKF_MAX_TRACK_AGE_MS + 1),
+                -ETIMEDOUT, "Reading after a long gap should end the track");
+  zassert_false(ekf_is_tracking(), "Stale track should be dropped");
+}
+
+ZTEST_SUITE(ekf_suite, NULL, NULL, ekf_before, NULL, NULL);
@@ -0,0 +1,233 @@
+/*
+ * Dipole Position Solver Unit Tests
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * These tests check the closed-form dipole Jacobian against the
+ * finite-difference reference and run the Gauss-Newton solver on
+ * noise-free synthetic measurements, without requiring hardware.
+ */
+
+#include "position.h"
+#include <math.h>
+#include <string.h>
+#include <zephyr/ztest.h>
+
+/* Relative tolerance between analytic and central-difference Jacobians */
+#define JACOBIAN_REL_TOL 0.01f
+
+/* Dipole strength used for synthetic fields (matches solver initial guess) */
+#define TEST_DIPOLE_M 1.0e10f
+
+/* =============================================================================
+ * Helpers
+ * =============================================================================
+ */
+
+/**
+ * @brief Compare both Jacobians column by column at one magnet position
+ *
+ * Each column is compared relative to its own largest entry, since the
+ * position and moment columns differ by many orders of magnitude.
+ */
+static void check_jacobian_at(float x, float y, float M,
+                              const struct sensor_pos *sensor) {
+  float J_fd[3][3];
+  float J_an[3][3];
+
+  position_compute_jacobian(x, y, M, sensor, J_fd);
+  position_compute_jacobian_analytic(x, y, M, sensor, J_an);
+
+  for (int col = 0; col < 3; col++) {
+    float scale = 0.0f;
+    for (int row = 0; row < 3; row++) {
+      scale = fmaxf(scale, fabsf(J_fd[row][col]));
+    }
+    if (scale == 0.0f) {
+      continue;
+    }
+
+    for (int row = 0; row < 3; row++) {
+      float diff = fabsf(J_an[row][col] - J_fd[row][col]) / scale;
+      zassert_true(diff < JACOBIAN_REL_TOL,
+                   "J[%d][%d] mismatch at (%.1f, %.1f): analytic=%g fd=%g",
+                   row, col, (double)x, (double)y, (double)J_an[row][col],
+                   (double)J_fd[row][col]);
+    }
+  }
+}
+
+static void check_jacobian_grid(void) {
+  for (int s = 1; s <= position_get_node_count(); s++) {
+    const struct sensor_pos *sensor = position_get_sensor_pos(s);
+
+    for (float x = -50.0f; x <= 1050.0f; x += 137.5f) {
+      for (float y = -50.0f; y <= 1050.0f; y += 137.5f) {
+        check_jacobian_at(x, y, TEST_DIPOLE_M, sensor);
+      }
+    }
+  }
+}
+
+/* =============================================================================
+ * Test Suite Setup
+ * =============================================================================
+ */
+
+static void *position_suite_setup(void) {
+  printk("Dipole Position Solver Unit Tests\n");
+  return NULL;
+}
+
+static void position_before(void *fixture) {
+  ARG_UNUSED(fixture);
+  /* Default orientation: north pole up */
+  position_set_dipole_orientation(0.0f, 0.0f, 1.0f);
+  position_set_node_count(POSITION_DEFAULT_NODE_COUNT);
+}
+
+/* =============================================================================
+ * Jacobian Tests
+ * =============================================================================
+ */
+
+/**
+ * @brief Analytic Jacobian matches finite differences for an upright magnet
+ */
+ZTEST(position_suite, test_jacobian_matches_fd_upright) {
+  check_jacobian_grid();
+}
+
+/**
+ * @brief Analytic Jacobian matches finite differences for a tilted magnet
+ *
+ * A tilted moment exercises the m_x and m_y terms that vanish when the
+ * magnet points straight up.
+ */
+ZTEST(position_suite, test_jacobian_matches_fd_tilted) {
+  position_set_dipole_orientation(0.3f, -0.5f, 0.8f);
+  check_jacobian_grid();
+}
+
+/**
+ * @brief Analytic Jacobian stays accurate directly above a sensor
+ *
+ * Closest approach (r = z0) is where the field curvature is largest.
+ */
+ZTEST(position_suite, test_jacobian_matches_fd_overhead) {
+  const struct sensor_pos *sensor = position_get_sensor_pos(2);
+
+  check_jacobian_at(sensor->x + 5.0f, sensor->y - 3.0f, TEST_DIPOLE_M, sensor);
+  check_jacobian_at(sensor->x + 40.0f, sensor->y + 25.0f, TEST_DIPOLE_M,
+                    sensor);
+}
+
+/**
+ * @brief dB/dM column equals the unit-moment field B / M
+ */
+ZTEST(position_suite, test_jacobian_moment_column) {
+  const struct sensor_pos *sensor = position_get_sensor_pos(1);
+  struct vec3_f B;
+  float J[3][3];
+
+  position_compute_dipole_field(300.0f, 450.0f, TEST_DIPOLE_M, sensor, &B);
+  position_compute_jacobian_analytic(300.0f, 450.0f, TEST_DIPOLE_M, sensor, J);
+
+  zassert_within(J[0][2] * TEST_DIPOLE_M, B.x, fabsf(B.x) * 1e-4f + 1e-6f,
+                 "dBx/dM * M should equal Bx");
+  zassert_within(J[1][2] * TEST_DIPOLE_M, B.y, fabsf(B.y) * 1e-4f + 1e-6f,
+                 "dBy/dM * M should equal By");
+  zassert_within(J[2][2] * TEST_DIPOLE_M, B.z, fabsf(B.z) * 1e-4f + 1e-6f,
+                 "dBz/dM * M should equal Bz");
+}
+
+/* =============================================================================
+ * Solver Tests
+ * =============================================================================
+ */
+
+/**
+ * @brief Gauss-Newton holds a known magnet position given ideal fields
+ *
+ * Starting at the true parameters, the fused field/Jacobian path must
+ * reproduce the measurements so the solver converges without drifting.
+ */
+ZTEST(position_suite, test_dipole_solver_fixed_point) {
+  static struct node_state nodes[MAX_NODES + 1];
+  const float true_x = 420.0f;
+  const float true_y = 380.0f;
+
+  memset(nodes, 0, sizeof(nodes));
+  for (int nid = 1; nid <= position_get_node_count(); nid++) {
+    struct vec3_f B;
+    position_compute_dipole_field(true_x, true_y, TEST_DIPOLE_M,
+                                  position_get_sensor_pos(nid), &B);
+    nodes[nid].have_baseline = true;
+    nodes[nid].last_B_mag.x = (int32_t)lrintf(B.x);
+    nodes[nid].last_B_mag.y = (int32_t)lrintf(B.y);
+    nodes[nid].last_B_mag.z = (int32_t)lrintf(B.z);
+  }
+
+  struct position_estimate guess = {
+      .x = true_x, .y = true_y, .M = TEST_DIPOLE_M, .converged = true};
+  struct position_estimate est;
+
+  zassert_true(position_estimate_dipole(nodes, &guess, &est),
+               "Solver should run with three sensors");
+  zassert_true(est.converged, "Solver should converge at the true position");
+  zassert_within(est.x, true_x, 1.0f, "x=%.1f expected %.1f", (double)est.x,
+                 (double)true_x);
+  zassert_within(est.y, true_y, 1.0f, "y=%.1f expected %.1f", (double)est.y,
+                 (double)true_y);
+}
+
+/* =============================================================================
+ * Node Array Tests
+ * =============================================================================
+ */
+
+/**
+ * @brief Only the strongest active nodes are selected, strongest first
+ */
+ZTEST(position_suite, test_select_strongest_nodes) {
+  static struct node_state nodes[MAX_NODES + 1];
+  uint8_t ids[POSITION_SOLVER_NODES];
+
+  zassert_equal(position_set_node_count(MAX_NODES), 0,
+                "Full capacity should be accepted");
+  zassert_not_equal(position_set_node_count(MAX_NODES + 1), 0,
+                    "Beyond capacity should be rejected");
+
+  /* Node n sees a field of n * 1000 m-uT; node 2 has no baseline */
+  memset(nodes, 0, sizeof(nodes));
+  for (int nid = 1; nid <= MAX_NODES; nid++) {
+    nodes[nid].have_baseline = (nid != 2);
+    nodes[nid].last_B_mag.z = nid * 1000;
+  }
+
+  int count = position_select_nodes(nodes, ids);
+  int expected = MIN(POSITION_SOLVER_NODES, MAX_NODES - 1);
+  zassert_equal(count, expected, "count=%d expected %d", count, expected);
+
+  int next = MAX_NODES;
+  for (int k = 0; k < count; k++, next--) {
+    if (next == 2) {
+      next--;
+    }
+    zassert_equal(ids[k], next, "ids[%d]=%u expected %d", k, ids[k], next);
+  }
+
+  /* Shrinking the array drops the inactive nodes from selection */
+  zassert_equal(position_set_node_count(3), 0, "Three nodes should be valid");
+  zassert_is_null(position_get_sensor_pos(4), "Node 4 should be inactive");
+  count = position_select_nodes(nodes, ids);
+  zassert_equal(count, 2, "Only nodes 1 and 3 have baselines");
+  zassert_equal(ids[0], 3, "Node 3 is strongest");
+}
+
+/* =============================================================================
+ * Register Test Suite
+ * =============================================================================
+ */
+
+ZTEST_SUITE(position_suite, NULL, position_suite_setup, position_before, NULL,
+            NULL);
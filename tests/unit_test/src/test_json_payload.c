@@ -13,6 +13,8 @@
 #include <zephyr/kernel.h>
 #include <zephyr/ztest.h>
 
+#include "json_payload.h"
+
 /* =============================================================================
  * Test Suite Setup/Teardown
  * =============================================================================
@@ -150,6 +152,27 @@ ZTEST(json_payload_suite, test_nabc_telemetry_format) {
   zassert_not_null(strstr(buffer, "misogaje"), "Should have team name");
 }
 
+/**
+ * @brief Test the real payload encoder from json_payload.c
+ */
+ZTEST(json_payload_suite, test_json_payload_construct) {
+  char buffer[128];
+  struct payload payload = {
+      .state.reported.uptime = 1234,
+      .state.reported.app_version = "0.0.1",
+  };
+
+  int ret = json_payload_construct(buffer, sizeof(buffer), &payload);
+
+  zassert_equal(ret, 0, "json_payload_construct failed: %d", ret);
+  zassert_not_null(strstr(buffer, "\"reported\""),
+                   "Should have reported object");
+  zassert_not_null(strstr(buffer, "\"uptime\":1234"),
+                   "Should have uptime value");
+  zassert_not_null(strstr(buffer, "\"app_version\":\"0.0.1\""),
+                   "Should have app version");
+}
+
 /* =============================================================================
  * Register Test Suite
  * =============================================================================
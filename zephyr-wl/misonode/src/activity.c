@@ -0,0 +1,65 @@
+#include <string.h>
+
+#include "activity.h"
+
+// Squared Euclidean length of a, in (m-uT)^2
+static int64_t norm2(const int32_t a[3])
+{
+    return (int64_t)a[0] * a[0] + (int64_t)a[1] * a[1] + (int64_t)a[2] * a[2];
+}
+
+void activity_init(struct activity *a)
+{
+    memset(a, 0, sizeof(*a));
+}
+
+bool activity_update(struct activity *a, const struct mag_sample *m, int64_t now_ms)
+{
+    const int32_t b[3] = {
+        (int32_t)m->x_uT_milli, (int32_t)m->y_uT_milli, (int32_t)m->z_uT_milli,
+    };
+
+    if (!a->have_baseline) {
+        for (int i = 0; i < 3; i++) {
+            a->base[i] = (int64_t)b[i] << ACTIVITY_BASELINE_SHIFT;
+            a->prev[i] = b[i];
+        }
+        a->last_move_ms = now_ms;
+        a->have_baseline = true;
+    }
+
+    int32_t anomaly[3], rate[3];
+    for (int i = 0; i < 3; i++) {
+        anomaly[i] = b[i] - (int32_t)(a->base[i] >> ACTIVITY_BASELINE_SHIFT);
+        rate[i] = b[i] - a->prev[i];
+        a->prev[i] = b[i];
+    }
+    int64_t anomaly2 = norm2(anomaly);
+    bool moving = norm2(rate) > (int64_t)ACTIVITY_RATE_MUT * ACTIVITY_RATE_MUT;
+    if (moving) a->last_move_ms = now_ms;
+
+    if (now_ms - a->last_move_ms >= ACTIVITY_RELEARN_MS &&
+        anomaly2 > (int64_t)ACTIVITY_ANOMALY_MUT * ACTIVITY_ANOMALY_MUT / 4) {
+        for (int i = 0; i < 3; i++) {
+            a->base[i] = (int64_t)b[i] << ACTIVITY_BASELINE_SHIFT;
+        }
+        anomaly2 = 0;
+    }
+
+    if (anomaly2 > (int64_t)ACTIVITY_ANOMALY_MUT * ACTIVITY_ANOMALY_MUT || moving) {
+        a->last_trigger_ms = now_ms;
+        a->active = true;
+    } else if (a->active && now_ms - a->last_trigger_ms >= ACTIVITY_HOLD_MS) {
+        a->active = false;
+    }
+
+    // Follow slow drift (temperature, nearby steel) only while quiet
+    if (!a->active &&
+        anomaly2 <= (int64_t)ACTIVITY_ANOMALY_MUT * ACTIVITY_ANOMALY_MUT / 4) {
+        for (int i = 0; i < 3; i++) {
+            a->base[i] += b[i] - (a->base[i] >> ACTIVITY_BASELINE_SHIFT);
+        }
+    }
+
+    return a->active;
+}
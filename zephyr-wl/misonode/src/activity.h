@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mag.h"
+
+// Running baseline: exponential average over 2^ACTIVITY_BASELINE_SHIFT
+// samples (~11 min at 625 ms), like the gateway's baseline drift tracking
+#define ACTIVITY_BASELINE_SHIFT 10
+
+// Anomaly |B - baseline| (m-uT) that needs the high report rate. The
+// baseline stops following above half of it, so an approaching magnet is
+// not learned away.
+#define ACTIVITY_ANOMALY_MUT    1000
+
+// Change between consecutive samples (m-uT) that needs the high report
+// rate: the gateway EKF's 1-sigma measurement noise
+#define ACTIVITY_RATE_MUT       300
+
+// Time the high rate is kept after the last sample that crossed a threshold
+#define ACTIVITY_HOLD_MS        10000
+
+// A steady anomaly this long without a rate trigger (a magnet parked near
+// the node, or one present at boot that has left) becomes the new baseline
+#define ACTIVITY_RELEARN_MS     300000
+
+struct activity {
+    bool    have_baseline;
+    int64_t base[3];            // Baseline << ACTIVITY_BASELINE_SHIFT (m-uT)
+    int32_t prev[3];            // Previous sample (m-uT)
+    int64_t last_trigger_ms;
+    int64_t last_move_ms;       // Last sample over ACTIVITY_RATE_MUT
+    bool    active;
+};
+
+void activity_init(struct activity *a);
+
+// Feed the next filtered sample, taken at now_ms. Returns true while the
+// node should report at the high rate.
+bool activity_update(struct activity *a, const struct mag_sample *m, int64_t now_ms);
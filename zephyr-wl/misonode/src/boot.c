@@ -0,0 +1,53 @@
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+#include "boot.h"
+
+LOG_MODULE_REGISTER(boot, LOG_LEVEL_INF);
+
+#define BOOT_EPOCH_KEY "misonode/epoch"
+
+static uint16_t stored;
+
+static int epoch_set(const char *key, size_t len, settings_read_cb read_cb,
+                     void *cb_arg, void *param)
+{
+    ARG_UNUSED(key);
+    ARG_UNUSED(param);
+
+    if (len != sizeof(stored)) return -EINVAL;
+    int rc = read_cb(cb_arg, &stored, sizeof(stored));
+    return rc < 0 ? rc : 0;
+}
+
+int boot_epoch_next(uint16_t *epoch)
+{
+    int rc = settings_subsys_init();
+    if (rc == 0) rc = settings_load_subtree_direct(BOOT_EPOCH_KEY, epoch_set, NULL);
+    if (rc < 0) {
+        LOG_ERR("boot epoch load failed: %d", rc);
+        return rc;
+    }
+
+    // The gateway only accepts newer epochs, so the count must not wrap
+    if (stored == UINT16_MAX) {
+        LOG_ERR("boot epoch exhausted");
+        return -ERANGE;
+    }
+
+    // Saved before the first frame goes out, so a reset right after this
+    // cannot reuse the epoch
+    uint16_t next = stored + 1;
+    rc = settings_save_one(BOOT_EPOCH_KEY, &next, sizeof(next));
+    if (rc < 0) {
+        LOG_ERR("boot epoch save failed: %d", rc);
+        return rc;
+    }
+
+    stored = next;
+    *epoch = next;
+    LOG_INF("boot epoch %u", next);
+    return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Count this boot in flash (settings subsystem) and return the new count,
+// the epoch that goes into every frame header until the next reboot. The
+// gateway then accepts the frame counter restarting at 0 instead of taking
+// it for a replay, and keystreams of different boots never overlap.
+// Returns 0 or a negative errno; frames must not be sent without an epoch.
+int boot_epoch_next(uint16_t *epoch);
@@ -0,0 +1,210 @@
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/lora.h>
+#include <zephyr/logging/log.h>
+
+#include "link.h"
+#include "packet.h"
+
+LOG_MODULE_REGISTER(link, LOG_LEVEL_INF);
+
+int packet_parse_beacon(const uint8_t *in, size_t len, uint16_t *epoch,
+    uint32_t *seq, struct beacon *out);
+
+// Slot starts must not wait for sample processing on the main thread
+#define LINK_STACK_SIZE         2048
+#define LINK_PRIORITY           K_PRIO_COOP(2)
+
+// Listening starts this long before an expected beacon and ends this long
+// after its airtime. Covers both clocks' drift over a few superframes.
+#define LINK_GUARD_MS           20
+
+// Beacons missed in a row before the node stops using the schedule and
+// transmits freely again, listening for a beacon in between
+#define LINK_COAST_SUPERFRAMES  4
+
+// Listening chunk while no schedule is known: bounds the TX latency
+#define LINK_SEARCH_MS          250
+
+static const struct device *lora;
+static uint8_t my_id;
+static link_build_fn build;
+static K_SEM_DEFINE(tx_sem, 0, 1);
+
+static struct lora_modem_config cfg = {
+    .frequency      = 915000000UL,
+    .bandwidth      = BW_125_KHZ,
+    .datarate       = SF_7,
+    .coding_rate    = CR_4_5,
+    .preamble_len   = 8,
+    .tx_power       = 10,
+    .tx             = true,
+    .iq_inverted    = false,
+    .public_network = true,
+};
+
+// Schedule from the last beacon heard (link thread only)
+static struct beacon sched;
+static int64_t beacon_ms;       // Local time that beacon started
+
+// Newest beacon taken this boot: only a later gateway epoch, or a higher
+// count in the same epoch, is taken after it
+static uint16_t beacon_epoch;
+static uint32_t beacon_seq;
+static int missed = LINK_COAST_SUPERFRAMES + 1;
+
+static K_THREAD_STACK_DEFINE(link_stack, LINK_STACK_SIZE);
+static struct k_thread link_thread_data;
+
+// Time on air at SF7/125 kHz, CR 4/5, explicit header, CRC, 8-symbol
+// preamble: 12.25 + 8 + 5 per 28 bits of payload and CRC symbols of 1.024 ms
+static int64_t airtime_ms(size_t len)
+{
+    int64_t sym_x4 = 49 + 4 * (8 + 5 * (int64_t)((8 * len + 16 + 27) / 28));
+    return (sym_x4 * 1024 / 4 + 999) / 1000;
+}
+
+static int radio_mode(bool tx)
+{
+    static bool configured;
+    if (configured && cfg.tx == tx) return 0;
+
+    cfg.tx = tx;
+    int err = lora_config(lora, &cfg);
+    configured = err == 0;
+    return err;
+}
+
+static int own_slot(void)
+{
+    for (int k = 1; k < sched.slots; k++) {
+        if (sched.owner[k] == my_id) return k;
+    }
+    return 0;
+}
+
+static void transmit(int64_t tx_ms)
+{
+    uint8_t frame[SECURE_FRAME_MAX_LEN];
+    size_t len = build(frame, sizeof(frame), tx_ms);
+    if (len == 0) return;
+
+    int rc = radio_mode(true);
+    if (rc == 0) rc = lora_send(lora, frame, len);
+    if (rc < 0) LOG_ERR("lora_send err %d", rc);
+}
+
+// Listen for up to timeout; true if a new beacon was heard. A gateway
+// reboot restarts the count at 1 under a new epoch, so it is taken at
+// once; a recorded beacon is not, even after the schedule was lost.
+static bool listen_beacon(k_timeout_t timeout)
+{
+    uint8_t buf[SECURE_FRAME_MAX_LEN];
+    int16_t rssi;
+    int8_t snr;
+
+    if (radio_mode(false) != 0) {
+        k_sleep(timeout);
+        return false;
+    }
+    int len = lora_recv(lora, buf, sizeof(buf), timeout, &rssi, &snr);
+    int64_t end_ms = k_uptime_get();
+    if (len <= 0) return false;
+
+    struct beacon b;
+    uint16_t epoch;
+    uint32_t seq;
+    if (packet_parse_beacon(buf, (size_t)len, &epoch, &seq, &b) != 0) return false;
+    // Epoch 0 is never used by a gateway
+    if (epoch == 0 || epoch < beacon_epoch ||
+        (epoch == beacon_epoch && seq <= beacon_seq)) {
+        return false;
+    }
+
+    bool was_synced = missed <= LINK_COAST_SUPERFRAMES;
+    sched = b;
+    beacon_epoch = epoch;
+    beacon_seq = seq;
+    beacon_ms = end_ms - airtime_ms((size_t)len);
+    missed = 0;
+
+    if (!was_synced && own_slot() == 0) {
+        LOG_WRN("following beacon: no slot for node %u, not transmitting", my_id);
+    } else if (!was_synced) {
+        LOG_INF("following beacon: slot %d of %u, %u ms each",
+                own_slot(), sched.slots, sched.slot_ms);
+    }
+    return true;
+}
+
+static void link_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        if (missed > LINK_COAST_SUPERFRAMES) {
+            // No schedule: send requests as they come, listen in between
+            if (k_sem_take(&tx_sem, K_NO_WAIT) == 0) transmit(k_uptime_get());
+            listen_beacon(K_MSEC(LINK_SEARCH_MS));
+            continue;
+        }
+
+        // This superframe's own slot, if a frame is waiting. A node the
+        // gateway has no slot for stays silent: it would collide with a
+        // scheduled slot, and the gateway drops its frames anyway. The
+        // request is kept (the newest samples stay buffered) until a beacon
+        // gives it one.
+        int slot = own_slot();
+        if (slot > 0 && k_sem_count_get(&tx_sem)) {
+            int64_t at = beacon_ms + (int64_t)slot * sched.slot_ms;
+            if (at > k_uptime_get()) {
+                radio_mode(true);
+                k_sleep(K_TIMEOUT_ABS_MS(at));
+                k_sem_take(&tx_sem, K_NO_WAIT);
+                transmit(at);
+            }
+        }
+
+        // Next beacon; without it, coast on the old schedule
+        int64_t next = beacon_ms + (int64_t)sched.slots * sched.slot_ms;
+        int64_t until = next + LINK_GUARD_MS +
+            airtime_ms(SECURE_HDR_LEN + BEACON_PLAINTEXT_LEN(sched.slots) + TAG_LEN);
+        k_sleep(K_TIMEOUT_ABS_MS(next - LINK_GUARD_MS));
+        bool heard = false;
+        for (int64_t now = k_uptime_get(); !heard && now < until; now = k_uptime_get()) {
+            heard = listen_beacon(K_MSEC(until - now));
+        }
+        if (!heard) {
+            beacon_ms = next;
+            if (++missed > LINK_COAST_SUPERFRAMES) {
+                LOG_WRN("beacon lost, transmitting unscheduled");
+            }
+        }
+    }
+}
+
+int link_start(const struct device *dev, uint8_t node_id, link_build_fn fn)
+{
+    lora = dev;
+    my_id = node_id;
+    build = fn;
+
+    int err = radio_mode(false);
+    if (err < 0) {
+        LOG_ERR("lora_config failed");
+        return err;
+    }
+
+    k_tid_t tid = k_thread_create(&link_thread_data, link_stack,
+                                  K_THREAD_STACK_SIZEOF(link_stack),
+                                  link_thread, NULL, NULL, NULL,
+                                  LINK_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(tid, "link");
+    return 0;
+}
+
+void link_request_tx(void)
+{
+    k_sem_give(&tx_sem);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+// Fills frame (max bytes) with what should go out at tx_ms, the
+// k_uptime_get() time the transmission starts. Returns its length, or 0 if
+// there is nothing to send. Runs on the link thread.
+typedef size_t (*link_build_fn)(uint8_t *frame, size_t max, int64_t tx_ms);
+
+// Configure the radio and start the link thread. It listens for gateway
+// beacons and, once it hears one, transmits only in this node's slot.
+// Returns 0 or a negative errno.
+int link_start(const struct device *lora, uint8_t node_id, link_build_fn build);
+
+// Ask for a frame: sent at the start of the next own slot when following
+// the beacon, otherwise right away. Requests before that slot merge. While
+// the beacon has no slot for this node, nothing is sent.
+void link_request_tx(void);
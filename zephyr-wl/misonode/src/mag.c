@@ -1,22 +1,239 @@
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+
 #include "mag.h"
+#include "mmc5983ma.h"
+
+LOG_MODULE_REGISTER(mag, LOG_LEVEL_INF);
+
+// Temperature needs a single measurement (a few ms gap in continuous mode)
+#define MAG_TEMP_INTERVAL_MS 5000
+
+// Measurements averaged per mag_read(); past this the oldest are overwritten.
+// 100 Hz for 625 ms is 62.
+#define MAG_WINDOW_MAX 128
+
+// A measurement more than this many median absolute deviations (about 4
+// sigma) from the window median is dropped, but never one within
+// MAG_OUTLIER_MIN_MUT (8 counts), so a quiet window keeps its noise
+#define MAG_OUTLIER_MAD_MULT 6
+#define MAG_OUTLIER_MIN_MUT  50
+
+static const struct device *const mag_dev = DEVICE_DT_GET_ONE(memsic_mmc5983ma);
+
+static int16_t temp_c_times10;
+static int64_t temp_read_ms;
+static bool have_temp;
+
+static int fetch_xyz(const struct device *dev, struct sensor_value val[3])
+{
+    int err = sensor_sample_fetch_chan(dev, SENSOR_CHAN_MAGN_XYZ);
+    if (err) return err;
+    return sensor_channel_get(dev, SENSOR_CHAN_MAGN_XYZ, val);
+}
+
+// Gauss to microtesla *1000: 1 G = 100 uT
+static int32_t gauss_to_uT_milli(const struct sensor_value *v)
+{
+    return v->val1 * 100000 + v->val2 / 10;
+}
+
+#ifdef CONFIG_MMC5983MA_TRIGGER
+// Measurements since the last mag_read(), in m-uT. data_ready() fills
+// windows[active]; mag_read() flips active and filters the other one.
+struct mag_window {
+    int32_t v[3][MAG_WINDOW_MAX];
+    uint32_t n;             // Measurements taken, may exceed MAG_WINDOW_MAX
+    int64_t first_ms;
+    int64_t last_ms;
+};
+
+static struct k_spinlock lock;
+static struct mag_window windows[2];
+static int active;
+
+// System workqueue, once per measurement: only the I2C read and a copy
+static void data_ready(const struct device *dev, const struct sensor_trigger *trig)
+{
+    ARG_UNUSED(trig);
+
+    struct sensor_value val[3];
+    if (fetch_xyz(dev, val) != 0) return;
+
+    int32_t x = gauss_to_uT_milli(&val[0]);
+    int32_t y = gauss_to_uT_milli(&val[1]);
+    int32_t z = gauss_to_uT_milli(&val[2]);
+    int64_t now = k_uptime_get();
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    struct mag_window *w = &windows[active];
+    uint32_t i = w->n % MAG_WINDOW_MAX;
+    w->v[0][i] = x;
+    w->v[1][i] = y;
+    w->v[2][i] = z;
+    if (w->n++ == 0) w->first_ms = now;
+    w->last_ms = now;
+    k_spin_unlock(&lock, key);
+}
+
+static void sort_i32(int32_t *a, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        int32_t v = a[i];
+        size_t j = i;
+        for (; j > 0 && a[j - 1] > v; j--) a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0;
+    for (uint64_t bit = 1ULL << 62; bit; bit >>= 2) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return (uint32_t)r;
+}
+
+// Mean of one axis after dropping outliers, and the 1-sigma noise of that
+// mean (sample standard deviation / sqrt(kept)), in m-uT. Sorts v.
+static int32_t decimate_axis(int32_t *v, size_t n, uint32_t *noise, size_t *kept)
+{
+    static int32_t dev[MAG_WINDOW_MAX];
+
+    sort_i32(v, n);
+    int32_t med = v[n / 2];
+    for (size_t i = 0; i < n; i++) dev[i] = v[i] >= med ? v[i] - med : med - v[i];
+    sort_i32(dev, n);
+    int32_t limit = MAG_OUTLIER_MAD_MULT * dev[n / 2];
+    if (limit < MAG_OUTLIER_MIN_MUT) limit = MAG_OUTLIER_MIN_MUT;
+
+    // Sums of the offsets from the median stay small
+    int64_t sum = 0, sum_sq = 0;
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t d = v[i] - med;
+        if (d > limit || d < -limit) continue;
+        sum += d;
+        sum_sq += (int64_t)d * d;
+        k++;
+    }
+
+    // The median itself always passes, so k >= 1
+    int64_t half = (int64_t)k / 2;
+    int32_t mean = med + (int32_t)(sum >= 0 ? (sum + half) / (int64_t)k
+                                            : (sum - half) / (int64_t)k);
+    if (k > 1) {
+        uint64_t ss = (uint64_t)(sum_sq - sum * sum / (int64_t)k);
+        *noise = isqrt64(ss / ((uint64_t)(k - 1) * k));
+    } else {
+        *noise = 0;
+    }
+    *kept = k;
+    return mean;
+}
+#endif
+
+int mag_init(void)
+{
+    if (!device_is_ready(mag_dev)) {
+        LOG_ERR("MMC5983MA not ready");
+        return -ENODEV;
+    }
+
+#ifdef CONFIG_MMC5983MA_TRIGGER
+    static const struct sensor_trigger trig = {
+        .type = SENSOR_TRIG_DATA_READY,
+        .chan = SENSOR_CHAN_MAGN_XYZ,
+    };
+    int err = sensor_trigger_set(mag_dev, &trig, data_ready);
+    if (err) {
+        LOG_WRN("data-ready trigger unavailable (%d), polling", err);
+    }
+#endif
+    return 0;
+}
+
+int mag_read(struct mag_sample *out)
+{
+    int32_t xyz[3];
+    uint32_t noise = 0;
+    uint16_t n_avg = 0;
+    uint16_t delay_ms = 0;
+    int64_t now = k_uptime_get();
+
+#ifdef CONFIG_MMC5983MA_TRIGGER
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    struct mag_window *w = &windows[active];
+    active ^= 1;
+    windows[active].n = 0;
+    k_spin_unlock(&lock, key);
+
+    // data_ready() only writes the other window now
+    if (w->n) {
+        size_t n = w->n < MAG_WINDOW_MAX ? w->n : MAG_WINDOW_MAX;
+        size_t dropped = 0;
+        for (int a = 0; a < 3; a++) {
+            uint32_t na;
+            size_t kept;
+            xyz[a] = decimate_axis(w->v[a], n, &na, &kept);
+            if (na > noise) noise = na;
+            dropped += n - kept;
+        }
+        if (dropped) LOG_DBG("%u of %u axis readings dropped as outliers",
+                             (unsigned)dropped, (unsigned)(3 * n));
+
+        // Overwritten measurements no longer count towards the span
+        int64_t span = w->last_ms - w->first_ms;
+        if (w->n > n) span = span * (int64_t)(n - 1) / (int64_t)(w->n - 1);
+        n_avg = (uint16_t)n;
+        int64_t mid = w->last_ms - span / 2;
+        delay_ms = (uint16_t)MIN(now - mid, UINT16_MAX);
+    }
+#endif
+
+    // No interrupt: continuous mode keeps the registers current, just read them
+    if (n_avg == 0) {
+        struct sensor_value val[3];
+        int err = fetch_xyz(mag_dev, val);
+        if (err) return err;
+        for (int a = 0; a < 3; a++) xyz[a] = gauss_to_uT_milli(&val[a]);
+    }
+
+    if (!have_temp || now - temp_read_ms >= MAG_TEMP_INTERVAL_MS) {
+        struct sensor_value t;
+        if (sensor_sample_fetch_chan(mag_dev, SENSOR_CHAN_DIE_TEMP) == 0 &&
+            sensor_channel_get(mag_dev, SENSOR_CHAN_DIE_TEMP, &t) == 0) {
+            temp_c_times10 = (int16_t)(t.val1 * 10 + t.val2 / 100000);
+            have_temp = true;
+        }
+        temp_read_ms = now;
+    }
+
+    int32_t x = xyz[0];
+    int32_t y = xyz[1];
+    int32_t z = xyz[2];
+
+    out->x_uT_milli = (uint32_t)x;
+    out->y_uT_milli = (uint32_t)y;
+    out->z_uT_milli = (uint32_t)z;
+    out->temp_c_times10 = temp_c_times10;
+
+    // 1 count = 6.25 m-uT
+    out->raw_x_counts = (uint32_t)(x * 4 / 25 + MMC5983MA_OFFSET);
+    out->raw_y_counts = (uint32_t)(y * 4 / 25 + MMC5983MA_OFFSET);
+    out->raw_z_counts = (uint32_t)(z * 4 / 25 + MMC5983MA_OFFSET);
 
-void mag_read(struct mag_sample *out)
-{
-    // Pretend raw 18-bit values straight from sensor:
-    // Pick numbers in range ~0..16384 for ~±0.5 G-ish.
-    out->raw_x_counts = 8000;
-    out->raw_y_counts = 1000;
-    out->raw_z_counts = 7000;
-
-    // Convert fake raw counts -> microtesla *1000.
-    // Math we'll actually do in real code later:
-    // 1 count ≈ 0.006103515625 µT (from datasheet scaling logic)
-    // So uT = counts * 0.006103515625
-    // uT*1000 = counts * 6.103515625
-    out->x_uT_milli = (uint32_t)(out->raw_x_counts * 6.1035f); // ~48828
-    out->y_uT_milli = (uint32_t)(out->raw_y_counts * 6.1035f); // ~6103
-    out->z_uT_milli = (uint32_t)(out->raw_z_counts * 6.1035f); // ~42724
-
-    // Fake temperature: 24.5 C
-    out->temp_c_times10 = 245;
+    out->n_avg = n_avg;
+    out->noise_uT_milli = (uint16_t)MIN(noise, UINT16_MAX);
+    out->delay_ms = delay_ms;
+    return 0;
 }
@@ -10,13 +10,29 @@ struct mag_sample {
     // Temperature in degC *10 (so 24.5 C => 245)
     int16_t  temp_c_times10;
 
-    // (Optional future: raw 18-bit counts if we ever want to debug calibration)
+    // Raw 18-bit counts (offset binary, 131072 = 0 field)
     uint32_t raw_x_counts;
     uint32_t raw_y_counts;
     uint32_t raw_z_counts;
+
+    // Measurements averaged into this sample (0: a single polled one)
+    uint16_t n_avg;
+
+    // 1-sigma noise of the averaged field, largest axis, m-uT (0 if unknown)
+    uint16_t noise_uT_milli;
+
+    // How long before mag_read() returned the value applies (mid-window)
+    uint16_t delay_ms;
 };
 
-// Called by main.
-// Fills out with "realistic" data for now.
-// Later we replace the internals with actual I2C to MMC5983MA.
-void mag_read(struct mag_sample *out);
+// Set up the MMC5983MA. It runs in continuous mode at its devicetree odr;
+// with the INT pin wired, every finished measurement is captured as it
+// completes, otherwise mag_read() fetches the latest one.
+// Returns 0 or a negative errno.
+int mag_init(void);
+
+// With the INT pin wired: the mean of every measurement since the last
+// call, after dropping outliers, with its noise. Otherwise the latest
+// measurement. The temperature is refreshed every MAG_TEMP_INTERVAL_MS.
+// Returns 0, or a negative errno if no measurement is available.
+int mag_read(struct mag_sample *out);
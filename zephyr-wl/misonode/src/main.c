@@ -1,10 +1,12 @@
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
-#include <zephyr/drivers/lora.h>
 #include <zephyr/logging/log.h>
 #include <string.h>
 #include <stdint.h>
 
+#include "activity.h"
+#include "boot.h"
+#include "link.h"
 #include "mag.h"
 #include "packet.h"
 
@@ -12,8 +14,77 @@ LOG_MODULE_REGISTER(misonode, LOG_LEVEL_INF);
 
 #define NODE_ID 0x01
 
-size_t packet_build_secure_frame_encmac(uint8_t node_id, uint32_t tx_seq,
-    const struct mag_sample *m_in, uint8_t *out, size_t out_max);
+/* Sample every 625 ms. Each sample is the outlier-filtered mean of the ~62
+ * measurements the sensor took at 100 Hz since the previous one, sent with
+ * its noise. Packed as 18-bit keyframe plus deltas, eight samples of a
+ * still magnet make a ~48-byte frame (~98 ms at SF7/125 kHz) against 30
+ * bytes for a single sample */
+#define SAMPLE_INTERVAL_MS  625
+#define BATCH_SAMPLES       8
+
+/* Report rate, picked per sample by activity_update(). Far from the magnet
+ * a heartbeat frame every 15 s carries the newest eight samples; with the
+ * magnet close or moving, a frame every 1.25 s carries the two samples
+ * taken since the last one. The gateway treats a node as stale only after
+ * two missed heartbeats. */
+#define HEARTBEAT_SAMPLES   24
+#define ACTIVE_SAMPLES      2
+
+size_t packet_build_secure_frame_encmac(uint8_t node_id, uint16_t epoch,
+    uint32_t tx_seq, const struct mag_sample *m_in, uint8_t *out, size_t out_max);
+size_t packet_build_secure_batch_encmac(uint8_t node_id, uint16_t epoch,
+    uint32_t tx_seq, const struct mag_sample *m_in, const uint16_t *age_ms, size_t n,
+    uint8_t *out, size_t out_max);
+size_t packet_build_secure_packed_encmac(uint8_t node_id, uint16_t epoch, uint32_t tx_seq,
+    const struct mag_sample *m_in, size_t n, uint16_t interval_ms,
+    uint16_t newest_age_ms, size_t *used, uint8_t *out, size_t out_max);
+
+/* Samples waiting for the link thread, newest last and evenly spaced */
+static K_MUTEX_DEFINE(buf_lock);
+static struct mag_sample m[BATCH_SAMPLES];
+static size_t count;
+static size_t since_tx;             /* Samples taken since the last frame */
+static int64_t newest_ms;           /* When the newest sample was read */
+static uint16_t boot_epoch;         /* Set once, before the link starts */
+static uint32_t tx_seq;             /* From 0 in every boot epoch */
+static uint32_t samples_unsent;     /* Oldest samples a frame had no room for */
+
+/* Link thread, at the start of the transmission */
+static size_t build_frame(uint8_t *frame, size_t max, int64_t tx_ms)
+{
+    size_t len = 0, used = 0, n;
+
+    k_mutex_lock(&buf_lock, K_FOREVER);
+    n = since_tx < count ? since_tx : count;
+    if (n) {
+        /* An averaged sample stands for the middle of its window */
+        int64_t age = tx_ms - newest_ms + m[count - 1].delay_ms;
+        len = packet_build_secure_packed_encmac(NODE_ID, boot_epoch, tx_seq, &m[count - n], n,
+            SAMPLE_INTERVAL_MS, (uint16_t)(age > UINT16_MAX ? UINT16_MAX : age),
+            &used, frame, max);
+        /* On failure the samples stay pending for the next request */
+        if (len > 0) {
+            since_tx = 0;
+        }
+        /* Deltas too large to pack all of them: the oldest are lost, as a
+         * later frame only carries samples taken after this one */
+        if (len > 0 && used < n) {
+            samples_unsent += n - used;
+            LOG_WRN("%u oldest samples did not fit (%u so far)",
+                    (unsigned)(n - used), samples_unsent);
+        }
+    }
+    k_mutex_unlock(&buf_lock);
+
+    if (len == 0) {
+        if (n) LOG_ERR("build frame failed");
+        return 0;
+    }
+    LOG_INF("send node=%u epoch=%u seq=%u len=%u samples=%u",
+            NODE_ID, boot_epoch, tx_seq, (unsigned)len, (unsigned)used);
+    tx_seq++;
+    return len;
+}
 
 void main(void)
 {
@@ -23,39 +94,64 @@ void main(void)
         return;
     }
 
-    struct lora_modem_config cfg = {
-        .frequency      = 915000000UL,
-        .bandwidth      = BW_125_KHZ,
-        .datarate       = SF_7,
-        .coding_rate    = CR_4_5,
-        .preamble_len   = 8,
-        .tx_power       = 10,
-        .tx             = true,
-        .iq_inverted    = false,
-        .public_network = true,
-    };
-    if (lora_config(lora, &cfg) < 0) {
-        LOG_ERR("lora_config failed");
+    if (mag_init() != 0) {
+        return;
+    }
+
+    if (boot_epoch_next(&boot_epoch) != 0) {
+        return;
+    }
+
+    if (link_start(lora, NODE_ID, build_frame) != 0) {
         return;
     }
 
     LOG_INF("misonode: TX (Encrypt-then-MAC, SipHash + stream)");
 
-    uint32_t tx_seq = 0;
+    bool was_active = false;
+    struct activity act;
+    activity_init(&act);
+
+    /* Absolute deadlines keep the spacing the frame header promises,
+     * whatever mag_read() costs */
+    int64_t next_ms = k_uptime_get();
+
     while (1) {
-        struct mag_sample m;
-        mag_read(&m);
-
-        uint8_t frame[SECURE_FRAME_LEN];
-        size_t len = packet_build_secure_frame_encmac(NODE_ID, tx_seq, &m, frame, sizeof(frame));
-        if (len == 0) {
-            LOG_ERR("build frame failed");
-        } else {
-            int rc = lora_send(lora, frame, len);
-            if (rc < 0) LOG_ERR("lora_send err %d", rc);
-            else        LOG_INF("sent node=%u seq=%u len=%u", NODE_ID, tx_seq, (unsigned)len);
-            tx_seq++;
+        struct mag_sample s;
+        int64_t taken_ms = k_uptime_get();
+        next_ms += SAMPLE_INTERVAL_MS;
+        if (mag_read(&s) != 0) {
+            /* A gap breaks the even spacing of a frame: start a new one */
+            LOG_WRN("mag_read failed");
+            k_mutex_lock(&buf_lock, K_FOREVER);
+            count = 0;
+            k_mutex_unlock(&buf_lock);
+            k_sleep(K_TIMEOUT_ABS_MS(next_ms));
+            continue;
+        }
+
+        bool active = activity_update(&act, &s, taken_ms);
+        if (active != was_active) {
+            LOG_INF("%s report rate", active ? "high" : "heartbeat");
+        }
+
+        k_mutex_lock(&buf_lock, K_FOREVER);
+        if (count == BATCH_SAMPLES) {
+            memmove(&m[0], &m[1], (BATCH_SAMPLES - 1) * sizeof(m[0]));
+            count--;
+        }
+        m[count++] = s;
+        newest_ms = taken_ms;
+        since_tx++;
+        /* Becoming active asks at once: that is when the solver needs data */
+        bool send = active ? (since_tx >= ACTIVE_SAMPLES || !was_active)
+                           : since_tx >= HEARTBEAT_SAMPLES;
+        k_mutex_unlock(&buf_lock);
+        was_active = active;
+
+        if (send) {
+            link_request_tx();
         }
-        k_sleep(K_SECONDS(5));
+        k_sleep(K_TIMEOUT_ABS_MS(next_ms));
     }
 }
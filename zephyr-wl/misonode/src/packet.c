@@ -12,6 +12,7 @@ static const uint8_t NODE_MASTER_KEY[16] = {
 
 size_t packet_build_secure_frame_encmac(
     uint8_t  node_id,
+    uint16_t epoch,
     uint32_t tx_seq,
     const struct mag_sample *m_in,
     uint8_t *out,
@@ -20,15 +21,11 @@ size_t packet_build_secure_frame_encmac(
     if (out_max < SECURE_FRAME_LEN) return 0;
 
     // Header
-    out[0] = node_id;
-    out[1] = (uint8_t)(tx_seq >> 0);
-    out[2] = (uint8_t)(tx_seq >> 8);
-    out[3] = (uint8_t)(tx_seq >> 16);
-    out[4] = (uint8_t)(tx_seq >> 24);
+    pack_secure_header(out, node_id, epoch, tx_seq);
 
     // Build payload from sample
     struct sensor_frame s = {
-        .node_id = node_id, .tx_seq = tx_seq,
+        .node_id = node_id, .epoch = epoch, .tx_seq = tx_seq,
         .x_uT_milli = m_in->x_uT_milli,
         .y_uT_milli = m_in->y_uT_milli,
         .z_uT_milli = m_in->z_uT_milli,
@@ -40,20 +37,135 @@ size_t packet_build_secure_frame_encmac(
     // Derive subkeys; encrypt (XOR keystream); MAC over AAD||ciphertext
     uint8_t K_enc[16], K_mac[16], ks[SENSOR_PLAINTEXT_LEN];
     kdf_split_keys(NODE_MASTER_KEY, node_id, K_enc, K_mac);
-    keystream_from_seq(ks, sizeof(ks), K_enc, tx_seq);
+    keystream_from_seq(ks, sizeof(ks), K_enc, epoch, tx_seq);
 
-    uint8_t *ct = &out[5];
+    uint8_t *ct = &out[SECURE_HDR_LEN];
     for (size_t i = 0; i < SENSOR_PLAINTEXT_LEN; ++i) ct[i] = pt[i] ^ ks[i];
 
-    uint8_t mac_input[1 + 4 + SENSOR_PLAINTEXT_LEN];
-    mac_input[0] = node_id;
-    mac_input[1] = out[1]; mac_input[2] = out[2];
-    mac_input[3] = out[3]; mac_input[4] = out[4];
-    memcpy(&mac_input[5], ct, SENSOR_PLAINTEXT_LEN);
+    uint8_t mac_input[SECURE_HDR_LEN + SENSOR_PLAINTEXT_LEN];
+    memcpy(mac_input, out, SECURE_HDR_LEN);
+    memcpy(&mac_input[SECURE_HDR_LEN], ct, SENSOR_PLAINTEXT_LEN);
 
     uint8_t tag[TAG_LEN];
     siphash24(tag, mac_input, sizeof(mac_input), K_mac);
 
-    memcpy(&out[5 + SENSOR_PLAINTEXT_LEN], tag, TAG_LEN);
+    memcpy(&out[SECURE_HDR_LEN + SENSOR_PLAINTEXT_LEN], tag, TAG_LEN);
     return SECURE_FRAME_LEN;
 }
+
+/* Header, encrypted payload and tag around pt; out holds SECURE_HDR_LEN + pt_len + TAG_LEN */
+static size_t seal_frame(uint8_t node_id, uint16_t epoch, uint32_t tx_seq,
+    const uint8_t *pt, size_t pt_len, uint8_t *out)
+{
+    pack_secure_header(out, node_id, epoch, tx_seq);
+
+    // Same keystream and MAC as a single-sample frame, over the longer payload
+    uint8_t K_enc[16], K_mac[16], ks[SENSOR_PACKED_PLAINTEXT_MAX];
+    kdf_split_keys(NODE_MASTER_KEY, node_id, K_enc, K_mac);
+    keystream_from_seq(ks, pt_len, K_enc, epoch, tx_seq);
+
+    uint8_t *ct = &out[SECURE_HDR_LEN];
+    for (size_t i = 0; i < pt_len; ++i) ct[i] = pt[i] ^ ks[i];
+
+    // Header and ciphertext are contiguous: MAC them in place
+    siphash24(&out[SECURE_HDR_LEN + pt_len], out, SECURE_HDR_LEN + pt_len, K_mac);
+    return SECURE_HDR_LEN + pt_len + TAG_LEN;
+}
+
+size_t packet_build_secure_batch_encmac(
+    uint8_t  node_id,
+    uint16_t epoch,
+    uint32_t tx_seq,
+    const struct mag_sample *m_in,
+    const uint16_t *age_ms,
+    size_t   n,
+    uint8_t *out,
+    size_t   out_max)
+{
+    if (n == 0 || n > SENSOR_BATCH_MAX) return 0;
+    if (out_max < SECURE_BATCH_FRAME_LEN(n)) return 0;
+
+    // Build payload from samples
+    struct sensor_frame s[SENSOR_BATCH_MAX];
+    for (size_t i = 0; i < n; i++) {
+        s[i] = (struct sensor_frame){
+            .node_id = node_id, .epoch = epoch, .tx_seq = tx_seq,
+            .x_uT_milli = m_in[i].x_uT_milli,
+            .y_uT_milli = m_in[i].y_uT_milli,
+            .z_uT_milli = m_in[i].z_uT_milli,
+            .temp_c_times10 = m_in[i].temp_c_times10,
+            .age_ms = age_ms[i]
+        };
+    }
+    uint8_t pt[SENSOR_BATCH_PLAINTEXT_LEN(SENSOR_BATCH_MAX)];
+    size_t pt_len = pack_sensor_batch(pt, s, n);
+
+    return seal_frame(node_id, epoch, tx_seq, pt, pt_len, out);
+}
+
+size_t packet_build_secure_packed_encmac(
+    uint8_t  node_id,
+    uint16_t epoch,
+    uint32_t tx_seq,
+    const struct mag_sample *m_in,
+    size_t   n,
+    uint16_t interval_ms,
+    uint16_t newest_age_ms,
+    size_t  *used,
+    uint8_t *out,
+    size_t   out_max)
+{
+    *used = 0;
+    if (n == 0 || n > SENSOR_PACKED_MAX) return 0;
+
+    struct sensor_frame s[SENSOR_PACKED_MAX];
+    for (size_t i = 0; i < n; i++) {
+        s[i] = (struct sensor_frame){
+            .node_id = node_id, .epoch = epoch, .tx_seq = tx_seq,
+            .x_uT_milli = m_in[i].x_uT_milli,
+            .y_uT_milli = m_in[i].y_uT_milli,
+            .z_uT_milli = m_in[i].z_uT_milli,
+            .temp_c_times10 = m_in[i].temp_c_times10,
+            .noise_mut = m_in[i].noise_uT_milli,
+        };
+    }
+    s[n - 1].age_ms = newest_age_ms;
+
+    // Large deltas (a magnet moving close by) widen w; the oldest samples
+    // that no longer fit are left out
+    unsigned w;
+    size_t k = sensor_packed_fit(s, n, &w);
+    if (out_max < SECURE_HDR_LEN + SENSOR_PACKED_PLAINTEXT_LEN(k, w) + TAG_LEN) return 0;
+
+    uint8_t pt[SENSOR_PACKED_PLAINTEXT_MAX];
+    size_t pt_len = pack_sensor_packed(pt, &s[n - k], k, w, interval_ms);
+
+    *used = k;
+    return seal_frame(node_id, epoch, tx_seq, pt, pt_len, out);
+}
+
+int packet_parse_beacon(
+    const uint8_t *in,
+    size_t   len,
+    uint16_t *epoch,
+    uint32_t *seq,
+    struct beacon *out)
+{
+    if (len < SECURE_HDR_LEN + BEACON_PLAINTEXT_LEN(2) + TAG_LEN ||
+        len > SECURE_HDR_LEN + BEACON_PLAINTEXT_LEN(BEACON_SLOTS_MAX) + TAG_LEN ||
+        in[0] != BEACON_NODE_ID) return -1;
+
+    size_t pt_len = len - (SECURE_HDR_LEN + TAG_LEN);
+    uint8_t K_enc[16], K_mac[16], tag[TAG_LEN];
+    kdf_split_keys(NODE_MASTER_KEY, BEACON_NODE_ID, K_enc, K_mac);
+    siphash24(tag, in, SECURE_HDR_LEN + pt_len, K_mac);
+    if (memcmp(tag, &in[SECURE_HDR_LEN + pt_len], TAG_LEN) != 0) return -1;
+
+    uint8_t id;
+    unpack_secure_header(in, &id, epoch, seq);
+
+    uint8_t pt[BEACON_PLAINTEXT_LEN(BEACON_SLOTS_MAX)];
+    keystream_from_seq(pt, pt_len, K_enc, *epoch, *seq);
+    for (size_t i = 0; i < pt_len; ++i) pt[i] ^= in[SECURE_HDR_LEN + i];
+    return unpack_beacon(pt, pt_len, out);
+}
@@ -1,55 +1,96 @@
+#include <string.h>
 #include "siphash.h"
 
+/* Little-endian loads and stores. On little-endian targets memcpy becomes
+ * plain word accesses (unaligned ones where the core allows them, e.g.
+ * Cortex-M33); elsewhere the bytes are assembled one by one. */
 static inline uint64_t U8TO64_LE(const uint8_t *p){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
     return ((uint64_t)p[0])       | ((uint64_t)p[1] << 8)  |
            ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
            ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
            ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+#endif
+}
+static inline void U64TO8_LE(uint8_t *p, uint64_t v){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(p, &v, sizeof(v));
+#else
+    for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(v >> (8 * i));
+#endif
 }
 static inline uint64_t ROTL64(uint64_t x, int b){ return (x << b) | (x >> (64 - b)); }
-static inline void sipround(uint64_t *v0, uint64_t *v1, uint64_t *v2, uint64_t *v3){
-    *v0 += *v1; *v1 = ROTL64(*v1,13) ^ *v0; *v0 = ROTL64(*v0,32);
-    *v2 += *v3; *v3 = ROTL64(*v3,16) ^ *v2;
-    *v0 += *v3; *v3 = ROTL64(*v3,21) ^ *v0;
-    *v2 += *v1; *v1 = ROTL64(*v1,17) ^ *v2; *v2 = ROTL64(*v2,32);
+
+struct sip_state { uint64_t v0, v1, v2, v3; };
+
+static inline void sipround(struct sip_state *s){
+    s->v0 += s->v1; s->v1 = ROTL64(s->v1,13) ^ s->v0; s->v0 = ROTL64(s->v0,32);
+    s->v2 += s->v3; s->v3 = ROTL64(s->v3,16) ^ s->v2;
+    s->v0 += s->v3; s->v3 = ROTL64(s->v3,21) ^ s->v0;
+    s->v2 += s->v1; s->v1 = ROTL64(s->v1,17) ^ s->v2; s->v2 = ROTL64(s->v2,32);
 }
 
-void siphash24(uint8_t out[8], const uint8_t *m, size_t len, const uint8_t key[16]){
+static inline void sip_init(struct sip_state *s, const uint8_t key[16]){
     uint64_t k0 = U8TO64_LE(key + 0);
     uint64_t k1 = U8TO64_LE(key + 8);
-    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
-    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
-    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
-    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+    s->v0 = 0x736f6d6570736575ULL ^ k0;
+    s->v1 = 0x646f72616e646f6dULL ^ k1;
+    s->v2 = 0x6c7967656e657261ULL ^ k0;
+    s->v3 = 0x7465646279746573ULL ^ k1;
+}
+
+/* Two compression rounds over one message word */
+static inline void sip_compress(struct sip_state *s, uint64_t m){
+    s->v3 ^= m; sipround(s); sipround(s); s->v0 ^= m;
+}
+
+/* Last word (tail bytes and length), then the four finalization rounds */
+static inline uint64_t sip_finish(struct sip_state s, uint64_t b){
+    sip_compress(&s, b);
+    s.v2 ^= 0xff;
+    sipround(&s); sipround(&s); sipround(&s); sipround(&s);
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+void siphash24(uint8_t out[8], const uint8_t *m, size_t len, const uint8_t key[16]){
+    struct sip_state s;
+    sip_init(&s, key);
 
     const uint8_t *end = m + (len & ~((size_t)7));
-    int left = (int)(len & 7);
+    size_t left = len & 7;
 
     for (const uint8_t *p = m; p != end; p += 8){
-        uint64_t mi = U8TO64_LE(p);
-        v3 ^= mi; sipround(&v0,&v1,&v2,&v3); sipround(&v0,&v1,&v2,&v3); v0 ^= mi;
+        sip_compress(&s, U8TO64_LE(p));
     }
 
-    uint64_t b = ((uint64_t)len) << 56;
-    switch (left) { /* fallthroughs intentional */
-        case 7: b |= ((uint64_t)m[len - 7]) << 48;
-        case 6: b |= ((uint64_t)m[len - 6]) << 40;
-        case 5: b |= ((uint64_t)m[len - 5]) << 32;
-        case 4: b |= ((uint64_t)m[len - 4]) << 24;
-        case 3: b |= ((uint64_t)m[len - 3]) << 16;
-        case 2: b |= ((uint64_t)m[len - 2]) << 8;
-        case 1: b |= ((uint64_t)m[len - 1]);
-        default: break;
-    }
+    /* Tail: zero-padded word, never read past the message */
+    uint8_t tail[8] = {0};
+    memcpy(tail, end, left);
+    uint64_t b = (((uint64_t)len) << 56) | U8TO64_LE(tail);
 
-    v3 ^= b; sipround(&v0,&v1,&v2,&v3); sipround(&v0,&v1,&v2,&v3); v0 ^= b;
-    v2 ^= 0xff;
-    sipround(&v0,&v1,&v2,&v3); sipround(&v0,&v1,&v2,&v3);
-    sipround(&v0,&v1,&v2,&v3); sipround(&v0,&v1,&v2,&v3);
-    uint64_t tag = v0 ^ v1 ^ v2 ^ v3;
+    U64TO8_LE(out, sip_finish(s, b));
+}
+
+void siphash24_ctr(uint8_t *out, size_t n, const uint8_t prefix[8], const uint8_t key[16]){
+    struct sip_state s;
+    sip_init(&s, key);
+    sip_compress(&s, U8TO64_LE(prefix));
 
-    out[0]=(uint8_t)(tag>>0);  out[1]=(uint8_t)(tag>>8);
-    out[2]=(uint8_t)(tag>>16); out[3]=(uint8_t)(tag>>24);
-    out[4]=(uint8_t)(tag>>32); out[5]=(uint8_t)(tag>>40);
-    out[6]=(uint8_t)(tag>>48); out[7]=(uint8_t)(tag>>56);
+    /* Every block shares the state after the prefix word; only the last
+     * word (counter byte and the length, 9) differs */
+    for (uint64_t i = 0; n > 0; ++i){
+        uint64_t tag = sip_finish(s, (9ULL << 56) | i);
+        if (n >= 8){
+            U64TO8_LE(out, tag);
+            out += 8;
+            n -= 8;
+        } else {
+            for (size_t k = 0; k < n; ++k) out[k] = (uint8_t)(tag >> (8 * k));
+            n = 0;
+        }
+    }
 }